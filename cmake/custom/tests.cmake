@@ -8,7 +8,7 @@
 option(ENABLE_TESTS "Enable test suite" ON)
 
 macro(add_Catch_test)
-  set(oneValueArgs NAME COST)
+  set(oneValueArgs NAME COST MPI_PROCS)
   set(multiValueArgs LABELS DEPENDS REFERENCE_FILES)
   cmake_parse_arguments(add_Catch_test
     "${options}"
@@ -17,6 +17,12 @@ macro(add_Catch_test)
     ${ARGN}
     )
 
+  # tests of the bank ranks are started with MPI_PROCS ranks
+  set(_launcher "")
+  if(add_Catch_test_MPI_PROCS)
+    set(_launcher ${MPIEXEC_EXECUTABLE} ${MPIEXEC_NUMPROC_FLAG} ${add_Catch_test_MPI_PROCS} ${MPIEXEC_PREFLAGS})
+  endif()
+
   # FIXME The location of mrcpp-tests should be relative to PROJECT_BINARY_DIR.
   # However, the default build paths inherited from Autocmake tuck it under
   # CMAKE_BINARY_DIR. This is irrelevant for a standalone build of MRCPP, but
@@ -25,6 +31,7 @@ macro(add_Catch_test)
     NAME
       ${add_Catch_test_NAME}
     COMMAND
+      ${_launcher}
       ${CMAKE_BINARY_DIR}/${CMAKE_INSTALL_BINDIR}/mrcpp-tests
       [${add_Catch_test_NAME}] --success --out
       ${PROJECT_BINARY_DIR}/tests/${add_Catch_test_NAME}.log --durations yes
@@ -0,0 +1,120 @@
+#include "MRCPP/Gaussians"
+#include "MRCPP/MWFunctions"
+#include "MRCPP/MWOperators"
+#include "MRCPP/Printer"
+#include "MRCPP/Timer"
+#include "MRCPP/trees/MWNode.h"
+
+/*
+ * Benchmark of the memory layout of tree nodes. The same functions are
+ * computed with nodes in creation order and with nodes reordered along the
+ * Hilbert curve (FunctionTree::setNodeOrdering). The locality is measured as
+ * the distance in memory (in units of nodes) between spatial neighbours, which
+ * is a proxy for the cache and TLB misses of the band traversal in apply()
+ * and the neighbour lookups in multiply().
+ */
+
+const auto min_scale = -4;
+const auto max_depth = 25;
+
+const auto order = 7;
+const auto prec = 1.0e-5;
+const auto repeat = 3;
+
+const auto D = 3;
+
+// Mean serial index distance between end nodes and their same-scale face
+// neighbours in other sibling groups (siblings are always consecutive)
+double neighbour_distance(mrcpp::FunctionTree<D> &tree) {
+    auto dist = 0.0;
+    auto count = 0;
+    for (auto i = 0; i < tree.getNEndNodes(); i++) {
+        const auto &node = tree.getEndMWNode(i);
+        const auto &idx = node.getNodeIndex();
+        for (auto d = 0; d < D; d++) {
+            auto l = idx.getTranslation();
+            l[d] += 1;
+            auto *neighbour = tree.findNode(mrcpp::NodeIndex<D>(idx.getScale(), l));
+            if (neighbour == nullptr) continue;
+            if (&neighbour->getMWParent() == &node.getMWParent()) continue;
+            dist += std::abs(neighbour->getSerialIx() - node.getSerialIx());
+            count++;
+        }
+    }
+    return (count > 0) ? dist / count : 0.0;
+}
+
+void run(const mrcpp::MultiResolutionAnalysis<D> &MRA, mrcpp::PoissonOperator &P, mrcpp::GaussExp<D> &f_func, bool ordered) {
+    mrcpp::FunctionTree<D> f_tree(MRA);
+    mrcpp::FunctionTree<D> g_tree(MRA);
+    f_tree.setNodeOrdering(ordered);
+    g_tree.setNodeOrdering(ordered);
+    // Grow the grid one Gaussian at a time, as in a typical adaptive
+    // calculation, which interleaves the nodes of different regions
+    for (auto i = 0; i < f_func.size(); i++) mrcpp::build_grid(f_tree, f_func.getFunc(i));
+    mrcpp::project(prec, f_tree, f_func);
+    mrcpp::apply(prec, g_tree, P, f_tree);
+
+    auto t_apply = mrcpp::Timer(false);
+    auto t_mult = mrcpp::Timer(false);
+    auto h_norm = 0.0;
+    for (auto n = 0; n < repeat; n++) {
+        mrcpp::FunctionTree<D> v_tree(MRA);
+        t_apply.resume();
+        mrcpp::apply(prec, v_tree, P, f_tree);
+        t_apply.stop();
+
+        mrcpp::FunctionTree<D> h_tree(MRA);
+        h_tree.setNodeOrdering(ordered);
+        t_mult.resume();
+        mrcpp::multiply(prec, h_tree, 1.0, f_tree, g_tree);
+        t_mult.stop();
+        h_norm = std::sqrt(h_tree.getSquareNorm());
+    }
+
+    mrcpp::print::header(0, (ordered) ? "Hilbert ordered nodes" : "Nodes in creation order");
+    mrcpp::print::value(0, "f_tree nodes", f_tree.getNNodes());
+    mrcpp::print::value(0, "f_tree neighbour distance", neighbour_distance(f_tree), "(nodes)");
+    mrcpp::print::value(0, "g_tree neighbour distance", neighbour_distance(g_tree), "(nodes)");
+    mrcpp::print::value(0, "g_tree norm", std::sqrt(g_tree.getSquareNorm()));
+    mrcpp::print::value(0, "h_tree norm", h_norm);
+    mrcpp::print::separator(0, ' ');
+    mrcpp::print::time(0, "Time apply", t_apply);
+    mrcpp::print::time(0, "Time multiply", t_mult);
+    mrcpp::print::separator(0, '=', 2);
+}
+
+int main(int argc, char **argv) {
+    auto timer = mrcpp::Timer();
+
+    // Initialize printing
+    auto printlevel = 0;
+    mrcpp::Printer::init(printlevel);
+    mrcpp::print::environment(0);
+
+    // Constructing world box
+    auto corner = std::array<int, D>{-1, -1, -1};
+    auto boxes = std::array<int, D>{2, 2, 2};
+    auto world = mrcpp::BoundingBox<D>(min_scale, corner, boxes);
+
+    // Constructing basis and MRA
+    auto basis = mrcpp::InterpolatingBasis(order);
+    auto MRA = mrcpp::MultiResolutionAnalysis<D>(world, basis, max_depth);
+
+    // A few well separated Gaussians, to get an adaptive grid
+    auto beta = 100.0;
+    auto alpha = std::pow(beta / mrcpp::pi, 3.0 / 2.0);
+    auto f_func = mrcpp::GaussExp<D>();
+    for (auto i = 0; i < 6; i++) {
+        auto pos = mrcpp::Coord<D>{0.3 * i - 0.7, 0.2 * i - 0.5, 0.1 * i - 0.2};
+        f_func.append(mrcpp::GaussFunc<D>(beta, alpha, pos));
+    }
+
+    mrcpp::PoissonOperator P(MRA, prec);
+
+    run(MRA, P, f_func, false);
+    run(MRA, P, f_func, true);
+
+    mrcpp::print::footer(0, timer, 2);
+    return 0;
+}
@@ -25,6 +25,14 @@
 
 #include "ConvolutionOperator.h"
 
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+
+#include "MRCPP/version.h"
+
+#include "core/CrossCorrelationCache.h"
 #include "core/InterpolatingBasis.h"
 #include "core/LegendreBasis.h"
 
@@ -39,14 +47,44 @@
 
 #include "trees/BandWidth.h"
 #include "trees/FunctionTreeVector.h"
+#include "trees/OperatorNode.h"
 #include "trees/OperatorTree.h"
 
 #include "utils/Printer.h"
 #include "utils/Timer.h"
+#include "utils/details.h"
 #include "utils/math_utils.h"
 
 namespace mrcpp {
 
+static std::string &operator_cache_dir() {
+    static std::string dir = []() -> std::string {
+        if (const char *env_p = std::getenv("MRCPP_OPERATOR_CACHE")) return env_p;
+        return "";
+    }();
+    return dir;
+}
+
+/** @brief Set the directory used to store and load operator components
+ *
+ * @param[in] dir: Cache directory, an empty string disables the cache
+ *
+ * @details Each kernel term of a ConvolutionOperator is stored in a separate
+ * file, keyed by the MRA, the Gaussian term, the precisions and the operator
+ * root and reach. Operators constructed later (also by other processes) with
+ * the same parameters are loaded from disk instead of being recomputed.
+ * The default is taken from the MRCPP_OPERATOR_CACHE environment variable.
+ * The directory must exist.
+ */
+void set_operator_cache(const std::string &dir) {
+    operator_cache_dir() = dir;
+}
+
+/** @returns Current operator cache directory, empty if the cache is disabled */
+const std::string &get_operator_cache() {
+    return operator_cache_dir();
+}
+
 template <int D>
 ConvolutionOperator<D>::ConvolutionOperator(const MultiResolutionAnalysis<D> &mra, GaussExp<1> &kernel, double prec)
         : MWOperator<D>(mra, mra.getRootScale(), -10) {
@@ -75,36 +113,75 @@ ConvolutionOperator<D>::ConvolutionOperator(const MultiResolutionAnalysis<D> &mr
     Printer::setPrintLevel(oldlevel);
 }
 
+/** @brief Project each kernel term and expand it into an OperatorTree
+ *
+ * @details The terms are independent and are built concurrently, one term
+ * per thread (the tree builders run serially inside the parallel region).
+ * The resulting trees are stored in raw_exp in the same order as the kernel.
+ */
 template <int D> void ConvolutionOperator<D>::initialize(GaussExp<1> &kernel, double k_prec, double o_prec) {
     auto k_mra = this->getKernelMRA();
     auto o_mra = this->getOperatorMRA();
 
-    TreeBuilder<2> builder;
-    OperatorAdaptor adaptor(o_prec, o_mra.getMaxScale());
+    // Make sure the shared cross correlation coefficients are loaded before
+    // entering the parallel region, the cache is not safe for concurrent loading
+    int order = o_mra.getOrder();
+    int type = o_mra.getScalingBasis().getScalingType();
+    if (type == Interpol) {
+        getCrossCorrelationCache(Interpol, ccc);
+        ccc.load(order);
+    } else if (type == Legendre) {
+        getCrossCorrelationCache(Legendre, ccc);
+        ccc.load(order);
+    }
+
+    int nTerms = kernel.size();
+    std::vector<std::unique_ptr<OperatorTree>> o_trees(nTerms);
+    const std::string &cache_dir = get_operator_cache();
 
-    for (int i = 0; i < kernel.size(); i++) {
+#pragma omp parallel for schedule(dynamic) shared(o_trees, kernel, k_mra, o_mra) num_threads(mrcpp_get_num_threads())
+    for (int i = 0; i < nTerms; i++) {
         // Rescale Gaussian for D-dim application
         auto *k_func = kernel.getFunc(i).copy();
         k_func->setCoef(std::copysign(std::pow(std::abs(k_func->getCoef()), 1.0 / D), k_func->getCoef()));
 
+        auto o_tree = std::make_unique<OperatorTree>(o_mra, o_prec);
+
+        std::string cache_key, cache_file;
+        if (not cache_dir.empty()) {
+            cache_key = getCacheKey(*k_func, k_prec, o_prec);
+            std::stringstream fname;
+            fname << cache_dir << "/oper_" << std::hex << std::hash<std::string>{}(cache_key) << ".tree";
+            cache_file = fname.str();
+            if (o_tree->loadTree(cache_file, cache_key)) {
+                delete k_func;
+                o_tree->setupOperNodeCache();
+                o_trees[i] = std::move(o_tree);
+                continue;
+            }
+        }
+
         FunctionTree<1> k_tree(k_mra);
         mrcpp::build_grid(k_tree, *k_func);      // Generate empty grid to hold narrow Gaussian
         mrcpp::project(k_prec, k_tree, *k_func); // Project Gaussian starting from the empty grid
         delete k_func;
 
+        TreeBuilder<2> builder;
+        OperatorAdaptor adaptor(o_prec, o_mra.getMaxScale());
         CrossCorrelationCalculator calculator(k_tree);
-        auto o_tree = std::make_unique<OperatorTree>(o_mra, o_prec);
         builder.build(*o_tree, calculator, adaptor, -1); // Expand 1D kernel into 2D operator
 
         Timer trans_t;
         o_tree->mwTransform(BottomUp);
         o_tree->calcSquareNorm();
+        if (not cache_file.empty()) o_tree->saveTree(cache_file, cache_key);
         o_tree->setupOperNodeCache();
         print::time(10, "Time transform", trans_t);
         print::separator(10, ' ');
 
-        this->raw_exp.push_back(std::move(o_tree));
+        o_trees[i] = std::move(o_tree);
     }
+    for (auto &o_tree : o_trees) this->raw_exp.push_back(std::move(o_tree));
 }
 
 template <int D> MultiResolutionAnalysis<1> ConvolutionOperator<D>::getKernelMRA() const {
@@ -141,6 +218,40 @@ template <int D> MultiResolutionAnalysis<1> ConvolutionOperator<D>::getKernelMRA
     return kern_mra;
 }
 
+/** @returns String uniquely identifying one operator component
+ *
+ * @param[in] k_func: Rescaled kernel term
+ * @param[in] k_prec: Kernel projection precision
+ * @param[in] o_prec: Operator build precision
+ *
+ * @details Floating point numbers are written in hexadecimal notation,
+ * so that the key is exact. The library version and the node size are part
+ * of the key, since the cached trees hold raw nodes.
+ */
+template <int D> std::string ConvolutionOperator<D>::getCacheKey(const Gaussian<1> &k_func, double k_prec, double o_prec) const {
+    auto o_mra = this->getOperatorMRA();
+    auto k_mra = this->getKernelMRA();
+
+    std::stringstream key;
+    key << std::hexfloat;
+    key << "build " << program_version() << " " << sizeof(OperatorNode) << "\n";
+    auto print_mra = [&key](const auto &mra) {
+        const auto &box = mra.getWorldBox();
+        const auto &basis = mra.getScalingBasis();
+        key << "basis " << basis.getScalingType() << " " << basis.getScalingOrder() << "\n";
+        key << "depth " << mra.getMaxDepth() << "\n";
+        key << "box " << box.getCornerIndex() << " " << box.getScalingFactors() << " " << box.isPeriodic();
+        for (int d = 0; d < box.getScalingFactors().size(); d++) key << " " << box.size(d);
+        key << "\n";
+    };
+    print_mra(o_mra);
+    print_mra(k_mra);
+    key << "root " << this->oper_root << " reach " << this->oper_reach << "\n";
+    key << "prec " << k_prec << " " << o_prec << "\n";
+    key << k_func;
+    return key.str();
+}
+
 template class ConvolutionOperator<1>;
 template class ConvolutionOperator<2>;
 template class ConvolutionOperator<3>;
@@ -25,10 +25,15 @@
 
 #pragma once
 
+#include <string>
+
 #include "MWOperator.h"
 
 namespace mrcpp {
 
+void set_operator_cache(const std::string &dir);
+const std::string &get_operator_cache();
+
 /** @class ConvolutionOperator
  *
  * @brief Convolution defined by a Gaussian expansion
@@ -79,6 +84,7 @@ protected:
     void setBuildPrec(double prec) { this->build_prec = prec; }
 
     MultiResolutionAnalysis<1> getKernelMRA() const;
+    std::string getCacheKey(const Gaussian<1> &k_func, double k_prec, double o_prec) const;
 
     double build_prec{-1.0};
 };
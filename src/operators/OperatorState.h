@@ -52,6 +52,7 @@ public:
         this->kp1_dm1 = math_utils::ipow(this->kp1, D - 1);
         this->gData = this->gNode->getCoefs();
         this->maxDeltaL = -1;
+        this->scrData = scr1;
 
         T *scr2 = scr1 + this->kp1_d;
 
@@ -87,6 +88,7 @@ public:
     int getOperIndex(int i) const { return GET_OP_IDX(this->ft, this->gt, i); }
 
     T **getAuxData() { return this->aux; }
+    T *getScratchData() { return this->scrData; }
     double **getOperData() { return this->oData; }
 
     friend class ConvolutionCalculator<D, T>;
@@ -112,6 +114,7 @@ private:
     T *aux[D + 1];
     T *gData;
     T *fData;
+    T *scrData;
     double *oData[D];
 
     void calcMaxDeltaL() {
@@ -23,6 +23,8 @@
  * <https://mrcpp.readthedocs.io/>
  */
 
+#include <unordered_map>
+
 #include "ConvolutionCalculator.h"
 #include "operators/ConvolutionOperator.h"
 #include "operators/OperatorState.h"
@@ -51,19 +53,67 @@ ConvolutionCalculator<D, T>::ConvolutionCalculator(double p, ConvolutionOperator
         : maxDepth(depth)
         , prec(p)
         , oper(&o)
-        , fTree(&f) {
+        , fTree(&f)
+        , fTrees({&f}) {
     if (this->maxDepth > MaxDepth) MSG_ABORT("Beyond MaxDepth");
     initBandSizes();
     initTimers();
+    indexInputTrees();
+    this->scheduler = &this->nodeScheduler;
+}
+
+/** @brief Calculator for applying the operator to several functions at once
+ *
+ * @details The output trees are built in lock-step: g[0] is the tree that is
+ * passed to the TreeBuilder, and the nodes of the other output trees are
+ * created to match the nodes of g[0]. The band traversal and operator
+ * screening is shared among all functions, and the f-components of all
+ * functions are contracted together with the operator.
+ */
+template <int D, typename T>
+ConvolutionCalculator<D, T>::ConvolutionCalculator(double p, ConvolutionOperator<D> &o, std::vector<FunctionTree<D, T> *> &f, std::vector<FunctionTree<D, T> *> &g, int depth)
+        : maxDepth(depth)
+        , prec(p)
+        , oper(&o)
+        , fTree(f[0])
+        , fTrees(f)
+        , gTrees(g) {
+    if (this->maxDepth > MaxDepth) MSG_ABORT("Beyond MaxDepth");
+    if (this->fTrees.size() != this->gTrees.size()) MSG_ABORT("Size mismatch");
+    initBandSizes();
+    initTimers();
+    indexInputTrees();
+    this->scheduler = &this->nodeScheduler;
 }
 
 template <int D, typename T> ConvolutionCalculator<D, T>::~ConvolutionCalculator() {
+    restoreInputTrees();
     clearTimers();
     this->operStat.flushNodeCounters();
     println(10, this->operStat);
+    if (this->scheduler == &this->nodeScheduler) println(10, this->nodeScheduler);
     for (int i = 0; i < this->bandSizes.size(); i++) { delete this->bandSizes[i]; }
 }
 
+/** @brief Enable hashed node lookup in the input trees
+ *
+ * @details The band traversal looks up every f-node within the operator
+ * bandwidth by index, which is a hash probe instead of a walk from the root
+ * when the tree is indexed. The previous state is restored on destruction.
+ */
+template <int D, typename T> void ConvolutionCalculator<D, T>::indexInputTrees() {
+    for (auto *f : this->fTrees) {
+        this->fIndexed.push_back(f->hasNodeIndexing());
+        f->setNodeIndexing(true);
+    }
+}
+
+template <int D, typename T> void ConvolutionCalculator<D, T>::restoreInputTrees() {
+    // reverse order, in case the same tree appears more than once
+    for (int i = this->fTrees.size() - 1; i >= 0; i--) this->fTrees[i]->setNodeIndexing(this->fIndexed[i]);
+    this->fIndexed.clear();
+}
+
 template <int D, typename T> void ConvolutionCalculator<D, T>::initTimers() {
     int nThreads = mrcpp_get_max_threads();
     for (int i = 0; i < nThreads; i++) {
@@ -138,10 +188,83 @@ template <int D, typename T> void ConvolutionCalculator<D, T>::calcBandSizeFacto
     bs(depth, this->nComp2) = bs.row(depth).maxCoeff();
 }
 
-/** Return a vector of nodes in F affected by O, given a node in G */
-template <int D, typename T> MWNodeVector<D, T> *ConvolutionCalculator<D, T>::makeOperBand(const MWNode<D, T> &gNode, std::vector<NodeIndex<D>> &idx_band) {
-    auto *band = new MWNodeVector<D, T>;
+/** @brief Compute the f-nodes of all g-nodes in the vector within the bandwidth of the operator.
+ *
+ * @details The band of each g-node is stored as a row of positions into a list
+ * of unique f-nodes (one per input function), such that each f-node is looked up (and possibly generated)
+ * only once per node vector, and the rows can be traversed without any tree
+ * descents or allocations in calcNode. Each thread collects the band of a
+ * contiguous block of g-nodes, so that overlapping bands of neighboring nodes
+ * are merged. The blocks are concatenated in g-node order afterwards.
+ */
+template <int D, typename T> void ConvolutionCalculator<D, T>::makeBandTable(const MWNodeVector<D, T> &gVec) {
+    int nNodes = gVec.size();
+    int nThreads = mrcpp_get_num_threads();
+    std::vector<std::vector<NodeIndex<D>>> t_indices(nThreads);
+    std::vector<std::vector<int>> t_rows(nThreads);
+    this->bandRowStart.assign(nNodes + 1, 0);
+
+#pragma omp parallel shared(gVec, t_indices, t_rows) num_threads(nThreads)
+    {
+        int t = mrcpp_get_thread_num();
+        this->band_t[t]->resume();
+        std::unordered_map<NodeIndex<D>, int> t_pos;
+        std::vector<NodeIndex<D>> idx_band;
+#pragma omp for schedule(static)
+        for (int n = 0; n < nNodes; n++) {
+            idx_band.clear();
+            makeOperBand(*gVec[n], idx_band);
+            for (auto &idx : idx_band) {
+                auto it = t_pos.emplace(idx, t_indices[t].size());
+                if (it.second) t_indices[t].push_back(idx);
+                t_rows[t].push_back(it.first->second);
+            }
+            this->bandRowStart[n + 1] = idx_band.size();
+        }
+        this->band_t[t]->stop();
+    }
+
+    // Static schedule assigns the blocks of g-nodes in thread order
+    std::vector<int> t_offset(nThreads + 1, 0);
+    std::vector<int> r_offset(nThreads + 1, 0);
+    for (int t = 0; t < nThreads; t++) {
+        t_offset[t + 1] = t_offset[t] + t_indices[t].size();
+        r_offset[t + 1] = r_offset[t] + t_rows[t].size();
+    }
+    for (int n = 0; n < nNodes; n++) this->bandRowStart[n + 1] += this->bandRowStart[n];
+
+    this->bandIndices.resize(t_offset[nThreads]);
+    this->bandNodes.resize(t_offset[nThreads] * this->fTrees.size());
+    this->bandRows.resize(r_offset[nThreads]);
+
+#pragma omp parallel shared(t_indices, t_rows, t_offset, r_offset) num_threads(nThreads)
+    {
+        int t = mrcpp_get_thread_num();
+        this->band_t[t]->resume();
+#pragma omp for schedule(static)
+        for (int i = 0; i < nThreads; i++) {
+            for (int r = 0; r < t_rows[i].size(); r++) this->bandRows[r_offset[i] + r] = t_rows[i][r] + t_offset[i];
+            std::copy(t_indices[i].begin(), t_indices[i].end(), this->bandIndices.begin() + t_offset[i]);
+        }
+        int nIndices = this->bandIndices.size();
+        int nFuncs = this->fTrees.size();
+#pragma omp for schedule(guided)
+        for (int i = 0; i < nIndices; i++) {
+            for (int j = 0; j < nFuncs; j++) this->bandNodes[i * nFuncs + j] = &this->fTrees[j]->getNode(this->bandIndices[i]);
+        }
+        this->band_t[t]->stop();
+    }
+}
+
+template <int D, typename T> void ConvolutionCalculator<D, T>::clearBandTable() {
+    this->bandNodes.clear();
+    this->bandIndices.clear();
+    this->bandRowStart.clear();
+    this->bandRows.clear();
+}
 
+/** Return the indices of nodes in F affected by O, given a node in G */
+template <int D, typename T> void ConvolutionCalculator<D, T>::makeOperBand(const MWNode<D, T> &gNode, std::vector<NodeIndex<D>> &idx_band) {
     int o_depth = gNode.getScale() - this->oper->getOperatorRoot();
     int g_depth = gNode.getDepth();
     int width = this->oper->getMaxBandWidth(o_depth);
@@ -174,44 +297,35 @@ template <int D, typename T> MWNodeVector<D, T> *ConvolutionCalculator<D, T>::ma
             nbox[i] = eIdx[i] - sIdx[i] + 1;
         }
 
-        fillOperBand(band, idx_band, sIdx, nbox, D - 1);
+        fillOperBand(idx_band, sIdx, nbox, D - 1);
     }
-    return band;
 }
 
-/** Recursively retrieve all reachable f-nodes within the bandwidth. */
-template <int D, typename T> void ConvolutionCalculator<D, T>::fillOperBand(MWNodeVector<D, T> *band, std::vector<NodeIndex<D>> &idx_band, NodeIndex<D> &idx, const int *nbox, int dim) {
+/** Recursively collect the indices of all reachable f-nodes within the bandwidth. */
+template <int D, typename T> void ConvolutionCalculator<D, T>::fillOperBand(std::vector<NodeIndex<D>> &idx_band, NodeIndex<D> &idx, const int *nbox, int dim) {
     int l_start = idx[dim];
     for (int j = 0; j < nbox[dim]; j++) {
         // Recurse until dim == 0
         if (dim > 0) {
-            fillOperBand(band, idx_band, idx, nbox, dim - 1);
+            fillOperBand(idx_band, idx, nbox, dim - 1);
             idx[dim]++;
             continue;
         }
         if (not manipulateOperator) {
-            MWNode<D, T> &fNode = this->fTree->getNode(idx);
             idx_band.push_back(idx);
-            band->push_back(&fNode);
 
         } else {
             const auto oper_scale = this->oper->getOperatorRoot();
             if (oper_scale == 0) {
                 if (periodic::in_unit_cell<D>(idx) and onUnitcell) {
-                    MWNode<D, T> &fNode = this->fTree->getNode(idx);
                     idx_band.push_back(idx);
-                    band->push_back(&fNode);
                 }
                 if (not periodic::in_unit_cell<D>(idx) and not onUnitcell) {
-                    MWNode<D, T> &fNode = this->fTree->getNode(idx);
                     idx_band.push_back(idx);
-                    band->push_back(&fNode);
                 }
             } else if (oper_scale < 0) {
                 if (periodic::in_unit_cell<D>(idx) and onUnitcell) {
-                    MWNode<D, T> &fNode = this->fTree->getNode(idx);
                     idx_band.push_back(idx);
-                    band->push_back(&fNode);
                 }
                 if (not onUnitcell) MSG_ABORT("Cannot do with negative operator scale");
             } else
@@ -222,80 +336,194 @@ template <int D, typename T> void ConvolutionCalculator<D, T>::fillOperBand(MWNo
     idx[dim] = l_start;
 }
 
+/** Calculate all nodes in the vector, using a band table for the
+ * f-nodes within the bandwidth of each g-node. The cost of a g-node is
+ * predicted by the length of its band row, which is used by the scheduler
+ * to balance the work between threads. */
+template <int D, typename T> void ConvolutionCalculator<D, T>::calcNodeVector(MWNodeVector<D, T> &nodeVec) {
+    makeBandTable(nodeVec);
+    initNodeVector(nodeVec);
+    int nNodes = nodeVec.size();
+    if (this->scheduler != nullptr) {
+        std::vector<double> costs(nNodes);
+        for (int n = 0; n < nNodes; n++) costs[n] = 1.0 + this->bandRowStart[n + 1] - this->bandRowStart[n];
+        this->scheduler->run(costs, [this, &nodeVec](int n) { calcNode(*nodeVec[n], n); });
+    } else {
+#pragma omp parallel shared(nodeVec) num_threads(mrcpp_get_num_threads())
+        {
+#pragma omp for schedule(guided)
+            for (int n = 0; n < nNodes; n++) {
+                MWNode<D, T> &node = *nodeVec[n];
+                calcNode(node, n);
+            }
+        }
+    }
+    updateTreeNorms();
+    clearBandTable();
+    this->gNodes.clear();
+    postProcess();
+}
+
+/** @brief Collect the output nodes of all functions and set up per-thread work memory
+ *
+ * @details The nodes of the additional output trees are created (if needed)
+ * to match the nodes of the tree that is being built.
+ */
+template <int D, typename T> void ConvolutionCalculator<D, T>::initNodeVector(MWNodeVector<D, T> &nodeVec) {
+    int nNodes = nodeVec.size();
+    int nFuncs = this->fTrees.size();
+    this->gNodes.resize(nNodes * nFuncs);
+    for (int n = 0; n < nNodes; n++) {
+        this->gNodes[n * nFuncs] = nodeVec[n];
+        const NodeIndex<D> &idx = nodeVec[n]->getNodeIndex();
+        for (int j = 1; j < nFuncs; j++) this->gNodes[n * nFuncs + j] = &this->gTrees[j]->getNode(idx, true);
+    }
+
+    int nThreads = mrcpp_get_num_threads();
+    int nCoefs = this->fTree->getTDim() * this->fTree->getKp1_d();
+    this->workMem.resize(nThreads);
+    this->funcStates.resize(nThreads);
+    for (int t = 0; t < nThreads; t++) {
+        this->workMem[t].resize(nFuncs * nCoefs);
+        this->funcStates[t].active.resize(nFuncs);
+        this->funcStates[t].fNorm.resize(nFuncs);
+        this->funcStates[t].gThreshold.resize(nFuncs);
+        this->funcStates[t].gData.resize(nFuncs);
+    }
+}
+
+/** @brief Approximate norms of the additional output trees, used for thresholding
+ *
+ * @details The tree that is being built gets its norm from the TreeBuilder,
+ * this does the same for the other output trees.
+ */
+template <int D, typename T> void ConvolutionCalculator<D, T>::updateTreeNorms() {
+    int nFuncs = this->gTrees.size();
+    if (nFuncs < 2) return;
+    int nNodes = this->gNodes.size() / nFuncs;
+    if (this->nVectors == 0) {
+        this->gScalingNorms.assign(nFuncs, 0.0);
+        this->gWaveletNorms.assign(nFuncs, 0.0);
+    }
+    for (int j = 1; j < nFuncs; j++) {
+        double sNorm = 0.0;
+        double wNorm = 0.0;
+        for (int n = 0; n < nNodes; n++) {
+            const MWNode<D, T> &node = *this->gNodes[n * nFuncs + j];
+            if (node.getDepth() < 0) continue;
+            sNorm += node.getScalingNorm();
+            wNorm += node.getWaveletNorm();
+        }
+        if (this->nVectors == 0) this->gScalingNorms[j] = sNorm;
+        this->gWaveletNorms[j] += wNorm;
+
+        MWTree<D, T> &gTree = *this->gTrees[j];
+        if (this->gScalingNorms[j] < 0.0 or this->gWaveletNorms[j] < 0.0) {
+            gTree.squareNorm = -1.0;
+        } else {
+            gTree.squareNorm = this->gScalingNorms[j] + this->gWaveletNorms[j];
+        }
+    }
+    this->nVectors++;
+}
+
+/** Nodes are computed in calcNodeVector, which sets up the band table. */
 template <int D, typename T> void ConvolutionCalculator<D, T>::calcNode(MWNode<D, T> &node) {
+    NOT_REACHED_ABORT;
+}
+
+template <int D, typename T> void ConvolutionCalculator<D, T>::calcNode(MWNode<D, T> &node, int row) {
+    int nFuncs = this->fTrees.size();
+    FuncState &fs = this->funcStates[mrcpp_get_thread_num()];
     auto &gNode = static_cast<FunctionNode<D, T> &>(node);
-    gNode.zeroCoefs();
 
     int o_depth = gNode.getScale() - this->oper->getOperatorRoot();
     if (manipulateOperator and this->oper->getOperatorRoot() < 0) o_depth = gNode.getDepth();
-    T tmpCoefs[gNode.getNCoefs()];
-    OperatorState<D, T> os(gNode, tmpCoefs);
-    this->operStat.incrementGNodeCounters(gNode);
-
-    // Get all nodes in f within the bandwith of O in g
-    this->band_t[mrcpp_get_thread_num()]->resume();
-    std::vector<NodeIndex<D>> idx_band;
-    MWNodeVector<D, T> *fBand = makeOperBand(gNode, idx_band);
-    this->band_t[mrcpp_get_thread_num()]->stop();
-
-    MWTree<D, T> &gTree = gNode.getMWTree();
-    double gThrs = gTree.getSquareNorm();
-    if (gThrs > 0.0) {
-        auto nTerms = static_cast<double>(this->oper->size());
-        auto precFac = this->precFunc(gNode.getNodeIndex());
-        gThrs = this->prec * precFac * std::sqrt(gThrs / nTerms);
+    OperatorState<D, T> os(gNode, this->workMem[mrcpp_get_thread_num()].data());
+
+    auto nTerms = static_cast<double>(this->oper->size());
+    auto precFac = this->precFunc(gNode.getNodeIndex());
+    for (int j = 0; j < nFuncs; j++) {
+        MWNode<D, T> &gNode_j = *this->gNodes[row * nFuncs + j];
+        gNode_j.zeroCoefs();
+        this->operStat.incrementGNodeCounters(gNode_j);
+
+        double gThrs = gNode_j.getMWTree().getSquareNorm();
+        if (gThrs > 0.0) gThrs = this->prec * precFac * std::sqrt(gThrs / nTerms);
+        fs.gThreshold[j] = gThrs;
+        fs.gData[j] = gNode_j.getCoefs();
     }
 
-    os.gThreshold = gThrs;
-
     this->calc_t[mrcpp_get_thread_num()]->resume();
-    for (int n = 0; n < fBand->size(); n++) {
-        MWNode<D, T> &fNode = *(*fBand)[n];
-        NodeIndex<D> &fIdx = idx_band[n];
-        os.setFNode(fNode);
+    // All nodes in f within the bandwith of O in g
+    for (int n = this->bandRowStart[row]; n < this->bandRowStart[row + 1]; n++) {
+        int pos = this->bandRows[n];
+        MWNode<D, T> **fNodes = &this->bandNodes[pos * nFuncs];
+        NodeIndex<D> &fIdx = this->bandIndices[pos];
+        os.setFNode(*fNodes[0]);
         os.setFIndex(fIdx);
         for (int ft = 0; ft < this->nComp; ft++) {
-            double fNorm = fNode.getComponentNorm(ft);
-            if (fNorm < MachineZero) { continue; }
-            os.setFComponent(ft);
-            for (int gt = 0; gt < this->nComp; gt++) {
-                if (o_depth == 0 or gt != 0 or ft != 0) {
-                    os.setGComponent(gt);
-                    applyOperComp(os);
+            fs.nActive = 0;
+            for (int j = 0; j < nFuncs; j++) {
+                double fNorm = fNodes[j]->getComponentNorm(ft);
+                if (fNorm < MachineZero) { continue; }
+                fs.active[fs.nActive] = j;
+                fs.fNorm[fs.nActive] = fNorm;
+                fs.nActive++;
+            }
+            if (fs.nActive == 0) { continue; }
+            if (fs.nActive == 1) {
+                fs.fData = fNodes[fs.active[0]]->getCoefs() + ft * os.kp1_d;
+            } else {
+                // Stack the f-components contiguously at the start of the work memory
+                T *fStack = os.getScratchData();
+                for (int a = 0; a < fs.nActive; a++) {
+                    const T *fData = fNodes[fs.active[a]]->getCoefs() + ft * os.kp1_d;
+                    std::copy(fData, fData + os.kp1_d, fStack + a * os.kp1_d);
                 }
+                fs.fData = fStack;
             }
+            os.setFComponent(ft);
+            int gtMask = (1 << this->nComp) - 1;
+            if (o_depth != 0 and ft == 0) gtMask &= ~1;
+            applyOperComp(os, fs, gtMask);
         }
     }
     this->calc_t[mrcpp_get_thread_num()]->stop();
 
     this->norm_t[mrcpp_get_thread_num()]->resume();
-    gNode.calcNorms();
+    for (int j = 0; j < nFuncs; j++) this->gNodes[row * nFuncs + j]->calcNorms();
     this->norm_t[mrcpp_get_thread_num()]->stop();
-    delete fBand;
 }
 
-/** Apply each component (term) of the operator expansion to a node in f */
-template <int D, typename T> void ConvolutionCalculator<D, T>::applyOperComp(OperatorState<D, T> &os) {
-    double fNorm = os.fNode->getComponentNorm(os.ft);
+/** Apply each component (term) of the operator expansion to a node in f.
+ * All g-components in gtMask are treated in one batch per term. */
+template <int D, typename T> void ConvolutionCalculator<D, T>::applyOperComp(OperatorState<D, T> &os, FuncState &fs, int gtMask) {
     int o_depth = os.fNode->getScale() - this->oper->getOperatorRoot();
     for (int i = 0; i < this->oper->size(); i++) {
         // IMPORTANT: only 0-th dimension
         const OperatorTree &ot = this->oper->getComponent(i, 0);
         const BandWidth &bw = ot.getBandWidth();
         if (os.getMaxDeltaL() > bw.getMaxWidth(o_depth)) { continue; }
-        os.fThreshold = getBandSizeFactor(i, o_depth, os) * fNorm;
-        applyOperator(i, os);
+        applyOperator(i, os, fs, gtMask);
     }
 }
 
-/** @brief Apply a single operator component (term) to a single f-node.
+/** @brief Apply a single operator component (term) to a single f-component.
  *
- * @details Apply a single operator component (term) to a single f-node.
- * Whether the operator actualy is applied is determined by a screening threshold.
+ * @details Apply a single operator component (term) to a single f-component,
+ * for all g-components in gtMask simultaneously. Whether the operator actualy
+ * is applied to a given g-component is determined by a screening threshold,
+ * and when several functions are applied together the g-component is kept
+ * if it is significant for any of them.
  * Here we make use of the sparcity of matrices \f$ A, B, C \f$.
  *
+ * The operator block in direction d depends only on bit d of the f- and
+ * g-component indices, so there are at most two different blocks per
+ * direction. These are collected in oBatch and the surviving g-components
+ * are passed on to tensorApplyOperComp as a bit mask.
  */
-template <int D, typename T> void ConvolutionCalculator<D, T>::applyOperator(int i, OperatorState<D, T> &os) {
+template <int D, typename T> void ConvolutionCalculator<D, T>::applyOperator(int i, OperatorState<D, T> &os, FuncState &fs, int gtMask) {
     MWNode<D, T> &gNode = *os.gNode;
     MWNode<D, T> &fNode = *os.fNode;
 
@@ -303,83 +531,189 @@ template <int D, typename T> void ConvolutionCalculator<D, T>::applyOperator(int
     const NodeIndex<D> &gIdx = gNode.getNodeIndex();
     int o_depth = gNode.getScale() - this->oper->getOperatorRoot();
 
-    double oNorm = 1.0;
-    double **oData = os.getOperData();
-
+    const OperatorNode *oNode[D];
+    bool inBand[D][2];
     for (int d = 0; d < D; d++) {
         auto &oTree = this->oper->getComponent(i, d);
         int oTransl = fIdx[d] - gIdx[d];
 
         //  The following will check the actual band width in each direction.
         //  Not needed if the thresholding at the end of this routine is active.
-        int a = (os.gt & (1 << d)) >> d;
-        int b = (os.ft & (1 << d)) >> d;
-        int idx = (a << 1) + b;
-        if (oTree.isOutsideBand(oTransl, o_depth, idx)) { return; }
-
-        const OperatorNode &oNode = oTree.getNode(o_depth, oTransl);
-        int oIdx = os.getOperIndex(d);
-        oNorm *= oNode.getComponentNorm(oIdx);
-        oData[d] = const_cast<double *>(oNode.getCoefs()) + oIdx * os.kp1_2;
+        int b = (os.ft >> d) & 1;
+        inBand[d][0] = not oTree.isOutsideBand(oTransl, o_depth, b);
+        inBand[d][1] = not oTree.isOutsideBand(oTransl, o_depth, 2 + b);
+        if (not(inBand[d][0] or inBand[d][1])) { return; }
+        oNode[d] = &oTree.getNode(o_depth, oTransl);
     }
-    double upperBound = oNorm * os.fThreshold;
-    if (upperBound > os.gThreshold) {
-        this->operStat.incrementFNodeCounters(fNode, os.ft, os.gt);
-        tensorApplyOperComp(os);
+
+    int gtBatch = 0;
+    for (int gt = 0; gt < this->nComp; gt++) {
+        if (not(gtMask & (1 << gt))) { continue; }
+        double oNorm = 1.0;
+        for (int d = 0; d < D; d++) {
+            int a = (gt >> d) & 1;
+            if (not inBand[d][a]) {
+                oNorm = 0.0;
+                break;
+            }
+            oNorm *= oNode[d]->getComponentNorm(GET_OP_IDX(os.ft, gt, d));
+        }
+        if (oNorm == 0.0) { continue; }
+        os.gt = gt;
+        double bandFac = getBandSizeFactor(i, o_depth, os);
+        for (int a = 0; a < fs.nActive; a++) {
+            os.fThreshold = bandFac * fs.fNorm[a];
+            double upperBound = oNorm * os.fThreshold;
+            if (upperBound > fs.gThreshold[fs.active[a]]) {
+                this->operStat.incrementFNodeCounters(fNode, os.ft, gt);
+                gtBatch |= (1 << gt);
+                break;
+            }
+        }
+    }
+    if (gtBatch == 0) { return; }
+
+    double *oBatch[D][2];
+    for (int d = 0; d < D; d++) {
+        int b = (os.ft >> d) & 1;
+        for (int a = 0; a < 2; a++) {
+            int oIdx = 2 * a + b;
+            oBatch[d][a] = inBand[d][a] ? const_cast<double *>(oNode[d]->getCoefs()) + oIdx * os.kp1_2 : nullptr;
+        }
     }
+    tensorApplyOperComp(os, fs, oBatch, gtBatch);
 }
 
-/** Perorm the required linear algebra operations in order to apply an
-operator component to a f-node in a n-dimensional tesor space. */
-template <int D, typename T> void ConvolutionCalculator<D, T>::tensorApplyOperComp(OperatorState<D, T> &os) {
-    T **aux = os.getAuxData();
-    double **oData = os.getOperData();
-    /*
-#ifdef HAVE_BLAS
-    double mult = 0.0;
-    for (int i = 0; i < D; i++) {
-        if (oData[i] != 0) {
-            if (i == D - 1) { // Last dir: Add up into g
-                mult = 1.0;
-            }
-            const double *f = aux[i];
-            double *g = const_cast<double *>(aux[i + 1]);
-            cblas_dgemm(CblasColMajor, CblasTrans, CblasNoTrans, os.kp1_dm1, os.kp1, os.kp1, 1.0, f, os.kp1, oData[i], os.kp1, mult, g, os.kp1_dm1);
-        } else {
-            // Identity operator in direction i
-            Eigen::Map<MatrixXd> f(aux[i], os.kp1, os.kp1_dm1);
-            Eigen::Map<MatrixXd> g(aux[i + 1], os.kp1_dm1, os.kp1);
-            if (oData[i] == 0) {
-                if (i == D - 1) { // Last dir: Add up into g
-                    g += f.transpose();
-                } else {
-                    g = f.transpose();
+/** @brief Perform the linear algebra operations required to apply an operator
+ * component to a f-component in a n-dimensional tensor space.
+ *
+ * @details The contraction is done one direction at a time, and the partial
+ * result after direction d depends only on the lowest d+1 bits of the
+ * g-component index. Partial results are therefore computed once per distinct
+ * prefix and shared among all g-components in the batch, which for D=3
+ * reduces the number of small matrix products from 24 to at most 14.
+ *
+ * The f-components of all active functions are stacked as the slowest index
+ * and contracted together. Each contraction rotates the tensor indices, so
+ * after the last direction the function index has become the fastest one,
+ * and the results are added into the g-nodes with a stride.
+ *
+ * Layout of the work memory (in units of nFuncs*kp1_d): the stacked
+ * f-components, 2^d slots for the partial results after direction d for
+ * 0 < d < D, and the final result.
+ */
+template <int D, typename T>
+void ConvolutionCalculator<D, T>::tensorApplyOperComp(OperatorState<D, T> &os, FuncState &fs, double *oBatch[][2], int gtBatch) {
+    const int kp1 = os.kp1;
+    const int kp1_d = os.kp1_d;
+    const int nActive = fs.nActive;
+    const int slotSize = nActive * kp1_d;
+    T *scrLevels = os.getScratchData() + this->fTrees.size() * kp1_d;
+    T *scrResult = scrLevels + ((1 << D) - 2) * slotSize;
+
+    for (int d = 0; d < D; d++) {
+        const int nPrefix = 2 << d;
+        const int prefixMask = nPrefix - 1;
+        int prefixes = 0;
+        for (int gt = 0; gt < this->nComp; gt++) {
+            if (gtBatch & (1 << gt)) prefixes |= (1 << (gt & prefixMask));
+        }
+        bool lastDir = (d == D - 1);
+        for (int p = 0; p < nPrefix; p++) {
+            if (not(prefixes & (1 << p))) { continue; }
+            const double *op = oBatch[d][(p >> d) & 1];
+            const T *f = (d == 0) ? fs.fData : scrLevels + ((1 << d) - 2 + (p & (prefixMask >> 1))) * slotSize;
+            if (not lastDir) {
+                tensorContract(kp1, nActive, f, op, scrLevels + (nPrefix - 2 + p) * slotSize, false);
+            } else if (nActive == 1) {
+                tensorContract(kp1, 1, f, op, fs.gData[fs.active[0]] + p * kp1_d, true);
+            } else {
+                tensorContract(kp1, nActive, f, op, scrResult, false);
+                for (int a = 0; a < nActive; a++) {
+                    Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, 1>> g(fs.gData[fs.active[a]] + p * kp1_d, kp1_d);
+                    Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, 1>, 0, Eigen::InnerStride<>> r(scrResult + a, kp1_d, Eigen::InnerStride<>(nActive));
+                    g += r;
                 }
             }
         }
     }
-#else
-    */
-    for (int i = 0; i < D; i++) {
-        Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>> f(aux[i], os.kp1, os.kp1_dm1);
-        Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>> g(aux[i + 1], os.kp1_dm1, os.kp1);
-        if (oData[i] != nullptr) {
-            Eigen::Map<MatrixXd> op(oData[i], os.kp1, os.kp1);
-            if (i == D - 1) { // Last dir: Add up into g
-                g.noalias() += f.transpose() * op;
+}
+
+/** Single direction contraction g = f^T * op (or g += f^T * op), where f is
+ * (k+1)x((k+1)^(D-1)*nFuncs) and op is (k+1)x(k+1). A null op means identity.
+ * The common orders are dispatched to fixed-size kernels. */
+template <int D, typename T> void ConvolutionCalculator<D, T>::tensorContract(int kp1, int nFuncs, const T *f, const double *op, T *g, bool add) {
+    switch (kp1) {
+        case 2: tensorContract<2>(nFuncs, f, op, g, add); return;
+        case 3: tensorContract<3>(nFuncs, f, op, g, add); return;
+        case 4: tensorContract<4>(nFuncs, f, op, g, add); return;
+        case 5: tensorContract<5>(nFuncs, f, op, g, add); return;
+        case 6: tensorContract<6>(nFuncs, f, op, g, add); return;
+        case 7: tensorContract<7>(nFuncs, f, op, g, add); return;
+        case 8: tensorContract<8>(nFuncs, f, op, g, add); return;
+        case 9: tensorContract<9>(nFuncs, f, op, g, add); return;
+        case 10: tensorContract<10>(nFuncs, f, op, g, add); return;
+        default: break;
+    }
+    int nCols = math_utils::ipow(kp1, D - 1) * nFuncs;
+    Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>> fMap(f, kp1, nCols);
+    Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>> gMap(g, nCols, kp1);
+    if (op != nullptr) {
+        Eigen::Map<const MatrixXd> oMap(op, kp1, kp1);
+        if (add) {
+            gMap.noalias() += fMap.transpose() * oMap;
+        } else {
+            gMap.noalias() = fMap.transpose() * oMap;
+        }
+    } else {
+        if (add) {
+            gMap.noalias() += fMap.transpose();
+        } else {
+            gMap.noalias() = fMap.transpose();
+        }
+    }
+}
+
+template <int D, typename T>
+template <int K>
+void ConvolutionCalculator<D, T>::tensorContract(int nFuncs, const T *f, const double *op, T *g, bool add) {
+    constexpr int K_dm1 = (D == 1) ? 1 : ((D == 2) ? K : K * K);
+    static_assert(D <= 3, "Fixed-size contraction only implemented for D <= 3");
+    if (nFuncs != 1) {
+        Eigen::Map<const Eigen::Matrix<T, K, Eigen::Dynamic>> fMap(f, K, K_dm1 * nFuncs);
+        Eigen::Map<Eigen::Matrix<T, Eigen::Dynamic, K>> gMap(g, K_dm1 * nFuncs, K);
+        if (op != nullptr) {
+            Eigen::Map<const Eigen::Matrix<double, K, K>> oMap(op);
+            if (add) {
+                gMap.noalias() += fMap.transpose() * oMap;
             } else {
-                g.noalias() = f.transpose() * op;
+                gMap.noalias() = fMap.transpose() * oMap;
             }
         } else {
-            // Identity operator in direction i
-            if (i == D - 1) { // Last dir: Add up into g
-                g.noalias() += f.transpose();
+            if (add) {
+                gMap.noalias() += fMap.transpose();
             } else {
-                g.noalias() = f.transpose();
+                gMap.noalias() = fMap.transpose();
             }
         }
+        return;
+    }
+    Eigen::Map<const Eigen::Matrix<T, K, K_dm1>> fMap(f);
+    Eigen::Map<Eigen::Matrix<T, K_dm1, K>> gMap(g);
+    if (op != nullptr) {
+        Eigen::Map<const Eigen::Matrix<double, K, K>> oMap(op);
+        if (add) {
+            gMap.noalias() += fMap.transpose() * oMap;
+        } else {
+            gMap.noalias() = fMap.transpose() * oMap;
+        }
+    } else {
+        if (add) {
+            gMap.noalias() += fMap.transpose();
+        } else {
+            gMap.noalias() = fMap.transpose();
+        }
     }
-    //#endif
 }
 
 template <int D, typename T> void ConvolutionCalculator<D, T>::touchParentNodes(MWTree<D, T> &tree) const {
@@ -392,7 +726,7 @@ template <int D, typename T> void ConvolutionCalculator<D, T>::touchParentNodes(
                 std::copy_n(a.begin(), D, l.begin());
                 NodeIndex<D> idx(i, l);
                 tree.getNode(idx);
-                this->fTree->getNode(idx);
+                for (auto *f : this->fTrees) f->getNode(idx);
             }
         }
     }
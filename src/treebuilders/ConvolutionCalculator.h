@@ -36,9 +36,11 @@ namespace mrcpp {
 template <int D, typename T> class ConvolutionCalculator final : public TreeCalculator<D, T> {
 public:
     ConvolutionCalculator(double p, ConvolutionOperator<D> &o, FunctionTree<D, T> &f, int depth = MaxDepth);
+    ConvolutionCalculator(double p, ConvolutionOperator<D> &o, std::vector<FunctionTree<D, T> *> &f, std::vector<FunctionTree<D, T> *> &g, int depth = MaxDepth);
     ~ConvolutionCalculator() override;
 
     MWNodeVector<D, T> *getInitialWorkVector(MWTree<D, T> &tree) const override;
+    void calcNodeVector(MWNodeVector<D, T> &nodeVec) override;
 
     void setPrecFunction(const std::function<double(const NodeIndex<D> &idx)> &prec_func) { this->precFunc = prec_func; }
     void startManipulateOperator(bool excUnit) {
@@ -53,24 +55,59 @@ private:
     bool onUnitcell{false};
     ConvolutionOperator<D> *oper;
     FunctionTree<D, T> *fTree;
+    std::vector<FunctionTree<D, T> *> fTrees; ///< Input functions, fTrees[0] == fTree
+    std::vector<FunctionTree<D, T> *> gTrees; ///< Output functions, empty for a single function
+    std::vector<bool> fIndexed;               ///< Node indexing state of fTrees before the apply
     std::vector<Timer *> band_t;
     std::vector<Timer *> calc_t;
     std::vector<Timer *> norm_t;
 
     OperatorStatistics operStat;
+    NodeScheduler nodeScheduler;
     std::vector<Eigen::MatrixXi *> bandSizes;
     std::function<double(const NodeIndex<D> &idx)> precFunc = [](const NodeIndex<D> &idx) { return 1.0; };
 
+    // Band table for the current node vector: the (unique) f-nodes within
+    // the bandwidth of the operator, and for each g-node a row of positions
+    // into these, stored contiguously with row offsets in bandRowStart.
+    std::vector<MWNode<D, T> *> bandNodes;
+    std::vector<NodeIndex<D>> bandIndices;
+    std::vector<int> bandRowStart;
+    std::vector<int> bandRows;
+
+    // Output nodes of all functions for the current node vector
+    std::vector<MWNode<D, T> *> gNodes;
+    std::vector<double> gScalingNorms;
+    std::vector<double> gWaveletNorms;
+    int nVectors{0};
+
+    // Per-thread state for the functions that are applied together
+    struct FuncState {
+        int nActive{0};
+        std::vector<int> active;        ///< Functions with non-vanishing f-component
+        std::vector<double> fNorm;      ///< Norm of the f-component of the active functions
+        std::vector<double> gThreshold; ///< Screening threshold of all output functions
+        std::vector<T *> gData;         ///< Coefficients of the output g-node of all functions
+        const T *fData{nullptr};        ///< f-components of the active functions, stacked
+    };
+    std::vector<FuncState> funcStates;
+    std::vector<std::vector<T>> workMem;
+
     static const int nComp = (1 << D);
     static const int nComp2 = (1 << D) * (1 << D);
 
-    MWNodeVector<D, T> *makeOperBand(const MWNode<D, T> &gNode, std::vector<NodeIndex<D>> &idx_band);
-    void fillOperBand(MWNodeVector<D, T> *band, std::vector<NodeIndex<D>> &idx_band, NodeIndex<D> &idx, const int *nbox, int dim);
+    void makeBandTable(const MWNodeVector<D, T> &gVec);
+    void clearBandTable();
+    void makeOperBand(const MWNode<D, T> &gNode, std::vector<NodeIndex<D>> &idx_band);
+    void fillOperBand(std::vector<NodeIndex<D>> &idx_band, NodeIndex<D> &idx, const int *nbox, int dim);
 
     void initTimers();
     void clearTimers();
     void printTimers() const;
 
+    void indexInputTrees();
+    void restoreInputTrees();
+
     void initBandSizes();
     int getBandSizeFactor(int i, int depth, const OperatorState<D, T> &os) const {
         int k = os.gt * this->nComp + os.ft;
@@ -80,15 +117,21 @@ private:
     void calcBandSizeFactor(Eigen::MatrixXi &bs, int depth, const BandWidth &bw);
 
     void calcNode(MWNode<D, T> &node) override;
+    void calcNode(MWNode<D, T> &node, int row);
     void postProcess() override {
         printTimers();
         clearTimers();
         initTimers();
     }
 
-    void applyOperComp(OperatorState<D, T> &os);
-    void applyOperator(int i, OperatorState<D, T> &os);
-    void tensorApplyOperComp(OperatorState<D, T> &os);
+    void initNodeVector(MWNodeVector<D, T> &nodeVec);
+    void updateTreeNorms();
+
+    void applyOperComp(OperatorState<D, T> &os, FuncState &fs, int gtMask);
+    void applyOperator(int i, OperatorState<D, T> &os, FuncState &fs, int gtMask);
+    void tensorApplyOperComp(OperatorState<D, T> &os, FuncState &fs, double *oBatch[][2], int gtBatch);
+    static void tensorContract(int kp1, int nFuncs, const T *f, const double *op, T *g, bool add);
+    template <int K> static void tensorContract(int nFuncs, const T *f, const double *op, T *g, bool add);
 
     void touchParentNodes(MWTree<D, T> &tree) const;
 };
@@ -46,12 +46,15 @@ template <int D, typename T>
 DerivativeCalculator<D, T>::DerivativeCalculator(int dir, DerivativeOperator<D> &o, FunctionTree<D, T> &f)
         : applyDir(dir)
         , fTree(&f)
-        , oper(&o) {
+        , oper(&o)
+        , fIndexed(f.hasNodeIndexing()) {
     if (dir < 0 or dir >= D) MSG_ABORT("Invalid apply dir");
+    this->fTree->setNodeIndexing(true);
     initTimers();
 }
 
 template <int D, typename T> DerivativeCalculator<D, T>::~DerivativeCalculator() {
+    this->fTree->setNodeIndexing(this->fIndexed);
     this->operStat.flushNodeCounters();
     println(10, this->operStat);
 }
@@ -42,6 +42,7 @@ private:
     int applyDir;
     FunctionTree<D, T> *fTree;
     DerivativeOperator<D> *oper;
+    bool fIndexed; ///< Node indexing state of fTree before the apply
 
     std::vector<Timer> band_t;
     std::vector<Timer> calc_t;
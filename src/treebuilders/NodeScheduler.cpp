@@ -0,0 +1,152 @@
+/*
+ * MRCPP, a numerical library based on multiresolution analysis and
+ * the multiwavelet basis which provide low-scaling algorithms as well as
+ * rigorous error control in numerical computations.
+ * Copyright (C) 2021 Stig Rune Jensen, Jonas Juselius, Luca Frediani and contributors.
+ *
+ * This file is part of MRCPP.
+ *
+ * MRCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MRCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with MRCPP.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * For information on the complete list of contributors to MRCPP, see:
+ * <https://mrcpp.readthedocs.io/>
+ */
+
+#include "NodeScheduler.h"
+
+#include <algorithm>
+#include <iomanip>
+
+#include "utils/Timer.h"
+
+namespace mrcpp {
+
+NodeScheduler::NodeScheduler()
+        : nThreads(mrcpp_get_max_threads())
+        , queues(nThreads)
+        , threadTime(nThreads, 0.0) {
+#ifdef MRCPP_HAS_OMP
+    for (auto &q : this->queues) omp_init_lock(&q.omp_lock);
+#endif
+}
+
+NodeScheduler::~NodeScheduler() {
+#ifdef MRCPP_HAS_OMP
+    for (auto &q : this->queues) omp_destroy_lock(&q.omp_lock);
+#endif
+}
+
+/** @brief Compute all nodes of a vector
+ *
+ * @param[in] costs: Predicted (relative) cost of each node
+ * @param[in] calc: Computes the node with the given position in the vector
+ */
+void NodeScheduler::run(const std::vector<double> &costs, const std::function<void(int)> &calc) {
+    partition(costs);
+
+    std::vector<double> vecTime(this->nThreads, 0.0);
+    int nTeam = 1;
+#pragma omp parallel shared(calc, vecTime, nTeam) num_threads(std::min(mrcpp_get_num_threads(), this->nThreads))
+    {
+        int thread = mrcpp_get_thread_num();
+#ifdef MRCPP_HAS_OMP
+#pragma omp single
+        nTeam = omp_get_num_threads();
+#endif
+        Timer t_calc;
+        for (int n = next(thread); n >= 0; n = next(thread)) calc(n);
+        vecTime[thread] = t_calc.elapsed();
+    }
+
+    double maxTime = 0.0;
+    double sumTime = 0.0;
+    for (int i = 0; i < nTeam; i++) {
+        this->threadTime[i] += vecTime[i];
+        maxTime = std::max(maxTime, vecTime[i]);
+        sumTime += vecTime[i];
+    }
+    this->totMaxTime += maxTime;
+    this->totAvgTime += sumTime / nTeam;
+    this->nNodes += costs.size();
+    this->nVectors++;
+}
+
+/** Split the vector into one contiguous block per thread with equal predicted cost */
+void NodeScheduler::partition(const std::vector<double> &costs) {
+    int nCosts = costs.size();
+    double totCost = 0.0;
+    for (auto c : costs) totCost += c;
+
+    int n = 0;
+    double accCost = 0.0;
+    for (int i = 0; i < this->nThreads; i++) {
+        auto &q = this->queues[i];
+        q.head = n;
+        double target = totCost * (i + 1) / this->nThreads;
+        while (n < nCosts and (accCost + 0.5 * costs[n] <= target or i == this->nThreads - 1)) accCost += costs[n++];
+        q.tail = n;
+    }
+}
+
+/** @returns Position of the next node to compute, -1 when all nodes are taken */
+int NodeScheduler::next(int thread) {
+    for (int i = 0; i < this->nThreads; i++) {
+        int owner = (thread + i) % this->nThreads;
+        auto &q = this->queues[owner];
+        int n = -1;
+#ifdef MRCPP_HAS_OMP
+        omp_set_lock(&q.omp_lock);
+#endif
+        if (q.head < q.tail) n = (i == 0) ? q.head++ : --q.tail;
+#ifdef MRCPP_HAS_OMP
+        omp_unset_lock(&q.omp_lock);
+#endif
+        if (n < 0) continue;
+        if (i > 0) {
+#pragma omp atomic
+            this->nStolen++;
+        }
+        return n;
+    }
+    return -1;
+}
+
+void NodeScheduler::clearStatistics() {
+    std::fill(this->threadTime.begin(), this->threadTime.end(), 0.0);
+    this->totMaxTime = 0.0;
+    this->totAvgTime = 0.0;
+    this->nVectors = 0;
+    this->nNodes = 0;
+    this->nStolen = 0;
+}
+
+/** @returns Time of the slowest thread relative to the average thread, summed over all node vectors (1.0 is perfect balance) */
+double NodeScheduler::getImbalance() const {
+    if (this->totAvgTime <= 0.0) return 1.0;
+    return this->totMaxTime / this->totAvgTime;
+}
+
+std::ostream &NodeScheduler::print(std::ostream &o) const {
+    o << "*NodeScheduler statistics: " << std::endl << std::endl;
+    o << "  Node vectors                 : " << this->nVectors << std::endl;
+    o << "  Total calculated nodes       : " << this->nNodes << std::endl;
+    o << "  Nodes stolen                 : " << this->nStolen << std::endl;
+    o << "  Load imbalance (max/avg)     : " << std::fixed << std::setprecision(3) << getImbalance() << std::endl;
+    o << "  Time per thread              :";
+    for (auto t : this->threadTime) o << " " << std::setprecision(3) << t;
+    o << std::defaultfloat << std::endl;
+    return o;
+}
+
+} // namespace mrcpp
@@ -0,0 +1,89 @@
+/*
+ * MRCPP, a numerical library based on multiresolution analysis and
+ * the multiwavelet basis which provide low-scaling algorithms as well as
+ * rigorous error control in numerical computations.
+ * Copyright (C) 2021 Stig Rune Jensen, Jonas Juselius, Luca Frediani and contributors.
+ *
+ * This file is part of MRCPP.
+ *
+ * MRCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MRCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with MRCPP.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * For information on the complete list of contributors to MRCPP, see:
+ * <https://mrcpp.readthedocs.io/>
+ */
+
+#pragma once
+
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include "utils/omp_utils.h"
+
+namespace mrcpp {
+
+/** @class NodeScheduler
+ *
+ * @brief Distributes the nodes of a node vector over threads by predicted cost
+ *
+ * @details The node vector is split into contiguous blocks of (approximately)
+ * equal predicted cost, one per thread, which keeps neighboring nodes (that
+ * share most of their input data) on the same thread. Each thread works
+ * through its own block from the front. Threads that run out of work steal
+ * single nodes from the back of the other blocks, which corrects for errors
+ * in the cost model.
+ *
+ * The time each thread spends on calculations is accumulated over all node
+ * vectors, and the achieved load balance can be printed.
+ */
+class NodeScheduler final {
+public:
+    NodeScheduler();
+    NodeScheduler(const NodeScheduler &sched) = delete;
+    NodeScheduler &operator=(const NodeScheduler &sched) = delete;
+    ~NodeScheduler();
+
+    void run(const std::vector<double> &costs, const std::function<void(int)> &calc);
+
+    void clearStatistics();
+    double getImbalance() const;
+    int getNStolen() const { return this->nStolen; }
+
+    friend std::ostream &operator<<(std::ostream &o, const NodeScheduler &sched) { return sched.print(o); }
+
+protected:
+    struct Queue {
+        int head{0}; ///< Next node of the owner
+        int tail{0}; ///< One past the last node, stolen from the back
+#ifdef MRCPP_HAS_OMP
+        omp_lock_t omp_lock;
+#endif
+    };
+
+    int nThreads;
+    std::vector<Queue> queues;
+    std::vector<double> threadTime; ///< Accumulated calculation time per thread
+    double totMaxTime{0.0};         ///< Sum over node vectors of the slowest thread
+    double totAvgTime{0.0};         ///< Sum over node vectors of the average thread
+    int nVectors{0};
+    int nNodes{0};
+    int nStolen{0};
+
+    void partition(const std::vector<double> &costs);
+    int next(int thread);
+
+    std::ostream &print(std::ostream &o) const;
+};
+
+} // namespace mrcpp
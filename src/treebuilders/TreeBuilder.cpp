@@ -80,6 +80,8 @@ template <int D, typename T> void TreeBuilder<D, T>::build(MWTree<D, T> &tree, T
     tree.resetEndNodeTable();
     delete workVec;
 
+    if (tree.hasNodeOrdering()) tree.reorderNodes();
+
     print::separator(10, ' ');
     print::time(10, "Time calc", calc_t);
     print::time(10, "Time norm", norm_t);
@@ -25,6 +25,7 @@
 
 #pragma once
 
+#include "NodeScheduler.h"
 #include "trees/MWNode.h"
 
 namespace mrcpp {
@@ -36,20 +37,33 @@ public:
 
     virtual MWNodeVector<D, T> *getInitialWorkVector(MWTree<D, T> &tree) const { return tree.copyEndNodeTable(); }
 
+    /** Use a cost-model driven scheduler for the node vectors, nullptr gives a plain guided schedule */
+    void setScheduler(NodeScheduler *sched) { this->scheduler = sched; }
+
     virtual void calcNodeVector(MWNodeVector<D, T> &nodeVec) {
+        int nNodes = nodeVec.size();
+        if (this->scheduler != nullptr) {
+            std::vector<double> costs(nNodes);
+            for (int n = 0; n < nNodes; n++) costs[n] = estimateCost(*nodeVec[n]);
+            this->scheduler->run(costs, [this, &nodeVec](int n) { calcNode(*nodeVec[n]); });
+        } else {
 #pragma omp parallel shared(nodeVec) num_threads(mrcpp_get_num_threads())
-        {
-            int nNodes = nodeVec.size();
+            {
 #pragma omp for schedule(guided)
-            for (int n = 0; n < nNodes; n++) {
-                MWNode<D, T> &node = *nodeVec[n];
-                calcNode(node);
+                for (int n = 0; n < nNodes; n++) {
+                    MWNode<D, T> &node = *nodeVec[n];
+                    calcNode(node);
+                }
             }
         }
         postProcess();
     }
 
 protected:
+    NodeScheduler *scheduler{nullptr};
+
+    /** Predicted cost of calculating a node, relative to other nodes in the same vector */
+    virtual double estimateCost(const MWNode<D, T> &node) const { return 1.0; }
     virtual void calcNode(MWNode<D, T> &node) = 0;
     virtual void postProcess() {}
 };
@@ -26,6 +26,7 @@
 #pragma once
 
 #include "TreeAdaptor.h"
+#include "trees/MWTree.h"
 #include "utils/Printer.h"
 #include "utils/tree_utils.h"
 
@@ -41,16 +42,24 @@ public:
     ~WaveletAdaptor() override = default;
 
     void setPrecFunction(const std::function<double(const NodeIndex<D> &idx)> &prec_func) { this->precFunc = prec_func; }
+    /** Split also where any of the coupled trees (sharing the grid of the built tree) needs refinement */
+    void setCoupledTrees(const std::vector<MWTree<D, T> *> &trees) { this->coupledTrees = trees; }
 
 protected:
     bool absPrec;
     double prec;
     double splitFac;
     std::function<double(const NodeIndex<D> &idx)> precFunc = [](const NodeIndex<D> &idx) { return 1.0; };
+    std::vector<MWTree<D, T> *> coupledTrees;
 
     bool splitNode(const MWNode<D, T> &node) const override {
         auto precFac = this->precFunc(node.getNodeIndex()); // returns 1.0 by default
-        return tree_utils::split_check(node, this->prec * precFac, this->splitFac, this->absPrec);
+        if (tree_utils::split_check(node, this->prec * precFac, this->splitFac, this->absPrec)) return true;
+        for (auto *tree : this->coupledTrees) {
+            const MWNode<D, T> *cNode = tree->findNode(node.getNodeIndex());
+            if (cNode != nullptr and tree_utils::split_check(*cNode, this->prec * precFac, this->splitFac, this->absPrec)) return true;
+        }
+        return false;
     }
 };
 
@@ -38,6 +38,7 @@
 #include "trees/FunctionTree.h"
 #include "utils/Printer.h"
 #include "utils/Timer.h"
+#include "utils/parallel.h"
 #include <optional>
 
 namespace mrcpp {
@@ -135,6 +136,142 @@ template <int D> void apply(double prec, CompFunction<D> &out, ConvolutionOperat
     }
 }
 
+/** @brief Application of MW integral convolution operator on a fixed grid
+ *
+ * @param[in] prec: Build precision of output function
+ * @param[out] out: Output function to be built
+ * @param[in] oper: Convolution operator to apply
+ * @param[in] inp: Input function
+ * @param[in] grid: Function defining the output grid, e.g. the output of a previous application
+ * @param[in] refine: Run a single refinement sweep after the grid is computed, default false
+ * @param[in] absPrec: Build output tree based on absolute precision, default false
+ *
+ * @details The grid of `out` is replaced by a copy of the `grid` tree, and
+ * all nodes of this grid are computed in a single parallel pass, instead of
+ * building the output scale by scale. This is useful when a good output grid
+ * is known in advance, e.g. in late iterations of an SCF procedure. With
+ * `refine` the end nodes that do not satisfy the precision are split once and
+ * the new children computed, otherwise the grid is used as is.
+ *
+ * @note If `grid` is the `out` tree itself its grid is reused and its
+ * coefficients are overwritten.
+ *
+ */
+template <int D, typename T> void apply_on_grid(double prec, FunctionTree<D, T> &out, ConvolutionOperator<D> &oper, FunctionTree<D, T> &inp, FunctionTree<D, T> &grid, bool refine, bool absPrec) {
+    if (out.getMRA() != grid.getMRA()) MSG_ABORT("Incompatible MRA");
+    if (&grid != &out) copy_grid(out, grid);
+    apply(prec, out, oper, inp, (refine) ? 1 : 0, absPrec);
+}
+
+/** @brief Application of MW integral convolution operator to several functions
+ *
+ * @param[in] prec: Build precision of output functions
+ * @param[out] out: Output functions to be built
+ * @param[in] oper: Convolution operator to apply
+ * @param[in] inp: Input functions
+ * @param[in] maxIter: Maximum number of refinement iterations in output trees, default -1
+ * @param[in] absPrec: Build output trees based on absolute precision, default false
+ *
+ * @details Applies the operator to all input functions in a single pass,
+ * sharing the band traversal and operator screening among the functions and
+ * contracting all of them together with each operator node. The output trees
+ * are built on a common grid, which is refined wherever any of the outputs
+ * needs refinement. The output is scaled with the coefficients of the input
+ * vector, the output coefficients are ignored.
+ *
+ * @note This algorithm will start at the union of the grids present in the
+ * `out` trees when the function is called (these grids should however be
+ * EMPTY, e.i. no coefs).
+ *
+ */
+template <int D, typename T> void apply(double prec, FunctionTreeVector<D, T> &out, ConvolutionOperator<D> &oper, FunctionTreeVector<D, T> &inp, int maxIter, bool absPrec) {
+    if (out.size() != inp.size()) MSG_ABORT("Size mismatch");
+    if (inp.size() == 0) return;
+
+    std::vector<FunctionTree<D, T> *> outTrees;
+    std::vector<FunctionTree<D, T> *> inpTrees;
+    for (int i = 0; i < inp.size(); i++) {
+        outTrees.push_back(&get_func(out, i));
+        inpTrees.push_back(&get_func(inp, i));
+        if (outTrees[i]->getMRA() != inpTrees[i]->getMRA()) MSG_ABORT("Incompatible MRA");
+    }
+    FunctionTree<D, T> &lead = *outTrees[0];
+
+    Timer pre_t;
+    if (outTrees.size() > 1) {
+        std::vector<FunctionTree<D, T> *> coupled(outTrees.begin() + 1, outTrees.end());
+        build_grid(lead, coupled);
+    }
+    oper.calcBandWidths(prec);
+    int maxScale = lead.getMRA().getMaxScale();
+    WaveletAdaptor<D, T> adaptor(prec, maxScale, absPrec);
+    adaptor.setCoupledTrees(std::vector<MWTree<D, T> *>(outTrees.begin() + 1, outTrees.end()));
+    ConvolutionCalculator<D, T> calculator(prec, oper, inpTrees, outTrees);
+    pre_t.stop();
+    TreeBuilder<D, T> builder;
+    builder.build(lead, calculator, adaptor, maxIter);
+
+    Timer post_t;
+    oper.clearBandWidths();
+    for (int i = 0; i < outTrees.size(); i++) {
+        FunctionTree<D, T> &tree = *outTrees[i];
+        if (i > 0) tree.resetEndNodeTable();
+        tree.mwTransform(TopDown, false); // add coarse scale contributions
+        tree.mwTransform(BottomUp);
+        tree.calcSquareNorm();
+        tree.deleteGeneratedParents();
+        T coef = get_coef(inp, i);
+        if (std::abs(coef - T(1.0)) > MachinePrec) tree.rescale(coef);
+    }
+    for (auto *tree : inpTrees) {
+        tree->deleteGenerated();
+        tree->deleteGeneratedParents();
+    }
+    post_t.stop();
+
+    print::time(10, "Time pre operator", pre_t);
+    print::time(10, "Time post operator", post_t);
+    print::separator(10, ' ');
+}
+
+/** @brief Application of MW integral convolution operator to a vector of functions
+ *
+ * @param[in] prec: Build precision of output functions
+ * @param[out] out: Output functions to be built, same size as inp
+ * @param[in] oper: Convolution operator to apply
+ * @param[in] inp: Input functions
+ * @param[in] maxIter: Maximum number of refinement iterations in output trees, default -1
+ * @param[in] absPrec: Build output trees based on absolute precision, default false
+ *
+ * @details Each component of the locally owned functions is applied in one
+ * pass per component and type (real or complex), see the FunctionTreeVector
+ * version above. Output functions that are not yet defined get the
+ * parameters of the corresponding input function.
+ */
+void apply(double prec, CompFunctionVector &out, ConvolutionOperator<3> &oper, CompFunctionVector &inp, int maxIter, bool absPrec) {
+    if (out.size() != inp.size()) MSG_ABORT("Size mismatch");
+    for (int icomp = 0; icomp < 4; icomp++) {
+        FunctionTreeVector<3, double> inpD, outD;
+        FunctionTreeVector<3, ComplexDouble> inpC, outC;
+        for (int i = 0; i < inp.size(); i++) {
+            if (not mpi::my_func(inp[i])) continue;
+            if (icomp >= inp[i].Ncomp()) continue;
+            if (out[i].isreal() == 0 and out[i].iscomplex() == 0) out[i] = inp[i].paramCopy();
+            if (inp[i].isreal()) {
+                if (out[i].CompD[icomp] == nullptr) out[i].alloc_comp(icomp);
+                inpD.push_back(std::make_tuple(1.0, inp[i].CompD[icomp]));
+                outD.push_back(std::make_tuple(1.0, out[i].CompD[icomp]));
+            } else {
+                if (out[i].CompC[icomp] == nullptr) out[i].alloc_comp(icomp);
+                inpC.push_back(std::make_tuple(1.0, inp[i].CompC[icomp]));
+                outC.push_back(std::make_tuple(1.0, out[i].CompC[icomp]));
+            }
+        }
+        apply(prec, outD, oper, inpD, maxIter, absPrec);
+        apply(prec, outC, oper, inpC, maxIter, absPrec);
+    }
+}
+
 /** @brief Application of MW integral convolution operator
  *
  * @param[in] inside: Use points inside (true) or outside (false) the unitcell
@@ -550,6 +687,12 @@ template void
 apply<2, double>(double prec, FunctionTree<2, double> &out, ConvolutionOperator<2> &oper, FunctionTree<2, double> &inp, FunctionTreeVector<2, double> &precTrees, int maxIter, bool absPrec);
 template void
 apply<3, double>(double prec, FunctionTree<3, double> &out, ConvolutionOperator<3> &oper, FunctionTree<3, double> &inp, FunctionTreeVector<3, double> &precTrees, int maxIter, bool absPrec);
+template void apply<1, double>(double prec, FunctionTreeVector<1, double> &out, ConvolutionOperator<1> &oper, FunctionTreeVector<1, double> &inp, int maxIter, bool absPrec);
+template void apply<2, double>(double prec, FunctionTreeVector<2, double> &out, ConvolutionOperator<2> &oper, FunctionTreeVector<2, double> &inp, int maxIter, bool absPrec);
+template void apply<3, double>(double prec, FunctionTreeVector<3, double> &out, ConvolutionOperator<3> &oper, FunctionTreeVector<3, double> &inp, int maxIter, bool absPrec);
+template void apply_on_grid<1, double>(double prec, FunctionTree<1, double> &out, ConvolutionOperator<1> &oper, FunctionTree<1, double> &inp, FunctionTree<1, double> &grid, bool refine, bool absPrec);
+template void apply_on_grid<2, double>(double prec, FunctionTree<2, double> &out, ConvolutionOperator<2> &oper, FunctionTree<2, double> &inp, FunctionTree<2, double> &grid, bool refine, bool absPrec);
+template void apply_on_grid<3, double>(double prec, FunctionTree<3, double> &out, ConvolutionOperator<3> &oper, FunctionTree<3, double> &inp, FunctionTree<3, double> &grid, bool refine, bool absPrec);
 template void apply_far_field<1, double>(double prec, FunctionTree<1, double> &out, ConvolutionOperator<1> &oper, FunctionTree<1, double> &inp, int maxIter, bool absPrec);
 template void apply_far_field<2, double>(double prec, FunctionTree<2, double> &out, ConvolutionOperator<2> &oper, FunctionTree<2, double> &inp, int maxIter, bool absPrec);
 template void apply_far_field<3, double>(double prec, FunctionTree<3, double> &out, ConvolutionOperator<3> &oper, FunctionTree<3, double> &inp, int maxIter, bool absPrec);
@@ -594,6 +737,12 @@ template void apply<3, ComplexDouble>(double prec,
                                       FunctionTreeVector<3, ComplexDouble> &precTrees,
                                       int maxIter,
                                       bool absPrec);
+template void apply<1, ComplexDouble>(double prec, FunctionTreeVector<1, ComplexDouble> &out, ConvolutionOperator<1> &oper, FunctionTreeVector<1, ComplexDouble> &inp, int maxIter, bool absPrec);
+template void apply<2, ComplexDouble>(double prec, FunctionTreeVector<2, ComplexDouble> &out, ConvolutionOperator<2> &oper, FunctionTreeVector<2, ComplexDouble> &inp, int maxIter, bool absPrec);
+template void apply<3, ComplexDouble>(double prec, FunctionTreeVector<3, ComplexDouble> &out, ConvolutionOperator<3> &oper, FunctionTreeVector<3, ComplexDouble> &inp, int maxIter, bool absPrec);
+template void apply_on_grid<1, ComplexDouble>(double prec, FunctionTree<1, ComplexDouble> &out, ConvolutionOperator<1> &oper, FunctionTree<1, ComplexDouble> &inp, FunctionTree<1, ComplexDouble> &grid, bool refine, bool absPrec);
+template void apply_on_grid<2, ComplexDouble>(double prec, FunctionTree<2, ComplexDouble> &out, ConvolutionOperator<2> &oper, FunctionTree<2, ComplexDouble> &inp, FunctionTree<2, ComplexDouble> &grid, bool refine, bool absPrec);
+template void apply_on_grid<3, ComplexDouble>(double prec, FunctionTree<3, ComplexDouble> &out, ConvolutionOperator<3> &oper, FunctionTree<3, ComplexDouble> &inp, FunctionTree<3, ComplexDouble> &grid, bool refine, bool absPrec);
 template void apply_far_field<1, ComplexDouble>(double prec, FunctionTree<1, ComplexDouble> &out, ConvolutionOperator<1> &oper, FunctionTree<1, ComplexDouble> &inp, int maxIter, bool absPrec);
 template void apply_far_field<2, ComplexDouble>(double prec, FunctionTree<2, ComplexDouble> &out, ConvolutionOperator<2> &oper, FunctionTree<2, ComplexDouble> &inp, int maxIter, bool absPrec);
 template void apply_far_field<3, ComplexDouble>(double prec, FunctionTree<3, ComplexDouble> &out, ConvolutionOperator<3> &oper, FunctionTree<3, ComplexDouble> &inp, int maxIter, bool absPrec);
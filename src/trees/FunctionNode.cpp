@@ -282,6 +282,7 @@ template <int D, typename T> void FunctionNode<D, T>::createChildren(bool coefs)
         child_p->clearHasCoefs();
 
         this->getMWTree().incrementNodeCount(child_p->getScale());
+        this->getMWTree().registerNode(child_p);
         sIdx++;
         child_p++;
         if (coefs) coefs_p += n_coefs;
@@ -357,6 +358,7 @@ template <int D, typename T> void FunctionNode<D, T>::genParent() {
     parent_p->clearHasCoefs();
 
     this->getMWTree().incrementNodeCount(parent_p->getScale());
+    this->getMWTree().registerNode(parent_p);
 }
 
 template <int D, typename T> void FunctionNode<D, T>::deleteChildren() {
@@ -377,6 +379,7 @@ template <int D, typename T> void FunctionNode<D, T>::dealloc() {
         ftree.getGenNodeAllocator().deleteUnusedChunks();
     } else {
         ftree.decrementNodeCount(this->getScale());
+        ftree.unregisterNode(this);
         ftree.getNodeAllocator().dealloc(sIdx);
     }
 }
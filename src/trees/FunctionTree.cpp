@@ -25,15 +25,26 @@
 
 #include "FunctionTree.h"
 
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
 #include <fstream>
+#include <future>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
 
 #include "FunctionNode.h"
 #include "NodeAllocator.h"
+#include "TreeFile.h"
 
 #include "treebuilders/grid.h"
 #include "utils/Bank.h"
 #include "utils/Printer.h"
 #include "utils/Timer.h"
+#include "utils/math_utils.h"
 #include "utils/mpi_utils.h"
 #include "utils/periodic_utils.h"
 #include "utils/tree_utils.h"
@@ -96,6 +107,7 @@ template <int D, typename T> void FunctionTree<D, T>::allocRootNodes() {
         root_p->clearHasCoefs();
 
         this->incrementNodeCount(root_p->getScale());
+        this->registerNode(root_p);
         sIdx++;
         root_p++;
         coef_p += n_coefs;
@@ -107,6 +119,20 @@ template <int D, typename T> FunctionTree<D, T>::~FunctionTree() {
     if (this->getNNodes() > 0) this->deleteRootNodes();
 }
 
+/** @brief Check that a world box read from an interop file is the world of this tree
+ *
+ * @details The world is assumed to be a cube from -L to L, with L a power of 2
+ */
+template <int D, typename T> static void check_interop_world(const FunctionTree<D, T> &tree, const double (*coord)[2]) {
+    int L = std::pow(2, -tree.getRootScale());
+    double TXT_thres = 1.0e-14; // threshold for differences in scaling factors
+    for (int d = 0; d < D; d++) {
+        if (std::abs(coord[d][0] + L) > TXT_thres or std::abs(coord[d][1] - L) > TXT_thres) {
+            MSG_ABORT("Interop world [" << coord[d][0] << ", " << coord[d][1] << "] in direction " << d << " is not [" << -L << ", " << L << "]");
+        }
+    }
+}
+
 /** @brief Read a previously stored tree assuming text/ASCII format,
  *   in a representation using MADNESS conventions for n, l and index order.
  * @param[in] file: File name
@@ -119,48 +145,100 @@ template <int D, typename T> void FunctionTree<D, T>::loadTreeTXT(const std::str
     if (NDIM != D) NOT_IMPLEMENTED_ABORT;
     double coord[D][2];
     for (int d = 0; d < D; d++) in >> coord[d][0] >> coord[d][1];
+    check_interop_world(*this, coord);
 
-    int p = 1;
-    int rscale = this->getRootScale(); // root scale of target MRA (MRChem) . NB: negative
-    for (int i = rscale; i < 0; i++) p *= 2;
-    int L = p; // NB for now we assume the world as a cube going from -L to +L and L is a power of 2
-    // We require that the world box size is identical and a power of 2
-    double TXT_thres = 1.0e-14; // threshold for differences in scaling factors
-    for (int d = 0; d < D; d++) {
-        if (std::abs(coord[d][0] + L) > TXT_thres) std::cout << coord[d][0] << " " << L << std::endl;
-        if (std::abs(coord[d][0] + L) > TXT_thres) NOT_IMPLEMENTED_ABORT;
-        if (std::abs(coord[d][1] - L) > TXT_thres) std::cout << coord[d][1] << " " << L << std::endl;
-        if (std::abs(coord[d][1] - L) > TXT_thres) NOT_IMPLEMENTED_ABORT;
+    in >> k;
+    if (k != this->getKp1()) NOT_IMPLEMENTED_ABORT;
+    int ncoefs = math_utils::ipow(k, D); // number of coefficents for one single node
+
+    int nread; // number of nodes to read
+    in >> nread;
+    std::vector<int> scales(nread);
+    std::vector<std::array<int, D>> translations(nread);
+    std::vector<T> values(static_cast<size_t>(nread) * ncoefs);
+    for (int n = 0; n < nread; n++) {
+        in >> scales[n];
+        for (int i = 0; i < D; i++) in >> translations[n][i];
+        for (int i = 0; i < ncoefs; i++) in >> values[static_cast<size_t>(n) * ncoefs + i];
+    }
+    in.close();
+    setInteropValues(scales, translations, values);
+}
+
+/** @brief Read a tree written by saveTreeBIN
+ * @param[in] file: File name
+ * @note This tree must have the exact same MRA the one that was saved
+ */
+template <int D, typename T> void FunctionTree<D, T>::loadTreeBIN(const std::string &file) {
+    Timer t1;
+    std::ifstream in(file, std::ios::binary);
+    if (not in.is_open()) MSG_ABORT("Unable to open file: " << file);
+
+    tree_file::InteropHeader header;
+    in.read((char *)&header, sizeof(tree_file::InteropHeader));
+    if (not in or not tree_file::is_interop_file(header)) MSG_ABORT("Not an interop file: " << file);
+    bool swap = tree_file::swap_interop_header(header);
+
+    int coefType = (std::is_same<T, double>::value) ? tree_file::Real64 : tree_file::Complex64;
+    if (header.dim != D) NOT_IMPLEMENTED_ABORT;
+    if (header.coefType != coefType) MSG_ABORT("Scalar type mismatch in interop file");
+    if (header.kp1 != this->getKp1()) NOT_IMPLEMENTED_ABORT;
+    double coord[D][2];
+    for (int d = 0; d < D; d++) coord[d][0] = header.lower[d];
+    for (int d = 0; d < D; d++) coord[d][1] = header.upper[d];
+    check_interop_world(*this, coord);
+
+    int64_t nNodes = header.nNodes;
+    std::vector<tree_file::InteropEntry> entries(nNodes);
+    std::vector<T> values(nNodes * header.nValues);
+    in.seekg(header.indexOffset, std::ios::beg);
+    in.read((char *)entries.data(), nNodes * sizeof(tree_file::InteropEntry));
+    in.seekg(header.valueOffset, std::ios::beg);
+    in.read((char *)values.data(), values.size() * sizeof(T));
+    if (not in) MSG_ABORT("Truncated interop file: " << file);
+    in.close();
+    if (swap) {
+        tree_file::swap_bytes((char *)entries.data(), 4 * nNodes, sizeof(int32_t));
+        tree_file::swap_bytes((char *)values.data(), values.size() * sizeof(T) / sizeof(double), sizeof(double));
     }
 
+    std::vector<int> scales(nNodes);
+    std::vector<std::array<int, D>> translations(nNodes);
+    for (int64_t n = 0; n < nNodes; n++) {
+        scales[n] = entries[n].scale;
+        for (int d = 0; d < D; d++) translations[n][d] = entries[n].l[d];
+    }
+    setInteropValues(scales, translations, values);
+    print::time(10, "Time read interop", t1);
+}
+
+/** @brief Build the tree from function values in MADNESS conventions
+ * @param[in] scales: MADNESS scale of each node
+ * @param[in] translations: MADNESS translation of each node
+ * @param[in] values: Values at the quadrature points of each node, MADNESS order
+ *
+ * @details Common part of loadTreeTXT and loadTreeBIN. The tree is cleared and
+ * rebuilt, with end nodes at the parents of the given nodes.
+ */
+template <int D, typename T>
+void FunctionTree<D, T>::setInteropValues(const std::vector<int> &scales, const std::vector<std::array<int, D>> &translations, const std::vector<T> &values) {
     int nChildren = 1;
     for (int d = 0; d < D; d++) nChildren *= 2;
 
-    int nmax = 0; // deppeset scale in TXT
-    in >> k;
-    if (k != this->getKp1()) NOT_IMPLEMENTED_ABORT;
-    k--; // MRChem defines k as highest polynomial order. MADNESS as number of polynomials
+    int p = 1;
+    int rscale = this->getRootScale(); // root scale of target MRA (MRChem) . NB: negative
+    for (int i = rscale; i < 0; i++) p *= 2;
+    int L = p; // NB for now we assume the world as a cube going from -L to +L and L is a power of 2
 
-    int ncoefs = 1; // number of coefficents for one single node (not a full MRChem MWnode which stores 2**D of them)
-    for (int i = 0; i < D; i++) ncoefs *= k + 1;
+    int nmax = 0; // deppeset scale in TXT
+    int kp1 = this->getKp1();
+    int ncoefs = this->getKp1_d(); // number of coefficents for one single node (not a full MRChem MWnode which stores 2**D of them)
 
     std::vector<std::vector<MWNode<D, T> *>> NodeTable(50); // to store all the nodes pointers
     std::map<int, int> mp;                                  // to store the number of children stored in each parent node
     // MRChem and MADNESS do not use the same indices order for the qudrature points
     // We read MADNESS convention (note that mapMRC[mapMRC[i]]=i for all i)
-    std::vector<int> mapMRC; // mapping vector
-    int kx = k;
-    int ky = k;
-    int kz = k;
-    if (D < 3) kz = 0;
-    if (D < 2) ky = 0;
-    int kp1 = k + 1;
-    // MADNESS: zyx and i=k,k-1,k-2... MRChem: xyz, i=0,1,2,3 ...
-    for (int x = kx; x >= 0; x--) {
-        for (int y = ky; y >= 0; y--) {
-            for (int z = kz; z >= 0; z--) { mapMRC.push_back(z * kp1 * kp1 + y * kp1 + x); }
-        }
-    }
+    std::vector<int> mapMRC = tree_file::madness_order(D, kp1);
 
     MWNode<D, T> **roots = this->getRootBox().getNodes();
     for (int rIdx = 0; rIdx < nChildren; rIdx++) {
@@ -169,20 +247,15 @@ template <int D, typename T> void FunctionTree<D, T>::loadTreeTXT(const std::str
     }
     this->clearEndNodeTable();
 
-    int nread; // number of nodes to read
-    in >> nread;
-    while (nread-- > 0) {
+    for (size_t m = 0; m < scales.size(); m++) {
         // NB: MRChem stores quadrature points values in the PARENT node. 2**D nodes are stored in the same parent
-        int n;    // TXT scale
-        int n_in; // MRChem scale
-        in >> n_in;
-        n = n_in + rscale - 1; // MRChem does not define root scale as zero.
-
-        std::array<int, D> l_in; // translation index TXT
-        std::array<int, D> l;    // translation index MRChem
-        std::array<int, D> lp;   // translation index MRChem, parent
+        int n;                    // TXT scale
+        int n_in = scales[m];     // MRChem scale
+        n = n_in + rscale - 1;    // MRChem does not define root scale as zero.
 
-        for (int i = 0; i < D; i++) in >> l_in[i];
+        const std::array<int, D> &l_in = translations[m]; // translation index TXT
+        std::array<int, D> l;                             // translation index MRChem
+        std::array<int, D> lp;                            // translation index MRChem, parent
 
         // MRChem defines smallest l as -(2**n)*L , where -L is smallest world coordinate.
         // note that root scale has 2**D nodes (if range is -L,L)
@@ -200,7 +273,7 @@ template <int D, typename T> void FunctionTree<D, T>::loadTreeTXT(const std::str
             if (abs(l[i]) % 2 == 1) c_ix += p;
             p *= 2;
         }
-        T *values = node->getCoefs();
+        T *coefs = node->getCoefs();
         if (mp[node->getSerialIx()] == 0) {
             // init to zero
             node->zeroCoefs();
@@ -212,13 +285,13 @@ template <int D, typename T> void FunctionTree<D, T>::loadTreeTXT(const std::str
                 }
             }
         }
-        values += c_ix * ncoefs;                                  // repoint to the right child position (ncoefs is for one child only)
-        for (int i = 0; i < ncoefs; i++) in >> values[mapMRC[i]]; // the indice i is mapped
-        mp[node->getSerialIx()]++;                                // counts the number of children included
-        nmax = std::max(nmax, n_in);                              // deepest scale in TXT
+        coefs += c_ix * ncoefs; // repoint to the right child position (ncoefs is for one child only)
+        const T *in = values.data() + m * ncoefs;
+        for (int i = 0; i < ncoefs; i++) coefs[mapMRC[i]] = in[i]; // the indice i is mapped
+        mp[node->getSerialIx()]++;                                 // counts the number of children included
+        nmax = std::max(nmax, n_in);                               // deepest scale in TXT
         if (mp[node->getSerialIx()] == 1) NodeTable[n_in].push_back(node);
     }
-    in.close();
     // transform all nodes from quadrature point values to scaling coefficients
     for (int n = nmax; n > -1; n--) {
         for (int i = 0; i < NodeTable[n].size(); i++) {
@@ -285,14 +358,34 @@ template <int D, typename T> void FunctionTree<D, T>::loadTreeTXT(const std::str
     this->calcSquareNorm();
 }
 
+/** @brief Function values at the quadrature points of the children of an end node
+ * @param[in] node: End node, is left unchanged
+ * @param[in] mapMRC: Quadrature point order, from tree_file::madness_order
+ * @param[out] out: 2^D (k+1)^D values in MADNESS order
+ */
+template <int D, typename T> static void get_interop_values(MWNode<D, T> &node, const std::vector<int> &mapMRC, T *out) {
+    // the transforms are done in place, the coefficients are restored afterwards
+    int nCoefs = node.getNCoefs();
+    int kp1_d = node.getKp1_d();
+    std::vector<T> saved(node.getCoefs(), node.getCoefs() + nCoefs);
+    node.mwTransform(Reconstruction);
+    node.cvTransform(Forward);
+    const T *values = node.getCoefs();
+    for (int cix = 0; cix < node.getTDim(); cix++) {
+        for (int i = 0; i < kp1_d; i++) out[cix * kp1_d + i] = values[cix * kp1_d + mapMRC[i]];
+    }
+    std::copy(saved.begin(), saved.end(), node.getCoefs());
+}
+
 /** @brief Write the tree to disk in text/ASCII format in a representation
  *   using MADNESS conventions for n, l and index order.
  * @param[in] file: File name
+ *
+ * @details The text format is meant for inspection and small trees, see
+ * saveTreeBIN for a binary file with the same content.
  */
 template <int D, typename T> void FunctionTree<D, T>::saveTreeTXT(const std::string &fname) {
-    int nRoots = this->getRootBox().size();
-    MWNode<D, T> **roots = this->getRootBox().getNodes();
-
+    if (this->isPacked()) MSG_ABORT("Cannot export a tree with packed coefficients");
     std::ofstream out(fname);
     out << std::setprecision(14);
     out << D << std::endl;
@@ -312,29 +405,17 @@ template <int D, typename T> void FunctionTree<D, T>::saveTreeTXT(const std::str
 
     // MRChem and MADNESS do not use the same indices order for the qudrature points
     // We write into MADNESS convention (note that mapMRC[mapMRC[i]]=i for all i)
-    std::vector<int> mapMRC; // mapping vector
-    int kx = kp1 - 1;
-    int ky = kp1 - 1;
-    int kz = kp1 - 1;
-    if (D < 3) kz = 0;
-    if (D < 2) ky = 0;
-    // MADNESS: zyx and i=k,k-1,k-2... MRChem: xyz, i=0,1,2,3 ...
-    for (int x = kx; x >= 0; x--) {
-        for (int y = ky; y >= 0; y--) {
-            for (int z = kz; z >= 0; z--) { mapMRC.push_back(z * kp1 * kp1 + y * kp1 + x); }
-        }
-    }
+    std::vector<int> mapMRC = tree_file::madness_order(D, kp1);
+    std::vector<T> values(Tdim * ncoefs);
 
     int L = std::pow(2, -rscale);
     int count = -1;
     while (++count < nout) {
         std::array<int, D> l;
-        NodeIndex<D> idx = this->endNodeTable[count]->getNodeIndex();
-        MWNode<D, T> *node = &(this->getNode(idx, false));
-        T *values = node->getCoefs();
+        MWNode<D, T> *node = this->endNodeTable[count];
+        NodeIndex<D> idx = node->getNodeIndex();
         int n = idx.getScale();
-        node->mwTransform(Reconstruction);
-        node->cvTransform(Forward);
+        get_interop_values(*node, mapMRC, values.data());
         // we write for each children nodes separately
         for (int i = 0; i < D; i++) {
             // l in interval [0, max], while in MRCPP it is defined in [-max/2, max/2-1]
@@ -347,76 +428,523 @@ template <int D, typename T> void FunctionTree<D, T>::saveTreeTXT(const std::str
                 out << l[i] + p << " ";
             }
             out << std::endl;
-            for (int i = 0; i < ncoefs; i++) out << values[cix * ncoefs + mapMRC[i]] << " ";
+            for (int i = 0; i < ncoefs; i++) out << values[cix * ncoefs + i] << " ";
             out << std::endl;
         }
     }
     out.close();
 }
+
+/** @brief Write the tree to disk in the binary interop format of TreeFile.h
+ * @param[in] file: File name
+ *
+ * @details Same content as saveTreeTXT, unformatted. The values are computed
+ * in parallel for batches of end nodes, and each batch is written while the
+ * next one is computed, so the writer is limited by the disk rather than the
+ * transforms. Packed trees must be unpacked before they are exported.
+ */
+template <int D, typename T> void FunctionTree<D, T>::saveTreeBIN(const std::string &file) {
+    Timer t1;
+    if (this->isPacked()) MSG_ABORT("Cannot export a tree with packed coefficients");
+    std::ofstream out(file, std::ios::binary);
+    if (not out.is_open()) MSG_ABORT("Unable to open file: " << file);
+
+    int Tdim = this->getTDim();
+    int kp1_d = this->getKp1_d();
+    int64_t nEnd = this->endNodeTable.size();
+    int coefType = (std::is_same<T, double>::value) ? tree_file::Real64 : tree_file::Complex64;
+    auto header = tree_file::make_interop_header(this->getMRA(), coefType, Tdim * nEnd);
+    out.write((const char *)&header, sizeof(tree_file::InteropHeader));
+
+    // scales start at zero at the world box, translations at its lower corner
+    int rscale = this->getRootScale();
+    std::vector<tree_file::InteropEntry> entries(header.nNodes);
+    for (int64_t m = 0; m < nEnd; m++) {
+        const NodeIndex<D> &idx = this->endNodeTable[m]->getNodeIndex();
+        int n = idx.getScale();
+        for (int cix = 0; cix < Tdim; cix++) {
+            tree_file::InteropEntry &entry = entries[m * Tdim + cix];
+            std::memset(&entry, 0, sizeof(tree_file::InteropEntry));
+            entry.scale = n - rscale + 2; // NB: children are one scale larger than node
+            for (int d = 0; d < D; d++) entry.l[d] = 2 * (idx.getTranslation(d) + (int64_t(1) << (n - rscale))) + ((cix >> d) & 1);
+        }
+    }
+    out.write((const char *)entries.data(), entries.size() * sizeof(tree_file::InteropEntry));
+    std::vector<char> padding(header.valueOffset - header.indexOffset - entries.size() * sizeof(tree_file::InteropEntry), 0);
+    out.write(padding.data(), padding.size());
+
+    std::vector<int> mapMRC = tree_file::madness_order(D, this->getKp1());
+    const int64_t batchSize = 1024; // end nodes per batch
+    int64_t batchValues = batchSize * Tdim * kp1_d;
+    std::vector<T> buffers[2] = {std::vector<T>(batchValues), std::vector<T>(batchValues)};
+    std::future<void> writing;
+    for (int64_t first = 0, b = 0; first < nEnd; first += batchSize, b = 1 - b) {
+        int64_t nBatch = std::min(batchSize, nEnd - first);
+        T *values = buffers[b].data();
+#pragma omp parallel for schedule(static) num_threads(mrcpp_get_num_threads())
+        for (int64_t m = 0; m < nBatch; m++) get_interop_values(*this->endNodeTable[first + m], mapMRC, values + m * Tdim * kp1_d);
+        if (writing.valid()) writing.get();
+        writing = std::async(std::launch::async, [&out, values, nBatch, Tdim, kp1_d]() { out.write((const char *)values, nBatch * Tdim * kp1_d * sizeof(T)); });
+    }
+    if (writing.valid()) writing.get();
+    if (not out) MSG_ERROR("Failed to write interop file: " << file);
+    out.close();
+    print::time(10, "Time write interop", t1);
+}
+
+/** @brief Create the nodes of a tree file node table, breadth first from the root nodes
+ * @returns The nodes of the tree, in node table order
+ */
+template <int D, typename T>
+static std::vector<MWNode<D, T> *> create_nodes(FunctionTree<D, T> &tree, const tree_file::NodeEntry *entries, int64_t nNodes, bool coefs) {
+    std::vector<MWNode<D, T> *> nodes(nNodes);
+    int64_t nCreated = tree.getRootBox().size();
+    if (nCreated > nNodes) MSG_ABORT("Invalid node table in tree file");
+    for (int i = 0; i < nCreated; i++) nodes[i] = &tree.getRootMWNode(i);
+    for (int64_t n = 0; n < nNodes; n++) {
+        std::array<int, D> l;
+        for (int d = 0; d < D; d++) l[d] = entries[n].l[d];
+        if (nodes[n] == nullptr or nodes[n]->getNodeIndex() != NodeIndex<D>(entries[n].scale, l)) MSG_ABORT("Invalid node table in tree file");
+        if (entries[n].flags & tree_file::HasChildren) {
+            if (nCreated + nodes[n]->getTDim() > nNodes) MSG_ABORT("Invalid node table in tree file");
+            nodes[n]->createChildren(coefs);
+            for (int i = 0; i < nodes[n]->getTDim(); i++) nodes[nCreated++] = &nodes[n]->getMWChild(i);
+        }
+    }
+    if (nCreated != nNodes) MSG_ABORT("Invalid node table in tree file");
+    return nodes;
+}
+
 /** @brief Write the tree structure to disk, for later use
  * @param[in] file: File name, will get ".tree" extension
+ *
+ * @details The tree is written in the portable format described in
+ * TreeFile.h: a header with the MRA and the scalar type, a table of node
+ * indices, and the coefficients as one contiguous array, with a checksum for
+ * each block of nodes. Packed trees are written in single precision.
  */
 template <int D, typename T> void FunctionTree<D, T>::saveTree(const std::string &file) {
     Timer t1;
-    this->deleteGenerated();
-    auto &allocator = this->getNodeAllocator();
-
     std::stringstream fname;
     fname << file << ".tree";
     std::fstream f;
     f.open(fname.str(), std::ios::out | std::ios::binary);
     if (not f.is_open()) MSG_ERROR("Unable to open file");
-
-    // Write size of tree
-    int nChunks = allocator.getNChunksUsed();
-    f.write((char *)&nChunks, sizeof(int));
-
-    // Write tree data, chunk by chunk
-    for (int iChunk = 0; iChunk < nChunks; iChunk++) {
-        f.write((char *)allocator.getNodeChunk(iChunk), allocator.getNodeChunkSize());
-        f.write((char *)allocator.getCoefChunk(iChunk), allocator.getCoefChunkSize());
-    }
+    saveTree(f);
     f.close();
-    this->saveTreeTXT("MRC.dat");
     print::time(10, "Time write", t1);
 }
 
+/** @brief Write the tree to a binary stream, in the format of saveTree
+ * @param[in] f: Output stream, the tree is written from its current position
+ *
+ * @details All offsets in the file are relative to the start of the tree,
+ * so several trees can be written one after another to the same stream, or
+ * into memory buffers that are written to disk later. The tree is not
+ * changed: generated nodes are left out of the file, but kept in the tree.
+ */
+template <int D, typename T> void FunctionTree<D, T>::saveTree(std::ostream &f) {
+    auto &allocator = this->getNodeAllocator();
+    bool packed = allocator.isPacked();
+    auto hasChildren = [](MWNode<D, T> *node) { return node->getNChildren() > 0 and not node->getMWChild(0).isGenNode(); };
+
+    // Nodes breadth first, siblings are consecutive
+    std::vector<MWNode<D, T> *> nodes;
+    for (int i = 0; i < this->rootBox.size(); i++) nodes.push_back(&this->getRootMWNode(i));
+    for (int n = 0; n < nodes.size(); n++) {
+        if (not hasChildren(nodes[n])) continue;
+        for (int i = 0; i < nodes[n]->getNChildren(); i++) nodes.push_back(&nodes[n]->getMWChild(i));
+    }
+    int64_t nNodes = nodes.size();
+
+    // Node table and scale index
+    std::vector<tree_file::NodeEntry> entries(nNodes);
+    for (int64_t n = 0; n < nNodes; n++) {
+        const NodeIndex<D> &idx = nodes[n]->getNodeIndex();
+        auto &entry = entries[n];
+        entry = {idx.getScale(), 0, {0, 0, 0}};
+        for (int d = 0; d < D; d++) entry.l[d] = idx[d];
+        if (nodes[n]->hasCoefs()) entry.flags |= tree_file::HasCoefs;
+        if (nodes[n]->isEndNode()) entry.flags |= tree_file::EndNode;
+        if (hasChildren(nodes[n])) entry.flags |= tree_file::HasChildren;
+    }
+    std::vector<tree_file::ScaleEntry> scales = tree_file::make_scale_index(entries.data(), nNodes);
+
+    bool isComplex = std::is_same<T, ComplexDouble>::value;
+    int coefType = (isComplex) ? tree_file::Complex64 : tree_file::Real64;
+    int coefSize = sizeof(T);
+    if (packed) {
+        coefType = (isComplex) ? tree_file::Complex32 : tree_file::Real32;
+        coefSize = sizeof(typename NodeAllocator<D, T>::P);
+    }
+    tree_file::Header header = tree_file::make_header(this->getMRA(), coefType, coefSize, nNodes, scales.size());
+    if (this->conjugate()) header.flags |= tree_file::Conjugate;
+    f.write((char *)&header, sizeof(header));
+    f.write((char *)entries.data(), nNodes * sizeof(tree_file::NodeEntry));
+    f.write((char *)scales.data(), scales.size() * sizeof(tree_file::ScaleEntry));
+
+    // Write node norms
+    int tDim = (1 << D);
+    std::vector<double> norms(nNodes * tDim, -1.0);
+    for (int64_t n = 0; n < nNodes; n++) {
+        if (not nodes[n]->hasCoefs()) continue;
+        for (int i = 0; i < tDim; i++) norms[n * tDim + i] = nodes[n]->getComponentNorm(i);
+    }
+    f.write((char *)norms.data(), norms.size() * sizeof(double));
+    std::vector<char> padding(header.coefOffset - header.normOffset - norms.size() * sizeof(double), 0);
+    f.write(padding.data(), padding.size());
+
+    // Write coefficients, block by block
+    int64_t nodeBytes = 1ll * header.nCoefs * coefSize;
+    int nBlocks = (nNodes + header.blockSize - 1) / header.blockSize;
+    std::vector<uint64_t> checksums(nBlocks);
+    std::vector<char> buffer(header.blockSize * nodeBytes);
+    for (int b = 0; b < nBlocks; b++) {
+        int64_t first = 1ll * b * header.blockSize;
+        int64_t nBlock = std::min<int64_t>(header.blockSize, nNodes - first);
+        for (int64_t n = 0; n < nBlock; n++) {
+            MWNode<D, T> &node = *nodes[first + n];
+            char *dst = buffer.data() + n * nodeBytes;
+            const char *src = (char *)node.getCoefs();
+            if (packed) {
+                int sIdx = node.getSerialIx();
+                int nodesPerChunk = allocator.getMaxNodesPerChunk();
+                src = (char *)(allocator.getPackedChunk(sIdx / nodesPerChunk) + (sIdx % nodesPerChunk) * allocator.getNCoefs());
+            }
+            if (node.hasCoefs()) {
+                std::memcpy(dst, src, nodeBytes);
+            } else {
+                std::memset(dst, 0, nodeBytes);
+            }
+        }
+        checksums[b] = tree_file::checksum(buffer.data(), nBlock * nodeBytes);
+        f.write(buffer.data(), nBlock * nodeBytes);
+    }
+    f.write((char *)checksums.data(), nBlocks * sizeof(uint64_t));
+    if (not f) MSG_ERROR("Failed to write tree");
+}
+
 /** @brief Read a previously stored tree structure from disk
  * @param[in] file: File name, will get ".tree" extension
- * @note This tree must have the exact same MRA the one that was saved
+ * @note This tree must have the same MRA as the one that was saved, but
+ * the file can be written by a different binary or on a machine with
+ * different byte order. Files in the old raw chunk format can still be read,
+ * but then the tree must also come from the exact same build.
  */
 template <int D, typename T> void FunctionTree<D, T>::loadTree(const std::string &file) {
     Timer t1;
-
     std::stringstream fname;
     fname << file << ".tree";
+    std::fstream f;
+    f.open(fname.str(), std::ios::in | std::ios::binary);
+    if (not f.is_open()) MSG_ERROR("Unable to open file");
+    loadTree(f);
+    f.close();
+    print::time(10, "Time read tree", t1);
+}
 
+/** @brief Read a tree from a binary stream, written by saveTree
+ * @param[in] f: Input stream, positioned at the start of the tree
+ * @note The stream is left at the end of the tree, ready for the next one
+ */
+template <int D, typename T> void FunctionTree<D, T>::loadTree(std::istream &f) {
+    readTree(f, nullptr, std::numeric_limits<int>::max());
+}
+
+/** @brief Read the part of a stored tree that overlaps a given region
+ * @param[in] file: File name, will get ".tree" extension
+ * @param[in] region: Box in world coordinates where the tree is needed
+ * @param[in] maxScale: Finest scale of the nodes that are read
+ *
+ * @details Nodes are refined only if they overlap the region, and only down
+ * to maxScale. All other nodes become end nodes that keep their stored
+ * scaling and wavelet coefficients, so the function is complete inside the
+ * region and coarser outside. Only the node table down to maxScale and the
+ * coefficient blocks of the nodes that are read are taken from the file.
+ * Periodic images of the region are not considered.
+ */
+template <int D, typename T> void FunctionTree<D, T>::loadTree(const std::string &file, const BoundingBox<D> &region, int maxScale) {
+    Timer t1;
+    std::stringstream fname;
+    fname << file << ".tree";
     std::fstream f;
     f.open(fname.str(), std::ios::in | std::ios::binary);
     if (not f.is_open()) MSG_ERROR("Unable to open file");
+    readTree(f, &region, maxScale);
+    f.close();
+    print::time(10, "Time read tree", t1);
+}
+
+template <int D, typename T> void FunctionTree<D, T>::readTree(std::istream &f, const BoundingBox<D> *region, int maxScale) {
+    std::streampos start = f.tellg();
+    tree_file::Header header;
+    f.read((char *)&header, sizeof(header));
+    if (not f or not tree_file::is_tree_file(header)) {
+        if (region != nullptr) MSG_WARN("Old tree file format, reading the full tree");
+        f.clear();
+        f.seekg(start);
+        loadRawChunks(f);
+        return;
+    }
+    bool swap = tree_file::swap_header(header);
+    if (not tree_file::check_header(header, this->getMRA())) MSG_ABORT("Incompatible tree file");
+
+    bool isComplex = (header.coefType == tree_file::Complex64 or header.coefType == tree_file::Complex32);
+    bool packed = (header.coefType == tree_file::Real32 or header.coefType == tree_file::Complex32);
+    if (isComplex != std::is_same<T, ComplexDouble>::value) MSG_ABORT("Scalar type mismatch in tree file");
+    int expectedSize = (packed) ? sizeof(typename NodeAllocator<D, T>::P) : sizeof(T);
+    if (header.coefSize != expectedSize) MSG_ABORT("Invalid coefficient size in tree file");
+
+    // Whether the translations [lMin, lMax] on the given scale overlap the region
+    auto sfac = this->getMRA().getWorldBox().getScalingFactors();
+    auto overlaps = [region, sfac](int scale, const int32_t *lMin, const int32_t *lMax) {
+        if (region == nullptr) return true;
+        double two_n = std::pow(2.0, -scale);
+        for (int d = 0; d < D; d++) {
+            if (sfac[d] * two_n * (lMax[d] + 1) <= region->getLowerBound(d)) return false;
+            if (sfac[d] * two_n * lMin[d] >= region->getUpperBound(d)) return false;
+        }
+        return true;
+    };
+    auto read_node_table = [&f, &start, &header, swap](std::vector<tree_file::NodeEntry> &entries, int64_t nEntries) {
+        entries.resize(nEntries);
+        f.seekg(start + std::streamoff(header.nodeOffset));
+        f.read((char *)entries.data(), nEntries * sizeof(tree_file::NodeEntry));
+        if (swap) tree_file::swap_bytes((char *)entries.data(), nEntries * sizeof(tree_file::NodeEntry) / sizeof(int32_t), sizeof(int32_t));
+    };
+
+    // Read scale index, older files get it from the full node table
+    int64_t nNodes = header.nNodes;
+    std::vector<tree_file::NodeEntry> entries;
+    std::vector<tree_file::ScaleEntry> scales(header.nScales);
+    if (header.nScales > 0) {
+        f.seekg(start + std::streamoff(header.scaleOffset));
+        f.read((char *)scales.data(), scales.size() * sizeof(tree_file::ScaleEntry));
+        for (auto &scale : scales) {
+            if (swap) tree_file::swap_bytes((char *)&scale.scale, 8, sizeof(int32_t));
+            if (swap) tree_file::swap_bytes((char *)&scale.firstNode, 2, sizeof(int64_t));
+        }
+    } else {
+        read_node_table(entries, nNodes);
+        scales = tree_file::make_scale_index(entries.data(), nNodes);
+    }
 
-    // Read size of tree
+    // Nodes on finer scales than the last one overlapping the region are never needed
+    int64_t nRead = 0;
+    for (auto &scale : scales) {
+        if (scale.scale > maxScale) break;
+        nRead = scale.firstNode + scale.nNodes;
+        if (not overlaps(scale.scale, scale.lMin, scale.lMax)) break;
+    }
+    if (entries.size() != nRead) read_node_table(entries, nRead);
+
+    int nBlocks = (nNodes + header.blockSize - 1) / header.blockSize;
+    std::vector<uint64_t> checksums(nBlocks);
+    f.seekg(start + std::streamoff(header.checksumOffset));
+    f.read((char *)checksums.data(), nBlocks * sizeof(uint64_t));
+    if (not f) MSG_ABORT("Unexpected end of tree file");
+    if (swap) tree_file::swap_bytes((char *)checksums.data(), nBlocks, sizeof(uint64_t));
+
+    // Rebuild the tree structure, breadth first from the root nodes
+    this->deleteGenerated();
+    this->clear();
+    int tDim = (1 << D);
+    int64_t nCreated = this->rootBox.size();
+    if (nCreated > nRead) MSG_ABORT("Invalid node table in tree file");
+    std::vector<MWNode<D, T> *> nodes(nRead, nullptr);
+    for (int i = 0; i < nCreated; i++) nodes[i] = &this->getRootMWNode(i);
+    for (int64_t n = 0; n < nRead; n++) {
+        const auto &entry = entries[n];
+        std::array<int, D> l;
+        for (int d = 0; d < D; d++) l[d] = entry.l[d];
+        if (nodes[n] != nullptr and nodes[n]->getNodeIndex() != NodeIndex<D>(entry.scale, l)) MSG_ABORT("Invalid node table in tree file");
+        if (not(entry.flags & tree_file::HasChildren)) continue;
+        int64_t firstChild = nCreated;
+        nCreated += tDim;
+        if (nodes[n] == nullptr or nCreated > nRead or not overlaps(entry.scale, entry.l, entry.l)) continue;
+        nodes[n]->createChildren(true);
+        for (int i = 0; i < tDim; i++) nodes[firstChild + i] = &nodes[n]->getMWChild(i);
+    }
+    if (nRead == nNodes and nCreated != nNodes) MSG_ABORT("Invalid node table in tree file");
+
+    // Read coefficients of the blocks with nodes in the tree
+    int wordSize = (isComplex) ? header.coefSize / 2 : header.coefSize;
+    int64_t nodeBytes = 1ll * header.nCoefs * header.coefSize;
+    std::vector<char> buffer(header.blockSize * nodeBytes);
+    for (int b = 0; b < nBlocks; b++) {
+        int64_t first = 1ll * b * header.blockSize;
+        int64_t nBlock = std::min<int64_t>(header.blockSize, nNodes - first);
+        int64_t nUsed = std::max<int64_t>(0, std::min<int64_t>(nBlock, nRead - first));
+        if (nUsed == 0) break; // this and the following blocks are past the nodes read
+        if (std::none_of(nodes.begin() + first, nodes.begin() + first + nUsed, [](auto *node) { return node != nullptr; })) continue;
+
+        f.seekg(start + std::streamoff(header.coefOffset + first * nodeBytes));
+        f.read(buffer.data(), nBlock * nodeBytes);
+        if (not f) MSG_ABORT("Unexpected end of tree file");
+        if (tree_file::checksum(buffer.data(), nBlock * nodeBytes) != checksums[b]) MSG_ABORT("Checksum mismatch in tree file, block " << b);
+        if (swap) tree_file::swap_bytes(buffer.data(), nBlock * nodeBytes / wordSize, wordSize);
+        for (int64_t n = 0; n < nUsed; n++) {
+            if (nodes[first + n] == nullptr) continue;
+            MWNode<D, T> &node = *nodes[first + n];
+            const char *src = buffer.data() + n * nodeBytes;
+            if (packed) {
+                auto *p = (const typename NodeAllocator<D, T>::P *)src;
+                for (int i = 0; i < header.nCoefs; i++) node.getCoefs()[i] = static_cast<T>(p[i]);
+            } else {
+                std::memcpy(node.getCoefs(), src, nodeBytes);
+            }
+            if (entries[first + n].flags & tree_file::HasCoefs) {
+                node.setHasCoefs();
+                node.calcNorms();
+            } else {
+                node.clearHasCoefs();
+            }
+        }
+    }
+    f.seekg(start + std::streamoff(header.checksumOffset + nBlocks * sizeof(uint64_t)));
+
+    this->setConjugate(header.flags & tree_file::Conjugate);
+    this->resetEndNodeTable();
+    this->calcSquareNorm();
+    if (packed) this->packCoefs();
+}
+
+/** @brief Read a tree in the old format, with the raw chunks of the NodeAllocator */
+template <int D, typename T> void FunctionTree<D, T>::loadRawChunks(std::istream &f) {
+    Timer t1;
+
+    // Read size of tree, negative for single precision coefs
     int nChunks;
     f.read((char *)&nChunks, sizeof(int));
+    bool packed = (nChunks < 0);
+    nChunks = std::abs(nChunks);
 
     // Read tree data, chunk by chunk
     this->deleteRootNodes();
     auto &allocator = this->getNodeAllocator();
-    allocator.init(nChunks);
+    allocator.init(nChunks, true, packed);
     for (int iChunk = 0; iChunk < nChunks; iChunk++) {
         f.read((char *)allocator.getNodeChunk(iChunk), allocator.getNodeChunkSize());
-        f.read((char *)allocator.getCoefChunk(iChunk), allocator.getCoefChunkSize());
+        if (packed) {
+            f.read((char *)allocator.getPackedChunk(iChunk), allocator.getPackedChunkSize());
+        } else {
+            f.read((char *)allocator.getCoefChunk(iChunk), allocator.getCoefChunkSize());
+        }
     }
-    f.close();
     print::time(10, "Time read tree", t1);
 
     Timer t2;
     allocator.reassemble();
     this->resetEndNodeTable();
-    this->calcSquareNorm(true);
+    this->calcSquareNorm(not packed); // packed trees keep the stored node norms
     print::time(10, "Time rewrite pointers", t2);
 }
 
+/** @brief Use a tree file directly from disk, through a memory mapping
+ * @param[in] file: File name, will get ".tree" extension
+ *
+ * @details Only the node table is read into memory. The coefficients of all
+ * nodes except the roots refer in place to the mapped file, so the pages are
+ * read on first use and shared with all other processes mapping the same file
+ * through the page cache. The mapping is private: if the coefficients are
+ * modified, the touched pages are copied and the file is never changed. New
+ * nodes get ordinary coefficient memory. The mapping is released when the
+ * tree is cleared or destroyed.
+ *
+ * The file must be written in the native byte order and in double precision,
+ * and the checksums are not verified. Use loadTree for other files.
+ */
+template <int D, typename T> void FunctionTree<D, T>::mapTree(const std::string &file) {
+    Timer t1;
+    auto &allocator = this->getNodeAllocator();
+    if (allocator.isShared()) MSG_ABORT("Cannot map a tree in shared memory");
+
+    std::stringstream fname;
+    fname << file << ".tree";
+    int fd = open(fname.str().c_str(), O_RDONLY);
+    if (fd < 0) MSG_ABORT("Unable to open file: " << fname.str());
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        MSG_ABORT("Unable to stat file: " << fname.str());
+    }
+    size_t size = st.st_size;
+    void *data = (size >= sizeof(tree_file::Header)) ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (data == MAP_FAILED) MSG_ABORT("Unable to map file: " << fname.str());
+
+    tree_file::Header header = *(tree_file::Header *)data;
+    bool valid = tree_file::is_tree_file(header);
+    if (valid and tree_file::swap_header(header)) {
+        MSG_ERROR("Cannot map a tree file with the opposite byte order");
+        valid = false;
+    }
+    if (valid and not tree_file::check_header(header, this->getMRA())) valid = false;
+    int coefType = (std::is_same<T, ComplexDouble>::value) ? tree_file::Complex64 : tree_file::Real64;
+    if (valid and (header.coefType != coefType or header.coefSize != sizeof(T))) {
+        MSG_ERROR("Cannot map a tree file with a different coefficient type");
+        valid = false;
+    }
+    int64_t nNodes = header.nNodes;
+    int64_t nodeBytes = 1ll * header.nCoefs * sizeof(T);
+    // Every table must be aligned for its type and lie inside the file
+    auto inFile = [size](int64_t offset, int64_t count, int64_t bytes, int64_t align) {
+        if (offset < 0 or offset % align != 0 or offset > (int64_t)size) return false;
+        return (count >= 0 and count <= ((int64_t)size - offset) / bytes);
+    };
+    if (valid) {
+        bool fits = inFile(header.nodeOffset, nNodes, sizeof(tree_file::NodeEntry), alignof(tree_file::NodeEntry));
+        fits = fits and inFile(header.coefOffset, nNodes, nodeBytes, alignof(T));
+        if (header.normOffset != 0) fits = fits and inFile(header.normOffset, nNodes, (1 << D) * sizeof(double), alignof(double));
+        if (not fits) {
+            MSG_ERROR("Unexpected end of tree file");
+            valid = false;
+        }
+    }
+    if (not valid) {
+        munmap(data, size);
+        MSG_ABORT("Invalid tree file for mapping: " << fname.str());
+    }
+
+    // Create nodes without coefficient memory
+    this->deleteGenerated();
+    this->clear();
+    auto *entries = (const tree_file::NodeEntry *)((char *)data + header.nodeOffset);
+    std::vector<MWNode<D, T> *> nodes = create_nodes(*this, entries, nNodes, false);
+    allocator.attachMapping((char *)data, size);
+
+    auto *norms = (header.normOffset > 0) ? (const double *)((char *)data + header.normOffset) : nullptr;
+    for (int64_t n = 0; n < nNodes; n++) {
+        MWNode<D, T> &node = *nodes[n];
+        T *coefs = (T *)((char *)data + header.coefOffset + n * nodeBytes);
+        if (node.isRootNode()) {
+            std::memcpy(node.coefs, coefs, nodeBytes);
+        } else {
+            node.coefs = coefs;
+            node.setIsAllocated();
+        }
+        if (entries[n].flags & tree_file::HasCoefs) {
+            node.setHasCoefs();
+            if (norms != nullptr) {
+                node.squareNorm = 0.0;
+                for (int i = 0; i < node.getTDim(); i++) {
+                    node.componentNorms[i] = norms[n * node.getTDim() + i];
+                    node.squareNorm += node.componentNorms[i] * node.componentNorms[i];
+                }
+            } else {
+                node.calcNorms();
+            }
+        } else {
+            node.clearHasCoefs();
+            node.clearNorms();
+        }
+    }
+    this->setConjugate(header.flags & tree_file::Conjugate);
+    this->resetEndNodeTable();
+    this->calcSquareNorm();
+    print::time(10, "Time map tree", t1);
+}
+
 /** @returns Integral of the function over the entire computational domain */
 template <int D, typename T> T FunctionTree<D, T>::integrate() const {
 
@@ -1076,6 +1604,20 @@ template <int D, typename T> void FunctionTree<D, T>::appendTreeNoCoeff(MWTree<D
     }
 }
 
+/** @brief Store the coefficients of the tree in single precision
+ *
+ * @details Halves the memory footprint of the coefficients, e.g. for functions
+ * that are kept at loose precision, or are only stored between uses. The
+ * tree structure and node norms remain available, but the coefficients must
+ * be restored with unpackCoefs() before the function is used in any other
+ * operation. A packed tree is saved, sent and received in single precision,
+ * and is packed also after loadTree/recv_tree. Clearing the tree unpacks it.
+ */
+template <int D, typename T> void FunctionTree<D, T>::packCoefs() {
+    this->deleteGenerated();
+    this->getNodeAllocator().pack();
+}
+
 template <int D, typename T> void FunctionTree<D, T>::deleteGenerated() {
     for (int n = 0; n < this->getNEndNodes(); n++) this->getEndMWNode(n).deleteGenerated();
 }
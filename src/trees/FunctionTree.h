@@ -72,9 +72,15 @@ public:
     void setEndValues(Eigen::Matrix<T, Eigen::Dynamic, 1> &data);
 
     void saveTree(const std::string &file);
+    void saveTree(std::ostream &out);
     void saveTreeTXT(const std::string &file);
+    void saveTreeBIN(const std::string &file);
     void loadTree(const std::string &file);
+    void loadTree(std::istream &in);
+    void loadTree(const std::string &file, const BoundingBox<D> &region, int maxScale);
+    void mapTree(const std::string &file);
     void loadTreeTXT(const std::string &file);
+    void loadTreeBIN(const std::string &file);
 
     // In place operations
     void square();
@@ -92,6 +98,11 @@ public:
 
     int crop(double prec, double splitFac = 1.0, bool absPrec = true);
 
+    void packCoefs();
+    void unpackCoefs() { this->getNodeAllocator().unpack(); }
+    bool isPacked() const { return this->getNodeAllocator().isPacked(); }
+    bool isMapped() const { return this->getNodeAllocator().isMapped(); }
+
     FunctionNode<D, T> &getEndFuncNode(int i) { return static_cast<FunctionNode<D, T> &>(this->getEndMWNode(i)); }
     FunctionNode<D, T> &getRootFuncNode(int i) { return static_cast<FunctionNode<D, T> &>(this->rootBox.getNode(i)); }
 
@@ -130,6 +141,9 @@ protected:
     std::ostream &print(std::ostream &o) const override;
 
     void allocRootNodes();
+    void loadRawChunks(std::istream &in);
+    void readTree(std::istream &in, const BoundingBox<D> *region, int maxScale);
+    void setInteropValues(const std::vector<int> &scales, const std::vector<std::array<int, D>> &translations, const std::vector<T> &values);
 };
 
 } // namespace mrcpp
@@ -232,6 +232,7 @@ template <int D, typename T> void MWNode<D, T>::getCoefs(Eigen::Matrix<T, Eigen:
     if (not this->isAllocated()) MSG_ABORT("Node is not allocated");
     if (not this->hasCoefs()) MSG_ABORT("Node has no coefs");
     if (this->n_coefs == 0) MSG_ABORT("ncoefs == 0");
+    if (this->coefs == nullptr) MSG_ABORT("Coefs not available, tree is packed");
 
     c = Eigen::Matrix<T, Eigen::Dynamic, 1>::Map(this->coefs, this->n_coefs);
 }
@@ -241,6 +242,7 @@ template <int D, typename T> void MWNode<D, T>::getCoefs(Eigen::Matrix<T, Eigen:
  */
 template <int D, typename T> void MWNode<D, T>::zeroCoefs() {
     if (not this->isAllocated()) MSG_ABORT("Coefs not allocated " << *this);
+    if (this->coefs == nullptr) MSG_ABORT("Coefs not available, tree is packed");
 
     for (int i = 0; i < this->n_coefs; i++) { this->coefs[i] = 0.0; }
     this->zeroNorms();
@@ -266,6 +268,7 @@ template <int D, typename T> void MWNode<D, T>::attachCoefs(T *coefs) {
  */
 template <int D, typename T> void MWNode<D, T>::setCoefBlock(int block, int block_size, const T *c) {
     if (not this->isAllocated()) MSG_ABORT("Coefs not allocated");
+    if (this->coefs == nullptr) MSG_ABORT("Coefs not available, tree is packed");
     for (int i = 0; i < block_size; i++) { this->coefs[block * block_size + i] = c[i]; }
 }
 
@@ -281,6 +284,7 @@ template <int D, typename T> void MWNode<D, T>::setCoefBlock(int block, int bloc
  */
 template <int D, typename T> void MWNode<D, T>::addCoefBlock(int block, int block_size, const T *c) {
     if (not this->isAllocated()) MSG_ABORT("Coefs not allocated");
+    if (this->coefs == nullptr) MSG_ABORT("Coefs not available, tree is packed");
     for (int i = 0; i < block_size; i++) { this->coefs[block * block_size + i] += c[i]; }
 }
 
@@ -295,6 +299,7 @@ template <int D, typename T> void MWNode<D, T>::addCoefBlock(int block, int bloc
  */
 template <int D, typename T> void MWNode<D, T>::zeroCoefBlock(int block, int block_size) {
     if (not this->isAllocated()) MSG_ABORT("Coefs not allocated");
+    if (this->coefs == nullptr) MSG_ABORT("Coefs not available, tree is packed");
     for (int i = 0; i < block_size; i++) { this->coefs[block * block_size + i] = 0.0; }
 }
 
@@ -92,8 +92,14 @@ public:
     void getCoefs(Eigen::Matrix<T, Eigen::Dynamic, 1> &c) const;
     void printCoefs() const;
 
-    T *getCoefs() { return this->coefs; }
-    const T *getCoefs() const { return this->coefs; }
+    T *getCoefs() {
+        assert(this->coefs != nullptr or not this->hasCoefs()); // packed tree
+        return this->coefs;
+    }
+    const T *getCoefs() const {
+        assert(this->coefs != nullptr or not this->hasCoefs()); // packed tree
+        return this->coefs;
+    }
 
     void getPrimitiveQuadPts(Eigen::MatrixXd &pts) const;
     void getPrimitiveChildPts(Eigen::MatrixXd &pts) const;
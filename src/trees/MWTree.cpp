@@ -97,6 +97,8 @@ template <int D, typename T> void MWTree<D, T>::clear() {
         root.clearHasCoefs();
         root.clearNorms();
     }
+    this->getNodeAllocator().discardPacked(); // only the root nodes are left
+    this->getNodeAllocator().detachMapping();
     this->resetEndNodeTable();
     this->clearSquareNorm();
 }
@@ -222,6 +224,7 @@ template <int D, typename T> void MWTree<D, T>::mwTransformDown(bool overwrite)
  * unnecessary nodes.
  */
 template <int D, typename T> void MWTree<D, T>::setZero() {
+    this->getNodeAllocator().discardPacked();
     TreeIterator<D, T> it(*this);
     while (it.next()) {
         MWNode<D, T> &node = it.getNode();
@@ -294,6 +297,7 @@ template <int D, typename T> int MWTree<D, T>::getNNodesAtDepth(int depth) const
 /** @returns Size of all MW coefs in the tree, in kB */
 template <int D, typename T> int MWTree<D, T>::getSizeNodes() const {
     auto nCoefs = 1ll * getNNodes() * getTDim() * getKp1_d();
+    if (getNodeAllocator().isPacked()) return sizeof(typename NodeAllocator<D, T>::P) * nCoefs / 1024;
     return sizeof(T) * nCoefs / 1024;
 }
 
@@ -306,6 +310,7 @@ template <int D, typename T> int MWTree<D, T>::getSizeNodes() const {
  */
 template <int D, typename T> const MWNode<D, T> *MWTree<D, T>::findNode(NodeIndex<D> idx) const {
     if (getRootBox().isPeriodic()) { periodic::index_manipulation<D>(idx, getRootBox().getPeriodic()); }
+    if (this->nodeTable_p != nullptr) return this->nodeTable_p->find(idx);
     int rIdx = getRootBox().getBoxIndex(idx);
     if (rIdx < 0) return nullptr;
     const MWNode<D, T> &root = this->rootBox.getNode(rIdx);
@@ -322,6 +327,7 @@ template <int D, typename T> const MWNode<D, T> *MWTree<D, T>::findNode(NodeInde
  */
 template <int D, typename T> MWNode<D, T> *MWTree<D, T>::findNode(NodeIndex<D> idx) {
     if (getRootBox().isPeriodic()) { periodic::index_manipulation<D>(idx, getRootBox().getPeriodic()); }
+    if (this->nodeTable_p != nullptr) return this->nodeTable_p->find(idx);
     int rIdx = getRootBox().getBoxIndex(idx);
     if (rIdx < 0) return nullptr;
     MWNode<D, T> &root = this->rootBox.getNode(rIdx);
@@ -329,6 +335,50 @@ template <int D, typename T> MWNode<D, T> *MWTree<D, T>::findNode(NodeIndex<D> i
     return root.retrieveNodeNoGen(idx);
 }
 
+/** @brief Switch the hash index of the tree nodes on or off
+ *
+ * @details With the index enabled, findNode and getNode by NodeIndex look up
+ * allocated nodes in a hash table in constant time, instead of descending
+ * the tree from the root node. The index is kept up to date as nodes are
+ * created and deleted, at the price of a hash insertion per node. Generated
+ * nodes are not indexed, and are still found by tree descent.
+ */
+template <int D, typename T> void MWTree<D, T>::setNodeIndexing(bool enable) {
+    if (not enable) {
+        this->nodeTable_p.reset();
+        return;
+    }
+    if (this->nodeTable_p != nullptr) return;
+    this->nodeTable_p = std::make_unique<NodeHashTable<D, T>>();
+
+    std::vector<MWNode<D, T> *> stack;
+    for (int i = 0; i < this->rootBox.size(); i++) stack.push_back(&this->getRootMWNode(i));
+    while (not stack.empty()) {
+        MWNode<D, T> *node = stack.back();
+        stack.pop_back();
+        this->nodeTable_p->insert(node);
+        for (int i = 0; i < node->getNChildren(); i++) {
+            MWNode<D, T> *child = &node->getMWChild(i);
+            if (not child->isGenNode()) stack.push_back(child);
+        }
+    }
+}
+
+/** @brief Place the nodes in memory along a space-filling curve
+ *
+ * @param[in] hilbert: Use the Hilbert curve if true, otherwise Morton order
+ *
+ * @details The nodes and their coefficients are moved so that, within each
+ * scale, spatial neighbours are also close in memory. This improves the cache
+ * behaviour of operations that visit neighbouring nodes, like convolutions and
+ * multiplications. Pointers and references to nodes of this tree are
+ * invalidated. With setNodeOrdering(true) the tree is reordered automatically
+ * at the end of each TreeBuilder::build.
+ */
+template <int D, typename T> void MWTree<D, T>::reorderNodes(bool hilbert) {
+    getNodeAllocator().reorder(hilbert);
+}
+
 /** @brief Finds and returns the node reference with the given NodeIndex.
  *
  * @details This routine ALWAYS returns the node you ask for. If the
@@ -340,6 +390,11 @@ template <int D, typename T> MWNode<D, T> *MWTree<D, T>::findNode(NodeIndex<D> i
 template <int D, typename T> MWNode<D, T> &MWTree<D, T>::getNode(NodeIndex<D> idx, bool create) {
     if (getRootBox().isPeriodic()) periodic::index_manipulation<D>(idx, getRootBox().getPeriodic());
 
+    if (this->nodeTable_p != nullptr and idx.getScale() >= getRootScale()) {
+        MWNode<D, T> *node = this->nodeTable_p->find(idx);
+        if (node != nullptr) return *node;
+    }
+
     MWNode<D, T> *out = nullptr;
     MWNode<D, T> &root = getRootBox().getNode(idx);
     if (idx.getScale() < getRootScale()) {
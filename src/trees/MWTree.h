@@ -35,6 +35,7 @@
 #include "MultiResolutionAnalysis.h"
 #include "NodeAllocator.h"
 #include "NodeBox.h"
+#include "NodeHashTable.h"
 
 namespace mrcpp {
 
@@ -138,6 +139,13 @@ public:
 
     void makeMaxSquareNorms(); // sets values for maxSquareNorm and maxWSquareNorm in all nodes
 
+    void setNodeIndexing(bool enable);
+    bool hasNodeIndexing() const { return this->nodeTable_p != nullptr; }
+
+    void reorderNodes(bool hilbert = true);
+    void setNodeOrdering(bool enable) { this->nodeOrdering = enable; }
+    bool hasNodeOrdering() const { return this->nodeOrdering; }
+
     NodeAllocator<D, T> &getNodeAllocator() { return *this->nodeAllocator_p; }
     const NodeAllocator<D, T> &getNodeAllocator() const { return *this->nodeAllocator_p; }
     MWNodeVector<D, T> endNodeTable; ///< Final projected nodes
@@ -152,6 +160,7 @@ public:
     friend class FunctionNode<D, T>;
     friend class OperatorNode;
     friend class TreeBuilder<D, T>;
+    friend class ConvolutionCalculator<D, T>;
     friend class NodeAllocator<D, T>;
 
 protected:
@@ -181,6 +190,15 @@ protected:
     void incrementNodeCount(int scale);
     void decrementNodeCount(int scale);
 
+    std::unique_ptr<NodeHashTable<D, T>> nodeTable_p{nullptr}; ///< Optional index of all allocated nodes
+    bool nodeOrdering{false};                                  ///< Reorder nodes along the Hilbert curve after each build
+    void registerNode(MWNode<D, T> *node) {
+        if (this->nodeTable_p != nullptr) this->nodeTable_p->insert(node);
+    }
+    void unregisterNode(MWNode<D, T> *node) {
+        if (this->nodeTable_p != nullptr) this->nodeTable_p->erase(node);
+    }
+
     BankAccount *NodesCoeff = nullptr;
     bool conj{false};
 
@@ -26,6 +26,7 @@
 #include "NodeAllocator.h"
 
 #include <stack>
+#include <sys/mman.h>
 
 #include "FunctionNode.h"
 #include "FunctionTree.h"
@@ -78,9 +79,11 @@ template <int D, typename T> NodeAllocator<D, T>::NodeAllocator(OperatorTree *tr
 
 template <int D, typename T> NodeAllocator<D, T>::~NodeAllocator() {
     for (auto &chunk : this->nodeChunks) delete[](char *) chunk;
-    if (not isShared()) // if the data is shared, it must be freed by MPI_Win_free
+    if (not isShared()) // if the data is shared, it is given back to the pool by the SharedMemory
         for (auto &chunk : this->coefChunks) delete[] chunk;
+    for (auto &chunk : this->packedChunks) delete[] chunk;
     this->stackStatus.clear();
+    detachMapping();
     MRCPP_DESTROY_OMP_LOCK();
 }
 
@@ -109,12 +112,14 @@ template <int D, typename T> T *NodeAllocator<D, T>::getCoefNoLock(int sIdx) {
     if (sIdx < 0 or sIdx >= this->stackStatus.size()) return nullptr;
     int chunk = sIdx / this->maxNodesPerChunk; // which chunk
     int idx = sIdx % this->maxNodesPerChunk;   // position in chunk
+    if (chunk >= this->coefChunks.size() or this->coefChunks[chunk] == nullptr) return nullptr; // packed or no coefs
     return this->coefChunks[chunk] + idx * this->coefsPerNode;
 }
 
 template <int D, typename T> int NodeAllocator<D, T>::alloc(int nNodes, bool coefs) {
     MRCPP_SET_OMP_LOCK();
     if (nNodes <= 0 or nNodes > this->maxNodesPerChunk) MSG_ABORT("Cannot allocate " << nNodes << " nodes");
+    if (this->packed) MSG_ABORT("Cannot allocate nodes with packed coefficients");
     // move topstack to start of next chunk if current chunk is too small
     int cIdx = this->topStack % (this->maxNodesPerChunk);
     bool chunkOverflow = ((cIdx + nNodes) > this->maxNodesPerChunk);
@@ -124,6 +129,11 @@ template <int D, typename T> int NodeAllocator<D, T>::alloc(int nNodes, bool coe
     int chunk = this->topStack / this->maxNodesPerChunk;
     bool needNewChunk = (chunk >= this->nodeChunks.size());
     if (needNewChunk) appendChunk(coefs);
+    if (coefs and getCoefNoLock(this->topStack) == nullptr) {
+        // chunk was made without coefs, e.g. for a mapped tree
+        this->coefChunks.resize(this->nodeChunks.size(), nullptr);
+        this->coefChunks[chunk] = newCoefChunk();
+    }
 
     // return value is index of first new node
     auto sIdx = this->topStack;
@@ -171,14 +181,37 @@ template <int D, typename T> void NodeAllocator<D, T>::deallocAllCoeff() {
         for (auto &chunk : this->coefChunks) delete[] chunk;
     else
         delete this->shmem_p;
+    for (auto &chunk : this->packedChunks) delete[] chunk;
     this->shmem_p = nullptr;
     this->coefChunks.clear();
+    this->packedChunks.clear();
+    this->packed = false;
+    detachMapping();
 }
 
-template <int D, typename T> void NodeAllocator<D, T>::init(int nChunks, bool coefs) {
+template <int D, typename T> void NodeAllocator<D, T>::init(int nChunks, bool coefs, bool packed) {
     MRCPP_SET_OMP_LOCK();
     if (nChunks <= 0) MSG_ABORT("Invalid number of chunks: " << nChunks);
-    for (int i = getNChunks(); i < nChunks; i++) appendChunk(coefs);
+    if (packed and this->isShared()) MSG_ABORT("Cannot pack shared coefficients");
+
+    // switch storage of the existing chunks, their content is discarded
+    if (packed and not this->packed) {
+        for (auto &chunk : this->coefChunks) delete[] chunk;
+        this->coefChunks.clear();
+        for (int i = 0; i < getNChunks(); i++) this->packedChunks.push_back(new P[getPackedChunkSize() / sizeof(P)]);
+    } else if (not packed and this->packed) {
+        for (auto &chunk : this->packedChunks) delete[] chunk;
+        this->packedChunks.clear();
+        if (coefs) {
+            for (int i = 0; i < getNChunks(); i++) this->coefChunks.push_back(new T[getCoefChunkSize() / sizeof(T)]);
+        }
+    }
+    this->packed = packed;
+
+    for (int i = getNChunks(); i < nChunks; i++) {
+        appendChunk(coefs and not packed);
+        if (packed) this->packedChunks.push_back(new P[getPackedChunkSize() / sizeof(P)]);
+    }
 
     // reinitialize stacks
     int nodeCount = this->nodeChunks.size() * this->maxNodesPerChunk;
@@ -190,17 +223,8 @@ template <int D, typename T> void NodeAllocator<D, T>::init(int nChunks, bool co
 template <int D, typename T> void NodeAllocator<D, T>::appendChunk(bool coefs) {
     // make coeff chunk
     if (coefs) {
-        T *c_chunk = nullptr;
-        if (this->isShared()) {
-            // for coefficients, take from the shared memory block
-            c_chunk = this->shmem_p->sh_end_ptr;
-            this->shmem_p->sh_end_ptr += (this->coefsPerNode * this->maxNodesPerChunk);
-            // may increase size dynamically in the future
-            if (this->shmem_p->sh_max_ptr < this->shmem_p->sh_end_ptr) MSG_ABORT("Shared block too small");
-        } else {
-            c_chunk = new T[getCoefChunkSize() / sizeof(T)];
-        }
-        this->coefChunks.push_back(c_chunk);
+        this->coefChunks.resize(this->nodeChunks.size(), nullptr);
+        this->coefChunks.push_back(newCoefChunk());
     }
 
     // make node chunk
@@ -219,10 +243,40 @@ template <int D, typename T> void NodeAllocator<D, T>::appendChunk(bool coefs) {
     std::fill(this->stackStatus.begin() + oldsize, this->stackStatus.end(), 0);
 }
 
+template <int D, typename T> T *NodeAllocator<D, T>::newCoefChunk() {
+    if (not this->isShared()) return new T[getCoefChunkSize() / sizeof(T)];
+
+    // for coefficients, take from the shared memory block, which grows as needed
+    return this->shmem_p->allocate(this->coefsPerNode * this->maxNodesPerChunk);
+}
+
+/** @brief Take ownership of a memory mapped file
+ *
+ * @details The coefficients of nodes allocated without coefs may point into
+ * the mapping. It is unmapped by detachMapping(), which must not be called
+ * before those nodes are deleted.
+ */
+template <int D, typename T> void NodeAllocator<D, T>::attachMapping(char *data, size_t size) {
+    if (this->isShared()) MSG_ABORT("Cannot map shared coefficients");
+    detachMapping();
+    this->mapData = data;
+    this->mapSize = size;
+}
+
+template <int D, typename T> void NodeAllocator<D, T>::detachMapping() {
+    if (this->mapData != nullptr) munmap(this->mapData, this->mapSize);
+    this->mapData = nullptr;
+    this->mapSize = 0;
+}
+
 /** Fill all holes in the chunks with occupied nodes, then remove all empty chunks */
 template <int D, typename T> int NodeAllocator<D, T>::compress() {
     MRCPP_SET_OMP_LOCK();
     int nNodes = (1 << D);
+    if (this->packed or isMapped()) {
+        MRCPP_UNSET_OMP_LOCK();
+        return 0; // coefs cannot be moved while packed or mapped
+    }
     if (this->maxNodesPerChunk * this->nodeChunks.size() <= getTree().getNNodes() + this->maxNodesPerChunk + nNodes - 1) {
         MRCPP_UNSET_OMP_LOCK();
         return 0; // nothing to compress
@@ -262,10 +316,10 @@ template <int D, typename T> int NodeAllocator<D, T>::deleteUnusedChunks() {
     for (int i = nChunksUsed; i < nChunksTotal; i++) delete[](char *)(this->nodeChunks[i]);
 
     if (isShared()) {
-        // shared coefficients cannot be fully deallocated, only pointer is moved.
-        getMemory().sh_end_ptr -= (nChunksTotal - nChunksUsed) * this->coefsPerNode * this->maxNodesPerChunk;
+        // shared coefficients are not given back to the pool, only the end of the used part is moved.
+        if (nChunksUsed < this->coefChunks.size() and this->coefChunks[nChunksUsed] != nullptr) getMemory().deallocate(this->coefChunks[nChunksUsed]);
     } else {
-        for (int i = nChunksUsed; i < nChunksTotal; i++) delete[] this->coefChunks[i];
+        for (int i = nChunksUsed; i < this->coefChunks.size(); i++) delete[] this->coefChunks[i];
     }
 
     // shrink the stacks
@@ -306,6 +360,7 @@ template <int D, typename T> void NodeAllocator<D, T>::moveNodes(int nNodes, int
 
     // update node
     for (int i = 0; i < nNodes; i++) (dstNode + i)->serialIx = dstIdx + i;
+    for (int i = 0; i < nNodes; i++) getTree().registerNode(dstNode + i);
 
     // update parent
     dstNode->parent->childSerialIx = dstIdx;
@@ -362,13 +417,50 @@ template <int D, typename T> int NodeAllocator<D, T>::findNextOccupied(int sIdx)
     return sIdx;
 }
 
-/** Traverse tree and redefine pointer, counter and tables. */
-template <int D, typename T> void NodeAllocator<D, T>::reassemble() {
+/** @brief Redefine the pointers of the nodes in use in one chunk
+ *
+ * @details For a tree whose node chunks arrive one by one: each chunk can be
+ * relinked as soon as it is in place, and reassemble(false) is called when
+ * all of them are. The nodes in use are those that have their own serial
+ * index, the other places of the chunk are skipped.
+ */
+template <int D, typename T> void NodeAllocator<D, T>::relinkChunk(int iChunk) {
+    MRCPP_SET_OMP_LOCK();
+    for (int i = 0; i < this->maxNodesPerChunk; i++) {
+        int sIdx = iChunk * this->maxNodesPerChunk + i;
+        auto *node_p = getNodeNoLock(sIdx);
+        if (node_p->serialIx == sIdx) relinkNode(node_p);
+    }
+    MRCPP_UNSET_OMP_LOCK();
+}
+
+template <int D, typename T> void NodeAllocator<D, T>::relinkNode(MWNode<D, T> *node_p) {
+    // normally (intel) the virtual table does not change, but we overwrite anyway
+    *(char **)(node_p) = this->cvptr;
+    node_p->initNodeLock();
+
+    node_p->tree = this->tree_p;
+    node_p->coefs = getCoefNoLock(node_p->serialIx);
+    node_p->parent = getNodeNoLock(node_p->parentSerialIx);
+    auto *child_p = getNodeNoLock(node_p->childSerialIx);
+    for (int i = 0; i < node_p->getNChildren(); i++) {
+        assert(child_p != nullptr);
+        node_p->children[i] = child_p;
+        child_p++;
+    }
+}
+
+/** @brief Traverse tree and redefine pointer, counter and tables
+ *
+ * @param[in] relink: Redefine the pointers of the nodes, false if relinkChunk() was called for all chunks
+ */
+template <int D, typename T> void NodeAllocator<D, T>::reassemble(bool relink) {
     MRCPP_SET_OMP_LOCK();
     this->nNodes = 0;
     getTree().nodesAtDepth.clear();
     getTree().squareNorm = 0.0;
     getTree().clearEndNodeTable();
+    if (getTree().nodeTable_p != nullptr) getTree().nodeTable_p->clear();
 
     NodeBox<D, T> &rootbox = getTree().getRootBox();
     MWNode<D, T> **roots = rootbox.getNodes();
@@ -385,8 +477,6 @@ template <int D, typename T> void NodeAllocator<D, T>::reassemble() {
         auto *node_p = stack.top();
         assert(node_p != nullptr);
         auto sIdx = node_p->serialIx;
-        auto pIdx = node_p->parentSerialIx;
-        auto cIdx = node_p->childSerialIx;
 
         this->nNodes++;
         this->topStack = std::max(this->topStack, sIdx + 1);
@@ -394,23 +484,12 @@ template <int D, typename T> void NodeAllocator<D, T>::reassemble() {
         if (node_p->isEndNode()) getTree().squareNorm += node_p->getSquareNorm();
         if (node_p->isEndNode()) getTree().endNodeTable.push_back(node_p);
 
-        // normally (intel) the virtual table does not change, but we overwrite anyway
-        *(char **)(node_p) = this->cvptr;
-        node_p->initNodeLock();
-
-        node_p->tree = this->tree_p;
-        node_p->coefs = getCoefNoLock(sIdx);
-        node_p->parent = getNodeNoLock(pIdx);
+        if (relink) relinkNode(node_p);
         getTree().NodeIndex2serialIx[node_p->getNodeIndex()] = sIdx;
+        getTree().registerNode(node_p);
 
         stack.pop();
-        auto *child_p = getNodeNoLock(cIdx);
-        for (int i = 0; i < node_p->getNChildren(); i++) {
-            assert(child_p != nullptr);
-            node_p->children[i] = child_p;
-            stack.push(child_p);
-            child_p++;
-        }
+        for (int i = 0; i < node_p->getNChildren(); i++) stack.push(node_p->children[i]);
         this->stackStatus[sIdx] = 1; // occupied
     }
     this->last_p = getNodeNoLock(this->topStack);
@@ -418,6 +497,225 @@ template <int D, typename T> void NodeAllocator<D, T>::reassemble() {
     MRCPP_UNSET_OMP_LOCK();
 }
 
+/** @brief Lay out the nodes along a space-filling curve, scale by scale
+ *
+ * @param[in] hilbert: Follow the Hilbert curve if true, otherwise Morton (Z) order
+ *
+ * @details Nodes are placed in creation order by alloc(), which after adaptive
+ * refinement scatters spatial neighbours across the chunks. This routine
+ * copies the nodes and their coefficients into fresh chunks, one scale at a
+ * time, with the sibling groups of each scale ordered along the curve. The
+ * siblings stay consecutive and aligned as required by alloc(). Generated
+ * nodes live in a separate allocator and are left in place, only their parent
+ * pointers are updated. Shared memory trees are not reordered.
+ */
+template <int D, typename T> void NodeAllocator<D, T>::reorder(bool hilbert) {
+    if (this->isShared()) return; // all ranks would have to agree on the new layout
+    if (this->nNodes == 0) return;
+    if (this->packed) MSG_ABORT("Cannot reorder nodes with packed coefficients");
+    if (isMapped()) MSG_ABORT("Cannot reorder nodes with mapped coefficients");
+    if (this->coefChunks.size() != this->nodeChunks.size()) NOT_IMPLEMENTED_ABORT; // Nodes without coefs not handled atm
+
+    MRCPP_SET_OMP_LOCK();
+    int tDim = (1 << D);
+    int nRoots = getTree().getRootBox().size();
+    for (int rIdx = 0; rIdx < nRoots; rIdx++) {
+        if (getNodeNoLock(rIdx)->parentSerialIx >= 0) {
+            // nodes above the root scale are not reachable from the roots
+            MRCPP_UNSET_OMP_LOCK();
+            return;
+        }
+    }
+
+    // new position of each node, roots stay in front
+    std::vector<int> newIdx(this->stackStatus.size(), -1);
+    std::vector<MWNode<D, T> *> layout;
+    std::vector<MWNode<D, T> *> scaleNodes;
+    for (int rIdx = 0; rIdx < nRoots; rIdx++) {
+        auto *root_p = getNodeNoLock(rIdx);
+        newIdx[rIdx] = rIdx;
+        layout.push_back(root_p);
+        scaleNodes.push_back(root_p);
+    }
+    while (not scaleNodes.empty()) {
+        std::vector<MWNode<D, T> *> nextNodes;
+        for (auto *node_p : scaleNodes) {
+            if (node_p->getNChildren() == 0) continue;
+            if (node_p->children[0]->isGenNode()) continue;
+            // siblings are aligned to 2^D and never cross a chunk boundary
+            int pos = tDim * ((layout.size() + tDim - 1) / tDim);
+            if (pos / this->maxNodesPerChunk != (pos + tDim - 1) / this->maxNodesPerChunk) {
+                pos = this->maxNodesPerChunk * ((pos + tDim - 1) / this->maxNodesPerChunk);
+            }
+            layout.resize(pos, nullptr);
+            for (int i = 0; i < tDim; i++) {
+                newIdx[node_p->childSerialIx + i] = pos + i;
+                layout.push_back(node_p->children[i]);
+            }
+            const HilbertPath<D> &h = node_p->getHilbertPath();
+            for (int i = 0; i < tDim; i++) {
+                int cIdx = (hilbert) ? h.getZIndex(i) : i;
+                nextNodes.push_back(node_p->children[cIdx]);
+            }
+        }
+        scaleNodes = std::move(nextNodes);
+    }
+
+    // copy nodes and coefs into new chunks
+    int newTop = layout.size();
+    int nChunks = (newTop + this->maxNodesPerChunk - 1) / this->maxNodesPerChunk;
+    std::vector<MWNode<D, T> *> oldNodeChunks = std::move(this->nodeChunks);
+    std::vector<T *> oldCoefChunks = std::move(this->coefChunks);
+    this->nodeChunks.clear();
+    this->coefChunks.clear();
+    this->stackStatus.clear();
+    for (int i = 0; i < nChunks; i++) appendChunk(true);
+
+    for (int sIdx = 0; sIdx < newTop; sIdx++) {
+        auto *src_p = layout[sIdx];
+        if (src_p == nullptr) continue;
+        auto *dst_p = getNodeNoLock(sIdx);
+        int oldIdx = src_p->serialIx;
+        for (int i = 0; i < this->sizeOfNode; i++) ((char *)dst_p)[i] = ((char *)src_p)[i];
+
+        T *dstCoefs = getCoefNoLock(sIdx);
+        T *srcCoefs = oldCoefChunks[oldIdx / this->maxNodesPerChunk] + (oldIdx % this->maxNodesPerChunk) * this->coefsPerNode;
+        for (int i = 0; i < this->coefsPerNode; i++) dstCoefs[i] = srcCoefs[i];
+        if (src_p->coefs != nullptr) dst_p->coefs = dstCoefs;
+
+        dst_p->serialIx = sIdx;
+        this->stackStatus[sIdx] = 1;
+    }
+
+    // update links, the copies are complete at this point
+    for (int sIdx = 0; sIdx < newTop; sIdx++) {
+        if (layout[sIdx] == nullptr) continue;
+        auto *node_p = getNodeNoLock(sIdx);
+        node_p->initNodeLock();
+        if (node_p->parentSerialIx >= 0) {
+            node_p->parentSerialIx = newIdx[node_p->parentSerialIx];
+            node_p->parent = getNodeNoLock(node_p->parentSerialIx);
+        }
+        if (node_p->getNChildren() == 0) continue;
+        if (node_p->children[0]->isGenNode()) {
+            for (int i = 0; i < node_p->getNChildren(); i++) node_p->children[i]->parent = node_p;
+            continue;
+        }
+        node_p->childSerialIx = newIdx[node_p->childSerialIx];
+        for (int i = 0; i < node_p->getNChildren(); i++) node_p->children[i] = getNodeNoLock(node_p->childSerialIx + i);
+    }
+
+    MWNode<D, T> **roots = getTree().getRootBox().getNodes();
+    for (int rIdx = 0; rIdx < nRoots; rIdx++) roots[rIdx] = getNodeNoLock(rIdx);
+
+    for (auto &chunk : oldNodeChunks) delete[](char *) chunk;
+    for (auto &chunk : oldCoefChunks) delete[] chunk;
+
+    if (getTree().nodeTable_p != nullptr) getTree().nodeTable_p->clear();
+    for (int sIdx = 0; sIdx < newTop; sIdx++) {
+        if (layout[sIdx] == nullptr) continue;
+        auto *node_p = getNodeNoLock(sIdx);
+        if (not getTree().NodeIndex2serialIx.empty()) getTree().NodeIndex2serialIx[node_p->getNodeIndex()] = sIdx;
+        getTree().registerNode(node_p);
+    }
+
+    this->topStack = newTop;
+    this->last_p = getNodeNoLock(this->topStack);
+    MRCPP_UNSET_OMP_LOCK();
+
+    getTree().resetEndNodeTable();
+}
+
+/** @brief Convert the coefficients to single precision storage
+ *
+ * @details The double precision coefficient chunks are replaced by chunks of
+ * float (or complex<float>), which halves the memory of the coefficients.
+ * The node coefficient pointers are cleared, so the tree structure and node
+ * norms remain available, but the coefficients cannot be used or modified
+ * until unpack() is called: the nodes keep their HasCoefs flag, and the
+ * coefficient accessors of MWNode refuse the missing coefficients. Shared
+ * memory trees cannot be packed.
+ */
+template <int D, typename T> void NodeAllocator<D, T>::pack() {
+    if (this->isShared()) MSG_ABORT("Cannot pack shared coefficients");
+    if (isMapped()) MSG_ABORT("Cannot pack mapped coefficients");
+    MRCPP_SET_OMP_LOCK();
+    if (this->packed or this->coefChunks.empty()) {
+        MRCPP_UNSET_OMP_LOCK();
+        return;
+    }
+    int nCoefs = this->maxNodesPerChunk * this->coefsPerNode;
+    for (int iChunk = 0; iChunk < getNChunks(); iChunk++) {
+        T *src = (iChunk < this->coefChunks.size()) ? this->coefChunks[iChunk] : nullptr;
+        P *dst = new P[nCoefs];
+        for (int i = 0; i < this->maxNodesPerChunk; i++) {
+            int sIdx = iChunk * this->maxNodesPerChunk + i;
+            if (src == nullptr or this->stackStatus[sIdx] == 0) continue;
+            int n0 = i * this->coefsPerNode;
+            for (int j = n0; j < n0 + this->coefsPerNode; j++) dst[j] = static_cast<P>(src[j]);
+            getNodeNoLock(sIdx)->coefs = nullptr;
+        }
+        delete[] src;
+        this->packedChunks.push_back(dst);
+    }
+    this->coefChunks.clear();
+    this->packed = true;
+    MRCPP_UNSET_OMP_LOCK();
+}
+
+/** @brief Convert packed coefficients back to double precision storage */
+template <int D, typename T> void NodeAllocator<D, T>::unpack() {
+    MRCPP_SET_OMP_LOCK();
+    if (not this->packed) {
+        MRCPP_UNSET_OMP_LOCK();
+        return;
+    }
+    int nCoefs = this->maxNodesPerChunk * this->coefsPerNode;
+    for (int iChunk = 0; iChunk < getNChunks(); iChunk++) {
+        P *src = this->packedChunks[iChunk];
+        T *dst = new T[nCoefs];
+        this->coefChunks.push_back(dst);
+        for (int i = 0; i < this->maxNodesPerChunk; i++) {
+            int sIdx = iChunk * this->maxNodesPerChunk + i;
+            if (this->stackStatus[sIdx] == 0) continue;
+            int n0 = i * this->coefsPerNode;
+            for (int j = n0; j < n0 + this->coefsPerNode; j++) dst[j] = static_cast<T>(src[j]);
+            getNodeNoLock(sIdx)->coefs = dst + n0;
+        }
+        delete[] src;
+    }
+    this->packedChunks.clear();
+    this->packed = false;
+    MRCPP_UNSET_OMP_LOCK();
+}
+
+/** @brief Drop packed coefficients without converting them
+ *
+ * @details For trees whose coefficients are about to be overwritten. The
+ * chunks holding nodes get new, uninitialized, double precision coefficients,
+ * the other chunks get them when nodes are allocated there.
+ */
+template <int D, typename T> void NodeAllocator<D, T>::discardPacked() {
+    MRCPP_SET_OMP_LOCK();
+    if (not this->packed) {
+        MRCPP_UNSET_OMP_LOCK();
+        return;
+    }
+    for (auto &chunk : this->packedChunks) delete[] chunk;
+    this->packedChunks.clear();
+    this->coefChunks.assign(getNChunks(), nullptr);
+    for (int iChunk = 0; iChunk < getNChunks(); iChunk++) {
+        for (int i = 0; i < this->maxNodesPerChunk; i++) {
+            int sIdx = iChunk * this->maxNodesPerChunk + i;
+            if (this->stackStatus[sIdx] == 0) continue;
+            if (this->coefChunks[iChunk] == nullptr) this->coefChunks[iChunk] = newCoefChunk();
+            getNodeNoLock(sIdx)->coefs = this->coefChunks[iChunk] + i * this->coefsPerNode;
+        }
+    }
+    this->packed = false;
+    MRCPP_UNSET_OMP_LOCK();
+}
+
 template <int D, typename T> void NodeAllocator<D, T>::print() const {
     int n = 0;
     for (int iChunk = 0; iChunk < getNChunks(); iChunk++) {
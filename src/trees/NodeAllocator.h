@@ -33,6 +33,7 @@
 
 #pragma once
 
+#include <complex>
 #include <vector>
 
 #include "MRCPP/mrcpp_declarations.h"
@@ -40,8 +41,14 @@
 
 namespace mrcpp {
 
+/** Coefficient type used for single precision (packed) storage */
+template <typename T> struct PackedCoef { using type = float; };
+template <> struct PackedCoef<std::complex<double>> { using type = std::complex<float>; };
+
 template <int D, typename T> class NodeAllocator final {
 public:
+    using P = typename PackedCoef<T>::type;
+
     NodeAllocator(OperatorTree *tree, SharedMemory<T> *mem, int coefsPerNode, int nodesPerChunk);
     NodeAllocator(FunctionTree<D, T> *tree, SharedMemory<T> *mem, int coefsPerNode, int nodesPerChunk);
     NodeAllocator(const NodeAllocator<D, T> &tree) = delete;
@@ -52,10 +59,22 @@ public:
     void dealloc(int sIdx);
     void deallocAllCoeff();
 
-    void init(int nChunks, bool coefs = true);
+    void init(int nChunks, bool coefs = true, bool packed = false);
 
     int compress();
-    void reassemble();
+    void relinkChunk(int iChunk);
+    void reassemble(bool relink = true);
+    void reorder(bool hilbert = true);
+
+    void pack();
+    void unpack();
+    void discardPacked();
+    bool isPacked() const { return this->packed; }
+    bool isShared() const { return (this->shmem_p != nullptr); }
+
+    void attachMapping(char *data, size_t size);
+    void detachMapping();
+    bool isMapped() const { return (this->mapData != nullptr); }
     int deleteUnusedChunks();
 
     int getNNodes() const { return this->nNodes; }
@@ -65,12 +84,14 @@ public:
     int getNodeChunkSize() const { return this->maxNodesPerChunk * this->sizeOfNode; }
     int getCoefChunkSize() const { return this->maxNodesPerChunk * this->coefsPerNode * sizeof(T); }
     int getMaxNodesPerChunk() const { return this->maxNodesPerChunk; }
+    int getPackedChunkSize() const { return this->maxNodesPerChunk * this->coefsPerNode * sizeof(P); }
 
     T *getCoef_p(int sIdx);
     MWNode<D, T> *getNode_p(int sIdx);
 
     T *getCoefChunk(int i) { return this->coefChunks[i]; }
     MWNode<D, T> *getNodeChunk(int i) { return this->nodeChunks[i]; }
+    P *getPackedChunk(int i) { return this->packedChunks[i]; }
 
     void print() const;
 
@@ -80,25 +101,31 @@ protected:
     int sizeOfNode{0};       // sizeof(NodeType)
     int coefsPerNode{0};     // number of coef for one node
     int maxNodesPerChunk{0}; // max number of nodes per allocation
+    bool packed{false};      // coefs are stored in packedChunks, in single precision
 
     std::vector<int> stackStatus{};
     std::vector<T *> coefChunks{};
     std::vector<MWNode<D, T> *> nodeChunks{};
+    std::vector<P *> packedChunks{};
+
+    char *mapData{nullptr}; // memory mapped file holding the coefs of some nodes
+    size_t mapSize{0};
 
     char *cvptr{nullptr};              // pointer to virtual table
     MWNode<D, T> *last_p{nullptr};     // pointer just after the last active node, i.e. where to put next node
     MWTree<D, T> *tree_p{nullptr};     // pointer to external object
     SharedMemory<T> *shmem_p{nullptr}; // pointer to external object
 
-    bool isShared() const { return (this->shmem_p != nullptr); }
     MWTree<D, T> &getTree() { return *this->tree_p; }
     SharedMemory<T> &getMemory() { return *this->shmem_p; }
 
     T *getCoefNoLock(int sIdx);
     MWNode<D, T> *getNodeNoLock(int sIdx);
 
+    void relinkNode(MWNode<D, T> *node_p);
     void moveNodes(int nNodes, int srcIdx, int dstIdx);
     void appendChunk(bool coefs);
+    T *newCoefChunk();
 
     int findNextAvailable(int sIdx, int nNodes) const;
     int findNextOccupied(int sIdx) const;
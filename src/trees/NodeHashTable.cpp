@@ -0,0 +1,152 @@
+/*
+ * MRCPP, a numerical library based on multiresolution analysis and
+ * the multiwavelet basis which provide low-scaling algorithms as well as
+ * rigorous error control in numerical computations.
+ * Copyright (C) 2021 Stig Rune Jensen, Jonas Juselius, Luca Frediani and contributors.
+ *
+ * This file is part of MRCPP.
+ *
+ * MRCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MRCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with MRCPP.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * For information on the complete list of contributors to MRCPP, see:
+ * <https://mrcpp.readthedocs.io/>
+ */
+
+#include "NodeHashTable.h"
+#include "MWNode.h"
+#include "NodeIndex.h"
+
+namespace mrcpp {
+
+template <int D, typename T> NodeHashTable<D, T>::NodeHashTable() {
+    this->table = new Table(1024);
+    MRCPP_INIT_OMP_LOCK();
+}
+
+template <int D, typename T> NodeHashTable<D, T>::~NodeHashTable() {
+    for (auto *tab : this->retired) delete tab;
+    delete this->table.load();
+    MRCPP_DESTROY_OMP_LOCK();
+}
+
+/** @returns Node with the given index, nullptr if it is not in the table */
+template <int D, typename T> MWNode<D, T> *NodeHashTable<D, T>::find(const NodeIndex<D> &idx) const {
+    const Table &tab = *this->table.load(std::memory_order_acquire);
+    size_t hash = std::hash<NodeIndex<D>>{}(idx);
+    for (size_t i = hash & tab.mask;; i = (i + 1) & tab.mask) {
+        MWNode<D, T> *node = tab.slots[i].node.load(std::memory_order_acquire);
+        if (node == nullptr) return nullptr;
+        if (node == tombstone()) continue;
+        if (tab.slots[i].hash.load(std::memory_order_relaxed) != hash) continue;
+        if (node->getNodeIndex() == idx) return node;
+    }
+}
+
+/** @brief Add a node to the table, replacing any previous node with the same index */
+template <int D, typename T> void NodeHashTable<D, T>::insert(MWNode<D, T> *node) {
+    MRCPP_SET_OMP_LOCK();
+    Table &tab = *this->table.load(std::memory_order_relaxed);
+    const NodeIndex<D> &idx = node->getNodeIndex();
+    size_t hash = std::hash<NodeIndex<D>>{}(idx);
+    size_t free = tab.slots.size();
+    bool replaced = false;
+    for (size_t i = hash & tab.mask;; i = (i + 1) & tab.mask) {
+        MWNode<D, T> *old = tab.slots[i].node.load(std::memory_order_relaxed);
+        if (old == nullptr) break;
+        if (old == tombstone()) {
+            if (free == tab.slots.size()) free = i;
+            continue;
+        }
+        if (tab.slots[i].hash.load(std::memory_order_relaxed) == hash and old->getNodeIndex() == idx) {
+            tab.slots[i].node.store(node, std::memory_order_release);
+            replaced = true;
+            break;
+        }
+    }
+    if (not replaced) {
+        if (free < tab.slots.size()) {
+            // Reuse a tombstone, readers compare the index so this is safe
+            tab.slots[free].hash.store(hash, std::memory_order_relaxed);
+            tab.slots[free].node.store(node, std::memory_order_release);
+        } else {
+            insertSlot(tab, hash, node);
+            this->nUsed++;
+        }
+        this->nEntries++;
+        if (2 * this->nUsed > tab.slots.size()) grow();
+    }
+    MRCPP_UNSET_OMP_LOCK();
+}
+
+/** @brief Remove a node from the table, if it is the one stored for its index */
+template <int D, typename T> void NodeHashTable<D, T>::erase(MWNode<D, T> *node) {
+    MRCPP_SET_OMP_LOCK();
+    Table &tab = *this->table.load(std::memory_order_relaxed);
+    size_t hash = std::hash<NodeIndex<D>>{}(node->getNodeIndex());
+    for (size_t i = hash & tab.mask;; i = (i + 1) & tab.mask) {
+        MWNode<D, T> *old = tab.slots[i].node.load(std::memory_order_relaxed);
+        if (old == nullptr) break;
+        if (old == node) {
+            tab.slots[i].node.store(tombstone(), std::memory_order_release);
+            this->nEntries--;
+            break;
+        }
+    }
+    MRCPP_UNSET_OMP_LOCK();
+}
+
+/** @brief Remove all nodes, and free the memory of replaced tables */
+template <int D, typename T> void NodeHashTable<D, T>::clear() {
+    MRCPP_SET_OMP_LOCK();
+    for (auto *tab : this->retired) delete tab;
+    this->retired.clear();
+    delete this->table.load();
+    this->table = new Table(1024);
+    this->nEntries = 0;
+    this->nUsed = 0;
+    MRCPP_UNSET_OMP_LOCK();
+}
+
+template <int D, typename T> void NodeHashTable<D, T>::insertSlot(Table &tab, size_t hash, MWNode<D, T> *node) {
+    size_t i = hash & tab.mask;
+    while (tab.slots[i].node.load(std::memory_order_relaxed) != nullptr) i = (i + 1) & tab.mask;
+    tab.slots[i].hash.store(hash, std::memory_order_relaxed);
+    tab.slots[i].node.store(node, std::memory_order_release);
+}
+
+/** Rehash the live entries into a table with at most 25% load, dropping tombstones */
+template <int D, typename T> void NodeHashTable<D, T>::grow() {
+    Table *old = this->table.load(std::memory_order_relaxed);
+    size_t n = old->slots.size();
+    while (n < 4 * (size_t)this->nEntries) n *= 2;
+    auto *tab = new Table(n);
+    for (auto &slot : old->slots) {
+        MWNode<D, T> *node = slot.node.load(std::memory_order_relaxed);
+        if (node == nullptr or node == tombstone()) continue;
+        insertSlot(*tab, slot.hash.load(std::memory_order_relaxed), node);
+    }
+    this->table.store(tab, std::memory_order_release);
+    this->retired.push_back(old);
+    this->nUsed = this->nEntries;
+}
+
+template class NodeHashTable<1, double>;
+template class NodeHashTable<2, double>;
+template class NodeHashTable<3, double>;
+
+template class NodeHashTable<1, ComplexDouble>;
+template class NodeHashTable<2, ComplexDouble>;
+template class NodeHashTable<3, ComplexDouble>;
+
+} // namespace mrcpp
@@ -0,0 +1,93 @@
+/*
+ * MRCPP, a numerical library based on multiresolution analysis and
+ * the multiwavelet basis which provide low-scaling algorithms as well as
+ * rigorous error control in numerical computations.
+ * Copyright (C) 2021 Stig Rune Jensen, Jonas Juselius, Luca Frediani and contributors.
+ *
+ * This file is part of MRCPP.
+ *
+ * MRCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MRCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with MRCPP.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * For information on the complete list of contributors to MRCPP, see:
+ * <https://mrcpp.readthedocs.io/>
+ */
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "MRCPP/mrcpp_declarations.h"
+#include "utils/omp_utils.h"
+
+namespace mrcpp {
+
+/** @class NodeHashTable
+ *
+ * @brief Open addressing hash table from NodeIndex to the nodes of a tree
+ *
+ * @details Maps the NodeIndex of every allocated (non-generated) node of a
+ * tree to the node, so that nodes can be found in constant time without
+ * descending the tree from the root. The table is kept up to date by the
+ * tree whenever nodes are created, moved or deleted.
+ *
+ * Lookups are lock free and may run concurrently with insertions, which are
+ * serialized by a lock. The table grows when more than half of its slots
+ * are in use (live entries or tombstones), and is then rehashed to at most
+ * 25% load. When the table grows, the old slot array is kept
+ * alive until the table is cleared, such that concurrent readers never
+ * access freed memory. As for the tree itself, nodes must not be deleted
+ * while other threads look them up.
+ */
+template <int D, typename T> class NodeHashTable final {
+public:
+    NodeHashTable();
+    NodeHashTable(const NodeHashTable<D, T> &table) = delete;
+    NodeHashTable<D, T> &operator=(const NodeHashTable<D, T> &table) = delete;
+    ~NodeHashTable();
+
+    MWNode<D, T> *find(const NodeIndex<D> &idx) const;
+    void insert(MWNode<D, T> *node);
+    void erase(MWNode<D, T> *node);
+    void clear();
+
+    int size() const { return this->nEntries; }
+
+protected:
+    struct Slot {
+        std::atomic<size_t> hash{0};
+        std::atomic<MWNode<D, T> *> node{nullptr};
+    };
+    struct Table {
+        explicit Table(size_t n)
+                : mask(n - 1)
+                , slots(n) {}
+        const size_t mask;
+        std::vector<Slot> slots;
+    };
+
+    std::atomic<Table *> table{nullptr};
+    std::vector<Table *> retired; ///< Replaced tables, freed on clear
+    int nEntries{0};              ///< Live entries
+    int nUsed{0};                 ///< Live entries and tombstones
+#ifdef MRCPP_HAS_OMP
+    omp_lock_t omp_lock;
+#endif
+
+    static MWNode<D, T> *tombstone() { return reinterpret_cast<MWNode<D, T> *>(1); }
+    static void insertSlot(Table &tab, size_t hash, MWNode<D, T> *node);
+    void grow();
+};
+
+} // namespace mrcpp
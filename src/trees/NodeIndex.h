@@ -31,6 +31,8 @@
 
 #pragma once
 
+#include <array>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 
@@ -118,3 +120,16 @@ template <int D> bool siblings(const NodeIndex<D> &a, const NodeIndex<D> &b) {
 }
 
 } // namespace mrcpp
+
+namespace std {
+
+/** @brief Hash function for NodeIndex (allows to use std::unordered_map) */
+template <int D> struct hash<mrcpp::NodeIndex<D>> {
+    size_t operator()(const mrcpp::NodeIndex<D> &idx) const {
+        size_t h = static_cast<size_t>(idx.getScale());
+        for (int d = 0; d < D; d++) h = h * 0x9E3779B97F4A7C15ULL + static_cast<unsigned int>(idx[d]);
+        return h ^ (h >> 29);
+    }
+};
+
+} // namespace std
@@ -39,6 +39,7 @@ void OperatorNode::dealloc() {
     this->parentSerialIx = -1;
     this->childSerialIx = -1;
     this->tree->decrementNodeCount(this->getScale());
+    this->tree->unregisterNode(this);
     this->tree->getNodeAllocator().dealloc(sIdx);
 }
 
@@ -137,6 +138,7 @@ void OperatorNode::createChildren(bool coefs) {
         child_p->clearHasCoefs();
 
         this->getMWTree().incrementNodeCount(child_p->getScale());
+        this->getMWTree().registerNode(child_p);
         sIdx++;
         child_p++;
         if (coefs) coefs_p += n_coefs;
@@ -24,11 +24,24 @@
  */
 
 #include "OperatorTree.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MRCPP/version.h"
+
 #include "BandWidth.h"
 #include "NodeAllocator.h"
 #include "OperatorNode.h"
+#include "TreeFile.h"
 #include "TreeIterator.h"
 #include "utils/Printer.h"
+#include "utils/Timer.h"
 #include "utils/tree_utils.h"
 
 using namespace Eigen;
@@ -81,6 +94,7 @@ void OperatorTree::allocRootNodes() {
         root_p->clearHasCoefs();
 
         this->incrementNodeCount(root_p->getScale());
+        this->registerNode(root_p);
         sIdx++;
         root_p++;
         coef_p += n_coefs;
@@ -282,6 +296,150 @@ void OperatorTree::mwTransformDown(bool overwrite) {
     }
 }
 
+/** Header of the binary operator file, followed by the key string and the raw chunks */
+struct OperatorFileHeader {
+    char magic[8];
+    int version;
+    int nChunks;
+    int nodeChunkSize;
+    int coefChunkSize;
+    int keyLength;
+    int nodeSize;      // sizeof(OperatorNode), the chunks hold raw nodes
+    char build[32];    // library version that wrote the file
+    uint64_t checksum; // of the key and the chunks
+};
+
+static const char operFileMagic[8] = {'M', 'R', 'C', 'O', 'P', 'E', 'R', '\0'};
+static const int operFileVersion = 2;
+
+/** @brief Write the operator tree to disk, for later use
+ *
+ * @param[in] file: File name, written as is
+ * @param[in] key: String identifying the operator, verified on load
+ *
+ * @details The file is first written under a unique temporary name in the
+ * same directory and then renamed, so that concurrent readers never see a
+ * partially written file, even when several hosts share the directory.
+ * Generated nodes (e.g. from the node cache) are not stored.
+ */
+void OperatorTree::saveTree(const std::string &file, const std::string &key) {
+    Timer t1;
+    auto &allocator = this->getNodeAllocator();
+
+    OperatorFileHeader header;
+    std::memcpy(header.magic, operFileMagic, sizeof(header.magic));
+    header.version = operFileVersion;
+    header.nChunks = allocator.getNChunksUsed();
+    header.nodeChunkSize = allocator.getNodeChunkSize();
+    header.coefChunkSize = allocator.getCoefChunkSize();
+    header.keyLength = key.size();
+    header.nodeSize = sizeof(OperatorNode);
+    std::memset(header.build, 0, sizeof(header.build));
+    std::strncpy(header.build, program_version(), sizeof(header.build) - 1);
+    header.checksum = tree_file::checksum(key.data(), key.size());
+    for (int iChunk = 0; iChunk < header.nChunks; iChunk++) {
+        header.checksum = tree_file::checksum((char *)allocator.getNodeChunk(iChunk), header.nodeChunkSize, header.checksum);
+        header.checksum = tree_file::checksum((char *)allocator.getCoefChunk(iChunk), header.coefChunkSize, header.checksum);
+    }
+
+    std::string tmp_file = file + ".XXXXXX";
+    int fd = mkstemp(&tmp_file[0]);
+    if (fd < 0) {
+        MSG_WARN("Unable to open file: " << tmp_file);
+        return;
+    }
+    fchmod(fd, 0644); // readable by the other users of the cache
+    close(fd);
+    std::fstream f;
+    f.open(tmp_file, std::ios::out | std::ios::binary);
+    f.write((char *)&header, sizeof(header));
+    f.write(key.data(), key.size());
+    for (int iChunk = 0; iChunk < header.nChunks; iChunk++) {
+        f.write((char *)allocator.getNodeChunk(iChunk), header.nodeChunkSize);
+        f.write((char *)allocator.getCoefChunk(iChunk), header.coefChunkSize);
+    }
+    f.close();
+    if (f.fail() or std::rename(tmp_file.c_str(), file.c_str()) != 0) {
+        MSG_WARN("Unable to write file: " << file);
+        std::remove(tmp_file.c_str());
+    }
+    print::time(10, "Time write", t1);
+}
+
+/** @brief Read a previously stored operator tree from disk
+ *
+ * @param[in] file: File name, read as is
+ * @param[in] key: String identifying the operator, must match the stored key
+ *
+ * @returns False if the file is missing or does not match this tree, in which
+ * case the tree is left untouched
+ *
+ * @details The file is memory mapped read-only, so that processes on the same
+ * machine loading the same operator share the page cache. The tree must be
+ * freshly constructed with the same MRA as the one that was saved. Files
+ * written by another library version or node layout, and files whose
+ * checksum does not match, are ignored.
+ */
+bool OperatorTree::loadTree(const std::string &file, const std::string &key) {
+    Timer t1;
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 or info.st_size < (off_t)sizeof(OperatorFileHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t fileSize = info.st_size;
+    void *map_p = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map_p == MAP_FAILED) return false;
+
+    auto &allocator = this->getNodeAllocator();
+    auto *data_p = static_cast<const char *>(map_p);
+    OperatorFileHeader header;
+    std::memcpy(&header, data_p, sizeof(header));
+
+    bool valid = true;
+    if (std::memcmp(header.magic, operFileMagic, sizeof(header.magic)) != 0) valid = false;
+    if (header.version != operFileVersion) valid = false;
+    if (header.nodeChunkSize != allocator.getNodeChunkSize()) valid = false;
+    if (header.coefChunkSize != allocator.getCoefChunkSize()) valid = false;
+    if (header.nodeSize != (int)sizeof(OperatorNode)) valid = false;
+    if (strncmp(header.build, program_version(), sizeof(header.build)) != 0) valid = false;
+    if (header.keyLength != (int)key.size()) valid = false;
+    size_t chunkSize = header.nodeChunkSize + header.coefChunkSize;
+    size_t expected = sizeof(header) + key.size() + header.nChunks * chunkSize;
+    if (header.nChunks < 1 or fileSize != expected) valid = false;
+    if (valid and key.compare(0, key.size(), data_p + sizeof(header), key.size()) != 0) valid = false;
+    if (valid and tree_file::checksum(data_p + sizeof(header), fileSize - sizeof(header)) != header.checksum) valid = false;
+    if (not valid) {
+        munmap(map_p, fileSize);
+        MSG_WARN("Ignoring incompatible operator file: " << file);
+        return false;
+    }
+
+    // Read tree data, chunk by chunk
+    this->deleteRootNodes();
+    allocator.init(header.nChunks);
+    const char *chunk_p = data_p + sizeof(header) + key.size();
+    for (int iChunk = 0; iChunk < header.nChunks; iChunk++) {
+        std::memcpy((char *)allocator.getNodeChunk(iChunk), chunk_p, header.nodeChunkSize);
+        chunk_p += header.nodeChunkSize;
+        std::memcpy((char *)allocator.getCoefChunk(iChunk), chunk_p, header.coefChunkSize);
+        chunk_p += header.coefChunkSize;
+    }
+    munmap(map_p, fileSize);
+    print::time(10, "Time read tree", t1);
+
+    Timer t2;
+    allocator.reassemble();
+    this->resetEndNodeTable();
+    this->calcSquareNorm();
+    print::time(10, "Time rewrite pointers", t2);
+    return true;
+}
+
 std::ostream &OperatorTree::print(std::ostream &o) const {
     o << std::endl << "*OperatorTree: " << this->name << std::endl;
     return MWTree<2>::print(o);
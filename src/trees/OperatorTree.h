@@ -47,6 +47,9 @@ public:
     void setupOperNodeCache();
     void clearOperNodeCache();
 
+    void saveTree(const std::string &file, const std::string &key = "");
+    bool loadTree(const std::string &file, const std::string &key = "");
+
     BandWidth &getBandWidth() { return *this->bandWidth; }
     const BandWidth &getBandWidth() const { return *this->bandWidth; }
 
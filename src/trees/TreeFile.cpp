@@ -0,0 +1,268 @@
+/*
+ * MRCPP, a numerical library based on multiresolution analysis and
+ * the multiwavelet basis which provide low-scaling algorithms as well as
+ * rigorous error control in numerical computations.
+ * Copyright (C) 2021 Stig Rune Jensen, Jonas Juselius, Luca Frediani and contributors.
+ *
+ * This file is part of MRCPP.
+ *
+ * MRCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MRCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with MRCPP.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * For information on the complete list of contributors to MRCPP, see:
+ * <https://mrcpp.readthedocs.io/>
+ */
+
+#include "TreeFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "MultiResolutionAnalysis.h"
+#include "utils/Printer.h"
+
+namespace mrcpp {
+namespace tree_file {
+
+static const char fileMagic[8] = {'M', 'R', 'C', 'T', 'R', 'E', 'E', '\0'};
+static const char interopMagic[8] = {'M', 'R', 'C', 'M', 'A', 'D', 'N', '\0'};
+
+template <int D> static int coefs_per_node(const MultiResolutionAnalysis<D> &mra) {
+    int nCoefs = (1 << D);
+    for (int d = 0; d < D; d++) nCoefs *= mra.getOrder() + 1;
+    return nCoefs;
+}
+
+template <int D> Header make_header(const MultiResolutionAnalysis<D> &mra, int coefType, int coefSize, int64_t nNodes, int nScales) {
+    const auto &box = mra.getWorldBox();
+
+    Header header;
+    std::memset(&header, 0, sizeof(Header));
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.version = Version;
+    header.endian = EndianMark;
+    header.dim = D;
+    header.coefType = coefType;
+    header.coefSize = coefSize;
+    header.order = mra.getOrder();
+    header.scalingType = mra.getScalingBasis().getScalingType();
+    header.maxDepth = mra.getMaxDepth();
+    header.rootScale = box.getScale();
+    for (int d = 0; d < D; d++) {
+        header.nBoxes[d] = box.size(d);
+        header.corner[d] = box.getCornerIndex().getTranslation(d);
+        header.scaling[d] = box.getScalingFactors()[d];
+    }
+    if (box.isPeriodic()) header.flags |= Periodic;
+    header.nNodes = nNodes;
+    header.nCoefs = coefs_per_node(mra);
+    header.blockSize = BlockSize;
+
+    // sections follow the header, coefficients are aligned
+    header.nodeOffset = sizeof(Header);
+    header.nScales = nScales;
+    header.scaleOffset = header.nodeOffset + nNodes * sizeof(NodeEntry);
+    header.normOffset = header.scaleOffset + nScales * sizeof(ScaleEntry);
+    int64_t normEnd = header.normOffset + nNodes * (1 << D) * sizeof(double);
+    header.coefOffset = Alignment * ((normEnd + Alignment - 1) / Alignment);
+    header.checksumOffset = header.coefOffset + nNodes * header.nCoefs * coefSize;
+    return header;
+}
+
+/** @returns Whether a tree stored with this header can be read into a tree of the given MRA */
+template <int D> bool check_header(const Header &header, const MultiResolutionAnalysis<D> &mra) {
+    const auto &box = mra.getWorldBox();
+    bool ok = true;
+    if (header.version > Version) {
+        MSG_ERROR("Unsupported tree file version: " << header.version);
+        ok = false;
+    }
+    if (header.dim != D) {
+        MSG_ERROR("Dimension mismatch: " << header.dim << " != " << D);
+        ok = false;
+    }
+    if (header.order != mra.getOrder() or header.scalingType != mra.getScalingBasis().getScalingType()) {
+        MSG_ERROR("Scaling basis mismatch");
+        ok = false;
+    }
+    if (header.rootScale != box.getScale()) {
+        MSG_ERROR("Root scale mismatch: " << header.rootScale << " != " << box.getScale());
+        ok = false;
+    }
+    for (int d = 0; d < D; d++) {
+        bool boxOk = (header.nBoxes[d] == box.size(d) and header.corner[d] == box.getCornerIndex().getTranslation(d));
+        bool sfacOk = (std::abs(header.scaling[d] - box.getScalingFactors()[d]) <= 1.0e-12 * std::abs(header.scaling[d]));
+        if (not boxOk or not sfacOk) {
+            MSG_ERROR("World box mismatch in direction " << d);
+            ok = false;
+        }
+    }
+    if (header.nCoefs != coefs_per_node(mra)) {
+        MSG_ERROR("Number of coefficients mismatch");
+        ok = false;
+    }
+    return ok;
+}
+
+bool is_tree_file(const Header &header) {
+    return (std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) == 0);
+}
+
+/** @brief Convert the header to native byte order
+ * @returns True if the file was written with the opposite byte order
+ *
+ * @details Fields that are missing in older versions of the format are reset.
+ */
+bool swap_header(Header &header) {
+    bool swap = (header.endian != EndianMark);
+    if (swap) {
+        swap_bytes((char *)&header.version, 2, sizeof(uint32_t));
+        swap_bytes((char *)&header.dim, 14, sizeof(int32_t));
+        swap_bytes((char *)header.scaling, 3, sizeof(double));
+        swap_bytes((char *)&header.nNodes, 1, sizeof(int64_t));
+        swap_bytes((char *)&header.nCoefs, 2, sizeof(int32_t));
+        swap_bytes((char *)&header.nodeOffset, 5, sizeof(int64_t));
+        swap_bytes((char *)&header.nScales, 1, sizeof(int32_t));
+        if (header.endian != EndianMark) MSG_ABORT("Invalid byte order mark in tree file");
+    }
+    // these fields hold the first node entries in older versions
+    if (header.version < 2) header.normOffset = 0;
+    if (header.version < 3) header.scaleOffset = 0;
+    if (header.version < 3) header.nScales = 0;
+    return swap;
+}
+
+/** Reverse the byte order of nWords consecutive words of wordSize bytes */
+void swap_bytes(char *data, int64_t nWords, int wordSize) {
+    for (int64_t i = 0; i < nWords; i++) std::reverse(data + i * wordSize, data + (i + 1) * wordSize);
+}
+
+/** @brief Build the scale index of a node table
+ *
+ * @details The nodes are stored breadth first, so the nodes of each scale
+ * are consecutive in the table.
+ */
+std::vector<ScaleEntry> make_scale_index(const NodeEntry *entries, int64_t nNodes) {
+    std::vector<ScaleEntry> index;
+    for (int64_t n = 0; n < nNodes; n++) {
+        const NodeEntry &entry = entries[n];
+        if (index.empty() or index.back().scale != entry.scale) {
+            if (not index.empty() and entry.scale < index.back().scale) MSG_ABORT("Node table not sorted by scale");
+            ScaleEntry scale;
+            std::memset(&scale, 0, sizeof(ScaleEntry));
+            scale.scale = entry.scale;
+            scale.firstNode = n;
+            for (int d = 0; d < 3; d++) scale.lMin[d] = entry.l[d];
+            for (int d = 0; d < 3; d++) scale.lMax[d] = entry.l[d];
+            index.push_back(scale);
+        }
+        ScaleEntry &scale = index.back();
+        for (int d = 0; d < 3; d++) scale.lMin[d] = std::min(scale.lMin[d], entry.l[d]);
+        for (int d = 0; d < 3; d++) scale.lMax[d] = std::max(scale.lMax[d], entry.l[d]);
+        scale.nNodes++;
+    }
+    return index;
+}
+
+/** 64-bit FNV-1a hash of the given bytes, continued from hash for data in several parts */
+uint64_t checksum(const char *data, int64_t size, uint64_t hash) {
+    for (int64_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+/** @brief Header of an interop file of nNodes nodes
+ *
+ * @details The world is assumed to be a cube from -L to L, as in the text
+ * format, with L a power of two given by the root scale.
+ */
+template <int D> InteropHeader make_interop_header(const MultiResolutionAnalysis<D> &mra, int coefType, int64_t nNodes) {
+    const auto &box = mra.getWorldBox();
+    double L = std::pow(2.0, -box.getScale());
+    int kp1 = mra.getOrder() + 1;
+
+    InteropHeader header;
+    std::memset(&header, 0, sizeof(InteropHeader));
+    std::memcpy(header.magic, interopMagic, sizeof(interopMagic));
+    header.version = 1;
+    header.endian = EndianMark;
+    header.dim = D;
+    header.coefType = coefType;
+    header.kp1 = kp1;
+    header.nValues = 1;
+    for (int d = 0; d < D; d++) header.nValues *= kp1;
+    for (int d = 0; d < D; d++) {
+        header.lower[d] = -box.getScalingFactors()[d] * L;
+        header.upper[d] = box.getScalingFactors()[d] * L;
+    }
+    header.nNodes = nNodes;
+    header.indexOffset = sizeof(InteropHeader);
+    int64_t indexEnd = header.indexOffset + nNodes * sizeof(InteropEntry);
+    header.valueOffset = Alignment * ((indexEnd + Alignment - 1) / Alignment);
+    return header;
+}
+
+bool is_interop_file(const InteropHeader &header) {
+    return (std::memcmp(header.magic, interopMagic, sizeof(interopMagic)) == 0);
+}
+
+/** @brief Convert the interop header to native byte order
+ * @returns True if the file was written with the opposite byte order
+ */
+bool swap_interop_header(InteropHeader &header) {
+    bool swap = (header.endian != EndianMark);
+    if (swap) {
+        swap_bytes((char *)&header.version, 2, sizeof(uint32_t));
+        swap_bytes((char *)&header.dim, 4, sizeof(int32_t));
+        swap_bytes((char *)header.lower, 6, sizeof(double));
+        swap_bytes((char *)&header.nNodes, 3, sizeof(int64_t));
+        if (header.endian != EndianMark) MSG_ABORT("Invalid byte order mark in interop file");
+    }
+    return swap;
+}
+
+/** @brief Position of the MADNESS quadrature points in the MRCPP order
+ *
+ * @details MADNESS stores the values zyx with descending indices, MRCPP xyz
+ * with ascending indices. Note that the map is its own inverse.
+ */
+std::vector<int> madness_order(int dim, int kp1) {
+    int kx = kp1 - 1;
+    int ky = (dim < 2) ? 0 : kp1 - 1;
+    int kz = (dim < 3) ? 0 : kp1 - 1;
+    std::vector<int> mapMRC;
+    for (int x = kx; x >= 0; x--) {
+        for (int y = ky; y >= 0; y--) {
+            for (int z = kz; z >= 0; z--) { mapMRC.push_back(z * kp1 * kp1 + y * kp1 + x); }
+        }
+    }
+    return mapMRC;
+}
+
+template Header make_header<1>(const MultiResolutionAnalysis<1> &mra, int coefType, int coefSize, int64_t nNodes, int nScales);
+template Header make_header<2>(const MultiResolutionAnalysis<2> &mra, int coefType, int coefSize, int64_t nNodes, int nScales);
+template Header make_header<3>(const MultiResolutionAnalysis<3> &mra, int coefType, int coefSize, int64_t nNodes, int nScales);
+
+template bool check_header<1>(const Header &header, const MultiResolutionAnalysis<1> &mra);
+template bool check_header<2>(const Header &header, const MultiResolutionAnalysis<2> &mra);
+template bool check_header<3>(const Header &header, const MultiResolutionAnalysis<3> &mra);
+
+template InteropHeader make_interop_header<1>(const MultiResolutionAnalysis<1> &mra, int coefType, int64_t nNodes);
+template InteropHeader make_interop_header<2>(const MultiResolutionAnalysis<2> &mra, int coefType, int64_t nNodes);
+template InteropHeader make_interop_header<3>(const MultiResolutionAnalysis<3> &mra, int coefType, int64_t nNodes);
+
+} // namespace tree_file
+} // namespace mrcpp
@@ -0,0 +1,164 @@
+/*
+ * MRCPP, a numerical library based on multiresolution analysis and
+ * the multiwavelet basis which provide low-scaling algorithms as well as
+ * rigorous error control in numerical computations.
+ * Copyright (C) 2021 Stig Rune Jensen, Jonas Juselius, Luca Frediani and contributors.
+ *
+ * This file is part of MRCPP.
+ *
+ * MRCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MRCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with MRCPP.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * For information on the complete list of contributors to MRCPP, see:
+ * <https://mrcpp.readthedocs.io/>
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "MRCPP/mrcpp_declarations.h"
+
+namespace mrcpp {
+
+/** @brief Binary file format of FunctionTree::saveTree
+ *
+ * @details The file is self-describing and independent of the memory layout
+ * of the library, so it can be read by other binaries, streamed, or mapped
+ * into memory and accessed in place. It consists of six sections:
+ *
+ *  - Header:       file version, endianness, MRA, scalar type and offsets
+ *  - Node table:   one NodeEntry per node, breadth first from the root nodes,
+ *                  with the 2^D siblings of each parent stored consecutively
+ *  - Scale index:  one ScaleEntry per scale, with the range of the node table
+ *                  and the range of translations of the nodes on that scale
+ *  - Norms:        the 2^D component norms of each node, in node table order
+ *  - Coefficients: nCoefs scalars per node, in node table order, as one
+ *                  contiguous array starting at an aligned offset
+ *  - Checksums:    one checksum per block of blockSize nodes of coefficients
+ *
+ * All numbers are stored in the byte order of the writer, which is recorded
+ * in the header, and are swapped by the reader if necessary.
+ */
+namespace tree_file {
+
+const int Version = 3;
+const uint32_t EndianMark = 0x01020304;
+const int BlockSize = 64; ///< Nodes per checksummed coefficient block
+const int Alignment = 64; ///< Alignment of the coefficient section
+
+enum CoefType : int32_t { Real64 = 0, Complex64 = 1, Real32 = 2, Complex32 = 3 };
+enum HeaderFlag : int32_t { Periodic = 1, Conjugate = 2 };
+enum NodeFlag : int32_t { HasCoefs = 1, EndNode = 2, HasChildren = 4 };
+
+struct Header {
+    char magic[8];          ///< "MRCTREE"
+    uint32_t version;       ///< Format version
+    uint32_t endian;        ///< EndianMark in the byte order of the writer
+    int32_t dim;            ///< Dimension D
+    int32_t coefType;       ///< CoefType of the stored coefficients
+    int32_t coefSize;       ///< Bytes per coefficient
+    int32_t order;          ///< Polynomial order of the scaling basis
+    int32_t scalingType;    ///< Legendre or Interpol
+    int32_t maxDepth;       ///< Maximum depth of the MRA
+    int32_t rootScale;      ///< Scale of the root nodes
+    int32_t nBoxes[3];      ///< Root boxes in each direction
+    int32_t corner[3];      ///< Translation of the corner root box
+    int32_t flags;          ///< HeaderFlag bits
+    double scaling[3];      ///< Scaling factors of the world box
+    int64_t nNodes;         ///< Number of nodes in the node table
+    int32_t nCoefs;         ///< Coefficients per node, 2^D (k+1)^D
+    int32_t blockSize;      ///< Nodes per checksum block
+    int64_t nodeOffset;     ///< File offset of the node table
+    int64_t coefOffset;     ///< File offset of the coefficients
+    int64_t checksumOffset; ///< File offset of the checksums
+    int64_t normOffset;     ///< File offset of the node norms, zero in version 1
+    int64_t scaleOffset;    ///< File offset of the scale index, zero before version 3
+    int32_t nScales;        ///< Number of entries in the scale index
+    int32_t reserved;
+};
+
+struct NodeEntry {
+    int32_t scale;
+    int32_t flags; ///< NodeFlag bits
+    int32_t l[3];  ///< Translation, unused directions are zero
+};
+
+struct ScaleEntry {
+    int32_t scale;
+    int32_t lMin[3]; ///< Smallest translation in each direction
+    int32_t lMax[3]; ///< Largest translation in each direction
+    int32_t reserved;
+    int64_t firstNode; ///< Node table index of the first node on this scale
+    int64_t nNodes;    ///< Number of nodes on this scale
+};
+
+/** @brief Header of the binary interop format of FunctionTree::saveTreeBIN
+ *
+ * @details The interop format holds the same information as the text format
+ * of FunctionTree::saveTreeTXT, in MADNESS conventions: the function values
+ * at the quadrature points of the 2^D children of each end node, with scales
+ * counted from zero at the world box and translations from zero at its lower
+ * corner. It consists of three sections:
+ *
+ *  - Header:  InteropHeader, with the world box and the offsets
+ *  - Index:   one InteropEntry per node, scale and translation
+ *  - Values:  nValues scalars per node, in index order and with the
+ *             quadrature points in MADNESS order (z fastest, descending),
+ *             as one contiguous array starting at an aligned offset
+ *
+ * Byte order is handled as in the tree file format.
+ */
+struct InteropHeader {
+    char magic[8];       ///< "MRCMADN"
+    uint32_t version;    ///< Format version
+    uint32_t endian;     ///< EndianMark in the byte order of the writer
+    int32_t dim;         ///< Dimension D
+    int32_t coefType;    ///< Real64 or Complex64
+    int32_t kp1;         ///< Quadrature points in each direction
+    int32_t nValues;     ///< Values per node, (k+1)^D
+    double lower[3];     ///< Lower bounds of the world box
+    double upper[3];     ///< Upper bounds of the world box
+    int64_t nNodes;      ///< Number of nodes in the index
+    int64_t indexOffset; ///< File offset of the index
+    int64_t valueOffset; ///< File offset of the values
+};
+
+struct InteropEntry {
+    int32_t scale;
+    int32_t l[3]; ///< Translation, unused directions are zero
+};
+
+static_assert(sizeof(Header) == 160, "Unexpected padding in tree file header");
+static_assert(sizeof(NodeEntry) == 20, "Unexpected padding in tree file node entry");
+static_assert(sizeof(ScaleEntry) == 48, "Unexpected padding in tree file scale entry");
+static_assert(sizeof(InteropHeader) == 104, "Unexpected padding in interop file header");
+static_assert(sizeof(InteropEntry) == 16, "Unexpected padding in interop file entry");
+
+template <int D> Header make_header(const MultiResolutionAnalysis<D> &mra, int coefType, int coefSize, int64_t nNodes, int nScales);
+template <int D> bool check_header(const Header &header, const MultiResolutionAnalysis<D> &mra);
+
+bool is_tree_file(const Header &header);
+bool swap_header(Header &header);
+void swap_bytes(char *data, int64_t nWords, int wordSize);
+std::vector<ScaleEntry> make_scale_index(const NodeEntry *entries, int64_t nNodes);
+uint64_t checksum(const char *data, int64_t size, uint64_t hash = 14695981039346656037ull);
+
+template <int D> InteropHeader make_interop_header(const MultiResolutionAnalysis<D> &mra, int coefType, int64_t nNodes);
+bool is_interop_file(const InteropHeader &header);
+bool swap_interop_header(InteropHeader &header);
+std::vector<int> madness_order(int dim, int kp1);
+
+} // namespace tree_file
+} // namespace mrcpp
@@ -1,7 +1,20 @@
 #include "Printer.h"
 #include "Timer.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "Bank.h"
+#include "BankWindow.h"
 
 namespace mrcpp {
 
@@ -11,6 +24,118 @@ using namespace std;
 int metadata_block[3]; // can add more metadata in future
 int const size_metadata = 3;
 
+BankStatistics clientStatistics;
+
+namespace {
+// names of the messages, in the order of the enum
+const char *message_names[] = {
+    "CLOSE_BANK", "CLEAR_BANK", "NEW_ACCOUNT", "CLOSE_ACCOUNT", "GET_ORBITAL",
+    "GET_FUNCTION_AND_WAIT", "GET_FUNCTION_AND_DELETE", "SAVE_ORBITAL", "GET_FUNCTION", "SAVE_FUNCTION",
+    "GET_DATA", "SAVE_DATA", "SAVE_NODEDATA", "GET_NODEDATA", "GET_NODEBLOCK",
+    "GET_ORBBLOCK", "CLEAR_BLOCKS", "GET_MAXTOTDATA", "GET_TOTDATA", "INIT_TASKS",
+    "GET_NEXTTASK", "PUT_READYTASK", "DEL_READYTASK", "GET_READYTASK", "GET_READYTASK_DEL",
+    "GET_NODEBLOCK_ASYNC", "SAVE_NODEDATA_MANY", "SAVE_DATA_MANY", "GET_DATA_MANY", "GET_STATISTICS"
+};
+
+std::string message_name(int message) {
+    int n = sizeof(message_names) / sizeof(message_names[0]);
+    return (message >= 0 and message < n) ? message_names[message] : std::to_string(message);
+}
+
+// records the time of a client request when it goes out of scope. Requests
+// made inside another request (e.g. the items of a batch) are not recorded.
+class RequestTimer {
+public:
+    RequestTimer(int account, int message, long long bytes_in = 0, long long bytes_out = 0)
+            : timer(bank_stats)
+            , outer(depth++ == 0)
+            , account(account)
+            , message(message)
+            , bytes_in(bytes_in)
+            , bytes_out(bytes_out) {}
+    ~RequestTimer() {
+        depth--;
+        if (bank_stats and this->outer) clientStatistics.add(this->account, this->message, this->timer.elapsed(), this->bytes_in, this->bytes_out);
+    }
+
+private:
+    static thread_local int depth; // requests in progress on this thread
+    Timer timer;
+    bool outer;
+    int account;
+    int message;
+    long long bytes_in;
+    long long bytes_out;
+};
+thread_local int RequestTimer::depth = 0;
+} // namespace
+
+void BankStatistics::add(int account, int message, double time, long long bytes_in, long long bytes_out) {
+    MRCPP_SET_OMP_LOCK();
+    Entry &entry = this->entries[{account, message}];
+    entry.count++;
+    entry.bytes_in += bytes_in;
+    entry.bytes_out += bytes_out;
+    entry.time += time;
+    entry.max_time = std::max(entry.max_time, time);
+    int bin = 0;
+    for (double t = 1.0e-6; bin < nBins - 1 and time >= t; t *= 2.0) bin++;
+    entry.histogram[bin]++;
+    MRCPP_UNSET_OMP_LOCK();
+}
+
+void BankStatistics::add_queue_depth(int depth) {
+    MRCPP_SET_OMP_LOCK();
+    this->queue_samples++;
+    this->queue_sum += depth;
+    this->max_queue_depth = std::max(this->max_queue_depth, depth);
+    MRCPP_UNSET_OMP_LOCK();
+}
+
+void BankStatistics::clear() {
+    MRCPP_SET_OMP_LOCK();
+    this->entries.clear();
+    this->queue_samples = 0;
+    this->queue_sum = 0;
+    this->max_queue_depth = 0;
+    MRCPP_UNSET_OMP_LOCK();
+}
+
+/** @brief The statistics as one JSON object
+ * @param[in] role: "bank" or "client"
+ */
+std::string BankStatistics::json(const std::string &role) const {
+    std::ostringstream out;
+    out.precision(9);
+    MRCPP_SET_OMP_LOCK();
+    double mean_queue_depth = (this->queue_samples > 0) ? static_cast<double>(this->queue_sum) / this->queue_samples : 0.0;
+    out << "{\"rank\": " << world_rank << ", \"role\": \"" << role << "\", ";
+    out << "\"max_queue_depth\": " << this->max_queue_depth << ", \"mean_queue_depth\": " << mean_queue_depth << ", ";
+    out << "\"bin_upper_us\": [";
+    for (int i = 0; i < nBins - 1; i++) out << (i > 0 ? ", " : "") << (1ll << i);
+    out << "],\n \"requests\": [";
+    bool first = true;
+    for (auto &it : this->entries) {
+        const Entry &entry = it.second;
+        out << (first ? "\n" : ",\n");
+        out << "  {\"account\": " << it.first.first << ", \"message\": \"" << message_name(it.first.second) << "\", ";
+        out << "\"count\": " << entry.count << ", \"bytes_in\": " << entry.bytes_in << ", \"bytes_out\": " << entry.bytes_out << ", ";
+        out << "\"time\": " << entry.time << ", \"max_time\": " << entry.max_time << ", \"histogram\": [";
+        for (int i = 0; i < nBins; i++) out << (i > 0 ? ", " : "") << entry.histogram[i];
+        out << "]}";
+        first = false;
+    }
+    out << "]}\n";
+    MRCPP_UNSET_OMP_LOCK();
+    return out.str();
+}
+
+void BankStatistics::write(const std::string &file, const std::string &role) const {
+    std::ofstream out(file);
+    out << json(role);
+    if (not out) MSG_ERROR("Cannot write bank statistics to " << file);
+}
+
 Bank::~Bank() {
     // delete all data and accounts
 }
@@ -27,6 +152,109 @@ struct OrbBlock_struct {
     std::vector<int> id;        // the nodeid of the data
     // note that N_rows can be different inside the same orbblock: root node have scaling and wavelets, other nodes have only wavelets
 };
+namespace {
+#ifdef MRCPP_HAS_MPI
+// a function as bytes: its metadata followed by the trees of its components
+void write_func(std::ostream &out, CompFunction<3> &func) {
+    out.write(reinterpret_cast<const char *>(&func.func_ptr->data), sizeof(CompFunctionData<3>));
+    for (int i = 0; i < func.Ncomp(); i++) {
+        if (func.isreal()) func.CompD[i]->saveTree(out);
+        else func.CompC[i]->saveTree(out);
+    }
+}
+
+void read_func(std::istream &in, CompFunction<3> &func) {
+    int func_ncomp_in = func.Ncomp();
+    in.read(reinterpret_cast<char *>(&func.func_ptr->data), sizeof(CompFunctionData<3>));
+    if (func_ncomp_in < func.Ncomp()) func.alloc(func.Ncomp());
+    for (int i = 0; i < func.Ncomp(); i++) {
+        if (func.isreal()) func.CompD[i]->loadTree(in);
+        else func.CompC[i]->loadTree(in);
+    }
+}
+#endif
+
+// Disk tier of the bank, used if mpi::bank_mem_limit > 0. The memory chunks
+// are memory mapped segment files in the scratch directory. When the resident
+// data exceed the limit, the least recently used chunks and functions are
+// evicted: the pages of a chunk are written back and dropped, and the kernel
+// reloads them at the next access; a function is written to a file and freed,
+// and is read back when it is requested.
+struct spill_struct {
+    struct item {
+        double *chunk = nullptr; // start of the chunk, nullptr for a function
+        long long bytes = 0;     // size of the chunk
+        int fd = -1;             // segment file of the chunk
+        int account = -1;        // account and deposit index of a function
+        int ix = -1;
+        long long size = 0; // kB
+        bool on_disk = false;
+    };
+    std::list<item> resident;                                       // most recently used first
+    std::list<item> evicted;                                        // on disk only
+    std::map<double *, std::list<item>::iterator> chunks;           // items by start of the chunk
+    std::map<std::pair<int, int>, std::list<item>::iterator> funcs; // items by account and deposit index
+    long long resident_size = 0;                                    // kB
+    int nsegments = 0;
+
+    bool enabled() const { return mpi::bank_mem_limit > 0; }
+
+    std::string path(const std::string &name) const {
+        std::string dir = mpi::bank_scratch;
+        if (dir.empty() and std::getenv("TMPDIR") != nullptr) dir = std::getenv("TMPDIR");
+        if (dir.empty()) dir = "/tmp";
+        // the pid alone is not unique on a shared file system, or between containers
+        return dir + "/mrcpp_bank_" + std::to_string(getpid()) + "_" + std::to_string(world_rank) + "_" + name;
+    }
+    std::string func_path(int account, int ix) const { return path("func_" + std::to_string(account) + "_" + std::to_string(ix)); }
+
+    // the item that holds the data, or nullptr if it is not in a segment file
+    item *find(const double *data) {
+        auto it = chunks.upper_bound(const_cast<double *>(data));
+        if (it == chunks.begin()) return nullptr;
+        item &c = *(--it)->second;
+        return (data < c.chunk + c.bytes / sizeof(double)) ? &c : nullptr;
+    }
+};
+spill_struct spill;
+
+double *alloc_chunk(long long size) {
+    if (not spill.enabled()) return new double[size];
+    spill_struct::item c;
+    c.bytes = size * sizeof(double);
+    c.size = c.bytes / 1024;
+    std::string name = spill.path("segment_" + std::to_string(spill.nsegments++));
+    c.fd = ::open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (c.fd < 0 or ftruncate(c.fd, c.bytes) != 0) MSG_ABORT("Cannot create bank segment file " << name);
+    void *p = mmap(nullptr, c.bytes, PROT_READ | PROT_WRITE, MAP_SHARED, c.fd, 0);
+    if (p == MAP_FAILED) MSG_ABORT("Cannot map bank segment file " << name);
+    unlink(name.c_str()); // removed by the system when it is closed
+    c.chunk = static_cast<double *>(p);
+    spill.resident.push_front(c);
+    spill.chunks[c.chunk] = spill.resident.begin();
+    spill.resident_size += c.size;
+    return c.chunk;
+}
+
+void free_chunk(double *chunk) {
+    auto it = spill.chunks.find(chunk);
+    if (it == spill.chunks.end()) {
+        delete[] chunk;
+        return;
+    }
+    auto c = it->second;
+    munmap(c->chunk, c->bytes);
+    ::close(c->fd);
+    if (c->on_disk) {
+        spill.evicted.erase(c);
+    } else {
+        spill.resident_size -= c->size;
+        spill.resident.erase(c);
+    }
+    spill.chunks.erase(it);
+}
+} // namespace
+
 struct mem_struct {
     std::vector<double *> chunk_p; // vector with allocated chunks
     int p = -1;                    // position of next available memory (not allocated if < 0)
@@ -37,12 +265,12 @@ struct mem_struct {
         if (p < 0 or size > chunk_size or p + size > chunk_size) { // allocate new chunk of memory
             if (size > 1024 * 1024) {
                 // make a special chunk just for this
-                double *m_p = new double[size];
+                double *m_p = alloc_chunk(size);
                 chunk_p.push_back(m_p);
                 p = -1;
                 return m_p;
             } else {
-                double *m_p = new double[chunk_size];
+                double *m_p = alloc_chunk(chunk_size);
                 chunk_p.push_back(m_p);
                 p = 0;
             }
@@ -51,13 +279,40 @@ struct mem_struct {
         p += size;
         return m_p;
     }
+    // give the memory back, which is only possible for the data with a chunk of their own
+    void release(double *data, int size) {
+        if (size <= 1024 * 1024) return; // part of a chunk, freed with the account
+        auto it = std::find(chunk_p.begin(), chunk_p.end(), data);
+        if (it == chunk_p.end()) return;
+        chunk_p.erase(it);
+        free_chunk(data);
+    }
 };
 std::map<int, std::map<int, Blockdata_struct> *> get_nodeid2block; // to get block from its nodeid (all coeff for one node)
 std::map<int, std::map<int, OrbBlock_struct> *> get_orbid2block;   // to get block from its orbid
 
 std::map<int, mem_struct *> mem;
 
-int const MIN_SCALE = -999; // Smaller than smallest scale
+// append a column to the block of nodeid and to the block of orbid, and return where to store its data
+double *new_nodedata(std::map<int, Blockdata_struct> &nodeid2block, std::map<int, OrbBlock_struct> &orbid2block, mem_struct &mem, int nodeid, int orbid, int size) {
+    Blockdata_struct &block = nodeid2block[nodeid];
+    block.id2data[orbid] = block.data.size(); // internal index of the data in the block
+    double *data_p = mem.get_mem(size);
+    block.data.push_back(data_p);
+    block.id.push_back(orbid);
+    if (block.N_rows > 0 and block.N_rows != size) cout << " ERROR block size incompatible " << block.N_rows << " " << size << endl;
+    block.N_rows = size;
+
+    OrbBlock_struct &orbblock = orbid2block[orbid];
+    orbblock.id2data[nodeid] = orbblock.data.size(); // internal index of the data in the block
+    orbblock.data.push_back(data_p);
+    orbblock.id.push_back(nodeid);
+    return data_p;
+}
+
+int const MIN_SCALE = -999;      // Smaller than smallest scale
+int const max_batch = 1024 * 1024; // largest payload of a batched message, in doubles
+long long const max_prefetch = 64ll * 1024 * 1024; // memory for the buffers of a NodeBlockPrefetch, in bytes
 int naccounts = 0;
 
 void Bank::open() {
@@ -75,9 +330,13 @@ void Bank::open() {
     int next_task = 0;
     int tot_ntasks = 0;
     std::map<int, std::vector<int>> readytasks;
+    int nwaiting = 0; // clients waiting in a queue
     // The bank never goes out of this loop until it receives a close message!
     while (true) {
         MPI_Recv(messages, message_size, MPI_INT, MPI_ANY_SOURCE, MPI_ANY_TAG, comm_bank, &status);
+        Timer request_timer(bank_stats);
+        long long bytes_in = 0;  // payload received for this request
+        long long bytes_out = 0; // payload sent for this request
         if (printinfo)
             std::cout << world_rank << " got message " << messages[0] << " from " << status.MPI_SOURCE << " account " << messages[1] << " last account " << max_account_id << " message2 "
                       << messages[2] << std::endl;
@@ -86,12 +345,19 @@ void Bank::open() {
         // can be called directly:
         if (message == CLOSE_BANK) {
             if (is_bank and printinfo) std::cout << "Bank is closing" << std::endl;
+            if (bank_stats) this->statistics.write("bank_stats_" + std::to_string(world_rank) + ".json", "bank");
             this->clear_bank();
+            // remove the files of evicted functions in accounts that are still open
+            while (spill.funcs.size() > 0) spill_forget(spill.funcs.begin()->first.first, spill.funcs.begin()->first.second);
             break; // close bank, i.e stop listening for incoming messages
         } else if (message == GET_MAXTOTDATA) {
             int maxsize_int = maxsize / 1024; // convert into MB
             MPI_Send(&maxsize_int, 1, MPI_INT, status.MPI_SOURCE, 1171, comm_bank);
             continue;
+        } else if (message == GET_STATISTICS) {
+            std::string stats = this->statistics.json("bank");
+            MPI_Send(stats.data(), stats.size(), MPI_CHAR, status.MPI_SOURCE, 1173, comm_bank);
+            continue;
         } else if (message == GET_TOTDATA) {
             int maxsize_int = totcurrentsize / 1024; // convert into MB
             MPI_Send(&maxsize_int, 1, MPI_INT, status.MPI_SOURCE, 1172, comm_bank);
@@ -176,7 +442,9 @@ void Bank::open() {
                     size = block.N_rows;              // number of doubles to fetch
                     if (size != messages[4]) std::cout << "ERROR nodedata has wrong size" << std::endl;
                     double *data_p = block.data[dataindex];
+                    spill_touch(data_p);
                     if (size > 0) MPI_Send(data_p, size, MPI_DOUBLE, status.MPI_SOURCE, 3, comm_bank);
+                    bytes_out = 8ll * size;
                 } else {
                     // send entire block. First make one contiguous superblock
                     // Prepare the data as one contiguous block
@@ -185,6 +453,7 @@ void Bank::open() {
                     size = block.N_rows * block.data.size();
                     if (printinfo) std::cout << " rewrite into superblock " << block.data.size() << " " << block.N_rows << " nodeid " << nodeid << std::endl;
                     for (int j = 0; j < block.data.size(); j++) {
+                        spill_touch(block.data[j]);
                         for (int i = 0; i < block.N_rows; i++) { DataBlock(i, j) = block.data[j][i]; }
                     }
                     dataindex = 0; // start from first column
@@ -196,6 +465,7 @@ void Bank::open() {
                     // send info about the id of each column
                     MPI_Send(block.id.data(), metadata_block[1], MPI_INT, status.MPI_SOURCE, 2, comm_bank);
                     if (size > 0) MPI_Send(DataBlock.data(), size, MPI_DOUBLE, status.MPI_SOURCE, 3, comm_bank);
+                    bytes_out = 8ll * size;
                 }
             } else {
                 if (printinfo) std::cout << " block " << nodeid << " does not exist " << std::endl;
@@ -237,6 +507,7 @@ void Bank::open() {
                 for (int j = 0; j < block.data.size(); j++) {
                     int nodeid = block.id[j];
                     int Nrows = nodeid2block[nodeid].N_rows;
+                    spill_touch(block.data[j]);
                     for (int i = 0; i < Nrows; i++) { coeff[ij++] = block.data[j][i]; }
                 }
                 // send info about the size of the superblock
@@ -246,6 +517,7 @@ void Bank::open() {
                 MPI_Send(metadata_block, size_metadata, MPI_INT, status.MPI_SOURCE, 1, comm_bank);
                 MPI_Send(block.id.data(), metadata_block[1], MPI_INT, status.MPI_SOURCE, 2, comm_bank);
                 MPI_Send(coeff.data(), size, MPI_DOUBLE, status.MPI_SOURCE, 3, comm_bank);
+                bytes_out = 8ll * size;
             } else {
                 // it is possible and allowed that the block has not been written
                 if (printinfo) std::cout << " block does not exist " << orbid << " " << orbid2block.count(orbid) << std::endl;
@@ -255,6 +527,25 @@ void Bank::open() {
                 metadata_block[2] = 0; // total size = rows*columns
                 MPI_Send(metadata_block, size_metadata, MPI_INT, status.MPI_SOURCE, 1, comm_bank);
             }
+        } else if (message == GET_NODEBLOCK_ASYNC) {
+            // the whole block in one message, for NodeBlockPrefetch: number of columns, their ids and the data
+            int nodeid = messages[2];
+            int tag = messages[3]; // chosen by the client, which has already posted the receive
+            std::vector<double> buffer(1, 0.0);
+            if (nodeid2block.count(nodeid)) {
+                Blockdata_struct &block = nodeid2block[nodeid];
+                int ncols = block.data.size();
+                buffer.resize(1 + ncols + block.N_rows * ncols);
+                buffer[0] = ncols;
+                double *data_p = buffer.data() + 1 + ncols;
+                for (int j = 0; j < ncols; j++) {
+                    buffer[1 + j] = block.id[j];
+                    spill_touch(block.data[j]);
+                    for (int i = 0; i < block.N_rows; i++) data_p[j * block.N_rows + i] = block.data[j][i];
+                }
+            }
+            MPI_Send(buffer.data(), buffer.size(), MPI_DOUBLE, status.MPI_SOURCE, tag, comm_bank);
+            bytes_out = 8ll * buffer.size();
         }
 
         else if (message == GET_FUNCTION or message == GET_FUNCTION_AND_WAIT or message == GET_FUNCTION_AND_DELETE or message == GET_FUNCTION or message == GET_DATA) {
@@ -283,6 +574,7 @@ void Bank::open() {
                 } else {
                     // the id does not exist. Put in queue and Wait until it is defined
                     if (printinfo) std::cout << world_rank << " queuing " << id << " " << id2ix.count(id) << ix << std::endl;
+                    nwaiting++;
                     if (id2qu[id] == 0) {
                         queue.push_back({id, {status.MPI_SOURCE}});
                         id2qu[id] = queue.size() - 1;
@@ -299,43 +591,122 @@ void Bank::open() {
                         int found = 1;
                         MPI_Send(&found, 1, MPI_INT, status.MPI_SOURCE, 117, comm_bank);
                     }
+                    spill_touch(account, ix);
                     send_function(*deposits[ix].orb, status.MPI_SOURCE, 1, comm_bank);
+                    bytes_out = 1024ll * deposits[ix].orb->getSizeNodes();
                     if (message == GET_FUNCTION_AND_DELETE) {
                         currentsize[account] -= deposits[ix].orb->getSizeNodes();
                         totcurrentsize -= deposits[ix].orb->getSizeNodes();
+                        spill_forget(account, ix);
                         deposits[ix].orb->free();
                         id2ix[id] = 0;
                     }
                 }
-                if (message == GET_DATA) { MPI_Send(deposits[ix].data, deposits[ix].datasize, MPI_DOUBLE, status.MPI_SOURCE, 1, comm_bank); }
+                if (message == GET_DATA) {
+                    spill_touch(deposits[ix].data);
+                    MPI_Send(deposits[ix].data, deposits[ix].datasize, MPI_DOUBLE, status.MPI_SOURCE, 1, comm_bank);
+                    bytes_out = 8ll * deposits[ix].datasize;
+                }
             }
         } else if (message == SAVE_NODEDATA) {
             int nodeid = messages[2]; // which block to write
             int orbid = messages[3];  // which part of the block
             int size = messages[4];   // number of doubles
 
-            // test if the block exists already
             if (printinfo) std::cout << world_rank << " save data nodeid " << nodeid << " size " << size << std::endl;
             // append the incoming data
-            Blockdata_struct &block = nodeid2block[nodeid];
-            block.id2data[orbid] = nodeid2block[nodeid].data.size(); // internal index of the data in the block
-            double *data_p = mem[account]->get_mem(size);            // new double[size];
-            currentsize[account] += size / 128;                      // converted into kB
-            totcurrentsize += size / 128;                            // converted into kB
+            double *data_p = new_nodedata(nodeid2block, orbid2block, *mem[account], nodeid, orbid, size);
+            currentsize[account] += size / 128; // converted into kB
+            totcurrentsize += size / 128;       // converted into kB
             this->maxsize = std::max(totcurrentsize, this->maxsize);
-            block.data.push_back(data_p);
-            block.id.push_back(orbid);
-            if (block.N_rows > 0 and block.N_rows != size) cout << " ERROR block size incompatible " << block.N_rows << " " << size << endl;
-            block.N_rows = size;
-
-            OrbBlock_struct &orbblock = orbid2block[orbid];
-            orbblock.id2data[nodeid] = orbblock.data.size(); // internal index of the data in the block
-            orbblock.data.push_back(data_p);
-            orbblock.id.push_back(nodeid);
-            // orbblock.N_rows.push_back(size);
 
+            spill_touch(data_p);
             MPI_Recv(data_p, size, MPI_DOUBLE, status.MPI_SOURCE, 1, comm_bank, &status);
+            bytes_in = 8ll * size;
             if (printinfo) std::cout << " written block " << nodeid << " id " << orbid << " subblocks " << nodeid2block[nodeid].data.size() << std::endl;
+        } else if (message == SAVE_NODEDATA_MANY) {
+            // payload: orbid, nodeid and size of each item, followed by all the data
+            int count = messages[2];
+            std::vector<double> payload(messages[3]);
+            MPI_Recv(payload.data(), payload.size(), MPI_DOUBLE, status.MPI_SOURCE, 1, comm_bank, &status);
+            bytes_in = 8ll * payload.size();
+            const double *in_p = payload.data() + 3 * count;
+            for (int k = 0; k < count; k++) {
+                int orbid = payload[3 * k];
+                int nodeid = payload[3 * k + 1];
+                int size = payload[3 * k + 2];
+                double *data_p = new_nodedata(nodeid2block, orbid2block, *mem[account], nodeid, orbid, size);
+                currentsize[account] += size / 128; // converted into kB
+                totcurrentsize += size / 128;       // converted into kB
+                spill_touch(data_p);
+                std::copy(in_p, in_p + size, data_p);
+                in_p += size;
+            }
+            this->maxsize = std::max(totcurrentsize, this->maxsize);
+        } else if (message == SAVE_DATA_MANY) {
+            // payload: the ids, followed by the data of each id
+            int count = messages[2];
+            int size = messages[3];
+            std::vector<double> payload(count * (1 + size));
+            MPI_Recv(payload.data(), payload.size(), MPI_DOUBLE, status.MPI_SOURCE, 1, comm_bank, &status);
+            bytes_in = 8ll * payload.size();
+            for (int k = 0; k < count; k++) {
+                int id = payload[k];
+                const double *in_p = payload.data() + count + k * size;
+                int ix = id2ix[id];
+                if (ix == 0) {
+                    ix = deposits.size();
+                    deposits.resize(ix + 1);
+                    deposits[ix].hasdata = false;
+                    id2ix[id] = ix;
+                }
+                if (not deposits[ix].hasdata or deposits[ix].datasize < size) {
+                    if (deposits[ix].hasdata) {
+                        // the old data are too small to be overwritten
+                        currentsize[account] -= deposits[ix].datasize / 128;
+                        totcurrentsize -= deposits[ix].datasize / 128;
+                        mem[account]->release(deposits[ix].data, deposits[ix].datasize);
+                    }
+                    deposits[ix].data = mem[account]->get_mem(size);
+                    currentsize[account] += size / 128; // converted into kB
+                    totcurrentsize += size / 128;       // converted into kB
+                    deposits[ix].hasdata = true;
+                }
+                deposits[ix].id = id;
+                deposits[ix].datasize = size;
+                deposits[ix].source = status.MPI_SOURCE;
+                spill_touch(deposits[ix].data);
+                std::copy(in_p, in_p + size, deposits[ix].data);
+                if (id2qu[id] != 0) {
+                    // someone is waiting for those data. Send to them
+                    int iq = id2qu[id];
+                    for (int iqq : queue[iq].clients) MPI_Send(deposits[ix].data, size, MPI_DOUBLE, iqq, 1, comm_bank);
+                    nwaiting -= queue[iq].clients.size();
+                    bytes_out += 8ll * size * queue[iq].clients.size();
+                    queue[iq].clients.clear();
+                    queue[iq].id = -1;
+                    id2qu.erase(id);
+                }
+            }
+            this->maxsize = std::max(totcurrentsize, this->maxsize);
+        } else if (message == GET_DATA_MANY) {
+            // reply: one flag for each id (zero if it does not exist yet), followed by the data of each id
+            int count = messages[2];
+            int size = messages[3];
+            std::vector<int> ids(count);
+            MPI_Recv(ids.data(), count, MPI_INT, status.MPI_SOURCE, 1, comm_bank, &status);
+            std::vector<double> reply(count * (1 + size), 0.0);
+            for (int k = 0; k < count; k++) {
+                auto it = id2ix.find(ids[k]);
+                if (it == id2ix.end() or it->second == 0 or not deposits[it->second].hasdata) continue;
+                deposit &dep = deposits[it->second];
+                spill_touch(dep.data);
+                reply[k] = 1.0;
+                std::copy(dep.data, dep.data + std::min(size, dep.datasize), reply.data() + count + k * size);
+            }
+            MPI_Send(reply.data(), reply.size(), MPI_DOUBLE, status.MPI_SOURCE, 1, comm_bank);
+            bytes_in = 4ll * count;
+            bytes_out = 8ll * reply.size();
         } else if (message == SAVE_FUNCTION or message == SAVE_DATA) {
             // make a new deposit
             int id = messages[2];
@@ -384,17 +755,22 @@ void Bank::open() {
             id2ix[deposits[ix].id] = ix;
             deposits[ix].source = status.MPI_SOURCE;
             if (message == SAVE_FUNCTION) {
+                spill_forget(account, ix); // an evicted old version is not read back
                 recv_function(*deposits[ix].orb, deposits[ix].source, 1, comm_bank);
+                bytes_in = 1024ll * deposits[ix].orb->getSizeNodes();
                 if (exist_flag == 0) {
                     currentsize[account] += deposits[ix].orb->getSizeNodes();
                     totcurrentsize += deposits[ix].orb->getSizeNodes();
                     this->maxsize = std::max(totcurrentsize, this->maxsize);
                 }
+                spill_touch(account, ix);
             }
             if (message == SAVE_DATA) {
                 datasize = messages[3];
                 deposits[ix].datasize = datasize;
+                spill_touch(deposits[ix].data);
                 MPI_Recv(deposits[ix].data, datasize, MPI_DOUBLE, deposits[ix].source, 1, comm_bank, &status);
+                bytes_in = 8ll * datasize;
             }
             if (id2qu[deposits[ix].id] != 0) {
                 // someone is waiting for those data. Send to them
@@ -404,6 +780,7 @@ void Bank::open() {
                     if (message == SAVE_FUNCTION) { send_function(*deposits[ix].orb, iqq, 1, comm_bank); }
                     if (message == SAVE_DATA) { MPI_Send(deposits[ix].data, messages[3], MPI_DOUBLE, iqq, 1, comm_bank); }
                 }
+                nwaiting -= queue[iq].clients.size();
                 queue[iq].clients.clear(); // cannot erase entire queue[iq], because that would require to shift all the
                                            // id2qu value larger than iq
                 queue[iq].id = -1;
@@ -441,6 +818,10 @@ void Bank::open() {
             if (nready > 0) MPI_Send(readytasks[messages[2]].data(), nready, MPI_INT, status.MPI_SOURCE, 845, mpi::comm_bank);
             if (nready > 0) readytasks[messages[2]].resize(0);
         }
+        if (bank_stats) {
+            this->statistics.add(account, message, request_timer.elapsed(), bytes_in, bytes_out);
+            this->statistics.add_queue_depth(nwaiting);
+        }
     }
 #endif
 }
@@ -479,6 +860,7 @@ void Bank::remove_account(int account) {
     }
     std::vector<deposit> &deposits = *get_deposits[account];
     for (int ix = 1; ix < deposits.size(); ix++) {
+        spill_forget(account, ix);
         if (deposits[ix].orb != nullptr) deposits[ix].orb->free();
         if (deposits[ix].hasdata) {
             currentsize[account] -= deposits[ix].datasize / 128;
@@ -511,12 +893,113 @@ void Bank::remove_account(int account) {
     get_nodeid2block.erase(account);
     get_orbid2block.erase(account);
 
-    for (double *c_p : mem[account]->chunk_p) delete[] c_p;
+    for (double *c_p : mem[account]->chunk_p) free_chunk(c_p);
     mem.erase(account);
     currentsize.erase(account);
 #endif
 }
 
+/** @brief Mark the memory chunk that holds the data as recently used */
+void Bank::spill_touch(const double *data) {
+#ifdef MRCPP_HAS_MPI
+    if (not spill.enabled()) return;
+    spill_struct::item *c = spill.find(data);
+    if (c == nullptr) return;
+    auto it = spill.chunks[c->chunk];
+    if (c->on_disk) {
+        // the pages are read back by the kernel when they are accessed
+        c->on_disk = false;
+        spill.resident_size += c->size;
+        spill.resident.splice(spill.resident.begin(), spill.evicted, it);
+    } else {
+        spill.resident.splice(spill.resident.begin(), spill.resident, it);
+    }
+    spill_evict();
+#endif
+}
+
+/** @brief Mark a function deposit as recently used, and read it back if it was evicted */
+void Bank::spill_touch(int account, int ix) {
+#ifdef MRCPP_HAS_MPI
+    if (not spill.enabled()) return;
+    CompFunction<3> &func = *(*get_deposits[account])[ix].orb;
+    auto key = std::make_pair(account, ix);
+    auto found = spill.funcs.find(key);
+    if (found == spill.funcs.end()) {
+        spill_struct::item f;
+        f.account = account;
+        f.ix = ix;
+        spill.resident.push_front(f);
+        found = spill.funcs.emplace(key, spill.resident.begin()).first;
+    } else if (found->second->on_disk) {
+        std::string name = spill.func_path(account, ix);
+        std::ifstream in(name, std::ios::binary);
+        if (not in) MSG_ABORT("Cannot read bank spill file " << name);
+        read_func(in, func);
+        in.close();
+        unlink(name.c_str());
+        found->second->on_disk = false;
+        spill.resident.splice(spill.resident.begin(), spill.evicted, found->second);
+    } else {
+        spill.resident_size -= found->second->size;
+        spill.resident.splice(spill.resident.begin(), spill.resident, found->second);
+    }
+    found->second->size = func.getSizeNodes();
+    spill.resident_size += found->second->size;
+    spill_evict();
+#endif
+}
+
+/** @brief Forget a function deposit, and remove its file if it was evicted */
+void Bank::spill_forget(int account, int ix) {
+#ifdef MRCPP_HAS_MPI
+    auto found = spill.funcs.find(std::make_pair(account, ix));
+    if (found == spill.funcs.end()) return;
+    if (found->second->on_disk) {
+        unlink(spill.func_path(account, ix).c_str());
+        spill.evicted.erase(found->second);
+    } else {
+        spill.resident_size -= found->second->size;
+        spill.resident.erase(found->second);
+    }
+    spill.funcs.erase(found);
+#endif
+}
+
+/** @brief Evict the least recently used data until the rest fit in mpi::bank_mem_limit
+ *
+ * @details The most recently used item is never evicted, even if it is larger
+ * than the limit.
+ */
+void Bank::spill_evict() {
+#ifdef MRCPP_HAS_MPI
+    long long limit = 1024ll * bank_mem_limit; // kB
+    while (spill.resident_size > limit and spill.resident.size() > 1) {
+        auto it = std::prev(spill.resident.end());
+        if (it->chunk != nullptr) {
+            // write back the pages and drop them from memory and from the page cache
+            msync(it->chunk, it->bytes, MS_SYNC);
+            madvise(it->chunk, it->bytes, MADV_DONTNEED);
+            posix_fadvise(it->fd, 0, it->bytes, POSIX_FADV_DONTNEED);
+        } else {
+            CompFunction<3> &func = *(*get_deposits[it->account])[it->ix].orb;
+            std::string name = spill.func_path(it->account, it->ix);
+            int fd = ::open(name.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+            if (fd < 0) MSG_ABORT("Cannot create bank spill file " << name);
+            ::close(fd);
+            std::ofstream out(name, std::ios::binary);
+            write_func(out, func);
+            out.close();
+            if (not out) MSG_ABORT("Cannot write bank spill file " << name);
+            func.free();
+        }
+        spill.resident_size -= it->size;
+        it->on_disk = true;
+        spill.evicted.splice(spill.evicted.end(), spill.resident, it);
+    }
+#endif
+}
+
 int Bank::openAccount(int iclient, MPI_Comm comm) {
     // NB: this is a collective call, since we need all the accounts to be synchronized
     int account_id[1] = {-1};
@@ -634,15 +1117,174 @@ std::vector<int> Bank::get_totalsize() {
     return tot;
 }
 
+/** @brief The statistics of each bank rank, as JSON objects (see BankStatistics) */
+std::vector<std::string> Bank::get_statistics() {
+    std::vector<std::string> stats;
+#ifdef MRCPP_HAS_MPI
+    MPI_Status status;
+    int messages[message_size];
+    messages[0] = GET_STATISTICS;
+    for (int i = 0; i < bank_size; i++) {
+        MPI_Send(messages, 1, MPI_INT, bankmaster[i], 0, comm_bank);
+        int size;
+        MPI_Probe(bankmaster[i], 1173, comm_bank, &status);
+        MPI_Get_count(&status, MPI_CHAR, &size);
+        std::string text(size, ' ');
+        MPI_Recv(&text[0], size, MPI_CHAR, bankmaster[i], 1173, comm_bank, &status);
+        stats.push_back(text);
+    }
+#endif
+    return stats;
+}
+
+/** @brief Group the items of a batched request by bank rank
+ *
+ * @param[in] banks: Bank rank of each item, from 0 to nbanks - 1
+ * @param[in] sizes: Size of each item, in doubles
+ * @param[in] nbanks: Number of bank ranks
+ * @param[in] max_size: Largest payload of a batch, in doubles
+ *
+ * @returns The batches in order of bank rank, each as the bank rank and the
+ * indices of its items, in their original order. An item larger than
+ * max_size is a batch of its own.
+ */
+std::vector<std::pair<int, std::vector<int>>> make_batches(const std::vector<int> &banks, const std::vector<long long> &sizes, int nbanks, long long max_size) {
+    std::vector<std::vector<int>> items(nbanks);
+    for (int k = 0; k < banks.size(); k++) items[banks[k]].push_back(k);
+    std::vector<std::pair<int, std::vector<int>>> batches;
+    for (int i = 0; i < nbanks; i++) {
+        long long total = 0;
+        for (int k : items[i]) {
+            if (batches.size() == 0 or batches.back().first != i or total + sizes[k] > max_size) {
+                batches.push_back({i, {}});
+                total = 0;
+            }
+            batches.back().second.push_back(k);
+            total += sizes[k];
+        }
+    }
+    return batches;
+}
+
 // Accounts: (clients)
 
+#ifdef MRCPP_HAS_MPI
+// One-sided accounts (mpi::bank_rma). The data stays on the rank that
+// deposited it, and the index entry is written on a home rank chosen as
+// the bank rank would have been chosen.
+namespace {
+BankWindow::Key node_index_key(const NodeIndex<3> &nIdx) {
+    auto pack = [](int a, int b) { return static_cast<int64_t>((static_cast<uint64_t>(static_cast<uint32_t>(a)) << 32) | static_cast<uint32_t>(b)); };
+    return {BankWindow::NodeData, pack(nIdx.getScale(), nIdx.getTranslation(0)), pack(nIdx.getTranslation(1), nIdx.getTranslation(2))};
+}
+
+int node_index_home(BankWindow &window, const NodeIndex<3> &nIdx) {
+    return window.home(std::abs(nIdx.getTranslation(0) + nIdx.getTranslation(1) + nIdx.getTranslation(2)));
+}
+
+void rma_put(BankWindow &window, int home, const BankWindow::Key &key, int id, int64_t size, const double *data) {
+    int64_t disp = window.store(data, size);
+    window.insert(home, key, id, disp, size);
+}
+
+// latest deposit of the key, waits until it exists
+void rma_get(BankWindow &window, int home, const BankWindow::Key &key, int64_t size, double *data) {
+    BankWindow::Entry entry;
+    do {
+        entry = window.lookup(home, key, true).back();
+    } while (entry.size < 0);
+    entry.size = std::min(entry.size, size);
+    window.fetch(entry, data);
+    window.flush();
+}
+
+int rma_get_func(BankWindow &window, int id, CompFunction<3> &func, bool wait, bool del) {
+    int home = window.home(id);
+    BankWindow::Key key{BankWindow::Func, id, 0};
+    BankWindow::Entry entry;
+    do {
+        auto entries = window.lookup(home, key, wait);
+        if (entries.size() == 0) return 0;
+        entry = entries.back();
+    } while (entry.size < 0 and wait);
+    if (entry.size < 0) return 0;
+
+    std::vector<double> buffer(entry.size);
+    window.fetch(entry, buffer.data());
+    window.flush();
+    if (del) window.remove(home, entry);
+
+    // the first word holds the number of bytes
+    std::string bytes(reinterpret_cast<char *>(buffer.data() + 1), static_cast<size_t>(buffer[0]));
+    std::istringstream in(bytes);
+    read_func(in, func);
+    return 1;
+}
+
+void rma_put_func(BankWindow &window, int id, CompFunction<3> &func) {
+    std::ostringstream out;
+    write_func(out, func);
+    std::string bytes = out.str();
+    std::vector<double> buffer(1 + (bytes.size() + 7) / 8);
+    buffer[0] = bytes.size();
+    std::memcpy(buffer.data() + 1, bytes.data(), bytes.size());
+    rma_put(window, window.home(id), {BankWindow::Func, id, 0}, id, buffer.size(), buffer.data());
+}
+
+void rma_get_nodedata(BankWindow &window, int id, int nodeid, int size, double *data) {
+    auto entries = window.lookup(window.home(nodeid), {BankWindow::Node, nodeid, 0}, false);
+    for (int i = entries.size() - 1; i >= 0; i--) {
+        if (entries[i].id != id) continue;
+        entries[i].size = std::min<int64_t>(entries[i].size, size);
+        window.fetch(entries[i], data);
+        window.flush();
+        return;
+    }
+    std::fill(data, data + size, 0.0); // as the bank ranks, send zeroes
+}
+
+void rma_get_nodeblock(BankWindow &window, int nodeid, double *data, std::vector<int> &idVec) {
+    auto entries = window.lookup(window.home(nodeid), {BankWindow::Node, nodeid, 0}, false);
+    idVec.resize(entries.size());
+    int64_t shift = 0;
+    for (int i = 0; i < entries.size(); i++) {
+        idVec[i] = entries[i].id;
+        window.fetch(entries[i], data + shift);
+        shift += entries[i].size;
+    }
+    window.flush();
+}
+
+// all the nodes of an orbital are indexed on one rank, they come with the first bank
+double *rma_get_orbblock(BankWindow &window, int orbid, std::vector<int> &nodeidVec, int bankstart) {
+    std::vector<BankWindow::Entry> entries;
+    if (bankstart == 0) entries = window.lookup(window.home(orbid), {BankWindow::Orb, orbid, 0}, false);
+    nodeidVec.resize(entries.size());
+    if (entries.empty()) return nullptr;
+    int64_t totsize = 0;
+    for (auto &entry : entries) totsize += entry.size;
+    auto *data = new double[totsize];
+    int64_t shift = 0;
+    for (int i = 0; i < entries.size(); i++) {
+        nodeidVec[i] = entries[i].id;
+        window.fetch(entries[i], data + shift);
+        shift += entries[i].size;
+    }
+    window.flush();
+    return data;
+}
+} // namespace
+#endif
+
 // save orbital in Bank with identity id
 
 // get orbital with identity id.
 // If wait=0, return immediately with value zero if not available (default)
 // else, wait until available
 int BankAccount::get_func(int id, CompFunction<3> &func, int wait) {
+    RequestTimer timer(account_id, (wait == 0) ? GET_FUNCTION : GET_FUNCTION_AND_WAIT);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) return rma_get_func(*this->window, id, func, wait != 0, false);
     MPI_Status status;
     int messages[message_size];
     messages[1] = account_id;
@@ -670,7 +1312,9 @@ int BankAccount::get_func(int id, CompFunction<3> &func, int wait) {
 // get orbital with identity id, and delete from bank.
 // return immediately with value zero if not available
 int BankAccount::get_func_del(int id, CompFunction<3> &orb) {
+    RequestTimer timer(account_id, GET_FUNCTION_AND_DELETE);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) return rma_get_func(*this->window, id, orb, false, true);
     MPI_Status status;
     int messages[message_size];
     messages[0] = GET_FUNCTION_AND_DELETE;
@@ -691,7 +1335,12 @@ int BankAccount::get_func_del(int id, CompFunction<3> &orb) {
 
 // save function in Bank with identity id
 int BankAccount::put_func(int id, CompFunction<3> &func) {
+    RequestTimer timer(account_id, SAVE_FUNCTION, 0, 1024ll * func.getSizeNodes());
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        rma_put_func(*this->window, id, func);
+        return 1;
+    }
     // for now we distribute according to id
     int messages[message_size];
     messages[0] = SAVE_FUNCTION;
@@ -705,7 +1354,12 @@ int BankAccount::put_func(int id, CompFunction<3> &func) {
 
 // save data in Bank with identity id . datasize MUST have been set already. NB:not tested
 int BankAccount::put_data(int id, int size, double *data) {
+    RequestTimer timer(account_id, SAVE_DATA, 0, 8ll * size);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        rma_put(*this->window, this->window->home(id), {BankWindow::Data, id, 0}, id, size, data);
+        return 1;
+    }
     // for now we distribute according to id
     int messages[message_size];
 
@@ -722,7 +1376,12 @@ int BankAccount::put_data(int id, int size, double *data) {
 
 // save data in Bank with identity id . datasize MUST have been set already. NB:not tested
 int BankAccount::put_data(int id, int size, ComplexDouble *data) {
+    RequestTimer timer(account_id, SAVE_DATA, 0, 16ll * size);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        rma_put(*this->window, this->window->home(id), {BankWindow::Data, id, 0}, id, 2 * size, reinterpret_cast<double *>(data));
+        return 1;
+    }
     // for now we distribute according to id
     int messages[message_size];
 
@@ -739,7 +1398,12 @@ int BankAccount::put_data(int id, int size, ComplexDouble *data) {
 
 // save data in Bank with identity nIdx. datasize MUST have been set already. NB:not tested
 int BankAccount::put_data(NodeIndex<3> nIdx, int size, double *data) {
+    RequestTimer timer(account_id, SAVE_DATA, 0, 8ll * size);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        rma_put(*this->window, node_index_home(*this->window, nIdx), node_index_key(nIdx), 0, size, data);
+        return 1;
+    }
     // for now we distribute according to id
     int messages[message_size];
     messages[0] = SAVE_DATA;
@@ -758,7 +1422,12 @@ int BankAccount::put_data(NodeIndex<3> nIdx, int size, double *data) {
 
 // save data in Bank with identity nIdx. datasize MUST have been set already. NB:not tested
 int BankAccount::put_data(NodeIndex<3> nIdx, int size, ComplexDouble *data) {
+    RequestTimer timer(account_id, SAVE_DATA, 0, 16ll * size);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        rma_put(*this->window, node_index_home(*this->window, nIdx), node_index_key(nIdx), 0, 2 * size, reinterpret_cast<double *>(data));
+        return 1;
+    }
     // for now we distribute according to id
     int messages[message_size];
     messages[0] = SAVE_DATA;
@@ -777,7 +1446,12 @@ int BankAccount::put_data(NodeIndex<3> nIdx, int size, ComplexDouble *data) {
 
 // get data with identity id
 int BankAccount::get_data(int id, int size, double *data) {
+    RequestTimer timer(account_id, GET_DATA, 8ll * size);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        rma_get(*this->window, this->window->home(id), {BankWindow::Data, id, 0}, size, data);
+        return 1;
+    }
     MPI_Status status;
     int messages[message_size];
     messages[0] = GET_DATA;
@@ -792,7 +1466,12 @@ int BankAccount::get_data(int id, int size, double *data) {
 
 // get data with identity id
 int BankAccount::get_data(int id, int size, ComplexDouble *data) {
+    RequestTimer timer(account_id, GET_DATA, 16ll * size);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        rma_get(*this->window, this->window->home(id), {BankWindow::Data, id, 0}, 2 * size, reinterpret_cast<double *>(data));
+        return 1;
+    }
     MPI_Status status;
     int messages[message_size];
     messages[0] = GET_DATA;
@@ -808,7 +1487,12 @@ int BankAccount::get_data(int id, int size, ComplexDouble *data) {
 
 // get data with identity id
 int BankAccount::get_data(NodeIndex<3> nIdx, int size, double *data) {
+    RequestTimer timer(account_id, GET_DATA, 8ll * size);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        rma_get(*this->window, node_index_home(*this->window, nIdx), node_index_key(nIdx), size, data);
+        return 1;
+    }
     MPI_Status status;
     int messages[message_size];
     int id = std::abs(nIdx.getTranslation(0) + nIdx.getTranslation(1) + nIdx.getTranslation(2));
@@ -827,7 +1511,12 @@ int BankAccount::get_data(NodeIndex<3> nIdx, int size, double *data) {
 
 // get data with identity id
 int BankAccount::get_data(NodeIndex<3> nIdx, int size, ComplexDouble *data) {
+    RequestTimer timer(account_id, GET_DATA, 16ll * size);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        rma_get(*this->window, node_index_home(*this->window, nIdx), node_index_key(nIdx), 2 * size, reinterpret_cast<double *>(data));
+        return 1;
+    }
     MPI_Status status;
     int messages[message_size];
     int id = std::abs(nIdx.getTranslation(0) + nIdx.getTranslation(1) + nIdx.getTranslation(2));
@@ -847,7 +1536,15 @@ int BankAccount::get_data(NodeIndex<3> nIdx, int size, ComplexDouble *data) {
 
 // save data in Bank with identity id as part of block with identity nodeid.
 int BankAccount::put_nodedata(int id, int nodeid, int size, double *data) {
+    RequestTimer timer(account_id, SAVE_NODEDATA, 0, 8ll * size);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        // one copy of the data, indexed both by node and by orbital
+        int64_t disp = this->window->store(data, size);
+        this->window->insert(this->window->home(nodeid), {BankWindow::Node, nodeid, 0}, id, disp, size);
+        this->window->insert(this->window->home(id), {BankWindow::Orb, id, 0}, nodeid, disp, size);
+        return 1;
+    }
     // for now we distribute according to nodeid
     int messages[message_size];
     messages[0] = SAVE_NODEDATA;
@@ -864,7 +1561,15 @@ int BankAccount::put_nodedata(int id, int nodeid, int size, double *data) {
 // save data in Bank with identity id as part of block with identity nodeid.
 // NB: Complex is stored as two doubles
 int BankAccount::put_nodedata(int id, int nodeid, int size, ComplexDouble *data) {
+    RequestTimer timer(account_id, SAVE_NODEDATA, 0, 16ll * size);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        // one copy of the data, indexed both by node and by orbital
+        int64_t disp = this->window->store(reinterpret_cast<double *>(data), 2 * size);
+        this->window->insert(this->window->home(nodeid), {BankWindow::Node, nodeid, 0}, id, disp, 2 * size);
+        this->window->insert(this->window->home(id), {BankWindow::Orb, id, 0}, nodeid, disp, 2 * size);
+        return 1;
+    }
     // for now we distribute according to nodeid
     int messages[message_size];
     messages[0] = SAVE_NODEDATA;
@@ -878,9 +1583,150 @@ int BankAccount::put_nodedata(int id, int nodeid, int size, ComplexDouble *data)
     return 1;
 }
 
+/** @brief Save the data of several ids, with one message per bank rank
+ * @param[in] data: size doubles for each id, one after the other
+ */
+int BankAccount::put_data(const std::vector<int> &ids, int size, double *data) {
+    RequestTimer timer(account_id, SAVE_DATA_MANY, 0, 8ll * size * ids.size());
+#ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        for (int k = 0; k < ids.size(); k++) put_data(ids[k], size, data + k * size);
+        return 1;
+    }
+    std::vector<int> banks(ids.size());
+    std::vector<long long> sizes(ids.size(), 1 + size);
+    for (int k = 0; k < ids.size(); k++) banks[k] = ids[k] % bank_size;
+    for (auto &batch : make_batches(banks, sizes, bank_size, max_batch)) {
+        // the ids, followed by the data of each id
+        int count = batch.second.size();
+        std::vector<double> payload(count * (1 + size));
+        for (int b = 0; b < count; b++) {
+            int k = batch.second[b];
+            payload[b] = ids[k];
+            std::copy(data + k * size, data + (k + 1) * size, payload.data() + count + b * size);
+        }
+        int messages[message_size];
+        messages[0] = SAVE_DATA_MANY;
+        messages[1] = account_id;
+        messages[2] = count;
+        messages[3] = size;
+        MPI_Send(messages, 4, MPI_INT, bankmaster[batch.first], 0, comm_bank);
+        MPI_Send(payload.data(), payload.size(), MPI_DOUBLE, bankmaster[batch.first], 1, comm_bank);
+    }
+#endif
+    return 1;
+}
+
+// NB: Complex is stored as two doubles
+int BankAccount::put_data(const std::vector<int> &ids, int size, ComplexDouble *data) {
+    return put_data(ids, 2 * size, reinterpret_cast<double *>(data));
+}
+
+/** @brief Get the data of several ids, with one message per bank rank
+ * @param[out] data: size doubles for each id, one after the other
+ *
+ * @details As for a single id, waits for the ids that are not yet saved.
+ */
+int BankAccount::get_data(const std::vector<int> &ids, int size, double *data) {
+    RequestTimer timer(account_id, GET_DATA_MANY, 8ll * size * ids.size());
+#ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        for (int k = 0; k < ids.size(); k++) get_data(ids[k], size, data + k * size);
+        return 1;
+    }
+    std::vector<int> banks(ids.size());
+    std::vector<long long> sizes(ids.size(), 1 + size);
+    for (int k = 0; k < ids.size(); k++) banks[k] = ids[k] % bank_size;
+    for (auto &batch : make_batches(banks, sizes, bank_size, max_batch)) {
+        int count = batch.second.size();
+        std::vector<int> batch_ids(count);
+        for (int b = 0; b < count; b++) batch_ids[b] = ids[batch.second[b]];
+        MPI_Status status;
+        int messages[message_size];
+        messages[0] = GET_DATA_MANY;
+        messages[1] = account_id;
+        messages[2] = count;
+        messages[3] = size;
+        MPI_Send(messages, 4, MPI_INT, bankmaster[batch.first], 0, comm_bank);
+        MPI_Send(batch_ids.data(), count, MPI_INT, bankmaster[batch.first], 1, comm_bank);
+        // one flag for each id, followed by the data of each id
+        std::vector<double> reply(count * (1 + size));
+        MPI_Recv(reply.data(), reply.size(), MPI_DOUBLE, bankmaster[batch.first], 1, comm_bank, &status);
+        for (int b = 0; b < count; b++) {
+            int k = batch.second[b];
+            if (reply[b] > 0.0) {
+                std::copy(reply.data() + count + b * size, reply.data() + count + (b + 1) * size, data + k * size);
+            } else {
+                get_data(ids[k], size, data + k * size); // not saved yet, wait for it
+            }
+        }
+    }
+#endif
+    return 1;
+}
+
+// NB: Complex is stored as two doubles
+int BankAccount::get_data(const std::vector<int> &ids, int size, ComplexDouble *data) {
+    return get_data(ids, 2 * size, reinterpret_cast<double *>(data));
+}
+
+/** @brief Save several pieces of node data, with one message per bank rank
+ *
+ * @details Item k is saved as put_nodedata(ids[k], nodeids[k], sizes[k], data[k]).
+ */
+int BankAccount::put_nodedata(const std::vector<int> &ids, const std::vector<int> &nodeids, const std::vector<int> &sizes, const std::vector<double *> &data) {
+    RequestTimer timer(account_id, SAVE_NODEDATA_MANY);
+#ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        for (int k = 0; k < ids.size(); k++) put_nodedata(ids[k], nodeids[k], sizes[k], data[k]);
+        return 1;
+    }
+    std::vector<int> banks(ids.size());
+    std::vector<long long> batch_sizes(ids.size());
+    for (int k = 0; k < ids.size(); k++) {
+        banks[k] = nodeids[k] % bank_size;
+        batch_sizes[k] = 3 + sizes[k];
+    }
+    for (auto &batch : make_batches(banks, batch_sizes, bank_size, max_batch)) {
+        // id, nodeid and size of each item, followed by all the data
+        std::vector<double> payload;
+        for (int k : batch.second) {
+            payload.push_back(ids[k]);
+            payload.push_back(nodeids[k]);
+            payload.push_back(sizes[k]);
+        }
+        for (int k : batch.second) payload.insert(payload.end(), data[k], data[k] + sizes[k]);
+        int messages[message_size];
+        messages[0] = SAVE_NODEDATA_MANY;
+        messages[1] = account_id;
+        messages[2] = batch.second.size();
+        messages[3] = payload.size();
+        MPI_Send(messages, 4, MPI_INT, bankmaster[batch.first], 0, comm_bank);
+        MPI_Send(payload.data(), payload.size(), MPI_DOUBLE, bankmaster[batch.first], 1, comm_bank);
+    }
+#endif
+    return 1;
+}
+
+// NB: Complex is stored as two doubles
+int BankAccount::put_nodedata(const std::vector<int> &ids, const std::vector<int> &nodeids, const std::vector<int> &sizes, const std::vector<ComplexDouble *> &data) {
+    std::vector<int> double_sizes(sizes.size());
+    std::vector<double *> double_data(data.size());
+    for (int k = 0; k < sizes.size(); k++) {
+        double_sizes[k] = 2 * sizes[k];
+        double_data[k] = reinterpret_cast<double *>(data[k]);
+    }
+    return put_nodedata(ids, nodeids, double_sizes, double_data);
+}
+
 // get data with identity id
 int BankAccount::get_nodedata(int id, int nodeid, int size, double *data, std::vector<int> &idVec) {
+    RequestTimer timer(account_id, GET_NODEDATA, 8ll * size);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        rma_get_nodedata(*this->window, id, nodeid, size, data);
+        return 1;
+    }
     MPI_Status status;
     // get the column with identity id
     int messages[message_size];
@@ -897,7 +1743,12 @@ int BankAccount::get_nodedata(int id, int nodeid, int size, double *data, std::v
 
 // get data with identity id
 int BankAccount::get_nodedata(int id, int nodeid, int size, ComplexDouble *data, std::vector<int> &idVec) {
+    RequestTimer timer(account_id, GET_NODEDATA, 16ll * size);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        rma_get_nodedata(*this->window, id, nodeid, size, reinterpret_cast<double *>(data));
+        return 1;
+    }
     MPI_Status status;
     // get the column with identity id
     int messages[message_size];
@@ -914,7 +1765,12 @@ int BankAccount::get_nodedata(int id, int nodeid, int size, ComplexDouble *data,
 
 // get all data for nodeid (same nodeid, different orbitals)
 int BankAccount::get_nodeblock(int nodeid, double *data, std::vector<int> &idVec) {
+    RequestTimer timer(account_id, GET_NODEBLOCK);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        rma_get_nodeblock(*this->window, nodeid, data, idVec);
+        return 1;
+    }
     MPI_Status status;
     // get the entire superblock and also the id of each column
     int messages[message_size];
@@ -934,7 +1790,12 @@ int BankAccount::get_nodeblock(int nodeid, double *data, std::vector<int> &idVec
 
 // get all data for nodeid (same nodeid, different orbitals)
 int BankAccount::get_nodeblock(int nodeid, ComplexDouble *data, std::vector<int> &idVec) {
+    RequestTimer timer(account_id, GET_NODEBLOCK);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        rma_get_nodeblock(*this->window, nodeid, reinterpret_cast<double *>(data), idVec);
+        return 1;
+    }
     MPI_Status status;
     // get the entire superblock and also the id of each column
     int messages[message_size];
@@ -954,7 +1815,12 @@ int BankAccount::get_nodeblock(int nodeid, ComplexDouble *data, std::vector<int>
 
 // get all data with identity orbid (same orbital, different nodes)
 int BankAccount::get_orbblock(int orbid, double *&data, std::vector<int> &nodeidVec, int bankstart) {
+    RequestTimer timer(account_id, GET_ORBBLOCK);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        data = rma_get_orbblock(*this->window, orbid, nodeidVec, bankstart);
+        return 1;
+    }
     MPI_Status status;
     int nodeid = wrk_rank + bankstart;
     // get the entire superblock and also the nodeid of each column
@@ -967,7 +1833,7 @@ int BankAccount::get_orbblock(int orbid, double *&data, std::vector<int> &nodeid
     nodeidVec.resize(metadata_block[1]);
     int totsize = metadata_block[2];
     if (totsize > 0) MPI_Recv(nodeidVec.data(), metadata_block[1], MPI_INT, bankmaster[nodeid % bank_size], 2, comm_bank, &status);
-    data = new double[totsize];
+    data = (totsize > 0) ? new double[totsize] : nullptr; // the caller only frees non-empty blocks
     if (totsize > 0) MPI_Recv(data, totsize, MPI_DOUBLE, bankmaster[nodeid % bank_size], 3, comm_bank, &status);
 #endif
     return 1;
@@ -975,7 +1841,12 @@ int BankAccount::get_orbblock(int orbid, double *&data, std::vector<int> &nodeid
 
 // get all data with identity orbid (same orbital, different nodes)
 int BankAccount::get_orbblock(int orbid, ComplexDouble *&data, std::vector<int> &nodeidVec, int bankstart) {
+    RequestTimer timer(account_id, GET_ORBBLOCK);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        data = reinterpret_cast<ComplexDouble *>(rma_get_orbblock(*this->window, orbid, nodeidVec, bankstart));
+        return 1;
+    }
     MPI_Status status;
     int nodeid = wrk_rank + bankstart;
     // get the entire superblock and also the nodeid of each column
@@ -988,7 +1859,7 @@ int BankAccount::get_orbblock(int orbid, ComplexDouble *&data, std::vector<int>
     nodeidVec.resize(metadata_block[1]);
     int totsize = metadata_block[2];
     if (totsize > 0) MPI_Recv(nodeidVec.data(), metadata_block[1], MPI_INT, bankmaster[nodeid % bank_size], 2, comm_bank, &status);
-    data = new ComplexDouble[totsize / 2];
+    data = (totsize > 0) ? new ComplexDouble[totsize / 2] : nullptr;
     if (totsize > 0) MPI_Recv(data, totsize, MPI_DOUBLE, bankmaster[nodeid % bank_size], 3, comm_bank, &status);
 #endif
     return 1;
@@ -996,6 +1867,14 @@ int BankAccount::get_orbblock(int orbid, ComplexDouble *&data, std::vector<int>
 
 // creator. NB: collective
 BankAccount::BankAccount(int iclient, MPI_Comm comm) {
+#ifdef MRCPP_HAS_MPI
+    if (bank_rma) {
+        // 1/16 of the memory for the index
+        int64_t size = static_cast<int64_t>(bank_rma_size) * 1024 * 1024;
+        this->window = new BankWindow(comm, size - size / 16, size / 16);
+        return;
+    }
+#endif
     this->account_id = dataBank.openAccount(iclient, comm);
 #ifdef MRCPP_HAS_MPI
     MPI_Barrier(comm);
@@ -1004,18 +1883,37 @@ BankAccount::BankAccount(int iclient, MPI_Comm comm) {
 
 // destructor
 BankAccount::~BankAccount() {
+#ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        delete this->window; // NB: collective
+        return;
+    }
+#endif
     // The account will in reality not be removed before everybody has sent a delete message
     dataBank.closeAccount(this->account_id);
 }
 
 // closes account and reopen a new empty account. NB: account_id will change
 void BankAccount::clear(int iclient, MPI_Comm comm) {
+#ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        this->window->clear();
+        return;
+    }
+#endif
     this->account_id = dataBank.clearAccount(this->account_id, iclient, comm);
 }
 
 // creator. NB: collective
 TaskManager::TaskManager(int ntasks, int iclient, MPI_Comm comm) {
     this->n_tasks = ntasks;
+#ifdef MRCPP_HAS_MPI
+    if (bank_rma) {
+        // the counter is on rank 0, the ready tasks use the index only
+        this->window = new BankWindow(comm, 0, 1024 * 1024);
+        return;
+    }
+#endif
     if (bank_size == 0) return;
     this->account_id = dataBank.openTaskManager(ntasks, iclient, comm);
 #ifdef MRCPP_HAS_MPI
@@ -1023,16 +1921,74 @@ TaskManager::TaskManager(int ntasks, int iclient, MPI_Comm comm) {
 #endif
 }
 
+/** @brief Task manager where each rank owns a shard of the tasks
+ *
+ * @param[in] affinity: For each task, the rank of comm that should preferably
+ * execute it, for example the rank that holds its data, or -1 for any rank.
+ * Must be the same on all ranks.
+ *
+ * @details Each rank takes the tasks of its own shard in increasing order,
+ * and then steals from the shards of the other ranks, first from the ranks on
+ * the same node. The shard counters are atomic counters in a one-sided window
+ * on their owners, so the task bank is not used. The tasks are not handed out
+ * in global order, so a task must not wait for the result of another task.
+ */
+TaskManager::TaskManager(const std::vector<int> &affinity, MPI_Comm comm) {
+    this->n_tasks = affinity.size();
+    int rank = 0;
+    int size = 1;
+#ifdef MRCPP_HAS_MPI
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+#endif
+    // tasks without affinity are distributed round robin
+    this->shards.resize(size);
+    int next = 0;
+    for (int i = 0; i < this->n_tasks; i++) {
+        int owner = (affinity[i] >= 0) ? affinity[i] % size : next++ % size;
+        this->shards[owner].push_back(i);
+    }
+    this->victims.push_back(rank);
+    if (size == 1) return; // the serial counter is used
+#ifdef MRCPP_HAS_MPI
+    this->window = new BankWindow(comm, 0, 1024 * 1024);
+    for (int k = 1; k < size; k++)
+        if (this->window->onNode((rank + k) % size)) this->victims.push_back((rank + k) % size);
+    for (int k = 1; k < size; k++)
+        if (not this->window->onNode((rank + k) % size)) this->victims.push_back((rank + k) % size);
+#endif
+}
+
 // destructor
 TaskManager::~TaskManager() {
+#ifdef MRCPP_HAS_MPI
+    delete this->window;
+#endif
     // The account will in reality not be removed before everybody has sent a delete message
     if (this->account_id < 0) return;
     dataBank.closeTaskManager(this->account_id);
 }
 
 int TaskManager::next_task() {
+    RequestTimer timer(account_id, GET_NEXTTASK);
     int nexttask = 0;
+    if (this->shards.size() > 0) {
+        while (this->victim < this->victims.size()) {
+            int owner = this->victims[this->victim];
+            int64_t pos = this->task++;
+#ifdef MRCPP_HAS_MPI
+            if (this->window != nullptr) pos = this->window->next_count(owner);
+#endif
+            if (pos < this->shards[owner].size()) return this->shards[owner][pos];
+            this->victim++; // this shard is empty, steal from the next one
+        }
+        return -1;
+    }
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        nexttask = this->window->next_count(0);
+        return (nexttask < this->n_tasks) ? nexttask : -1;
+    }
     if (this->account_id >= 0) {
         MPI_Status status;
         int messages[message_size];
@@ -1049,7 +2005,12 @@ int TaskManager::next_task() {
 }
 
 void TaskManager::put_readytask(int i, int j) {
+    RequestTimer timer(account_id, PUT_READYTASK);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        this->window->insert(this->window->home(i), {BankWindow::Ready, i, 0}, j, 0, 0);
+        return;
+    }
     if (this->account_id < 0) return;
     MPI_Status status;
     int messages[message_size];
@@ -1062,7 +2023,17 @@ void TaskManager::put_readytask(int i, int j) {
 }
 
 void TaskManager::del_readytask(int i, int j) {
+    RequestTimer timer(account_id, DEL_READYTASK);
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        int home = this->window->home(i);
+        for (auto &entry : this->window->lookup(home, {BankWindow::Ready, i, 0}, false)) {
+            if (entry.id != j or entry.size < 0) continue;
+            this->window->remove(home, entry);
+            break;
+        }
+        return;
+    }
     if (this->account_id < 0) return;
     MPI_Status status;
     int messages[message_size];
@@ -1075,8 +2046,18 @@ void TaskManager::del_readytask(int i, int j) {
 }
 
 std::vector<int> TaskManager::get_readytask(int i, int del) {
+    RequestTimer timer(account_id, (del == 1) ? GET_READYTASK_DEL : GET_READYTASK);
     std::vector<int> readytasks;
 #ifdef MRCPP_HAS_MPI
+    if (this->window != nullptr) {
+        int home = this->window->home(i);
+        for (auto &entry : this->window->lookup(home, {BankWindow::Ready, i, 0}, false)) {
+            if (entry.size < 0) continue;
+            readytasks.push_back(entry.id);
+            if (del == 1) this->window->remove(home, entry);
+        }
+        return readytasks;
+    }
     if (this->account_id < 0) return readytasks;
     MPI_Status status;
     int messages[message_size];
@@ -1095,4 +2076,136 @@ std::vector<int> TaskManager::get_readytask(int i, int del) {
     return readytasks;
 }
 
+/** @param[in] account: Where the blocks are stored
+ * @param[in] rows: Largest number of rows of a block, in doubles
+ * @param[in] cols: Largest number of columns of a block
+ * @param[in] depth: Number of requests in flight
+ *
+ * @details With the one-sided bank the buffers take the size of the blocks
+ * fetched. The replies of the bank ranks are received into buffers of the
+ * largest block size, and depth is then reduced so that they use at most
+ * max_prefetch bytes (but at least one buffer).
+ */
+NodeBlockPrefetch::NodeBlockPrefetch(BankAccount &account, int rows, int cols, int depth)
+        : account(account)
+        , depth(std::min(std::max(depth, 1), 64))
+        , capacity(1 + cols + rows * cols) {
+    static std::atomic<int> instance(0); // distinct reply tags for the prefetches that are used together
+    this->tag = max_tag - 4096 + 64 * (instance++ % 64);
+    if (this->account.window == nullptr) {
+        long long nbuffers = max_prefetch / (sizeof(double) * static_cast<long long>(this->capacity));
+        this->depth = std::max(1, static_cast<int>(std::min<long long>(this->depth, nbuffers)));
+    }
+    this->slots.resize(this->depth);
+    for (int i = this->depth - 1; i >= 0; i--) this->free_slots.push_back(i);
+}
+
+NodeBlockPrefetch::~NodeBlockPrefetch() {
+    // the replies must be received even if they are not used
+    for (int s : this->inflight) complete(this->slots[s]);
+}
+
+/** @brief Add a node id to the list of blocks to fetch */
+void NodeBlockPrefetch::push(int nodeid) {
+    this->pending.push_back(nodeid);
+    request();
+}
+
+// request pending blocks while there are free buffers (buffers are allocated at first use, and only grow)
+void NodeBlockPrefetch::request() {
+#ifdef MRCPP_HAS_MPI
+    BankWindow *window = this->account.window;
+    if (window == nullptr and bank_size == 0) return;
+    while (this->pending.size() > 0 and this->free_slots.size() > 0) {
+        int s = this->free_slots.back();
+        this->free_slots.pop_back();
+        Slot &slot = this->slots[s];
+        slot.nodeid = this->pending.front();
+        this->pending.pop_front();
+        slot.requests.clear();
+        slot.idVec.clear();
+        slot.offset = 0;
+        slot.size = 0;
+        if (window != nullptr) {
+            auto entries = window->lookup(window->home(slot.nodeid), {BankWindow::Node, slot.nodeid, 0}, false);
+            long long total = 0;
+            for (auto &entry : entries) total += entry.size;
+            if (total > this->capacity) MSG_ABORT("Node block larger than expected");
+            if (slot.buffer.size() < total) slot.buffer.resize(total);
+            for (auto &entry : entries) {
+                window->fetch(entry, slot.buffer.data() + slot.size, &slot.requests);
+                slot.idVec.push_back(entry.id);
+                slot.size += entry.size;
+            }
+        } else {
+            int bank = bankmaster[slot.nodeid % bank_size];
+            slot.buffer.resize(this->capacity);
+            slot.requests.resize(1);
+            MPI_Irecv(slot.buffer.data(), this->capacity, MPI_DOUBLE, bank, this->tag + s, comm_bank, &slot.requests[0]);
+            int messages[message_size];
+            messages[0] = GET_NODEBLOCK_ASYNC;
+            messages[1] = this->account.account_id;
+            messages[2] = slot.nodeid;
+            messages[3] = this->tag + s;
+            MPI_Send(messages, 4, MPI_INT, bank, 0, comm_bank);
+        }
+        this->inflight.push_back(s);
+    }
+#endif
+}
+
+// wait for the block of a slot
+void NodeBlockPrefetch::complete(Slot &slot) {
+#ifdef MRCPP_HAS_MPI
+    std::vector<MPI_Status> status(slot.requests.size());
+    MPI_Waitall(slot.requests.size(), slot.requests.data(), status.data());
+    if (this->account.window == nullptr and slot.requests.size() > 0) {
+        int count;
+        MPI_Get_count(&status[0], MPI_DOUBLE, &count);
+        int ncols = slot.buffer[0];
+        slot.idVec.resize(ncols);
+        for (int j = 0; j < ncols; j++) slot.idVec[j] = slot.buffer[1 + j];
+        slot.offset = 1 + ncols;
+        slot.size = count - slot.offset;
+    }
+    slot.requests.clear();
+#endif
+}
+
+/** @brief Get all data for nodeid, as BankAccount::get_nodeblock
+ *
+ * @details Waits for the block if nodeid is the next one that was pushed.
+ * Blocks that were pushed before nodeid are dropped.
+ */
+int NodeBlockPrefetch::get_nodeblock(int nodeid, double *data, std::vector<int> &idVec) {
+    RequestTimer timer(this->account.account_id, GET_NODEBLOCK_ASYNC); // time waiting for the block
+    auto is_node = [this, nodeid](int s) { return this->slots[s].nodeid == nodeid; };
+    bool queued = std::any_of(this->inflight.begin(), this->inflight.end(), is_node);
+    queued = queued or std::find(this->pending.begin(), this->pending.end(), nodeid) != this->pending.end();
+    if (not queued) return this->account.get_nodeblock(nodeid, data, idVec);
+
+    while (true) {
+        if (this->inflight.size() == 0) request();
+        if (this->inflight.size() == 0) return this->account.get_nodeblock(nodeid, data, idVec);
+        int s = this->inflight.front();
+        this->inflight.pop_front();
+        Slot &slot = this->slots[s];
+        complete(slot);
+        bool found = (slot.nodeid == nodeid);
+        if (found) {
+            std::copy(slot.buffer.data() + slot.offset, slot.buffer.data() + slot.offset + slot.size, data);
+            idVec = slot.idVec;
+        }
+        this->free_slots.push_back(s);
+        request();
+        if (found) return 1;
+    }
+}
+
+/** @brief Get all data for nodeid, as BankAccount::get_nodeblock */
+int NodeBlockPrefetch::get_nodeblock(int nodeid, ComplexDouble *data, std::vector<int> &idVec) {
+    // NB: Complex is stored as two doubles
+    return get_nodeblock(nodeid, reinterpret_cast<double *>(data), idVec);
+}
+
 } // namespace mrcpp
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <array>
+#include <deque>
+
 #include "CompFunction.h"
+#include "omp_utils.h"
 #include "parallel.h"
 #include "trees/NodeIndex.h"
 
@@ -8,6 +12,8 @@ namespace mrcpp {
 
 using namespace mpi;
 
+class BankWindow;
+
 struct deposit {
     CompFunction<3> *orb;
     double *data; // for pure data arrays
@@ -49,8 +55,57 @@ enum {
     DEL_READYTASK,           // 22
     GET_READYTASK,           // 23
     GET_READYTASK_DEL,       // 24
+    GET_NODEBLOCK_ASYNC,     // 25
+    SAVE_NODEDATA_MANY,      // 26
+    SAVE_DATA_MANY,          // 27
+    GET_DATA_MANY,           // 28
+    GET_STATISTICS,          // 29
+};
+
+/** @brief Counters and timing histograms of bank requests
+ *
+ * @details One entry for each account and message type, with the number of
+ * requests, the bytes received and sent, the total and largest time, and a
+ * histogram of the time per request. Bin 0 counts requests below 1 us, bin i
+ * the range [2^(i-1), 2^i) us, and the last bin is open. Collected by the
+ * bank ranks in Bank::open() and by the clients in BankAccount and
+ * TaskManager if mpi::bank_stats is set.
+ */
+class BankStatistics {
+public:
+    static const int nBins = 24;
+
+    BankStatistics() { MRCPP_INIT_OMP_LOCK(); }
+    BankStatistics(const BankStatistics &stats) = delete;
+    BankStatistics &operator=(const BankStatistics &stats) = delete;
+    ~BankStatistics() { MRCPP_DESTROY_OMP_LOCK(); }
+
+    void add(int account, int message, double time, long long bytes_in = 0, long long bytes_out = 0);
+    void add_queue_depth(int depth);
+    void clear();
+    std::string json(const std::string &role) const;
+    void write(const std::string &file, const std::string &role) const;
+
+private:
+    struct Entry {
+        long long count = 0;
+        long long bytes_in = 0;
+        long long bytes_out = 0;
+        double time = 0.0;
+        double max_time = 0.0;
+        std::array<long long, nBins> histogram{};
+    };
+    std::map<std::pair<int, int>, Entry> entries; // by account and message type
+    long long queue_samples = 0;
+    long long queue_sum = 0;
+    int max_queue_depth = 0; // largest number of clients waiting for data
+#ifdef MRCPP_HAS_OMP
+    mutable omp_lock_t omp_lock; // client requests may be made by several threads
+#endif
 };
 
+extern BankStatistics clientStatistics; // requests of this client rank
+
 class Bank {
 public:
     Bank() = default;
@@ -59,6 +114,7 @@ public:
     void close();
     int get_maxtotalsize();
     std::vector<int> get_totalsize();
+    std::vector<std::string> get_statistics();
 
 private:
     friend class BankAccount;
@@ -77,6 +133,12 @@ private:
     void clear_bank();
     void remove_account(int account); // remove the content and the account
 
+    // disk tier, used if mpi::bank_mem_limit > 0
+    void spill_touch(const double *data);   // the data are used
+    void spill_touch(int account, int ix);  // the function deposit is used, it is read back if it was evicted
+    void spill_forget(int account, int ix); // the function deposit is deleted
+    void spill_evict();                     // evict until the resident data fit in the limit
+
     long long totcurrentsize = 0ll;                     // number of kB used by all accounts
     std::vector<int> accounts;                          // open bank accounts
     std::map<int, std::vector<deposit> *> get_deposits; // gives deposits of an account
@@ -86,6 +148,7 @@ private:
     std::map<int, std::map<int, std::vector<int>> *> get_readytasks; // used by task manager
     std::map<int, long long> currentsize;                            // total deposited data size (without containers)
     long long maxsize = 0;                                           // max total deposited data size (without containers)
+    BankStatistics statistics;                                       // requests served by this bank rank
 };
 
 class BankAccount {
@@ -107,19 +170,76 @@ public:
     int put_data(NodeIndex<3> nIdx, int size, ComplexDouble *data);
     int get_data(NodeIndex<3> nIdx, int size, double *data);
     int get_data(NodeIndex<3> nIdx, int size, ComplexDouble *data);
+    int put_data(const std::vector<int> &ids, int size, double *data);
+    int put_data(const std::vector<int> &ids, int size, ComplexDouble *data);
+    int get_data(const std::vector<int> &ids, int size, double *data);
+    int get_data(const std::vector<int> &ids, int size, ComplexDouble *data);
     int put_nodedata(int id, int nodeid, int size, double *data);
     int put_nodedata(int id, int nodeid, int size, ComplexDouble *data);
+    int put_nodedata(const std::vector<int> &ids, const std::vector<int> &nodeids, const std::vector<int> &sizes, const std::vector<double *> &data);
+    int put_nodedata(const std::vector<int> &ids, const std::vector<int> &nodeids, const std::vector<int> &sizes, const std::vector<ComplexDouble *> &data);
     int get_nodedata(int id, int nodeid, int size, double *data, std::vector<int> &idVec);
     int get_nodedata(int id, int nodeid, int size, ComplexDouble *data, std::vector<int> &idVec);
     int get_nodeblock(int nodeid, double *data, std::vector<int> &idVec);
     int get_nodeblock(int nodeid, ComplexDouble *data, std::vector<int> &idVec);
     int get_orbblock(int orbid, double *&data, std::vector<int> &nodeidVec, int bankstart);
     int get_orbblock(int orbid, ComplexDouble *&data, std::vector<int> &nodeidVec, int bankstart);
+
+private:
+    friend class NodeBlockPrefetch;
+    BankWindow *window = nullptr; // one-sided storage, used instead of the bank ranks if mpi::bank_rma
+};
+
+std::vector<std::pair<int, std::vector<int>>> make_batches(const std::vector<int> &banks, const std::vector<long long> &sizes, int nbanks, long long max_size);
+
+/** @brief Fetch node blocks from a BankAccount ahead of their use
+ *
+ * @details The node ids are given in the order they will be used with push().
+ * Up to depth blocks are requested without waiting, each into its own
+ * buffer, so that the transfers overlap with the work on the previous
+ * blocks. get_nodeblock() waits for the next block and copies it out, with
+ * the same result as BankAccount::get_nodeblock. Blocks pushed before the
+ * requested node id are dropped, and a node id that was not pushed is
+ * fetched directly from the account.
+ */
+class NodeBlockPrefetch {
+public:
+    NodeBlockPrefetch(BankAccount &account, int rows, int cols, int depth = 4);
+    NodeBlockPrefetch(const NodeBlockPrefetch &prefetch) = delete;
+    NodeBlockPrefetch &operator=(const NodeBlockPrefetch &prefetch) = delete;
+    ~NodeBlockPrefetch();
+    void push(int nodeid);
+    int get_nodeblock(int nodeid, double *data, std::vector<int> &idVec);
+    int get_nodeblock(int nodeid, ComplexDouble *data, std::vector<int> &idVec);
+
+private:
+    struct Slot {
+        int nodeid = -1;
+        int offset = 0; // start of the data in the buffer
+        int size = 0;   // number of doubles of data
+        std::vector<double> buffer;
+        std::vector<int> idVec;
+        std::vector<MPI_Request> requests;
+    };
+    BankAccount &account;
+    int depth;
+    int capacity;             // size of the buffers, in doubles
+    int tag = 0;              // first tag of the replies from the bank
+    std::vector<Slot> slots;  // one buffer for each request in flight
+    std::deque<int> pending;  // node ids not yet requested
+    std::deque<int> inflight; // slots with requests, in order of use
+    std::vector<int> free_slots;
+
+    void request();
+    void complete(Slot &slot);
 };
 
 class TaskManager {
 public:
     TaskManager(int ntasks, int iclient = wrk_rank, MPI_Comm comm = comm_wrk);
+    TaskManager(const std::vector<int> &affinity, MPI_Comm comm = comm_wrk);
+    TaskManager(const TaskManager &tasks) = delete;
+    TaskManager &operator=(const TaskManager &tasks) = delete;
     ~TaskManager();
     int next_task();
     void put_readytask(int i, int j);
@@ -128,6 +248,12 @@ public:
     int account_id = -1;
     int task = 0;    // used in serial case only
     int n_tasks = 0; // used in serial case only
+
+private:
+    BankWindow *window = nullptr;         // one-sided task counters, used instead of the task bank if mpi::bank_rma or with affinity
+    std::vector<std::vector<int>> shards; // tasks owned by each rank, used with affinity only
+    std::vector<int> victims;             // shards in the order they are taken from: own, same node, other nodes
+    int victim = 0;                       // position in victims of the current shard
 };
 
 int const message_size = 7;
@@ -0,0 +1,342 @@
+/*
+ * MRCPP, a numerical library based on multiresolution analysis and
+ * the multiwavelet basis which provide low-scaling algorithms as well as
+ * rigorous error control in numerical computations.
+ * Copyright (C) 2021 Stig Rune Jensen, Jonas Juselius, Luca Frediani and contributors.
+ *
+ * This file is part of MRCPP.
+ *
+ * MRCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MRCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with MRCPP.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * For information on the complete list of contributors to MRCPP, see:
+ * <https://mrcpp.readthedocs.io/>
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "BankWindow.h"
+#include "Printer.h"
+#include "parallel.h"
+
+namespace mrcpp {
+
+#ifdef MRCPP_HAS_MPI
+
+namespace {
+const int64_t HeaderBytes = 64; // word 0: next free entry, word 1: counter
+const int64_t BucketWords = 32; // claims, ready, kind, k1, k2, count, segments
+const int64_t EntryWords = 3;   // id and rank, offset, size (all stored +1, zero means unwritten)
+const int64_t SegmentSize = 8;  // entries in the first segment of a bucket, doubled for each new segment
+const int NSegments = BucketWords - 6;
+
+uint64_t hash_key(const BankWindow::Key &key) {
+    uint64_t h = static_cast<uint64_t>(key.kind) * 0x9e3779b97f4a7c15ull;
+    h ^= static_cast<uint64_t>(key.k1) + 0x632be59bd9b4e019ull + (h << 6) + (h >> 2);
+    h ^= static_cast<uint64_t>(key.k2) + 0x85ebca6b0e9c1ba1ull + (h << 6) + (h >> 2);
+    h ^= h >> 31;
+    h *= 0xbf58476d1ce4e5b9ull;
+    return h ^ (h >> 29);
+}
+} // namespace
+
+/** @param[in] comm: Communicator of all the ranks that use the window
+ * @param[in] heapBytes: Memory for the data deposited by each rank
+ * @param[in] indexBytes: Memory for the index on each rank
+ *
+ * @details Collective. The memory is allocated as a shared window on each
+ * node, which is exposed to all the ranks of comm through a second window.
+ */
+BankWindow::BankWindow(MPI_Comm comm, int64_t heapBytes, int64_t indexBytes)
+        : comm(comm) {
+    MPI_Comm_rank(comm, &this->comm_rank);
+    MPI_Comm_size(comm, &this->comm_size);
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &this->comm_node);
+
+    this->nBuckets = std::max(indexBytes / 3 / (BucketWords * 8), int64_t(64));
+    this->nEntries = std::max(2 * indexBytes / 3 / (EntryWords * 8), int64_t(256));
+    this->entryOffset = HeaderBytes + this->nBuckets * BucketWords * 8;
+    this->heapOffset = ((this->entryOffset + this->nEntries * EntryWords * 8 + 63) / 64) * 64;
+    this->heapSize = heapBytes / 8;
+    MPI_Aint totBytes = this->heapOffset + this->heapSize * 8;
+
+    MPI_Info info;
+    MPI_Info_create(&info);
+    MPI_Info_set(info, "alloc_shared_noncontig", "true");
+    MPI_Win_allocate_shared(totBytes, 1, info, this->comm_node, &this->base, &this->win_node);
+    MPI_Info_free(&info);
+    int node_size;
+    MPI_Comm_size(this->comm_node, &node_size);
+    if (node_size == this->comm_size) {
+        this->win = this->win_node; // all on one node, same ranks
+    } else {
+        MPI_Win_create(this->base, totBytes, 1, MPI_INFO_NULL, comm, &this->win);
+    }
+    std::memset(this->base, 0, this->heapOffset);
+
+    // Direct access to the memory of the other ranks on this node
+    MPI_Group group, group_node;
+    MPI_Comm_group(comm, &group);
+    MPI_Comm_group(this->comm_node, &group_node);
+    std::vector<int> ranks(this->comm_size), node_ranks(this->comm_size);
+    for (int i = 0; i < this->comm_size; i++) ranks[i] = i;
+    MPI_Group_translate_ranks(group, this->comm_size, ranks.data(), group_node, node_ranks.data());
+    MPI_Group_free(&group);
+    MPI_Group_free(&group_node);
+    this->node_base.resize(this->comm_size, nullptr);
+    for (int i = 0; i < this->comm_size; i++) {
+        if (node_ranks[i] == MPI_UNDEFINED) continue;
+        MPI_Aint size;
+        int disp_unit;
+        MPI_Win_shared_query(this->win_node, node_ranks[i], &size, &disp_unit, &this->node_base[i]);
+    }
+
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, this->win_node);
+    if (this->win != this->win_node) MPI_Win_lock_all(MPI_MODE_NOCHECK, this->win);
+    MPI_Win_sync(this->win_node);
+    if (this->win != this->win_node) MPI_Win_sync(this->win);
+    MPI_Barrier(comm);
+}
+
+/** @brief Collective, frees the windows and all the data */
+BankWindow::~BankWindow() {
+    if (this->win != this->win_node) {
+        MPI_Win_unlock_all(this->win);
+        MPI_Win_free(&this->win);
+    }
+    MPI_Win_unlock_all(this->win_node);
+    MPI_Win_free(&this->win_node);
+    MPI_Comm_free(&this->comm_node);
+}
+
+/** @brief Collective, removes all keys and data */
+void BankWindow::clear() {
+    MPI_Win_flush_all(this->win);
+    MPI_Barrier(this->comm);
+    std::memset(this->base, 0, this->heapOffset);
+    this->heapTop = 0;
+    this->buckets.clear();
+    MPI_Win_sync(this->win_node);
+    if (this->win != this->win_node) MPI_Win_sync(this->win);
+    MPI_Barrier(this->comm);
+}
+
+/** @brief Copy data to the heap of this rank
+ * @returns Offset of the data in the heap, to be used in insert()
+ */
+int64_t BankWindow::store(const double *data, int64_t size) {
+    if (this->heapTop + size > this->heapSize) MSG_ABORT("Bank window is full, increase mpi::bank_rma_size");
+    int64_t disp = this->heapTop;
+    std::memcpy(this->base + this->heapOffset + 8 * disp, data, 8 * size);
+    this->heapTop += size;
+    MPI_Win_sync(this->win_node);
+    if (this->win != this->win_node) MPI_Win_sync(this->win);
+    return disp;
+}
+
+/** @brief Append an entry for data stored by this rank to the list of a key
+ *
+ * @details The bucket of the key is created on the home rank if necessary.
+ * The entry gets its position from an atomic counter in the bucket, and
+ * the first writer of each segment allocates the segment.
+ */
+void BankWindow::insert(int home, const Key &key, int id, int64_t disp, int64_t size) {
+    int64_t b = find_bucket(home, key, true);
+    int64_t pos = fetch_add(home, bucket_disp(b) + 5 * 8, 1);
+
+    int s = 0;
+    int64_t start = 0;
+    while (pos >= start + (SegmentSize << s)) start += SegmentSize << s++;
+    if (s >= NSegments) MSG_ABORT("Too many entries for one key");
+
+    int64_t segDisp = bucket_disp(b) + (6 + s) * 8;
+    int64_t segBase = 0;
+    if (pos == start) {
+        int64_t capacity = SegmentSize << s;
+        segBase = fetch_add(home, 0, capacity);
+        if (segBase + capacity > this->nEntries) MSG_ABORT("Bank window index is full, increase mpi::bank_rma_size");
+        int64_t word = segBase + 1;
+        write(home, segDisp, &word, 1);
+        MPI_Win_flush(home, this->win);
+    } else {
+        int64_t word = 0;
+        while ((word = read(home, segDisp)) == 0) {}
+        segBase = word - 1;
+    }
+
+    int64_t words[EntryWords];
+    words[0] = static_cast<int64_t>((static_cast<uint64_t>(static_cast<uint32_t>(id)) << 32) | static_cast<uint32_t>(this->comm_rank + 1));
+    words[1] = disp + 1;
+    words[2] = size + 1;
+    write(home, entry_disp(segBase + pos - start), words, EntryWords);
+    MPI_Win_flush(home, this->win);
+}
+
+/** @brief All entries of a key, in the order they were inserted
+ * @param[in] wait: If true, wait until the key has at least one entry
+ */
+std::vector<BankWindow::Entry> BankWindow::lookup(int home, const Key &key, bool wait) {
+    std::vector<Entry> entries;
+    while (true) {
+        int64_t b = find_bucket(home, key, false);
+        if (b < 0) {
+            if (not wait) return entries;
+            continue;
+        }
+        if (read_entries(home, b, entries) and (not wait or entries.size() > 0)) return entries;
+    }
+}
+
+/** @brief Start the transfer of the data of an entry
+ * @param[in] requests: If given, one request is added for each remote
+ * transfer, to be completed with MPI_Wait. Otherwise complete with flush().
+ */
+void BankWindow::fetch(const Entry &entry, double *data, std::vector<MPI_Request> *requests) {
+    if (entry.size <= 0) return;
+    char *node_p = this->node_base[entry.rank];
+    if (node_p != nullptr) {
+        MPI_Win_sync(this->win_node);
+        std::memcpy(data, node_p + this->heapOffset + 8 * entry.disp, 8 * entry.size);
+    } else {
+        int size = static_cast<int>(entry.size);
+        MPI_Aint disp = this->heapOffset + 8 * entry.disp;
+        if (requests != nullptr) {
+            requests->emplace_back();
+            MPI_Rget(data, size, MPI_DOUBLE, entry.rank, disp, size, MPI_DOUBLE, this->win, &requests->back());
+        } else {
+            MPI_Get(data, size, MPI_DOUBLE, entry.rank, disp, size, MPI_DOUBLE, this->win);
+        }
+    }
+}
+
+void BankWindow::flush() {
+    MPI_Win_flush_local_all(this->win);
+}
+
+/** @brief Mark an entry as removed, the memory is reclaimed by clear() */
+void BankWindow::remove(int home, const Entry &entry) {
+    int64_t word = -1;
+    write(home, entry_disp(entry.index) + 2 * 8, &word, 1);
+    MPI_Win_flush(home, this->win);
+}
+
+/** @brief Atomically increment the counter on a rank and return its previous value */
+int64_t BankWindow::next_count(int rank) {
+    return fetch_add(rank, 8, 1);
+}
+
+/** @brief Find the bucket of a key in the index of the home rank
+ * @param[in] create: Claim a bucket if the key does not exist
+ * @returns Bucket number, negative if not found
+ */
+int64_t BankWindow::find_bucket(int home, const Key &key, bool create) {
+    auto it = this->buckets.find({home, key});
+    if (it != this->buckets.end()) return it->second;
+
+    // A bucket is claimed by the writer that first increments its claim
+    // counter, which then writes the key and sets the ready flag
+    int64_t b = hash_key(key) % this->nBuckets;
+    for (int64_t probe = 0; probe < this->nBuckets;) {
+        int64_t words[5];
+        read(home, bucket_disp(b), words, 5);
+        if (words[0] == 0) {
+            if (not create) return -1;
+            if (fetch_add(home, bucket_disp(b), 1) != 0) continue;
+            int64_t keyWords[3] = {key.kind, key.k1, key.k2};
+            write(home, bucket_disp(b) + 2 * 8, keyWords, 3);
+            MPI_Win_flush(home, this->win);
+            int64_t ready = 1;
+            write(home, bucket_disp(b) + 8, &ready, 1);
+            MPI_Win_flush(home, this->win);
+            this->buckets[{home, key}] = b;
+            return b;
+        }
+        if (words[1] == 0) continue; // key is being written
+        if (words[2] == key.kind and words[3] == key.k1 and words[4] == key.k2) {
+            this->buckets[{home, key}] = b;
+            return b;
+        }
+        b = (b + 1) % this->nBuckets;
+        probe++;
+    }
+    if (create) MSG_ABORT("Bank window index is full, increase mpi::bank_rma_size");
+    return -1;
+}
+
+/** @returns False if some of the entries are still being written */
+bool BankWindow::read_entries(int home, int64_t bucket, std::vector<Entry> &entries) {
+    int64_t words[1 + NSegments];
+    read(home, bucket_disp(bucket) + 5 * 8, words, 1 + NSegments);
+    int64_t count = words[0];
+
+    std::vector<int64_t> index(count);
+    std::vector<int64_t> buffer(count * EntryWords);
+    int64_t start = 0;
+    for (int s = 0; start < count; s++) {
+        int64_t segBase = words[1 + s] - 1;
+        if (segBase < 0) return false;
+        int64_t n = std::min(SegmentSize << s, count - start);
+        for (int64_t i = 0; i < n; i++) index[start + i] = segBase + i;
+        MPI_Get_accumulate(nullptr, 0, MPI_INT64_T, &buffer[start * EntryWords], n * EntryWords, MPI_INT64_T, home, entry_disp(segBase), n * EntryWords, MPI_INT64_T, MPI_NO_OP, this->win);
+        start += SegmentSize << s;
+    }
+    MPI_Win_flush(home, this->win);
+
+    entries.resize(count);
+    for (int64_t i = 0; i < count; i++) {
+        const int64_t *w = &buffer[i * EntryWords];
+        if (w[0] == 0 or w[1] == 0 or w[2] == 0) return false;
+        auto &entry = entries[i];
+        entry.id = static_cast<int32_t>(static_cast<uint64_t>(w[0]) >> 32);
+        entry.rank = static_cast<int>(static_cast<uint64_t>(w[0]) & 0xffffffffu) - 1;
+        entry.disp = w[1] - 1;
+        entry.size = (w[2] < 0) ? -1 : w[2] - 1;
+        entry.index = index[i];
+    }
+    return true;
+}
+
+int64_t BankWindow::bucket_disp(int64_t b) const {
+    return HeaderBytes + b * BucketWords * 8;
+}
+
+int64_t BankWindow::entry_disp(int64_t e) const {
+    return this->entryOffset + e * EntryWords * 8;
+}
+
+int64_t BankWindow::read(int rank, int64_t disp) {
+    int64_t word;
+    read(rank, disp, &word, 1);
+    return word;
+}
+
+void BankWindow::read(int rank, int64_t disp, int64_t *words, int n) {
+    MPI_Get_accumulate(nullptr, 0, MPI_INT64_T, words, n, MPI_INT64_T, rank, disp, n, MPI_INT64_T, MPI_NO_OP, this->win);
+    MPI_Win_flush(rank, this->win);
+}
+
+void BankWindow::write(int rank, int64_t disp, const int64_t *words, int n) {
+    MPI_Accumulate(words, n, MPI_INT64_T, rank, disp, n, MPI_INT64_T, MPI_REPLACE, this->win);
+}
+
+int64_t BankWindow::fetch_add(int rank, int64_t disp, int64_t value) {
+    int64_t result;
+    MPI_Fetch_and_op(&value, &result, MPI_INT64_T, rank, disp, MPI_SUM, this->win);
+    MPI_Win_flush(rank, this->win);
+    return result;
+}
+
+#endif
+
+} // namespace mrcpp
@@ -0,0 +1,126 @@
+/*
+ * MRCPP, a numerical library based on multiresolution analysis and
+ * the multiwavelet basis which provide low-scaling algorithms as well as
+ * rigorous error control in numerical computations.
+ * Copyright (C) 2021 Stig Rune Jensen, Jonas Juselius, Luca Frediani and contributors.
+ *
+ * This file is part of MRCPP.
+ *
+ * MRCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MRCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with MRCPP.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * For information on the complete list of contributors to MRCPP, see:
+ * <https://mrcpp.readthedocs.io/>
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "mpi_utils.h"
+
+namespace mrcpp {
+
+/** @brief One-sided storage behind BankAccount and TaskManager
+ *
+ * @details Used instead of the bank ranks when mpi::bank_rma is set. Every
+ * rank of the communicator exposes one fixed size memory window with two
+ * parts:
+ *
+ *  - Heap:  the data deposited by this rank, written locally and read by
+ *           the other ranks with MPI_Get, or with plain loads by the ranks
+ *           on the same node through a shared memory window
+ *  - Index: a hash table of keys, each with a growable list of entries that
+ *           tell where the data of the key is (owner rank, offset, size)
+ *
+ * The index of a key lives on its home rank, chosen by the caller, and is
+ * updated remotely with MPI atomics, so no rank has to serve requests.
+ * Entries are never moved or freed before clear(), which makes the lookups
+ * lock free: a reader that finds a key or entry that is still being written
+ * simply reads it again.
+ *
+ * All windows are locked with MPI_Win_lock_all for the lifetime of the
+ * object. Creation, clear() and destruction are collective.
+ */
+class BankWindow final {
+public:
+    enum Kind : int64_t { Data = 1, NodeData, Node, Orb, Func, Ready };
+
+    struct Key {
+        int64_t kind;
+        int64_t k1;
+        int64_t k2;
+        bool operator<(const Key &o) const { return std::tie(kind, k1, k2) < std::tie(o.kind, o.k1, o.k2); }
+    };
+
+    struct Entry {
+        int id;        ///< Identity of the data within the key
+        int rank;      ///< Rank that holds the data
+        int64_t disp;  ///< Offset of the data in the heap of rank (doubles)
+        int64_t size;  ///< Number of doubles, negative if removed
+        int64_t index; ///< Position of the entry in the index of the home rank
+    };
+
+    BankWindow(MPI_Comm comm, int64_t heapBytes, int64_t indexBytes);
+    BankWindow(const BankWindow &win) = delete;
+    BankWindow &operator=(const BankWindow &win) = delete;
+    ~BankWindow();
+
+    int home(int64_t id) const { return static_cast<int>(((id % this->comm_size) + this->comm_size) % this->comm_size); }
+    int getRank() const { return this->comm_rank; }
+    bool onNode(int rank) const { return this->node_base[rank] != nullptr; }
+
+    void clear();
+
+    int64_t store(const double *data, int64_t size);
+    void insert(int home, const Key &key, int id, int64_t disp, int64_t size);
+    std::vector<Entry> lookup(int home, const Key &key, bool wait);
+    void fetch(const Entry &entry, double *data, std::vector<MPI_Request> *requests = nullptr);
+    void flush();
+    void remove(int home, const Entry &entry);
+    int64_t next_count(int rank);
+
+private:
+    MPI_Comm comm;
+    MPI_Comm comm_node;
+    MPI_Win win;      // all ranks of comm, for atomics and remote access
+    MPI_Win win_node; // ranks on this node, same memory
+    int comm_rank{0};
+    int comm_size{1};
+
+    char *base{nullptr};
+    std::vector<char *> node_base; // base of the ranks on this node, null for the others
+    int64_t nBuckets{0};
+    int64_t nEntries{0};
+    int64_t entryOffset{0};
+    int64_t heapOffset{0};
+    int64_t heapSize{0}; // doubles
+    int64_t heapTop{0};  // doubles
+
+    std::map<std::pair<int, Key>, int64_t> buckets; // known buckets on each home rank
+
+    int64_t find_bucket(int home, const Key &key, bool create);
+    int64_t bucket_disp(int64_t b) const;
+    int64_t entry_disp(int64_t e) const;
+    bool read_entries(int home, int64_t bucket, std::vector<Entry> &entries);
+
+    int64_t read(int rank, int64_t disp);
+    void read(int rank, int64_t disp, int64_t *words, int n);
+    void write(int rank, int64_t disp, const int64_t *words, int n);
+    int64_t fetch_add(int rank, int64_t disp, int64_t value);
+};
+
+} // namespace mrcpp
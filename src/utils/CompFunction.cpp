@@ -1,13 +1,17 @@
 #include "CompFunction.h"
 #include "Bank.h"
 #include "Printer.h"
+#include "Timer.h"
 #include "parallel.h"
 #include "treebuilders/add.h"
 #include "treebuilders/grid.h"
 #include "treebuilders/multiply.h"
 #include "treebuilders/project.h"
 #include "trees/FunctionNode.h"
+#include "trees/TreeFile.h"
+#include <cstring>
 #include <fstream>
+#include <stdexcept>
 
 /* Some rules for CompFunction:
  * NComp is the number of components. If Ncomp>0, the corresponding trees must exist (can be only empty roots).
@@ -494,6 +498,7 @@ template <int D> void linear_combination(CompFunction<D> &out, const std::vector
         out.func_ptr->data.isreal = 0;
     }
     out.alloc(out.Ncomp());
+    if (share) mpi::barrier(mpi::comm_share); // wait until all ranks have zeroed the shared root nodes
     for (int comp = 0; comp < inp[0].Ncomp(); comp++) {
         if (not iscomplex) {
             FunctionTreeVector<D, double> fvec; // one component vector
@@ -763,6 +768,7 @@ void project(CompFunction<3> &out, std::function<double(const Coord<3> &r)> f, d
     out.func_ptr->isreal = 1;
     out.func_ptr->iscomplex = 0;
     if (out.Ncomp() < 1) out.alloc(1);
+    if (out.isShared()) mpi::barrier(mpi::comm_share); // wait until all ranks have zeroed the shared root nodes
     if (need_to_project) mrcpp::project<3>(prec, *out.CompD[0], f);
     mpi::share_function(out, 0, 123123, mpi::comm_share);
 }
@@ -773,6 +779,7 @@ void project(CompFunction<3> &out, std::function<ComplexDouble(const Coord<3> &r
     out.func_ptr->isreal = 0;
     out.func_ptr->iscomplex = 1;
     if (out.Ncomp() < 1) out.alloc(1);
+    if (out.isShared()) mpi::barrier(mpi::comm_share); // wait until all ranks have zeroed the shared root nodes
     if (need_to_project) mrcpp::project<3>(prec, *out.CompC[0], f);
     mpi::share_function(out, 0, 123123, mpi::comm_share);
 }
@@ -782,6 +789,7 @@ template <int D> void project(CompFunction<D> &out, RepresentableFunction<D, dou
     out.func_ptr->isreal = 1;
     out.func_ptr->iscomplex = 0;
     if (out.Ncomp() < 1) out.alloc(1);
+    if (out.isShared()) mpi::barrier(mpi::comm_share); // wait until all ranks have zeroed the shared root nodes
     if (need_to_project) mrcpp::project<D, double>(prec, *out.CompD[0], f);
     mpi::share_function(out, 0, 132231, mpi::comm_share);
 }
@@ -790,6 +798,7 @@ template <int D> void project(CompFunction<D> &out, RepresentableFunction<D, Com
     out.func_ptr->isreal = 0;
     out.func_ptr->iscomplex = 1;
     if (out.Ncomp() < 1) out.alloc(1);
+    if (out.isShared()) mpi::barrier(mpi::comm_share); // wait until all ranks have zeroed the shared root nodes
     if (need_to_project) mrcpp::project<D, ComplexDouble>(prec, *out.CompC[0], f);
     mpi::share_function(out, 0, 132231, mpi::comm_share);
 }
@@ -995,9 +1004,22 @@ void rotate_cplx(CompFunctionVector &Phi, const ComplexMatrix &U, CompFunctionVe
         ComplexMatrix coeffBlock(sizecoeff, N);
         max_ix++; // largest node index + 1. to store rotated orbitals with different id
         TaskManager tasks(max_n);
+        // tasks are claimed a few ahead, so that their node blocks are fetched while the previous ones are rotated.
+        // They are still processed in increasing order, which is required by the waiting for the parent splits.
+        NodeBlockPrefetch blocks(nodesPhi, 2 * sizecoeff, N);
+        std::deque<int> claimed;
+        bool all_claimed = false;
         for (int nn = 0; nn < max_n; nn++) {
-            int n = tasks.next_task();
-            if (n < 0) break;
+            while (not all_claimed and claimed.size() < 4) {
+                int m = tasks.next_task();
+                all_claimed = (m < 0);
+                if (all_claimed) break;
+                claimed.push_back(m);
+                blocks.push(indexVec_ref[m]);
+            }
+            if (claimed.size() == 0) break;
+            int n = claimed.front();
+            claimed.pop_front();
             double thres = prec * prec * scalefac_ref[n] * scalefac_ref[n];
             // 4a) make list of orbitals that should split the parent node, i.e. include this node
             int parentid = parindexVec_ref[n];
@@ -1019,7 +1041,7 @@ void rotate_cplx(CompFunctionVector &Phi, const ComplexMatrix &U, CompFunctionVe
 
             // 4b) rotate this node
             ComplexMatrix coeffBlock(csize, N); // largest possible used size
-            nodesPhi.get_nodeblock(indexVec_ref[n], coeffBlock.data(), orbjVec);
+            blocks.get_nodeblock(indexVec_ref[n], coeffBlock.data(), orbjVec);
             coeffBlock.conservativeResize(Eigen::NoChange, orbjVec.size()); // keep only used part
 
             // chunk of U, with reorganized indices and separate blocks for real and imag:
@@ -1038,6 +1060,7 @@ void rotate_cplx(CompFunctionVector &Phi, const ComplexMatrix &U, CompFunctionVe
 
             // 3c) find which orbitals need to further refine this node, and store rotated node (after each other while
             // in cache).
+            std::vector<ComplexDouble *> rotatedData;
             for (int i = 0; i < orbiVec.size(); i++) { // loop over rotated orbitals
                 needsplit[orbiVec[i]] = -1.0;          // default, do not split
                 // check if this node/orbital needs further refinement
@@ -1045,8 +1068,11 @@ void rotate_cplx(CompFunctionVector &Phi, const ComplexMatrix &U, CompFunctionVe
                 int kwstart = csize - sizecoeffW; // do not include scaling
                 for (int k = kwstart; k < csize; k++) wnorm += std::real(rotatedCoeff.col(i)[k] * std::conj(rotatedCoeff.col(i)[k]));
                 if (thres < wnorm or prec < 0) needsplit[orbiVec[i]] = 1.0;
-                nodesRotated.put_nodedata(orbiVec[i], indexVec_ref[n] + max_ix, csize, rotatedCoeff.col(i).data());
+                rotatedData.push_back(rotatedCoeff.col(i).data());
             }
+            // all the rotated orbitals of this node in one message
+            std::vector<int> rotatedNodeids(orbiVec.size(), indexVec_ref[n] + max_ix);
+            nodesRotated.put_nodedata(orbiVec, rotatedNodeids, std::vector<int>(orbiVec.size(), csize), rotatedData);
             nodeSplits.put_data(indexVec_ref[n], M, needsplit.data());
         }
         mpi::barrier(mpi::comm_wrk); // wait until all rotated nodes are ready
@@ -1073,7 +1099,7 @@ void rotate_cplx(CompFunctionVector &Phi, const ComplexMatrix &U, CompFunctionVe
             std::map<int, int> ix2coef;             // to find the index in coeffVec[] corresponding to a serialIx
             int ix = 0;
             std::vector<ComplexDouble *> pointerstodelete; // list of temporary arrays to clean up
-            for (int ibank = 0; ibank < mpi::bank_size; ibank++) {
+            for (int ibank = 0; ibank < std::max(mpi::bank_size, 1); ibank++) {
                 std::vector<int> nodeidVec;
                 ComplexDouble *dataVec; // will be allocated by bank
                 nodesRotated.get_orbblock(j, dataVec, nodeidVec, ibank);
@@ -1282,9 +1308,22 @@ void rotate(CompFunctionVector &Phi, const ComplexMatrix &U, CompFunctionVector
         DoubleMatrix coeffBlock(sizecoeff, N);
         max_ix++; // largest node index + 1. to store rotated orbitals with different id
         TaskManager tasks(max_n);
+        // tasks are claimed a few ahead, so that their node blocks are fetched while the previous ones are rotated.
+        // They are still processed in increasing order, which is required by the waiting for the parent splits.
+        NodeBlockPrefetch blocks(nodesPhi, sizecoeff, N);
+        std::deque<int> claimed;
+        bool all_claimed = false;
         for (int nn = 0; nn < max_n; nn++) {
-            int n = tasks.next_task();
-            if (n < 0) break;
+            while (not all_claimed and claimed.size() < 4) {
+                int m = tasks.next_task();
+                all_claimed = (m < 0);
+                if (all_claimed) break;
+                claimed.push_back(m);
+                blocks.push(indexVec_ref[m]);
+            }
+            if (claimed.size() == 0) break;
+            int n = claimed.front();
+            claimed.pop_front();
             double thres = prec * prec * scalefac_ref[n] * scalefac_ref[n];
             // 4a) make list of orbitals that should split the parent node, i.e. include this node
             int parentid = parindexVec_ref[n];
@@ -1306,7 +1345,7 @@ void rotate(CompFunctionVector &Phi, const ComplexMatrix &U, CompFunctionVector
 
             // 4b) rotate this node
             DoubleMatrix coeffBlock(csize, N); // largest possible used size
-            nodesPhi.get_nodeblock(indexVec_ref[n], coeffBlock.data(), orbjVec);
+            blocks.get_nodeblock(indexVec_ref[n], coeffBlock.data(), orbjVec);
             coeffBlock.conservativeResize(Eigen::NoChange, orbjVec.size()); // keep only used part
 
             // chunk of U, with reorganized indices and separate blocks for real and imag:
@@ -1324,6 +1363,7 @@ void rotate(CompFunctionVector &Phi, const ComplexMatrix &U, CompFunctionVector
 
             // 3c) find which orbitals need to further refine this node, and store rotated node (after each other while
             // in cache).
+            std::vector<double *> rotatedData;
             for (int i = 0; i < orbiVec.size(); i++) { // loop over rotated orbitals
                 needsplit[orbiVec[i]] = -1.0;          // default, do not split
                 // check if this node/orbital needs further refinement
@@ -1331,8 +1371,11 @@ void rotate(CompFunctionVector &Phi, const ComplexMatrix &U, CompFunctionVector
                 int kwstart = csize - sizecoeffW; // do not include scaling
                 for (int k = kwstart; k < csize; k++) wnorm += rotatedCoeff.col(i)[k] * rotatedCoeff.col(i)[k];
                 if (thres < wnorm or prec < 0) needsplit[orbiVec[i]] = 1.0;
-                nodesRotated.put_nodedata(orbiVec[i], indexVec_ref[n] + max_ix, csize, rotatedCoeff.col(i).data());
+                rotatedData.push_back(rotatedCoeff.col(i).data());
             }
+            // all the rotated orbitals of this node in one message
+            std::vector<int> rotatedNodeids(orbiVec.size(), indexVec_ref[n] + max_ix);
+            nodesRotated.put_nodedata(orbiVec, rotatedNodeids, std::vector<int>(orbiVec.size(), csize), rotatedData);
             nodeSplits.put_data(indexVec_ref[n], M, needsplit.data());
         }
         mpi::barrier(mpi::comm_wrk); // wait until all rotated nodes are ready
@@ -1362,7 +1405,7 @@ void rotate(CompFunctionVector &Phi, const ComplexMatrix &U, CompFunctionVector
             std::map<int, int> ix2coef;      // to find the index in coeffVec[] corresponding to a serialIx
             int ix = 0;
             std::vector<double *> pointerstodelete; // list of temporary arrays to clean up
-            for (int ibank = 0; ibank < mpi::bank_size; ibank++) {
+            for (int ibank = 0; ibank < std::max(mpi::bank_size, 1); ibank++) {
                 std::vector<int> nodeidVec;
                 double *dataVec; // will be allocated by bank
                 nodesRotated.get_orbblock(j, dataVec, nodeidVec, ibank);
@@ -1412,35 +1455,47 @@ void save_nodes(CompFunctionVector &Phi, FunctionTree<3> &refTree, BankAccount &
         if (Phi[j].isreal()) {
             Phi[j].real().makeCoeffVector(coeffVec, indexVec, parindexVec, scalefac, max_ix, refTree);
             int max_n = indexVec.size();
-            // send node coefs from Phi[j] to bank
+            // send node coefs from Phi[j] to bank, all nodes at once
             // except for the root nodes, only wavelets are sent
+            std::vector<int> nodeids, csizes;
+            std::vector<double *> nodedata;
             for (int i = 0; i < max_n; i++) {
                 if (indexVec[i] < 0) continue; // nodes that are not in refOrb
                 int csize = sizecoeffW;
                 if (parindexVec[i] < 0) csize = sizecoeff;
+                nodeids.push_back(indexVec[i]);
                 if (sizes > 0) { // fixed size
-                    account.put_nodedata(j, indexVec[i], sizes, coeffVec[i]);
+                    csizes.push_back(sizes);
+                    nodedata.push_back(coeffVec[i]);
                 } else {
-                    account.put_nodedata(j, indexVec[i], csize, &(coeffVec[i][sizecoeff - csize]));
+                    csizes.push_back(csize);
+                    nodedata.push_back(&(coeffVec[i][sizecoeff - csize]));
                 }
             }
+            account.put_nodedata(std::vector<int>(nodeids.size(), j), nodeids, csizes, nodedata);
         }
         // Complex components
         if (Phi[j].iscomplex()) {
             Phi[j].complex().makeCoeffVector(coeffVec_cplx, indexVec, parindexVec, scalefac, max_ix, refTree);
             int max_n = indexVec.size();
-            // send node coefs from Phi[j] to bank
+            // send node coefs from Phi[j] to bank, all nodes at once
+            std::vector<int> nodeids, csizes;
+            std::vector<ComplexDouble *> nodedata;
             for (int i = 0; i < max_n; i++) {
                 if (indexVec[i] < 0) continue; // nodes that are not in refOrb
                 // NB: the identifier (indexVec[i]) must be shifted for not colliding with the nodes from the real part
                 int csize = sizecoeffW;
                 if (parindexVec[i] < 0) csize = sizecoeff;
+                nodeids.push_back(indexVec[i]);
                 if (sizes > 0) { // fixed size
-                    account.put_nodedata(j, indexVec[i], sizes, coeffVec_cplx[i]);
+                    csizes.push_back(sizes);
+                    nodedata.push_back(coeffVec_cplx[i]);
                 } else {
-                    account.put_nodedata(j, indexVec[i], csize, &(coeffVec_cplx[i][sizecoeff - csize]));
+                    csizes.push_back(csize);
+                    nodedata.push_back(&(coeffVec_cplx[i][sizecoeff - csize]));
                 }
             }
+            account.put_nodedata(std::vector<int>(nodeids.size(), j), nodeids, csizes, nodedata);
         }
     }
 }
@@ -1487,7 +1542,7 @@ CompFunctionVector multiply(CompFunctionVector &Phi, RepresentableFunction<3> &f
     }
     mpi::allreduce_vector(PsihasReIm, mpi::comm_wrk);
     CompFunctionVector out(N);
-    for (int i = 0; i < N; i++) { out[0] = Phi[i].paramCopy(); }
+    for (int i = 0; i < N; i++) { out[i] = Phi[i].paramCopy(); }
     if (not PsihasReIm[0] and not PsihasReIm[1]) {
         return out; // do nothing
     }
@@ -1637,9 +1692,18 @@ CompFunctionVector multiply(CompFunctionVector &Phi, RepresentableFunction<3> &f
         // MPI
         int count1 = 0;
         int count2 = 0;
-        TaskManager tasks(max_n);
+        std::unique_ptr<TaskManager> tasks;
+        if (mpi::bank_rma) {
+            // the nodes are independent: each rank starts with the nodes whose index entry it holds in the
+            // one-sided bank, so that get_nodeblock looks them up locally (the coefficients stay on their owners)
+            std::vector<int> affinity(max_n);
+            for (int n = 0; n < max_n; n++) affinity[n] = indexVec_ref[n] % mpi::wrk_size;
+            tasks = std::make_unique<TaskManager>(affinity);
+        } else {
+            tasks = std::make_unique<TaskManager>(max_n);
+        }
         for (int nn = 0; nn < max_n; nn++) {
-            int n = tasks.next_task();
+            int n = tasks->next_task();
             if (n < 0) break;
             MWNode<D> node(*(refNodes[n]), false);
             // 3a) make values for f
@@ -1736,7 +1800,7 @@ CompFunctionVector multiply(CompFunctionVector &Phi, RepresentableFunction<3> &f
             int ix = 0;
             std::vector<double *> pointerstodelete; // list of temporary arrays to clean up
 
-            for (int ibank = 0; ibank < mpi::bank_size; ibank++) {
+            for (int ibank = 0; ibank < std::max(mpi::bank_size, 1); ibank++) {
                 std::vector<int> nodeidVec;
                 double *dataVec; // will be allocated by bank
                 nodesMultiplied.get_orbblock(j, dataVec, nodeidVec, ibank);
@@ -1810,166 +1874,100 @@ ComplexMatrix calc_lowdin_matrix(CompFunctionVector &Phi) {
     return S_m12;
 }
 
-/** @brief Orbital transformation out_j = sum_i inp_i*U_ij
- *
- * NOTE: OrbitalVector is considered a ROW vector, so rotation
- *       means matrix multiplication from the right
- *
- * MPI: Rank distribution of output vector is the same as input vector
+namespace {
+/** @brief Accumulates the upper triangle of S += P^H P, for panels P of node coefficients
  *
+ * @details The coefficient blocks of the nodes are stacked on top of each other
+ * into a panel, with one column for each orbital present in any of the nodes
+ * (zero where an orbital has no such node). A full panel is multiplied by
+ * itself as one rank-k update of the upper triangle (SYRK/HERK), rather than
+ * one small product per node. The panel is full when its rows times the
+ * columns in use would exceed maxSize coefficients: the nodes with few
+ * orbitals are gathered into tall panels, while a node with all the orbitals
+ * makes a panel on its own.
  */
-ComplexMatrix calc_overlap_matrix_cplx(CompFunctionVector &BraKet) {
-    int N = BraKet.size();
-    ComplexMatrix S = ComplexMatrix::Zero(N, N);
-    DoubleMatrix Sreal = S.real();
-    MultiResolutionAnalysis<3> *mra = BraKet.vecMRA;
-
-    // 1) make union tree without coefficients
-    mrcpp::FunctionTree<3> refTree(*mra);
-    mpi::allreduce_Tree_noCoeff(refTree, BraKet, mpi::comm_wrk);
-
-    int sizecoeff = (1 << refTree.getDim()) * refTree.getKp1_d();
-    int sizecoeffW = ((1 << refTree.getDim()) - 1) * refTree.getKp1_d();
-
-    // get a list of all nodes in union grid, as defined by their indices
-    std::vector<double> scalefac;
-    std::vector<double *> coeffVec_ref;
-    std::vector<int> indexVec_ref;    // serialIx of the nodes
-    std::vector<int> parindexVec_ref; // serialIx of the parent nodes
-    int max_ix;                       // largest index value (not used here)
-
-    refTree.makeCoeffVector(coeffVec_ref, indexVec_ref, parindexVec_ref, scalefac, max_ix, refTree);
-    int max_n = indexVec_ref.size();
-
-    // only used for serial case:
-    std::vector<std::vector<ComplexDouble *>> coeffVec(N);
-    std::map<int, std::vector<int>> node2orbVec; // for each node index, gives a vector with the indices of the orbitals using this node
-    std::vector<std::map<int, int>> orb2node(N); // for a given orbital and a given node, gives the node index in
-                                                 // the orbital given the node index in the reference tree
-
-    bool serial = mrcpp::mpi::wrk_size == 1; // flag for serial/MPI switch
-    mrcpp::BankAccount nodesBraKet;
-
-    // In the serial case we store the coeff pointers in coeffVec. In the mpi case the coeff are stored in the bank
-    if (serial) {
-        // 2) make list of all coefficients, and their reference indices
-        // for different orbitals, indexVec will give the same index for the same node in space
-        std::vector<int> parindexVec; // serialIx of the parent nodes
-        std::vector<int> indexVec;    // serialIx of the nodes
-        for (int j = 0; j < N; j++) {
-            // make vector with all coef pointers and their indices in the union grid
-            BraKet[j].complex().makeCoeffVector(coeffVec[j], indexVec, parindexVec, scalefac, max_ix, refTree);
-            // make a map that gives j from indexVec
-            int orb_node_ix = 0;
-            for (int ix : indexVec) {
-                orb2node[j][ix] = orb_node_ix++;
-                if (ix < 0) continue;
-                node2orbVec[ix].push_back(j);
-            }
+template <typename T> class OverlapPanel {
+public:
+    using Matrix = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>;
+
+    OverlapPanel(int N, int64_t maxSize)
+            : S(Matrix::Zero(N, N))
+            , maxSize(maxSize)
+            , column(N, -1) {}
+
+    /** Add the coefficients (rows values each) of the orbitals orbs at one node */
+    void add(const std::vector<const T *> &coefs, const std::vector<int> &orbs, int rows) {
+        int64_t nCols = this->orbs.size();
+        for (int j : orbs)
+            if (this->column[j] < 0) nCols++;
+        if (this->rows > 0 and (this->rows + rows) * nCols > this->maxSize) flush();
+        for (int j = 0; j < orbs.size(); j++) {
+            int &col = this->column[orbs[j]];
+            if (col < 0) {
+                col = this->orbs.size();
+                this->orbs.push_back(orbs[j]);
+            }
+            this->blocks.push_back({this->rows, col, static_cast<int64_t>(this->staged.size()), rows});
+            this->staged.insert(this->staged.end(), coefs[j], coefs[j] + rows);
         }
-    } else { // MPI case
-        // 2) send own nodes to bank, identifying them through the serialIx of refTree
-        save_nodes(BraKet, refTree, nodesBraKet);
-        mrcpp::mpi::barrier(mrcpp::mpi::comm_wrk); // wait until everything is stored before fetching!
-    }
-
-    // 3) make dot product for all the nodes and accumulate into S
-    int ibank = 0;
-#pragma omp parallel if (serial)
-    {
-        ComplexMatrix S_omp = ComplexMatrix::Zero(N, N); // copy for each thread
-
-#pragma omp for schedule(dynamic)
-        for (int n = 0; n < max_n; n++) {
-            if (n % mrcpp::mpi::wrk_size != mrcpp::mpi::wrk_rank) continue;
-            int csize;
-            int node_ix = indexVec_ref[n]; // SerialIx for this node in the reference tree
-            std::vector<int> orbVec;       // identifies which orbitals use this node
-            if (serial and node2orbVec[node_ix].size() <= 0) continue;
-            if (parindexVec_ref[n] < 0)
-                csize = sizecoeff;
-            else
-                csize = sizecoeffW;
-
-            // In the serial case we copy the coeff coeffBlock. In the mpi case coeffBlock is provided by the bank
-            if (serial) {
-                int shift = sizecoeff - sizecoeffW; // to copy only wavelet part
-                if (parindexVec_ref[n] < 0) shift = 0;
-                ComplexMatrix coeffBlock(csize, node2orbVec[node_ix].size());
-                for (int j : node2orbVec[node_ix]) { // loop over indices of the orbitals using this node
-                    int orb_node_ix = orb2node[j][node_ix];
-                    for (int k = 0; k < csize; k++) coeffBlock(k, orbVec.size()) = coeffVec[j][orb_node_ix][k + shift];
-                    orbVec.push_back(j);
-                }
-                if (orbVec.size() > 0) {
-                    ComplexMatrix S_temp(orbVec.size(), orbVec.size());
-                    S_temp.noalias() = coeffBlock.transpose().conjugate() * coeffBlock;
-                    for (int i = 0; i < orbVec.size(); i++) {
-                        for (int j = 0; j < orbVec.size(); j++) {
-                            if (BraKet[orbVec[i]].func_ptr->data.n1[0] != BraKet[orbVec[j]].func_ptr->data.n1[0] and BraKet[orbVec[i]].func_ptr->data.n1[0] != 0 and
-                                BraKet[orbVec[j]].func_ptr->data.n1[0] != 0)
-                                continue;
-                            S_omp(orbVec[i], orbVec[j]) += S_temp(i, j);
-                        }
-                    }
-                }
-            } else { // MPI case
-                ComplexMatrix coeffBlock(csize, N);
-                nodesBraKet.get_nodeblock(indexVec_ref[n], coeffBlock.data(), orbVec);
-
-                if (orbVec.size() > 0) {
-                    ComplexMatrix S_temp(orbVec.size(), orbVec.size());
-                    coeffBlock.conservativeResize(Eigen::NoChange, orbVec.size());
-                    S_temp.noalias() = coeffBlock.transpose().conjugate() * coeffBlock;
-                    for (int i = 0; i < orbVec.size(); i++) {
-                        for (int j = 0; j < orbVec.size(); j++) {
-                            if (BraKet[orbVec[i]].func_ptr->data.n1[0] != BraKet[orbVec[j]].func_ptr->data.n1[0] and BraKet[orbVec[i]].func_ptr->data.n1[0] != 0 and
-                                BraKet[orbVec[j]].func_ptr->data.n1[0] != 0)
-                                continue;
-                            S_omp(orbVec[i], orbVec[j]) += S_temp(i, j);
-                        }
-                    }
+        this->rows += rows;
+    }
+
+    /** Multiply the panel and add the product to S */
+    void flush() {
+        int n = this->orbs.size();
+        if (n > 0) {
+            this->panel.setZero(this->rows, n);
+            for (auto &b : this->blocks) this->panel.col(b.col).segment(b.row, b.size) = Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, 1>>(this->staged.data() + b.pos, b.size);
+            Matrix C = Matrix::Zero(n, n);
+            C.template selfadjointView<Eigen::Upper>().rankUpdate(this->panel.adjoint());
+            for (int b = 0; b < n; b++) {
+                for (int a = 0; a <= b; a++) {
+                    int i = this->orbs[a];
+                    int j = this->orbs[b];
+                    if (i <= j) this->S(i, j) += C(a, b);
+                    if (i > j) this->S(j, i) += Eigen::numext::conj(C(a, b));
                 }
             }
+            for (int j : this->orbs) this->column[j] = -1;
         }
-        if (serial) {
-#pragma omp critical
-            for (int i = 0; i < N; i++) {
-                for (int j = 0; j < N; j++) { S(i, j) += S_omp(i, j); }
-            }
-        }
-    }
-
-    for (int i = 0; i < N; i++) {
-        for (int j = 0; j <= i; j++) {
-            if (i != j) S(j, i) = std::conj(S(i, j)); // ensure exact symmetri
-        }
-    }
-
-    // Assumes linearity: result is sum of all nodes contributions
-    mrcpp::mpi::allreduce_matrix(S, mrcpp::mpi::comm_wrk);
-    // multiply by CompFunction multiplicative factor
-
-    ComplexVector Fac = ComplexVector::Zero(N);
-    for (int i = 0; i < N; i++) {
-        if (!mrcpp::mpi::my_func(BraKet[i])) continue;
-        Fac[i] = BraKet[i].func_ptr->data.c1[0];
-    }
-
-    mrcpp::mpi::allreduce_vector(Fac, mrcpp::mpi::comm_wrk);
-    for (int i = 0; i < N; i++) {
-        for (int j = 0; j < N; j++) { S(i, j) *= std::conj(Fac[i]) * Fac[j]; }
-    }
-
-    return S;
-}
-ComplexMatrix calc_overlap_matrix(CompFunctionVector &BraKet) {
-    // NB: should be spinseparated at this point!
-    if (BraKet[0].iscomplex()) { return calc_overlap_matrix_cplx(BraKet); }
-
+        this->orbs.clear();
+        this->blocks.clear();
+        this->staged.clear();
+        this->rows = 0;
+    }
+
+    Matrix S; // only the upper triangle is computed
+
+private:
+    struct Block {
+        int64_t row;  // first row in the panel
+        int col;      // column in the panel
+        int64_t pos;  // start in staged
+        int64_t size; // number of rows
+    };
+
+    int64_t maxSize; // coefficients per panel, unless a single node is larger
+    Matrix panel;
+    int64_t rows{0};         // rows in use in the panel
+    std::vector<int> orbs;   // orbital of each column in use
+    std::vector<int> column; // column of each orbital, -1 if not in the panel
+    std::vector<Block> blocks;
+    std::vector<T> staged; // coefficients of the blocks, until the number of columns is known
+};
+
+/** @brief Overlap matrix of real (T=double) or complex (T=ComplexDouble) functions
+ *
+ * @details Each thread (or each MPI rank) accumulates the nodes it treats into
+ * its own OverlapPanel. The upper triangles of the threads are then summed
+ * pairwise in a tree, and the spin and the lower triangle are applied once to
+ * the sum.
+ */
+template <typename T> ComplexMatrix overlap_matrix(CompFunctionVector &BraKet) {
+    using Matrix = Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>;
+    const int64_t panelSize = 1024 * 1024; // coefficients per panel
+    const int scalars = sizeof(T) / sizeof(double);
     int N = BraKet.size();
-    ComplexMatrix S = ComplexMatrix::Zero(N, N);
-
     MultiResolutionAnalysis<3> *mra = BraKet.vecMRA;
 
     // 1) make union tree without coefficients
@@ -1990,7 +1988,7 @@ ComplexMatrix calc_overlap_matrix(CompFunctionVector &BraKet) {
     int max_n = indexVec_ref.size();
 
     // only used for serial case:
-    std::vector<std::vector<double *>> coeffVec(N);
+    std::vector<std::vector<T *>> coeffVec(N);
     std::map<int, std::vector<int>> node2orbVec; // for each node index, gives a vector with the indices of the orbitals using this node
     std::vector<std::map<int, int>> orb2node(N); // for a given orbital and a given node, gives the node index in
                                                  // the orbital given the node index in the reference tree
@@ -2006,7 +2004,11 @@ ComplexMatrix calc_overlap_matrix(CompFunctionVector &BraKet) {
         std::vector<int> indexVec;    // serialIx of the nodes
         for (int j = 0; j < N; j++) {
             // make vector with all coef pointers and their indices in the union grid
-            BraKet[j].real().makeCoeffVector(coeffVec[j], indexVec, parindexVec, scalefac, max_ix, refTree);
+            if constexpr (std::is_same<T, ComplexDouble>::value) {
+                BraKet[j].complex().makeCoeffVector(coeffVec[j], indexVec, parindexVec, scalefac, max_ix, refTree);
+            } else {
+                BraKet[j].real().makeCoeffVector(coeffVec[j], indexVec, parindexVec, scalefac, max_ix, refTree);
+            }
             // make a map that gives j from indexVec
             int orb_node_ix = 0;
             for (int ix : indexVec) {
@@ -2021,76 +2023,67 @@ ComplexMatrix calc_overlap_matrix(CompFunctionVector &BraKet) {
         mrcpp::mpi::barrier(mrcpp::mpi::comm_wrk); // wait until everything is stored before fetching!
     }
 
-    // 3) make dot product for all the nodes and accumulate into S
-    int ibank = 0;
+    // 3) accumulate the products of all the nodes into the upper triangle of S
+    // in the MPI case the node blocks are fetched ahead of their use
+    NodeBlockPrefetch blocks(nodesBraKet, scalars * sizecoeff, N);
+    if (not serial)
+        for (int n = mrcpp::mpi::wrk_rank; n < max_n; n += mrcpp::mpi::wrk_size) blocks.push(indexVec_ref[n]);
+    std::vector<Matrix> S_omp(serial ? mrcpp_get_max_threads() : 1); // one for each thread
 #pragma omp parallel if (serial)
     {
-        ComplexMatrix S_omp = ComplexMatrix::Zero(N, N); // copy for each thread
+        int thread = mrcpp_get_thread_num();
+        int nThreads = 1;
+#ifdef MRCPP_HAS_OMP
+        nThreads = omp_get_num_threads();
+#endif
+        OverlapPanel<T> panel(N, panelSize);
+        Matrix coeffBlock; // only used in MPI case
+        std::vector<const T *> coefs;
+        std::vector<int> orbVec; // identifies which orbitals use this node
 
 #pragma omp for schedule(dynamic)
         for (int n = 0; n < max_n; n++) {
             if (n % mrcpp::mpi::wrk_size != mrcpp::mpi::wrk_rank) continue;
-            int csize;
             int node_ix = indexVec_ref[n]; // SerialIx for this node in the reference tree
-            std::vector<int> orbVec;       // identifies which orbitals use this node
-            if (serial and node2orbVec[node_ix].size() <= 0) continue;
-            if (parindexVec_ref[n] < 0)
-                csize = sizecoeff;
-            else
-                csize = sizecoeffW;
+            int csize = (parindexVec_ref[n] < 0) ? sizecoeff : sizecoeffW;
+            int shift = sizecoeff - csize; // to use only wavelet part
+            coefs.clear();
+            orbVec.clear();
 
-            // In the serial case we copy the coeff coeffBlock. In the mpi case coeffBlock is provided by the bank
+            // In the serial case the coefficients are used in place. In the mpi case coeffBlock is provided by the bank
             if (serial) {
-                int shift = sizecoeff - sizecoeffW; // to copy only wavelet part
-                if (parindexVec_ref[n] < 0) shift = 0;
-                DoubleMatrix coeffBlock(csize, node2orbVec[node_ix].size());
-                for (int j : node2orbVec[node_ix]) { // loop over indices of the orbitals using this node
-                    int orb_node_ix = orb2node[j][node_ix];
-                    for (int k = 0; k < csize; k++) coeffBlock(k, orbVec.size()) = coeffVec[j][orb_node_ix][k + shift];
+                auto it = node2orbVec.find(node_ix);
+                if (it == node2orbVec.end()) continue;
+                for (int j : it->second) { // loop over indices of the orbitals using this node
+                    coefs.push_back(coeffVec[j][orb2node[j][node_ix]] + shift);
                     orbVec.push_back(j);
                 }
-                if (orbVec.size() > 0) {
-                    ComplexMatrix S_temp(orbVec.size(), orbVec.size());
-                    S_temp.noalias() = coeffBlock.transpose() * coeffBlock;
-                    for (int i = 0; i < orbVec.size(); i++) {
-                        for (int j = 0; j < orbVec.size(); j++) {
-                            if (BraKet[orbVec[i]].func_ptr->data.n1[0] != BraKet[orbVec[j]].func_ptr->data.n1[0] and BraKet[orbVec[i]].func_ptr->data.n1[0] != 0 and
-                                BraKet[orbVec[j]].func_ptr->data.n1[0] != 0)
-                                continue;
-                            S_omp(orbVec[i], orbVec[j]) += S_temp(i, j);
-                        }
-                    }
-                }
             } else { // MPI case
-                DoubleMatrix coeffBlock(csize, N);
-                nodesBraKet.get_nodeblock(indexVec_ref[n], coeffBlock.data(), orbVec);
-
-                if (orbVec.size() > 0) {
-                    DoubleMatrix S_temp(orbVec.size(), orbVec.size());
-                    coeffBlock.conservativeResize(Eigen::NoChange, orbVec.size());
-                    S_temp.noalias() = coeffBlock.transpose() * coeffBlock;
-                    for (int i = 0; i < orbVec.size(); i++) {
-                        for (int j = 0; j < orbVec.size(); j++) {
-                            if (BraKet[orbVec[i]].func_ptr->data.n1[0] != BraKet[orbVec[j]].func_ptr->data.n1[0] and BraKet[orbVec[i]].func_ptr->data.n1[0] != 0 and
-                                BraKet[orbVec[j]].func_ptr->data.n1[0] != 0)
-                                continue;
-                            S(orbVec[i], orbVec[j]) += S_temp(i, j);
-                        }
-                    }
-                }
+                coeffBlock.resize(csize, N);
+                blocks.get_nodeblock(node_ix, coeffBlock.data(), orbVec);
+                for (int j = 0; j < orbVec.size(); j++) coefs.push_back(coeffBlock.col(j).data());
             }
+            if (orbVec.size() > 0) panel.add(coefs, orbVec, csize);
         }
-        if (serial) {
-#pragma omp critical
-            for (int i = 0; i < N; i++) {
-                for (int j = 0; j < N; j++) { S(i, j) += S_omp(i, j); }
-            }
+        panel.flush();
+        S_omp[thread] = std::move(panel.S);
+
+        // sum the threads pairwise, log2(nThreads) levels
+        for (int stride = 1; stride < nThreads; stride *= 2) {
+#pragma omp barrier
+            if (thread % (2 * stride) == 0 and thread + stride < nThreads) S_omp[thread].template triangularView<Eigen::Upper>() += S_omp[thread + stride];
         }
     }
 
-    for (int i = 0; i < N; i++) {
-        for (int j = 0; j <= i; j++) {
-            if (i != j) S(j, i) = std::conj(S(i, j)); // ensure exact symmetri
+    // the spins and the lower triangle are applied to the sum
+    ComplexMatrix S = ComplexMatrix::Zero(N, N);
+    for (int j = 0; j < N; j++) {
+        for (int i = 0; i <= j; i++) {
+            int spin_i = BraKet[i].func_ptr->data.n1[0];
+            int spin_j = BraKet[j].func_ptr->data.n1[0];
+            if (spin_i != spin_j and spin_i != 0 and spin_j != 0) continue;
+            S(i, j) = S_omp[0](i, j);
+            S(j, i) = std::conj(S(i, j)); // ensure exact symmetri
         }
     }
 
@@ -2110,6 +2103,23 @@ ComplexMatrix calc_overlap_matrix(CompFunctionVector &BraKet) {
 
     return S;
 }
+} // namespace
+
+/** @brief Compute the overlap matrix S_ij = <braket_i|braket_j>
+ *
+ *  Only the upper triangle is computed, the matrix is Hermitian by construction.
+ */
+ComplexMatrix calc_overlap_matrix(CompFunctionVector &BraKet) {
+    // NB: should be spinseparated at this point!
+    // the functions are not defined on the ranks that do not own them
+    IntVector iscomplex = IntVector::Zero(1);
+    for (int i = 0; i < BraKet.size(); i++) {
+        if (mrcpp::mpi::my_func(BraKet[i]) and BraKet[i].iscomplex()) iscomplex[0] = 1;
+    }
+    mrcpp::mpi::allreduce_vector(iscomplex, mrcpp::mpi::comm_wrk);
+    if (iscomplex[0]) return overlap_matrix<ComplexDouble>(BraKet);
+    return overlap_matrix<double>(BraKet);
+}
 
 /** @brief Compute the overlap matrix S_ij = <bra_i|ket_j>
  *
@@ -2228,6 +2238,15 @@ ComplexMatrix calc_overlap_matrix_cplx(CompFunctionVector &Bra, CompFunctionVect
     int totget = 0;
     int mxtotsiz = 0;
     int ibank = 0;
+    // in the MPI case the node blocks are fetched ahead of their use
+    NodeBlockPrefetch blocksBra(nodesBra, 2 * sizecoeff, N);
+    NodeBlockPrefetch blocksKet(nodesKet, 2 * sizecoeff, M);
+    if (not serial) {
+        for (int n = mrcpp::mpi::wrk_rank; n < max_n; n += mrcpp::mpi::wrk_size) {
+            blocksBra.push(indexVec_ref[n]);
+            blocksKet.push(indexVec_ref[n]);
+        }
+    }
     // the omp crashes sometime for unknown reasons?
 #pragma omp parallel if (serial)
     {
@@ -2286,8 +2305,8 @@ ComplexMatrix calc_overlap_matrix_cplx(CompFunctionVector &Bra, CompFunctionVect
 
                 ComplexMatrix coeffBlockBra(csize, N);
                 ComplexMatrix coeffBlockKet(csize, M);
-                nodesBra.get_nodeblock(indexVec_ref[n], coeffBlockBra.data(), orbVecBra); // get Bra parts
-                nodesKet.get_nodeblock(indexVec_ref[n], coeffBlockKet.data(), orbVecKet); // get Ket parts
+                blocksBra.get_nodeblock(indexVec_ref[n], coeffBlockBra.data(), orbVecBra); // get Bra parts
+                blocksKet.get_nodeblock(indexVec_ref[n], coeffBlockKet.data(), orbVecKet); // get Ket parts
                 totsiz += orbVecBra.size() * orbVecKet.size();
                 mxtotsiz += N * M;
                 totget += orbVecBra.size() + orbVecKet.size();
@@ -2455,6 +2474,15 @@ ComplexMatrix calc_overlap_matrix(CompFunctionVector &Bra, CompFunctionVector &K
     int totget = 0;
     int mxtotsiz = 0;
     int ibank = 0;
+    // in the MPI case the node blocks are fetched ahead of their use
+    NodeBlockPrefetch blocksBra(nodesBra, sizecoeff, N);
+    NodeBlockPrefetch blocksKet(nodesKet, sizecoeff, M);
+    if (not serial) {
+        for (int n = mrcpp::mpi::wrk_rank; n < max_n; n += mrcpp::mpi::wrk_size) {
+            blocksBra.push(indexVec_ref[n]);
+            blocksKet.push(indexVec_ref[n]);
+        }
+    }
 #pragma omp parallel if (serial)
     {
         DoubleMatrix S_omp = DoubleMatrix::Zero(N, M); // copy for each thread
@@ -2504,8 +2532,8 @@ ComplexMatrix calc_overlap_matrix(CompFunctionVector &Bra, CompFunctionVector &K
 
                 DoubleMatrix coeffBlockBra(csize, N);
                 DoubleMatrix coeffBlockKet(csize, M);
-                nodesBra.get_nodeblock(indexVec_ref[n], coeffBlockBra.data(), orbVecBra); // get Bra parts
-                nodesKet.get_nodeblock(indexVec_ref[n], coeffBlockKet.data(), orbVecKet); // get Ket parts
+                blocksBra.get_nodeblock(indexVec_ref[n], coeffBlockBra.data(), orbVecBra); // get Bra parts
+                blocksKet.get_nodeblock(indexVec_ref[n], coeffBlockKet.data(), orbVecKet); // get Ket parts
                 totsiz += orbVecBra.size() * orbVecKet.size();
                 mxtotsiz += N * M;
                 totget += orbVecBra.size() + orbVecKet.size();
@@ -2581,6 +2609,203 @@ void orthogonalize(double prec, CompFunctionVector &Bra, CompFunctionVector &Ket
     }
 }
 
+namespace {
+const char checkpointMagic[8] = "MRCCHKP";
+const uint32_t checkpointVersion = 2;
+
+struct CheckpointHeader {
+    char magic[8];    // "MRCCHKP"
+    uint32_t version; // format version
+    uint32_t endian;  // tree_file::EndianMark in the byte order of the writer
+    int32_t nFuncs;   // number of functions in the file
+    int32_t reserved;
+};
+
+// the CompFunctionData of a function, field by field, independent of the layout of the struct
+struct CheckpointEntry {
+    int32_t index; // position in the vector
+    int32_t Ncomp;
+    int32_t rank;
+    int32_t conj;
+    int32_t isreal;
+    int32_t iscomplex;
+    int32_t CompFn1;
+    int32_t CompFn2;
+    int32_t n1[4];
+    int32_t n2[4];
+    int32_t n3[4];
+    int32_t n4[4];
+    double CompFd1;
+    double CompFd2;
+    double CompFd3;
+    double c1[4][2]; // real and imaginary parts
+    double d1[4];
+    double d2[4];
+    double d3[4];
+};
+
+CheckpointEntry make_entry(int index, const CompFunctionData<3> &data) {
+    CheckpointEntry entry{index, data.Ncomp, data.rank, data.conj, data.isreal, data.iscomplex, data.CompFn1, data.CompFn2};
+    for (int i = 0; i < 4; i++) {
+        entry.n1[i] = data.n1[i];
+        entry.n2[i] = data.n2[i];
+        entry.n3[i] = data.n3[i];
+        entry.n4[i] = data.n4[i];
+        entry.c1[i][0] = data.c1[i].real();
+        entry.c1[i][1] = data.c1[i].imag();
+        entry.d1[i] = data.d1[i];
+        entry.d2[i] = data.d2[i];
+        entry.d3[i] = data.d3[i];
+    }
+    entry.CompFd1 = data.CompFd1;
+    entry.CompFd2 = data.CompFd2;
+    entry.CompFd3 = data.CompFd3;
+    return entry;
+}
+
+CompFunctionData<3> read_entry(const CheckpointEntry &entry) {
+    CompFunctionData<3> data;
+    data.Ncomp = entry.Ncomp;
+    data.rank = entry.rank;
+    data.conj = entry.conj;
+    data.isreal = entry.isreal;
+    data.iscomplex = entry.iscomplex;
+    data.CompFn1 = entry.CompFn1;
+    data.CompFn2 = entry.CompFn2;
+    data.CompFd1 = entry.CompFd1;
+    data.CompFd2 = entry.CompFd2;
+    data.CompFd3 = entry.CompFd3;
+    for (int i = 0; i < 4; i++) {
+        data.n1[i] = entry.n1[i];
+        data.n2[i] = entry.n2[i];
+        data.n3[i] = entry.n3[i];
+        data.n4[i] = entry.n4[i];
+        data.c1[i] = {entry.c1[i][0], entry.c1[i][1]};
+        data.d1[i] = entry.d1[i];
+        data.d2[i] = entry.d2[i];
+        data.d3[i] = entry.d3[i];
+    }
+    return data;
+}
+
+std::string checkpoint_name(const std::string &file) {
+    return file + "." + std::to_string(mpi::wrk_rank) + ".chk";
+}
+} // namespace
+
+/** @brief Write the functions of this MPI rank to disk in the background
+ *
+ * @param[in] Phi: Functions to save, only those belonging to this rank are written
+ * @param[in] file: File name, will get ".<rank>.chk" extension
+ * @returns A future that is ready when the file is written and closed,
+ * its get() rethrows a std::runtime_error if the file could not be written
+ *
+ * @details The component trees are first serialized into memory buffers in
+ * the saveTree format (in parallel over functions), which is the only part
+ * that blocks the caller, and does not change the trees. The buffers are then
+ * written to one container file per rank by a background thread, so the
+ * functions can be changed or freed while the checkpoint drains. The
+ * container has a versioned header, and holds, for each function, its index
+ * in Phi and its CompFunctionData as a CheckpointEntry, followed by the size
+ * and content of each component tree.
+ */
+std::future<void> save_checkpoint(CompFunctionVector &Phi, const std::string &file) {
+    Timer t1;
+    std::vector<int> funcs;
+    for (int j = 0; j < Phi.size(); j++) {
+        if (mpi::my_func(j)) funcs.push_back(j);
+    }
+
+    // Snapshot of each component tree
+    int nFuncs = funcs.size();
+    std::vector<std::vector<std::string>> buffers(nFuncs);
+#pragma omp parallel for schedule(dynamic)
+    for (int n = 0; n < nFuncs; n++) {
+        CompFunction<3> &func = Phi[funcs[n]];
+        for (int i = 0; i < func.Ncomp(); i++) {
+            std::ostringstream out(std::ios::binary);
+            if (func.isreal()) {
+                func.CompD[i]->saveTree(out);
+            } else {
+                func.CompC[i]->saveTree(out);
+            }
+            buffers[n].push_back(out.str());
+        }
+    }
+    std::vector<CheckpointEntry> entries(nFuncs);
+    for (int n = 0; n < nFuncs; n++) entries[n] = make_entry(funcs[n], Phi[funcs[n]].data());
+    print::time(10, "Time checkpoint snapshot", t1);
+
+    // Write to disk in the background
+    auto write = [fname = checkpoint_name(file), entries = std::move(entries), buffers = std::move(buffers)]() {
+        std::ofstream f(fname, std::ios::out | std::ios::binary);
+        if (not f.is_open()) throw std::runtime_error("Unable to open file: " + fname);
+        int nFuncs = entries.size();
+        CheckpointHeader header{};
+        std::memcpy(header.magic, checkpointMagic, sizeof(header.magic));
+        header.version = checkpointVersion;
+        header.endian = tree_file::EndianMark;
+        header.nFuncs = nFuncs;
+        f.write((char *)&header, sizeof(header));
+        for (int n = 0; n < nFuncs; n++) {
+            f.write((char *)&entries[n], sizeof(CheckpointEntry));
+            for (auto &buffer : buffers[n]) {
+                int64_t size = buffer.size();
+                f.write((char *)&size, sizeof(int64_t));
+                f.write(buffer.data(), size);
+            }
+        }
+        f.close();
+        if (not f) throw std::runtime_error("Failed to write checkpoint: " + fname);
+    };
+    return std::async(std::launch::async, std::move(write));
+}
+
+/** @brief Read the functions of this MPI rank from a checkpoint
+ *
+ * @param[in,out] Phi: Functions are loaded into their original position in Phi
+ * @param[in] file: File name, as given to save_checkpoint
+ *
+ * @details Must be called with the same number of MPI ranks as the checkpoint
+ * was written with, on a machine with the same byte order. The component
+ * trees are allocated with the default MRA.
+ */
+void load_checkpoint(CompFunctionVector &Phi, const std::string &file) {
+    Timer t1;
+    std::string fname = checkpoint_name(file);
+    std::ifstream f(fname, std::ios::in | std::ios::binary);
+    if (not f.is_open()) MSG_ABORT("Unable to open file: " << fname);
+
+    CheckpointHeader header;
+    f.read((char *)&header, sizeof(header));
+    if (not f or std::memcmp(header.magic, checkpointMagic, sizeof(header.magic)) != 0) MSG_ABORT("Invalid checkpoint file: " << fname);
+    if (header.endian != tree_file::EndianMark) MSG_ABORT("Checkpoint written with another byte order: " << fname);
+    if (header.version != checkpointVersion) MSG_ABORT("Unsupported checkpoint version " << header.version << ": " << fname);
+
+    for (int n = 0; n < header.nFuncs; n++) {
+        CheckpointEntry entry;
+        f.read((char *)&entry, sizeof(CheckpointEntry));
+        int j = entry.index;
+        if (not f or j < 0 or j >= Phi.size()) MSG_ABORT("Invalid checkpoint file: " << fname);
+        CompFunctionData<3> data = read_entry(entry);
+        CompFunction<3> func(data);
+        func.alloc(data.Ncomp, false);
+        for (int i = 0; i < func.Ncomp(); i++) {
+            int64_t size;
+            f.read((char *)&size, sizeof(int64_t));
+            std::streampos next = f.tellg() + std::streamoff(size);
+            if (func.isreal()) {
+                func.CompD[i]->loadTree(f);
+            } else {
+                func.CompC[i]->loadTree(f);
+            }
+            f.seekg(next);
+        }
+        Phi[j] = func;
+    }
+    print::time(10, "Time load checkpoint", t1);
+}
+
 /** @brief Orthogonalize the Bra against Ket
  *
  */
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <future>
+
 #include "mpi_utils.h"
 #include "trees/FunctionTreeVector.h"
 
@@ -43,6 +45,7 @@ template <int D> struct CompFunctionData {
     // used internally
     int shared{0};
     int Nchunks[4]{0, 0, 0, 0}; // number of chunks of each component tree
+    int packed[4]{0, 0, 0, 0};  // component trees with single precision coefficients
 };
 
 template <int D> class TreePtr final {
@@ -54,10 +57,10 @@ public:
         for (int i = 0; i < 4; i++) cplx[i] = nullptr;
         is_shared = share;
         if (is_shared and mpi::share_size > 1) {
-            // Memory size in MB defined in input. Virtual memory, does not cost anything if not used.
+            // The memory is taken from the shared memory pool of the node as the trees grow.
 #ifdef MRCPP_HAS_MPI
-            this->shared_mem_real = new mrcpp::SharedMemory<double>(mpi::comm_share, mpi::shared_memory_size);
-            this->shared_mem_cplx = new mrcpp::SharedMemory<ComplexDouble>(mpi::comm_share, mpi::shared_memory_size);
+            this->shared_mem_real = new mrcpp::SharedMemory<double>(mpi::comm_share);
+            this->shared_mem_cplx = new mrcpp::SharedMemory<ComplexDouble>(mpi::comm_share);
 #endif
         }
     }
@@ -195,5 +198,7 @@ ComplexMatrix calc_lowdin_matrix(CompFunctionVector &Phi);
 ComplexMatrix calc_overlap_matrix(CompFunctionVector &BraKet);
 ComplexMatrix calc_overlap_matrix(CompFunctionVector &Bra, CompFunctionVector &Ket);
 void orthogonalize(double prec, CompFunctionVector &Bra, CompFunctionVector &Ket);
+std::future<void> save_checkpoint(CompFunctionVector &Phi, const std::string &file);
+void load_checkpoint(CompFunctionVector &Phi, const std::string &file);
 
 } // namespace mrcpp
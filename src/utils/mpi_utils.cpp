@@ -29,54 +29,315 @@
 #include "trees/FunctionTree.h"
 #include "trees/NodeAllocator.h"
 
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <vector>
+
 namespace mrcpp {
 
-/** @brief SharedMemory constructor
+static const int bcast_segment = 4 * 1024 * 1024; // max message size in broadcast_tree, in bytes
+
+static std::map<mrcpp::mpi_comm, std::unique_ptr<SharedMemoryPool>> shared_pools; // one pool per communicator
+
+/** @brief SharedMemoryPool constructor
  *
  *  @param[in] comm: Communicator sharing resources
- *  @param[in] sh_size: Memory size, in MB
+ *
+ *  @details Collective in comm, the first window is allocated at once.
+ *  Without MPI the windows are plain heap memory.
  */
-template <typename T>
-SharedMemory<T>::SharedMemory(mrcpp::mpi_comm comm, int sh_size)
-        : sh_start_ptr(nullptr)
-        , sh_end_ptr(nullptr)
-        , sh_max_ptr(nullptr)
-        , sh_win(0)
-        , rank(0) {
-
+SharedMemoryPool::SharedMemoryPool(mrcpp::mpi_comm comm)
+        : comm(comm) {
 #ifdef MRCPP_HAS_MPI
     MPI_Comm_rank(comm, &this->rank);
-    // MPI_Aint types are used for adresses (can be larger than int)
-    MPI_Aint size = (rank == 0) ? sh_size : 0; // rank 0 defines length of segment
-    size *= 1024 * 1024;                       // ->MB NB: Must be multiplied separately, for not overflow int type.
+#endif
+    this->slab_size = std::max(mpi::shared_slab_size, 1);
+    this->slab_size *= 1024 * 1024;
+    addWindow(-1);
+}
+
+SharedMemoryPool::~SharedMemoryPool() {
+#ifdef MRCPP_HAS_MPI
+    int finalized = 0;
+    MPI_Finalized(&finalized);
+    if (finalized) return;
+    for (auto &w : this->windows) MPI_Win_free(&w.win);
+#else
+    for (auto &w : this->windows) delete[] reinterpret_cast<char *>(w.table);
+#endif
+}
+
+/** @brief Pool of a communicator, created at the first call (collective) */
+SharedMemoryPool &SharedMemoryPool::get(mrcpp::mpi_comm comm) {
+    auto &pool = shared_pools[comm];
+    if (pool == nullptr) pool = std::make_unique<SharedMemoryPool>(comm);
+    return *pool;
+}
 
+/** @brief Free the windows of all pools, called by mpi::finalize */
+void SharedMemoryPool::free_all() {
+    shared_pools.clear();
+}
+
+/** @brief Append a window to the pool (collective)
+ *
+ *  @param[in] id: SharedMemory the window is reserved for, -1 for none
+ */
+void SharedMemoryPool::addWindow(int id) {
+    int64_t size = std::max(mpi::shared_memory_size, 1);
+    size *= 1024 * 1024; // ->MB NB: Must be multiplied separately, for not overflow int type.
+    Window w;
+    w.nSlabs = std::max<int64_t>(size / this->slab_size, 1);
+    int64_t tableSize = ((w.nSlabs * sizeof(Slab) + 4095) / 4096) * 4096;
+
+    char *ptr = nullptr;
+#ifdef MRCPP_HAS_MPI
+    MPI_Aint winSize = (this->rank == 0) ? tableSize + w.nSlabs * this->slab_size : 0; // rank 0 defines length of segment
     int disp_unit = 16; // in order for the compiler to keep aligned
-    // size is in bytes
-    MPI_Win_allocate_shared(size, disp_unit, MPI_INFO_NULL, comm, &this->sh_start_ptr, &this->sh_win);
-    MPI_Win_fence(0, this->sh_win); // wait until finished
+    MPI_Win_allocate_shared(winSize, disp_unit, MPI_INFO_NULL, this->comm, &ptr, &w.win);
     MPI_Aint qsize = 0;
     int qdisp = 0;
-    MPI_Win_shared_query(this->sh_win, 0, &qsize, &qdisp, &this->sh_start_ptr);
-    MPI_Win_fence(0, this->sh_win);
-    this->sh_max_ptr = this->sh_start_ptr + qsize / sizeof(T);
-    this->sh_end_ptr = this->sh_start_ptr;
+    MPI_Win_shared_query(w.win, 0, &qsize, &qdisp, &ptr);
+#else
+    ptr = new char[tableSize + w.nSlabs * this->slab_size];
+    w.win = 0;
+#endif
+    w.table = reinterpret_cast<Slab *>(ptr);
+    w.base = ptr + tableSize;
+    if (this->rank == 0)
+        for (int i = 0; i < w.nSlabs; i++) w.table[i] = {-1, -1, 0, id};
+#ifdef MRCPP_HAS_MPI
+    MPI_Win_sync(w.win);
+    MPI_Barrier(this->comm);
 #endif
+    this->windows.push_back(w);
 }
 
-template <typename T> void SharedMemory<T>::clear() {
+/** The slab tables of all windows are guarded by a lock on the first window */
+void SharedMemoryPool::lock() {
 #ifdef MRCPP_HAS_MPI
-    this->sh_end_ptr = this->sh_start_ptr;
+    MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, this->windows[0].win);
+    MPI_Win_sync(this->windows[0].win);
+#endif
+}
+
+void SharedMemoryPool::unlock() {
+#ifdef MRCPP_HAS_MPI
+    MPI_Win_sync(this->windows[0].win);
+    MPI_Win_unlock(0, this->windows[0].win);
+#endif
+}
+
+/** @brief Identifier for a new SharedMemory (collective)
+ *
+ *  @details A whole window is reserved for the new id, so that each
+ *  SharedMemory can always grow to mpi::shared_memory_size MB, whatever the
+ *  other ones do. A window that is entirely free is reused, otherwise a new
+ *  one is appended, since this is only possible while all ranks are together.
+ *  For the same reason, a window is added if less than half a window of
+ *  unreserved slabs is left for the blocks that outgrow their own window.
+ */
+int SharedMemoryPool::newId() {
+    int id = this->next_id++;
+    int state[2] = {0, 0}; // window reserved, number of free unreserved slabs
+    if (this->rank == 0) reserve(id, state[0], state[1]);
+#ifdef MRCPP_HAS_MPI
+    MPI_Bcast(state, 2, MPI_INT, 0, this->comm);
+#endif
+    if (not state[0]) addWindow(id);
+    if (2 * state[1] < this->windows.back().nSlabs) addWindow(-1);
+    return id;
+}
+
+/** @brief Reserve an entirely free window for a SharedMemory
+ *
+ *  @param[in] id: Identifier of the SharedMemory
+ *  @param[out] found: 1 if a window was reserved
+ *  @param[out] nSpare: Number of free slabs left unreserved
+ */
+void SharedMemoryPool::reserve(int id, int &found, int &nSpare) {
+    found = 0;
+    nSpare = 0;
+    lock();
+    for (auto &w : this->windows) {
+        bool empty = true;
+        for (int i = 0; empty and i < w.nSlabs; i++) empty = (w.table[i].owner < 0 and w.table[i].reserved < 0);
+        if (empty and not found) {
+            for (int i = 0; i < w.nSlabs; i++) w.table[i].reserved = id;
+            found = 1;
+        }
+        for (int i = 0; i < w.nSlabs; i++)
+            if (w.table[i].owner < 0 and w.table[i].reserved < 0) nSpare++;
+    }
+    unlock();
+}
+
+int SharedMemoryPool::getNFreeSlabs() {
+    int nFree = 0;
+    lock();
+    for (auto &w : this->windows)
+        for (int i = 0; i < w.nSlabs; i++)
+            if (w.table[i].owner < 0) nFree++;
+    unlock();
+    return nFree;
+}
+
+/** @brief MPI window holding the memory at ptr
+ *
+ *  @details The first window of the pool if ptr is not in the pool.
+ */
+mrcpp::mpi_win SharedMemoryPool::getWindow(const void *ptr) const {
+    const char *p = static_cast<const char *>(ptr);
+    for (auto &w : this->windows)
+        if (p >= w.base and p < w.base + w.nSlabs * this->slab_size) return w.win;
+    return this->windows[0].win;
+}
+
+/** @brief Memory of a segment
+ *
+ *  @param[in] id: Identifier of the SharedMemory
+ *  @param[in] seq: Segment number in the SharedMemory
+ *  @param[in] size: Segment size, in bytes
+ *
+ *  @details The first rank asking for a segment claims a free run of slabs,
+ *  the other ranks of the group get the same memory. The run is taken in the
+ *  window reserved for the id, or else in slabs that are not reserved.
+ */
+char *SharedMemoryPool::claim(int id, int seq, int64_t size) {
+    char *ptr = nullptr;
+    int count = (size + this->slab_size - 1) / this->slab_size;
+    lock();
+    for (auto &w : this->windows) {
+        for (int i = 0; ptr == nullptr and i < w.nSlabs; i++) {
+            if (w.table[i].owner != id or w.table[i].seq != seq) continue;
+            if (w.table[i].count < count) MSG_ERROR("Shared memory segment " << seq << " has wrong size");
+            ptr = w.base + i * this->slab_size;
+        }
+    }
+    for (int reserved : {id, -1}) {
+        for (auto &w : this->windows) {
+            int run = 0;
+            for (int i = 0; ptr == nullptr and i < w.nSlabs; i++) {
+                run = (w.table[i].owner < 0 and w.table[i].reserved == reserved) ? run + 1 : 0;
+                if (run < count) continue;
+                int first = i - count + 1;
+                for (int j = first; j <= i; j++) w.table[j] = {id, -1, 0, reserved};
+                w.table[first] = {id, seq, count, reserved};
+                ptr = w.base + first * this->slab_size;
+            }
+        }
+    }
+    unlock();
+    if (ptr == nullptr) MSG_ABORT("Shared memory pool exhausted, increase mpi::shared_memory_size");
+    return ptr;
+}
+
+/** @brief Give all slabs and the window of a SharedMemory back to the pool */
+void SharedMemoryPool::release(int id) {
+    lock();
+    for (auto &w : this->windows) {
+        for (int i = 0; i < w.nSlabs; i++) {
+            auto &slab = w.table[i];
+            if (slab.owner == id) slab = {-1, -1, 0, slab.reserved};
+            if (slab.reserved == id) slab.reserved = -1;
+        }
+    }
+    unlock();
+}
+
+/** @brief SharedMemory constructor
+ *
+ *  @param[in] comm: Communicator sharing resources
+ *  @param[in] sh_size: Maximum memory size, in MB, zero for no limit
+ *
+ *  @details Collective in comm. No memory is taken from the pool before the
+ *  first allocation.
+ */
+template <typename T>
+SharedMemory<T>::SharedMemory(mrcpp::mpi_comm comm, int sh_size)
+        : rank(0)
+        , comm(comm) {
+#ifdef MRCPP_HAS_MPI
+    MPI_Comm_rank(comm, &this->rank);
+#endif
+    this->pool = &SharedMemoryPool::get(comm);
+    this->id = this->pool->newId();
+    this->max_size = sh_size;
+    this->max_size *= 1024 * 1024 / sizeof(T);
+#ifdef MRCPP_HAS_MPI
+    // synchronize as a window allocation would: the trees are allocated and zeroed on all ranks right after
+    MPI_Barrier(comm);
 #endif
 }
 
 template <typename T> SharedMemory<T>::~SharedMemory() {
+    if (this->pool == nullptr) return;
 #ifdef MRCPP_HAS_MPI
-    // deallocates the memory block
-    MPI_Win_free(&this->sh_win);
+    int finalized = 0;
+    MPI_Finalized(&finalized);
+    if (finalized) return;
+    // the segments are given back when no rank uses them anymore
+    MPI_Barrier(this->comm);
 #endif
+    if (this->rank == 0) this->pool->release(this->id);
+}
+
+/** @brief Allocate n contiguous elements
+ *
+ *  @details A new segment is appended to the chain if the current ones
+ *  are too small.
+ */
+template <typename T> T *SharedMemory<T>::allocate(int64_t n) {
+    T *ptr = nullptr;
+    for (; this->current < this->segments.size(); this->current++) {
+        auto &seg = this->segments[this->current];
+        if (seg.end + n > seg.max) continue;
+        ptr = seg.end;
+        seg.end += n;
+        return ptr;
+    }
+    int64_t slab = this->pool->getSlabSize();
+    int64_t size = slab * ((n * sizeof(T) + slab - 1) / slab);
+    int64_t reserved = 0;
+    for (auto &seg : this->segments) reserved += seg.max - seg.start;
+    if (this->max_size > 0 and reserved + size / sizeof(T) > this->max_size) MSG_ABORT("Shared block too small");
+
+    ptr = reinterpret_cast<T *>(this->pool->claim(this->id, this->segments.size(), size));
+    this->segments.push_back({ptr, ptr + n, ptr + size / sizeof(T)});
+    this->current = this->segments.size() - 1;
+    return ptr;
+}
+
+/** @brief Release all memory from ptr to the end of the chain
+ *
+ *  @details The segments are kept for later allocations.
+ */
+template <typename T> void SharedMemory<T>::deallocate(T *ptr) {
+    for (int i = 0; i < this->segments.size(); i++) {
+        auto &seg = this->segments[i];
+        if (ptr < seg.start or ptr >= seg.max) continue;
+        seg.end = ptr;
+        for (int j = i + 1; j < this->segments.size(); j++) this->segments[j].end = this->segments[j].start;
+        this->current = i;
+        return;
+    }
+    MSG_ERROR("Pointer not in shared memory block");
+}
+
+template <typename T> void SharedMemory<T>::clear() {
+    for (auto &seg : this->segments) seg.end = seg.start;
+    this->current = 0;
+}
+
+/** @brief Number of elements in use */
+template <typename T> int64_t SharedMemory<T>::getSize() const {
+    int64_t size = 0;
+    for (auto &seg : this->segments) size += seg.end - seg.start;
+    return size;
 }
 
-/** @brief Send FunctionTree to a given MPI rank using blocking communication
+/** @brief Send FunctionTree to a given MPI rank
  *
  *  @param[in] tree: FunctionTree to send
  *  @param[in] dst: MPI rank to send to
@@ -87,65 +348,184 @@ template <typename T> SharedMemory<T>::~SharedMemory() {
  *  @details The number of memory chunks must be known before we can send the
  *  tree. This can be specified in the last argument if known a priori, in order
  *  to speed up communication, otherwise it will be communicated in a separate
- *  step before the main communication.
+ *  step before the main communication. Packed trees are sent in single
+ *  precision, if nChunks is given the receiver must know that the tree is packed.
+ *  All node chunks are posted as nonblocking messages before the coefficient
+ *  chunks, and the function returns when all of them are sent.
  */
 template <int D, typename T> void send_tree(FunctionTree<D, T> &tree, int dst, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff) {
 #ifdef MRCPP_HAS_MPI
     auto &allocator = tree.getNodeAllocator();
+    if (allocator.isMapped()) MSG_ABORT("Cannot send a mapped tree, the coefficients are not in the chunks");
 
+    bool packed = allocator.isPacked();
     if (nChunks < 0) {
         nChunks = allocator.getNChunksUsed();
-        MPI_Send(&nChunks, sizeof(int), MPI_BYTE, dst, tag, comm);
+        int header[2] = {nChunks, packed};
+        MPI_Send(header, 2 * sizeof(int), MPI_BYTE, dst, tag, comm);
         println(10, " Sending " << nChunks << " chunks");
     }
 
     Timer t1;
+    std::vector<MPI_Request> requests;
     for (int iChunk = 0; iChunk < nChunks; iChunk++) {
-        MPI_Send(allocator.getNodeChunk(iChunk), allocator.getNodeChunkSize(), MPI_BYTE, dst, tag + iChunk + 1, comm);
-        if (coeff) MPI_Send(allocator.getCoefChunk(iChunk), allocator.getCoefChunkSize(), MPI_BYTE, dst, tag + iChunk + 1001, comm);
+        requests.push_back(MPI_REQUEST_NULL);
+        MPI_Isend(allocator.getNodeChunk(iChunk), allocator.getNodeChunkSize(), MPI_BYTE, dst, tag + iChunk + 1, comm, &requests.back());
     }
+    for (int iChunk = 0; coeff and iChunk < nChunks; iChunk++) {
+        requests.push_back(MPI_REQUEST_NULL);
+        if (packed) MPI_Isend(allocator.getPackedChunk(iChunk), allocator.getPackedChunkSize(), MPI_BYTE, dst, tag + iChunk + 1001, comm, &requests.back());
+        if (not packed) MPI_Isend(allocator.getCoefChunk(iChunk), allocator.getCoefChunkSize(), MPI_BYTE, dst, tag + iChunk + 1001, comm, &requests.back());
+    }
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
     println(10, " Time send                   " << std::setw(30) << t1.elapsed());
 #endif
 }
 
-/** @brief Receive FunctionTree from a given MPI rank using blocking communication
+/** @brief Receive FunctionTree from a given MPI rank
  *
  *  @param[in] tree: FunctionTree to write into
  *  @param[in] src: MPI rank to receive from
  *  @param[in] tag: unique identifier
  *  @param[in] comm: Communicator that defines ranks
  *  @param[in] nChunks: Number of memory chunks to receive
+ *  @param[in] coeff: Receive the coefficients, not only the tree structure
+ *  @param[in] packed: The coefficients are sent in single precision (only used if nChunks is given)
  *
  *  @details The number of memory chunks must be known before we can receive the
  *  tree. This can be specified in the last argument if known a priori, in order
  *  to speed up communication, otherwise it will be communicated in a separate
- *  step before the main communication.
+ *  step before the main communication. All chunks are posted as nonblocking
+ *  receives at once, so that the sender is never waiting for the receiver.
+ *  The nodes of each chunk are relinked as soon as it has arrived, while the
+ *  coefficients are still on their way.
  */
-template <int D, typename T> void recv_tree(FunctionTree<D, T> &tree, int src, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff) {
+template <int D, typename T> void recv_tree(FunctionTree<D, T> &tree, int src, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff, bool packed) {
 #ifdef MRCPP_HAS_MPI
     MPI_Status status;
     auto &allocator = tree.getNodeAllocator();
 
     if (nChunks < 0) {
-        MPI_Recv(&nChunks, sizeof(int), MPI_BYTE, src, tag, comm, &status);
+        int header[2];
+        MPI_Recv(header, 2 * sizeof(int), MPI_BYTE, src, tag, comm, &status);
+        nChunks = header[0];
+        packed = header[1];
         println(10, " Receiving " << nChunks << " chunks");
     }
 
     Timer t1;
     tree.deleteRootNodes();
-    allocator.init(nChunks, coeff);
+    allocator.init(nChunks, coeff, coeff and packed);
+    std::vector<MPI_Request> requests;
     for (int iChunk = 0; iChunk < nChunks; iChunk++) {
-        MPI_Recv(allocator.getNodeChunk(iChunk), allocator.getNodeChunkSize(), MPI_BYTE, src, tag + iChunk + 1, comm, &status);
-        if (coeff) MPI_Recv(allocator.getCoefChunk(iChunk), allocator.getCoefChunkSize(), MPI_BYTE, src, tag + iChunk + 1001, comm, &status);
+        requests.push_back(MPI_REQUEST_NULL);
+        MPI_Irecv(allocator.getNodeChunk(iChunk), allocator.getNodeChunkSize(), MPI_BYTE, src, tag + iChunk + 1, comm, &requests.back());
+    }
+    for (int iChunk = 0; coeff and iChunk < nChunks; iChunk++) {
+        requests.push_back(MPI_REQUEST_NULL);
+        if (packed) MPI_Irecv(allocator.getPackedChunk(iChunk), allocator.getPackedChunkSize(), MPI_BYTE, src, tag + iChunk + 1001, comm, &requests.back());
+        if (not packed) MPI_Irecv(allocator.getCoefChunk(iChunk), allocator.getCoefChunkSize(), MPI_BYTE, src, tag + iChunk + 1001, comm, &requests.back());
     }
+    for (int n = 0; n < nChunks; n++) {
+        int iChunk;
+        MPI_Waitany(nChunks, requests.data(), &iChunk, MPI_STATUS_IGNORE);
+        allocator.relinkChunk(iChunk);
+    }
+    MPI_Waitall(requests.size() - nChunks, requests.data() + nChunks, MPI_STATUSES_IGNORE);
     println(10, " Time receive                " << std::setw(30) << t1.elapsed());
 
     Timer t2;
-    allocator.reassemble();
+    allocator.reassemble(false);
     println(10, " Time rewrite pointers       " << std::setw(30) << t2.elapsed());
 #endif
 }
 
+/** @brief Broadcast a FunctionTree from one MPI rank to all others
+ *
+ *  @param[in,out] tree: FunctionTree to send (root) or write into (other ranks)
+ *  @param[in] root: MPI rank that holds the tree
+ *  @param[in] tag: unique identifier, tag and tag + 1 are used
+ *  @param[in] comm: Communicator that defines ranks
+ *  @param[in] coeff: Broadcast the coefficients, not only the tree structure
+ *
+ *  @details The tree is passed down a binomial tree of ranks. The chunks are
+ *  split into segments of at most bcast_segment bytes, node chunks first, and
+ *  each rank forwards a segment to its children as soon as it has arrived.
+ *  The transfers of the different levels of the binomial tree overlap, so
+ *  for large trees the time is dominated by a single transfer of the tree,
+ *  with a latency of log(P) segments on top.
+ */
+template <int D, typename T> void broadcast_tree(FunctionTree<D, T> &tree, int root, int tag, mrcpp::mpi_comm comm, bool coeff) {
+#ifdef MRCPP_HAS_MPI
+    int size, rank;
+    MPI_Comm_size(comm, &size);
+    MPI_Comm_rank(comm, &rank);
+    if (size == 1) return;
+
+    Timer t1;
+    auto &allocator = tree.getNodeAllocator();
+
+    // binomial tree, numbered relative to the root
+    int rel = (rank - root + size) % size;
+    int parent = -1;
+    int mask = 1;
+    while (mask < size) {
+        if (rel & mask) {
+            parent = (rel - mask + root) % size;
+            break;
+        }
+        mask <<= 1;
+    }
+    std::vector<int> children; // largest subtree first
+    for (mask >>= 1; mask > 0; mask >>= 1) {
+        if (rel + mask < size) children.push_back((rel + mask + root) % size);
+    }
+
+    int header[2] = {0, 0};
+    if (parent < 0) {
+        if (allocator.isMapped()) MSG_ABORT("Cannot send a mapped tree, the coefficients are not in the chunks");
+        header[0] = allocator.getNChunksUsed();
+        header[1] = allocator.isPacked();
+    } else {
+        MPI_Recv(header, 2, MPI_INT, parent, tag, comm, MPI_STATUS_IGNORE);
+    }
+    for (int dst : children) MPI_Send(header, 2, MPI_INT, dst, tag, comm);
+    int nChunks = header[0];
+    bool packed = header[1];
+    if (parent >= 0) {
+        tree.deleteRootNodes();
+        allocator.init(nChunks, coeff, coeff and packed);
+    }
+
+    // messages between two ranks are matched in the order they are posted
+    std::vector<std::pair<char *, int>> segments;
+    auto addSegments = [&segments](char *data, int nBytes) {
+        for (int offset = 0; offset < nBytes; offset += bcast_segment) segments.push_back({data + offset, std::min(bcast_segment, nBytes - offset)});
+    };
+    for (int iChunk = 0; iChunk < nChunks; iChunk++) addSegments((char *)allocator.getNodeChunk(iChunk), allocator.getNodeChunkSize());
+    for (int iChunk = 0; coeff and iChunk < nChunks; iChunk++) {
+        if (packed) addSegments((char *)allocator.getPackedChunk(iChunk), allocator.getPackedChunkSize());
+        if (not packed) addSegments((char *)allocator.getCoefChunk(iChunk), allocator.getCoefChunkSize());
+    }
+
+    std::vector<MPI_Request> recvRequests(segments.size(), MPI_REQUEST_NULL);
+    std::vector<MPI_Request> sendRequests;
+    if (parent >= 0) {
+        for (int i = 0; i < segments.size(); i++) MPI_Irecv(segments[i].first, segments[i].second, MPI_BYTE, parent, tag + 1, comm, &recvRequests[i]);
+    }
+    for (int i = 0; i < segments.size(); i++) {
+        MPI_Wait(&recvRequests[i], MPI_STATUS_IGNORE);
+        for (int dst : children) {
+            sendRequests.push_back(MPI_REQUEST_NULL);
+            MPI_Isend(segments[i].first, segments[i].second, MPI_BYTE, dst, tag + 1, comm, &sendRequests.back());
+        }
+    }
+    MPI_Waitall(sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
+    if (parent >= 0) allocator.reassemble();
+    println(10, " Time broadcast              " << std::setw(30) << t1.elapsed());
+#endif
+}
+
 /** @brief Share a FunctionTree among MPI processes that share the same physical memory
  *
  *  @param[in] tree: FunctionTree to write into
@@ -202,21 +582,27 @@ template class SharedMemory<ComplexDouble>;
 template void send_tree<1>(FunctionTree<1, double> &tree, int dst, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff);
 template void send_tree<2>(FunctionTree<2, double> &tree, int dst, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff);
 template void send_tree<3>(FunctionTree<3, double> &tree, int dst, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff);
-template void recv_tree<1>(FunctionTree<1, double> &tree, int src, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff);
-template void recv_tree<2>(FunctionTree<2, double> &tree, int src, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff);
-template void recv_tree<3>(FunctionTree<3, double> &tree, int src, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff);
+template void recv_tree<1>(FunctionTree<1, double> &tree, int src, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff, bool packed);
+template void recv_tree<2>(FunctionTree<2, double> &tree, int src, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff, bool packed);
+template void recv_tree<3>(FunctionTree<3, double> &tree, int src, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff, bool packed);
 template void share_tree<1>(FunctionTree<1, double> &tree, int src, int tag, mrcpp::mpi_comm comm);
+template void broadcast_tree<1>(FunctionTree<1, double> &tree, int root, int tag, mrcpp::mpi_comm comm, bool coeff);
 template void share_tree<2>(FunctionTree<2, double> &tree, int src, int tag, mrcpp::mpi_comm comm);
+template void broadcast_tree<2>(FunctionTree<2, double> &tree, int root, int tag, mrcpp::mpi_comm comm, bool coeff);
 template void share_tree<3>(FunctionTree<3, double> &tree, int src, int tag, mrcpp::mpi_comm comm);
+template void broadcast_tree<3>(FunctionTree<3, double> &tree, int root, int tag, mrcpp::mpi_comm comm, bool coeff);
 
 template void send_tree<1>(FunctionTree<1, ComplexDouble> &tree, int dst, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff);
 template void send_tree<2>(FunctionTree<2, ComplexDouble> &tree, int dst, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff);
 template void send_tree<3>(FunctionTree<3, ComplexDouble> &tree, int dst, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff);
-template void recv_tree<1>(FunctionTree<1, ComplexDouble> &tree, int src, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff);
-template void recv_tree<2>(FunctionTree<2, ComplexDouble> &tree, int src, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff);
-template void recv_tree<3>(FunctionTree<3, ComplexDouble> &tree, int src, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff);
+template void recv_tree<1>(FunctionTree<1, ComplexDouble> &tree, int src, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff, bool packed);
+template void recv_tree<2>(FunctionTree<2, ComplexDouble> &tree, int src, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff, bool packed);
+template void recv_tree<3>(FunctionTree<3, ComplexDouble> &tree, int src, int tag, mrcpp::mpi_comm comm, int nChunks, bool coeff, bool packed);
 template void share_tree<1>(FunctionTree<1, ComplexDouble> &tree, int src, int tag, mrcpp::mpi_comm comm);
+template void broadcast_tree<1>(FunctionTree<1, ComplexDouble> &tree, int root, int tag, mrcpp::mpi_comm comm, bool coeff);
 template void share_tree<2>(FunctionTree<2, ComplexDouble> &tree, int src, int tag, mrcpp::mpi_comm comm);
+template void broadcast_tree<2>(FunctionTree<2, ComplexDouble> &tree, int root, int tag, mrcpp::mpi_comm comm, bool coeff);
 template void share_tree<3>(FunctionTree<3, ComplexDouble> &tree, int src, int tag, mrcpp::mpi_comm comm);
+template void broadcast_tree<3>(FunctionTree<3, ComplexDouble> &tree, int root, int tag, mrcpp::mpi_comm comm, bool coeff);
 
 } // namespace mrcpp
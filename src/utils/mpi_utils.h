@@ -25,6 +25,10 @@
 
 #pragma once
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #ifdef MRCPP_HAS_MPI
 #include <mpi.h>
 #else
@@ -40,6 +44,12 @@ using mpi_request = MPI_Request;
 namespace mpi {
 extern bool numerically_exact;
 extern int shared_memory_size;
+extern int shared_slab_size;
+extern bool bank_rma;
+extern int bank_rma_size;
+extern int bank_mem_limit;
+extern std::string bank_scratch;
+extern bool bank_stats;
 
 extern int world_rank;
 extern int world_size;
@@ -68,34 +78,121 @@ extern MPI_Comm comm_bank;
 
 namespace mrcpp {
 
+/** @class SharedMemoryPool
+ *
+ *  @brief Node-level pool of shared memory
+ *
+ *  @details The pool is a chain of MPI shared windows of mpi::shared_memory_size
+ *  MB, divided into slabs of mpi::shared_slab_size MB. SharedMemory objects
+ *  carve their segments out of the pool as runs of consecutive slabs. Each
+ *  SharedMemory has a window reserved when it is constructed, and takes its
+ *  slabs there first, then among the slabs that are not reserved. At least
+ *  half a window of those is left free whenever a SharedMemory is constructed,
+ *  for the blocks that outgrow their own window. Slabs can
+ *  be claimed by any rank at any time, under an exclusive lock on the first
+ *  window, while new windows are only appended in collective calls, i.e. when
+ *  the pool or a SharedMemory object is constructed. The windows are only
+ *  virtual memory until the slabs are touched. Without MPI the windows are
+ *  allocated on the heap.
+ */
+class SharedMemoryPool {
+public:
+    explicit SharedMemoryPool(mrcpp::mpi_comm comm);
+    SharedMemoryPool(const SharedMemoryPool &pool) = delete;
+    SharedMemoryPool &operator=(const SharedMemoryPool &pool) = delete;
+    ~SharedMemoryPool();
+
+    static SharedMemoryPool &get(mrcpp::mpi_comm comm);
+    static void free_all();
+
+    int newId();
+    char *claim(int id, int seq, int64_t size);
+    void release(int id);
+
+    int64_t getSlabSize() const { return this->slab_size; }
+    int getNWindows() const { return this->windows.size(); }
+    mrcpp::mpi_win getWindow(const void *ptr) const;
+    int getNFreeSlabs();
+
+protected:
+    struct Slab {
+        int32_t owner;    // id of the SharedMemory using the slab, -1 if free
+        int32_t seq;      // segment of the owner starting at this slab, -1 if continued
+        int32_t count;    // number of slabs in the segment
+        int32_t reserved; // id of the SharedMemory the slab is reserved for, -1 if none
+    };
+    struct Window {
+        mrcpp::mpi_win win;
+        Slab *table; // slab table, at the start of the window
+        char *base;  // first slab
+        int nSlabs;
+    };
+
+    mrcpp::mpi_comm comm;
+    int rank{0};
+    int next_id{0};
+    int64_t slab_size{0}; // in bytes
+    std::vector<Window> windows;
+
+    void addWindow(int id);
+    void reserve(int id, int &found, int &nSpare);
+    void lock();
+    void unlock();
+};
+
 /** @class SharedMemory
  *
  *  @brief Shared memory block within a compute node
  *
- *  @details This class defines a shared memory window in a shared MPI
- *  communicator. In order to allocate a FunctionTree in shared memory,
- *  simply pass a SharedMemory object to the FunctionTree constructor.
+ *  @details This class defines a block of memory shared by the ranks of a
+ *  shared MPI communicator. In order to allocate a FunctionTree in shared
+ *  memory, simply pass a SharedMemory object to the FunctionTree constructor.
+ *  The block is a chain of segments taken from the SharedMemoryPool of the
+ *  communicator, and grows on demand. The ranks must allocate in the same
+ *  order: the n-th segment is the same memory on all ranks.
  */
 template <typename T> class SharedMemory {
 public:
-    SharedMemory(mrcpp::mpi_comm comm, int sh_size);
+    SharedMemory(mrcpp::mpi_comm comm, int sh_size = 0);
     SharedMemory(const SharedMemory &mem) = delete;
     SharedMemory<T> &operator=(const SharedMemory<T> &mem) = delete;
     ~SharedMemory();
 
+    T *allocate(int64_t n);
+    void deallocate(T *ptr);
     void clear(); // show shared memory as entirely available
 
-    T *sh_start_ptr;       // start of shared block
-    T *sh_end_ptr;         // end of used part
-    T *sh_max_ptr;         // end of shared block
-    mrcpp::mpi_win sh_win; // MPI window object
-    int rank;              // rank among shared group
+    int getNSegments() const { return this->segments.size(); }
+    int64_t getSize() const;
+
+    // the first segment, seen as the single window the block used to be
+    T *sh_start_ptr() const { return (this->segments.size() > 0) ? this->segments[0].start : nullptr; }
+    T *sh_end_ptr() const { return (this->segments.size() > 0) ? this->segments[0].end : nullptr; }
+    T *sh_max_ptr() const { return (this->segments.size() > 0) ? this->segments[0].max : nullptr; }
+    mrcpp::mpi_win sh_win() const { return this->pool->getWindow(sh_start_ptr()); }
+
+    int rank; // rank among shared group
+
+protected:
+    struct Segment {
+        T *start; // start of segment
+        T *end;   // end of used part
+        T *max;   // end of segment
+    };
+
+    mrcpp::mpi_comm comm;
+    SharedMemoryPool *pool{nullptr};
+    int id{-1};
+    int current{0};      // segment of the next allocation
+    int64_t max_size{0}; // in number of T, 0 for no limit
+    std::vector<Segment> segments;
 };
 
 template <int D, typename T> class FunctionTree;
 
 template <int D, typename T> void send_tree(FunctionTree<D, T> &tree, int dst, int tag, mrcpp::mpi_comm comm, int nChunks = -1, bool coeff = true);
-template <int D, typename T> void recv_tree(FunctionTree<D, T> &tree, int src, int tag, mrcpp::mpi_comm comm, int nChunks = -1, bool coeff = true);
+template <int D, typename T> void recv_tree(FunctionTree<D, T> &tree, int src, int tag, mrcpp::mpi_comm comm, int nChunks = -1, bool coeff = true, bool packed = false);
 template <int D, typename T> void share_tree(FunctionTree<D, T> &tree, int src, int tag, mrcpp::mpi_comm comm);
+template <int D, typename T> void broadcast_tree(FunctionTree<D, T> &tree, int root, int tag, mrcpp::mpi_comm comm, bool coeff = true);
 
 } // namespace mrcpp
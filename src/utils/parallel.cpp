@@ -7,7 +7,9 @@
 #include "Bank.h"
 #include "omp_utils.h"
 #include "parallel.h"
+#include "treebuilders/grid.h"
 #include "trees/FunctionTree.h"
+#include "trees/MWNode.h"
 
 #ifdef MRCPP_HAS_OMP
 #define mrcpp_get_max_threads() omp_get_max_threads()
@@ -39,7 +41,19 @@ Bank dataBank;
 namespace mpi {
 
 bool numerically_exact = false;
-int shared_memory_size = 1000;
+int shared_memory_size = 1000; // size in MB of each window of the shared memory pool of a node
+int shared_slab_size = 64;     // granularity in MB of the shared memory pool
+bool bank_rma = false;         // keep the bank in one-sided windows on the workers, no bank ranks
+int bank_rma_size = 500;       // memory in MB reserved by each worker for each bank account, see below
+int bank_mem_limit = 0;        // memory in MB for the data of each bank rank, the rest is spilled to disk (0: no limit)
+std::string bank_scratch;      // directory for the data spilled to disk, TMPDIR or /tmp if empty
+bool bank_stats = false;       // collect statistics of the bank requests, written to bank_stats_<rank>.json
+
+// With bank_rma, every BankAccount allocates a window of bank_rma_size MB on
+// each worker when it is created, and keeps it until it is destroyed. The
+// window cannot grow, so it must hold all the data a worker deposits in the
+// account (1/16 of it is used for the index), and a worker with n accounts
+// open reserves n * bank_rma_size MB.
 
 // these parameters set by initialize()
 int world_size = 1;
@@ -97,7 +111,7 @@ void initialize() {
     MPI_Comm comm_remainder;    // clients only
 
     // set bank_size automatically if not defined by user
-    if (world_size < 2) {
+    if (world_size < 2 or bank_rma) {
         bank_size = 0;
     } else if (bank_size < 0) {
         if (bank_per_node >= 0) {
@@ -109,7 +123,7 @@ void initialize() {
         if (bank_size != node_size * bank_per_node and world_rank == 0) std::cout << "WARNING: bank_size and bank_per_node are incompatible " << bank_size << " " << bank_per_node << std::endl;
     }
     if (world_size - bank_size < 1) MSG_ABORT("No MPI ranks left for working!");
-    if (bank_size < 1 and world_size > 1) MSG_ABORT("Bank size must be at least one when using MPI!");
+    if (bank_size < 1 and world_size > 1 and not bank_rma) MSG_ABORT("Bank size must be at least one when using MPI!");
 
     bankmaster.resize(bank_size);
     for (int i = 0; i < bank_size; i++) {
@@ -252,10 +266,12 @@ void initialize() {
 
 void finalize() {
 #ifdef MRCPP_HAS_MPI
+    if (bank_stats and not is_bank) clientStatistics.write("bank_client_stats_" + std::to_string(world_rank) + ".json", "client");
     if (bank_size > 0 and grand_master()) {
         println(4, " max data in bank " << dataBank.get_maxtotalsize() << " MB ");
         dataBank.close();
     }
+    SharedMemoryPool::free_all();
     MPI_Barrier(MPI_COMM_WORLD); // to ensure everybody got here
     MPI_Finalize();
 #endif
@@ -354,10 +370,13 @@ void send_function(const CompFunction<3> &func, int dst, int tag, MPI_Comm comm)
 #ifdef MRCPP_HAS_MPI
     for (int i = 0; i < func.Ncomp(); i++) {
         // make sure that Nchunks is up to date
-        if (func.isreal())
+        if (func.isreal()) {
             func.Nchunks()[i] = func.CompD[i]->getNChunks();
-        else
+            func.func_ptr->data.packed[i] = func.CompD[i]->isPacked();
+        } else {
             func.Nchunks()[i] = func.CompC[i]->getNChunks();
+            func.func_ptr->data.packed[i] = func.CompC[i]->isPacked();
+        }
     }
     MPI_Send(&func.func_ptr->data, sizeof(CompFunctionData<3>), MPI_BYTE, dst, 0, comm);
     for (int i = 0; i < func.Ncomp(); i++) {
@@ -375,12 +394,13 @@ void recv_function(CompFunction<3> &func, int src, int tag, MPI_Comm comm) {
     MPI_Status status;
     int func_ncomp_in = func.Ncomp();
     MPI_Recv(&func.func_ptr->data, sizeof(CompFunctionData<3>), MPI_BYTE, src, 0, comm, &status);
+    if (func_ncomp_in < func.Ncomp()) func.alloc(func.Ncomp());
     for (int i = 0; i < func.Ncomp(); i++) {
-        if (func_ncomp_in <= i) func.alloc(i + 1);
+        bool packed = func.func_ptr->data.packed[i];
         if (func.isreal())
-            mrcpp::recv_tree(*func.CompD[i], src, tag, comm, func.Nchunks()[i]);
+            mrcpp::recv_tree(*func.CompD[i], src, tag, comm, func.Nchunks()[i], true, packed);
         else
-            mrcpp::recv_tree(*func.CompC[i], src, tag, comm, func.Nchunks()[i]);
+            mrcpp::recv_tree(*func.CompC[i], src, tag, comm, func.Nchunks()[i], true, packed);
     }
 #endif
 }
@@ -399,7 +419,13 @@ void share_function(CompFunction<3> &func, int src, int tag, MPI_Comm comm) {
     }
 }
 
-/** @brief Add all mpi function into rank zero */
+/** @brief Add all mpi function into rank zero
+ *
+ * @details The functions are added pairwise along a binomial tree, so all
+ * pairs of a level add concurrently and there are log(P) levels. Each
+ * addition builds a new adaptive grid, see the fixed grid reduce_function
+ * for a cheaper alternative when a common grid is known.
+ */
 void reduce_function(double prec, CompFunction<3> &func, MPI_Comm comm) {
 /* 1) Each odd rank send to the left rank
    2) All odd ranks are "deleted" (can exit routine)
@@ -441,6 +467,98 @@ void reduce_function(double prec, CompFunction<3> &func, MPI_Comm comm) {
 #endif
 }
 
+#ifdef MRCPP_HAS_MPI
+static MPI_Datatype mpi_type(double) {
+    return MPI_DOUBLE;
+}
+static MPI_Datatype mpi_type(ComplexDouble) {
+    return MPI_C_DOUBLE_COMPLEX;
+}
+
+/** @brief Sum a tree over all ranks into rank zero, on a given grid
+ *
+ * @details The tree is copied onto the grid, which must be the same on all
+ * ranks, and the end node coefficients are summed with a single MPI_Reduce.
+ * The result replaces the tree on rank zero, the other ranks are unchanged.
+ */
+template <typename T> static void reduce_tree_on_grid(FunctionTree<3, T> &tree, FunctionTree<3, T> &grid, MPI_Comm comm) {
+    int comm_rank;
+    MPI_Comm_rank(comm, &comm_rank);
+
+    FunctionTree<3, T> sum(tree.getMRA());
+    mrcpp::build_grid(sum, grid);
+    mrcpp::copy_func(sum, tree);
+    sum.deleteGenerated();
+    sum.resetEndNodeTable(); // same node order on all ranks
+
+    int nNodes = sum.getNEndNodes();
+    int range[2] = {nNodes, -nNodes};
+    MPI_Allreduce(MPI_IN_PLACE, range, 2, MPI_INT, MPI_MAX, comm);
+    if (range[0] != -range[1]) MSG_ABORT("The grid must be the same on all ranks");
+    int nCoefs = sum.getTDim() * sum.getKp1_d();
+    std::vector<T> coefs(static_cast<size_t>(nNodes) * nCoefs);
+    for (int n = 0; n < nNodes; n++) {
+        const T *c = sum.getEndMWNode(n).getCoefs();
+        std::copy(c, c + nCoefs, coefs.data() + static_cast<size_t>(n) * nCoefs);
+    }
+    // in blocks, counts are int
+    const size_t block = 1 << 26;
+    for (size_t first = 0; first < coefs.size(); first += block) {
+        int count = std::min(block, coefs.size() - first);
+        T *data = coefs.data() + first;
+        if (comm_rank == 0) MPI_Reduce(MPI_IN_PLACE, data, count, mpi_type(T()), MPI_SUM, 0, comm);
+        if (comm_rank != 0) MPI_Reduce(data, nullptr, count, mpi_type(T()), MPI_SUM, 0, comm);
+    }
+    if (comm_rank != 0) return;
+
+    for (int n = 0; n < nNodes; n++) {
+        MWNode<3, T> &node = sum.getEndMWNode(n);
+        node.setCoefBlock(0, nCoefs, coefs.data() + static_cast<size_t>(n) * nCoefs);
+        node.setHasCoefs();
+        node.calcNorms();
+    }
+    sum.mwTransform(BottomUp);
+    sum.calcSquareNorm();
+    mrcpp::copy_grid(tree, sum);
+    mrcpp::copy_func(tree, sum);
+}
+#endif
+
+/** @brief Add all mpi function into rank zero, on a fixed grid
+ *
+ * @param[in,out] func: Function to add, holds the sum on rank zero
+ * @param[in] grid: Grid of the sum, the same on all ranks
+ * @param[in] comm: Communicator of the ranks to sum over
+ *
+ * @details Unlike the adaptive reduce_function, the functions are not added
+ * pairwise with a new adaptive grid at each step. Each rank copies its
+ * function onto the grid and the coefficients are summed in one collective
+ * operation. The grid must contain the grids of all the functions, it is
+ * typically the union grid made by allreduce_Tree_noCoeff. The function
+ * must have the same components and scalar type on all ranks. The sum is
+ * on the grid, also with a single rank.
+ */
+template <typename T> void reduce_function(CompFunction<3> &func, FunctionTree<3, T> &grid, MPI_Comm comm) {
+#ifdef MRCPP_HAS_MPI
+    // the ranks must agree on the number of reductions, or they would wait for each other
+    int range[6] = {func.Ncomp(), func.isreal(), func.iscomplex(), -func.Ncomp(), -func.isreal(), -func.iscomplex()};
+    MPI_Allreduce(MPI_IN_PLACE, range, 6, MPI_INT, MPI_MAX, comm);
+    for (int i = 0; i < 3; i++) {
+        if (range[i] != -range[3 + i]) MSG_ABORT("The function must have the same components and type on all ranks");
+    }
+
+    bool sameType = (std::is_same<T, double>::value) ? func.isreal() : func.iscomplex();
+    if (not sameType) MSG_ABORT("Grid and function must have the same scalar type");
+    for (int i = 0; i < func.Ncomp(); i++) {
+        if constexpr (std::is_same<T, double>::value) {
+            reduce_tree_on_grid(*func.CompD[i], grid, comm);
+        } else {
+            reduce_tree_on_grid(*func.CompC[i], grid, comm);
+        }
+    }
+#endif
+}
+
 /** @brief make union tree and send into rank zero */
 template <typename T> void reduce_Tree_noCoeff(mrcpp::FunctionTree<3, T> &tree, MPI_Comm comm) {
 /* 1) Each odd rank send to the left rank
@@ -521,33 +639,32 @@ template <typename T> void allreduce_Tree_noCoeff(mrcpp::FunctionTree<3, T> &tre
 #endif
 }
 
-/** @brief Distribute rank zero function to all ranks */
+/** @brief Distribute rank zero function to all ranks
+ *
+ * @details The trees are pipelined down a binomial tree of ranks, see
+ * broadcast_tree, so that the time is close to a single transfer of the
+ * function for large functions.
+ */
 void broadcast_function(CompFunction<3> &func, MPI_Comm comm) {
-/* use same strategy as a reduce, but in reverse order */
 #ifdef MRCPP_HAS_MPI
     int comm_size, comm_rank;
     MPI_Comm_rank(comm, &comm_rank);
     MPI_Comm_size(comm, &comm_size);
     if (comm_size == 1) return;
 
-    int fac = 1; // powers of 2
-    while (fac < comm_size) fac *= 2;
-    fac /= 2;
-
-    while (fac > 0) {
-        if (comm_rank % fac == 0 and (comm_rank / fac) % 2 == 1) {
-            // receive
-            int src = comm_rank - fac;
-            int tag = 4334 + comm_rank;
-            recv_function(func, src, tag, comm);
-        }
-        if (comm_rank % fac == 0 and (comm_rank / fac) % 2 == 0) {
-            // send
-            int dst = comm_rank + fac;
-            int tag = 4334 + dst;
-            if (dst < comm_size) send_function(func, dst, tag, comm);
+    int func_ncomp_in = func.Ncomp();
+    if (comm_rank == 0) {
+        for (int i = 0; i < func.Ncomp(); i++) {
+            if (func.isreal()) func.func_ptr->data.packed[i] = func.CompD[i]->isPacked();
+            if (func.iscomplex()) func.func_ptr->data.packed[i] = func.CompC[i]->isPacked();
         }
-        fac /= 2;
+    }
+    MPI_Bcast(&func.func_ptr->data, sizeof(CompFunctionData<3>), MPI_BYTE, 0, comm);
+    if (func_ncomp_in < func.Ncomp()) func.alloc(func.Ncomp());
+    for (int i = 0; i < func.Ncomp(); i++) {
+        int tag = 4334 + 2 * i;
+        if (func.isreal()) mrcpp::broadcast_tree(*func.CompD[i], 0, tag, comm);
+        if (func.iscomplex()) mrcpp::broadcast_tree(*func.CompC[i], 0, tag, comm);
     }
     MPI_Barrier(comm);
 #endif
@@ -555,41 +672,19 @@ void broadcast_function(CompFunction<3> &func, MPI_Comm comm) {
 
 /** @brief Distribute rank zero function to all ranks */
 template <typename T> void broadcast_Tree_noCoeff(mrcpp::FunctionTree<3, T> &tree, MPI_Comm comm) {
-/* use same strategy as a reduce, but in reverse order */
 #ifdef MRCPP_HAS_MPI
-    int comm_size, comm_rank;
-    MPI_Comm_rank(comm, &comm_rank);
-    MPI_Comm_size(comm, &comm_size);
-    if (comm_size == 1) return;
-
-    int fac = 1; // powers of 2
-    while (fac < comm_size) fac *= 2;
-    fac /= 2;
-
-    while (fac > 0) {
-        if (comm_rank % fac == 0 and (comm_rank / fac) % 2 == 1) {
-            // receive
-            int src = comm_rank - fac;
-            int tag = 4334 + comm_rank;
-            mrcpp::recv_tree(tree, src, tag, comm, -1, false);
-        }
-        if (comm_rank % fac == 0 and (comm_rank / fac) % 2 == 0) {
-            // send
-            int dst = comm_rank + fac;
-            int tag = 4334 + dst;
-            if (dst < comm_size) mrcpp::send_tree(tree, dst, tag, comm, -1, false);
-        }
-        fac /= 2;
-    }
+    mrcpp::broadcast_tree(tree, 0, 4334, comm, false);
     MPI_Barrier(comm);
 #endif
 }
 
+template void reduce_function(CompFunction<3> &func, FunctionTree<3, double> &grid, MPI_Comm comm);
 template void reduce_Tree_noCoeff(mrcpp::FunctionTree<3, double> &tree, MPI_Comm comm);
 template void allreduce_Tree_noCoeff(mrcpp::FunctionTree<3, double> &tree, std::vector<FunctionTree<3, double>> &Phi, MPI_Comm comm);
 template void broadcast_Tree_noCoeff(mrcpp::FunctionTree<3, double> &tree, MPI_Comm comm);
 template void allreduce_Tree_noCoeff(mrcpp::FunctionTree<3, double> &tree, std::vector<CompFunction<3>> &Phi, MPI_Comm comm);
 
+template void reduce_function(CompFunction<3> &func, FunctionTree<3, ComplexDouble> &grid, MPI_Comm comm);
 template void reduce_Tree_noCoeff(mrcpp::FunctionTree<3, ComplexDouble> &tree, MPI_Comm comm);
 template void allreduce_Tree_noCoeff(mrcpp::FunctionTree<3, ComplexDouble> &tree, std::vector<FunctionTree<3, ComplexDouble>> &Phi, MPI_Comm comm);
 template void broadcast_Tree_noCoeff(mrcpp::FunctionTree<3, ComplexDouble> &tree, MPI_Comm comm);
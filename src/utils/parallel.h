@@ -52,6 +52,7 @@ void recv_function(CompFunction<3> &func, int src, int tag, MPI_Comm comm = mpi:
 void share_function(CompFunction<3> &func, int src, int tag, MPI_Comm comm);
 
 void reduce_function(double prec, CompFunction<3> &func, MPI_Comm comm);
+template <typename T> void reduce_function(CompFunction<3> &func, FunctionTree<3, T> &grid, MPI_Comm comm);
 void broadcast_function(CompFunction<3> &func, MPI_Comm comm);
 
 template <typename T> void reduce_Tree_noCoeff(mrcpp::FunctionTree<3, T> &tree, MPI_Comm comm);
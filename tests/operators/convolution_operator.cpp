@@ -0,0 +1,115 @@
+/*
+ * MRCPP, a numerical library based on multiresolution analysis and
+ * the multiwavelet basis which provide low-scaling algorithms as well as
+ * rigorous error control in numerical computations.
+ * Copyright (C) 2021 Stig Rune Jensen, Jonas Juselius, Luca Frediani and contributors.
+ *
+ * This file is part of MRCPP.
+ *
+ * MRCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MRCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with MRCPP.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * For information on the complete list of contributors to MRCPP, see:
+ * <https://mrcpp.readthedocs.io/>
+ */
+
+#include "catch2/catch_all.hpp"
+
+#include "factory_functions.h"
+
+#include "functions/GaussExp.h"
+#include "operators/ConvolutionOperator.h"
+#include "treebuilders/apply.h"
+#include "treebuilders/project.h"
+#include "trees/OperatorTree.h"
+#include "utils/omp_utils.h"
+
+using namespace mrcpp;
+
+namespace convolution_operator {
+
+template <int D> void applyGaussConvolution(int order);
+
+/* Normalized Gaussian kernels, the convolution of two of them is again a
+ * normalized Gaussian, with exponent ab/(a+b) */
+template <int D> GaussExp<1> makeKernel(const std::vector<double> &exps) {
+    GaussExp<1> kernel;
+    for (double a : exps) kernel.append(GaussFunc<1>(a, std::pow(a / pi, D / 2.0)));
+    return kernel;
+}
+
+TEST_CASE("Build convolution operator terms concurrently", "[convolution_operator_build], [convolution_operator], [mw_operator]") {
+    double build_prec = 1.0e-4;
+
+    MultiResolutionAnalysis<3> *mra = nullptr;
+    initialize(&mra);
+    GaussExp<1> kernel = makeKernel<3>({1.0, 10.0, 100.0, 1000.0, 10000.0});
+
+    const int threads = mrcpp::max_threads;
+    set_max_threads(1);
+    ConvolutionOperator<3> ref(*mra, kernel, build_prec);
+    set_max_threads(4);
+    ConvolutionOperator<3> oper(*mra, kernel, build_prec);
+    set_max_threads(threads);
+
+    REQUIRE(oper.size() == kernel.size());
+    for (int i = 0; i < ref.size(); i++) {
+        REQUIRE(oper.getComponent(i, 0).getNNodes() == ref.getComponent(i, 0).getNNodes());
+        REQUIRE(oper.getComponent(i, 0).getSquareNorm() == ref.getComponent(i, 0).getSquareNorm());
+    }
+    finalize(&mra);
+}
+
+TEST_CASE("Apply Gaussian convolution operator", "[apply_convolution_operator], [convolution_operator], [mw_operator]") {
+    // fixed size and dynamic size contraction kernels
+    SECTION("3D, order 5") { applyGaussConvolution<3>(5); }
+    SECTION("2D, order 11") { applyGaussConvolution<2>(11); }
+}
+
+template <int D> void applyGaussConvolution(int order) {
+    double proj_prec = 1.0e-5;
+    double apply_prec = 1.0e-5;
+    double build_prec = 1.0e-6;
+
+    BoundingBox<D> world(std::array<int, 2>{-2, 2});
+    MultiResolutionAnalysis<D> mra(world, InterpolatingBasis(order));
+
+    std::vector<double> exps = {50.0, 200.0};
+    GaussExp<1> kernel = makeKernel<D>(exps);
+    ConvolutionOperator<D> oper(mra, kernel, build_prec);
+
+    double beta = 100.0;
+    std::array<double, D> pos{};
+    for (int d = 0; d < D; d++) pos[d] = 0.1 * (d + 1);
+    GaussFunc<D> fFunc(beta, std::pow(beta / pi, D / 2.0), pos);
+    GaussExp<D> gFunc;
+    for (double a : exps) {
+        double gamma = a * beta / (a + beta);
+        gFunc.append(GaussFunc<D>(gamma, std::pow(gamma / pi, D / 2.0), pos));
+    }
+
+    FunctionTree<D> fTree(mra);
+    FunctionTree<D> gTree(mra);
+    project(proj_prec, fTree, fFunc);
+    apply(apply_prec, gTree, oper, fTree);
+
+    REQUIRE(gTree.integrate() == Catch::Approx(2.0 * fTree.integrate()).epsilon(apply_prec));
+    for (double x : {0.0, 0.05, -0.1, 0.2}) {
+        Coord<D> r = pos;
+        r[0] += x;
+        r[D - 1] -= x;
+        REQUIRE(gTree.evalf(r) == Catch::Approx(gFunc.evalf(r)).epsilon(1.0e-3));
+    }
+}
+
+} // namespace convolution_operator
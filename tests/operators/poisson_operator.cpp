@@ -25,6 +25,11 @@
 
 #include "catch2/catch_all.hpp"
 
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sys/stat.h>
+
 #include "factory_functions.h"
 
 #include "functions/GaussFunc.h"
@@ -34,6 +39,7 @@
 #include "treebuilders/CrossCorrelationCalculator.h"
 #include "treebuilders/OperatorAdaptor.h"
 #include "treebuilders/TreeBuilder.h"
+#include "treebuilders/add.h"
 #include "treebuilders/apply.h"
 #include "treebuilders/grid.h"
 #include "treebuilders/multiply.h"
@@ -154,6 +160,164 @@ TEST_CASE("Apply Poisson's operator", "[apply_poisson], [poisson_operator], [mw_
     finalize(&mra);
 }
 
+TEST_CASE("Apply Poisson's operator to several functions", "[apply_poisson_vector], [poisson_operator], [mw_operator]") {
+    double proj_prec = 1.0e-4;
+    double apply_prec = 1.0e-3;
+    double build_prec = 1.0e-4;
+
+    MultiResolutionAnalysis<3> *mra = nullptr;
+    initialize(&mra);
+
+    PoissonOperator P(*mra, build_prec);
+
+    // Unit charge Gaussians of different widths, all well inside the box
+    std::vector<GaussFunc<3>> funcs;
+    for (auto beta : {1.0e3, 2.0e3, 5.0e2}) {
+        double alpha = std::pow(beta / pi, 3.0 / 2.0);
+        funcs.push_back(GaussFunc<3>(beta, alpha, {-0.25, 0.5, 0.9 + beta / 1.0e4}));
+    }
+
+    FunctionTreeVector<3> f_vec;
+    FunctionTreeVector<3> g_vec;
+    for (auto &func : funcs) {
+        auto *f_tree = new FunctionTree<3>(*mra);
+        project(proj_prec, *f_tree, func);
+        f_vec.push_back(std::make_tuple(1.0, f_tree));
+        g_vec.push_back(std::make_tuple(1.0, new FunctionTree<3>(*mra)));
+    }
+    apply(apply_prec, g_vec, P, f_vec);
+
+    for (int i = 0; i < funcs.size(); i++) {
+        FunctionTree<3> &f_tree = get_func(f_vec, i);
+        FunctionTree<3> &g_tree = get_func(g_vec, i);
+
+        double E_num = dot(g_tree, f_tree);
+        double E_ana = funcs[i].calcCoulombEnergy(funcs[i]);
+        REQUIRE(E_num == Catch::Approx(E_ana).epsilon(apply_prec));
+
+        FunctionTree<3> ref_tree(*mra);
+        apply(apply_prec, ref_tree, P, f_tree);
+        FunctionTree<3> diff_tree(*mra);
+        add(-1.0, diff_tree, 1.0, g_tree, -1.0, ref_tree);
+        REQUIRE(diff_tree.getSquareNorm() < apply_prec * apply_prec * ref_tree.getSquareNorm());
+    }
+    clear(f_vec, true);
+    clear(g_vec, true);
+    finalize(&mra);
+}
+
+TEST_CASE("Cache Poisson operator on disk", "[poisson_operator_cache], [poisson_operator], [mw_operator]") {
+    double proj_prec = 1.0e-4;
+    double apply_prec = 1.0e-3;
+    double build_prec = 1.0e-4;
+
+    MultiResolutionAnalysis<3> *mra = nullptr;
+    GaussFunc<3> *fFunc = nullptr;
+    initialize(&fFunc);
+    initialize(&mra);
+
+    FunctionTree<3> fTree(*mra);
+    project(proj_prec, fTree, *fFunc);
+
+    std::string cache_dir = "poisson_cache";
+    std::filesystem::remove_all(cache_dir);
+    std::filesystem::create_directory(cache_dir);
+    set_operator_cache(cache_dir);
+
+    PoissonOperator P_ref(*mra, build_prec);
+    int nFiles = std::distance(std::filesystem::directory_iterator(cache_dir), {});
+    REQUIRE(nFiles == P_ref.size());
+
+    PoissonOperator P_cache(*mra, build_prec);
+    REQUIRE(P_cache.size() == P_ref.size());
+    for (int i = 0; i < P_ref.size(); i++) {
+        const OperatorTree &ref = P_ref.getComponent(i, 0);
+        const OperatorTree &cache = P_cache.getComponent(i, 0);
+        REQUIRE(cache.getNNodes() == ref.getNNodes());
+        REQUIRE(cache.getSquareNorm() == ref.getSquareNorm());
+    }
+
+    // a damaged file is detected by its checksum, and replaced by a new file
+    // (the files are compared by inode, the unused end of a chunk is not initialized)
+    auto inodes = [cache_dir]() {
+        std::map<std::string, ino_t> ino;
+        struct stat st;
+        for (auto &entry : std::filesystem::directory_iterator(cache_dir)) {
+            if (stat(entry.path().c_str(), &st) == 0) ino[entry.path()] = st.st_ino;
+        }
+        return ino;
+    };
+    for (auto &entry : std::filesystem::directory_iterator(cache_dir)) {
+        std::fstream file(entry.path(), std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(-1, std::ios::end);
+        char last = file.get();
+        file.seekp(-1, std::ios::end);
+        file.put(last ^ 1);
+    }
+    auto damaged = inodes();
+    PoissonOperator P_damaged(*mra, build_prec);
+    for (int i = 0; i < P_ref.size(); i++) REQUIRE(P_damaged.getComponent(i, 0).getSquareNorm() == P_ref.getComponent(i, 0).getSquareNorm());
+    auto rebuilt = inodes();
+    REQUIRE(rebuilt.size() == damaged.size());
+    for (auto &file : rebuilt) REQUIRE(file.second != damaged[file.first]);
+    PoissonOperator P_rebuilt(*mra, build_prec);
+    REQUIRE(inodes() == rebuilt);
+
+    FunctionTree<3> gRef(*mra);
+    FunctionTree<3> gCache(*mra);
+    apply(apply_prec, gRef, P_ref, fTree);
+    apply(apply_prec, gCache, P_cache, fTree);
+    REQUIRE(gCache.getNNodes() == gRef.getNNodes());
+    REQUIRE(gCache.getSquareNorm() == gRef.getSquareNorm());
+
+    set_operator_cache("");
+    std::filesystem::remove_all(cache_dir);
+    finalize(&fFunc);
+    finalize(&mra);
+}
+
+TEST_CASE("Apply Poisson's operator on a fixed grid", "[apply_poisson_grid], [poisson_operator], [mw_operator]") {
+    double proj_prec = 1.0e-4;
+    double apply_prec = 1.0e-3;
+    double build_prec = 1.0e-4;
+
+    MultiResolutionAnalysis<3> *mra = nullptr;
+    GaussFunc<3> *fFunc = nullptr;
+    initialize(&fFunc);
+    initialize(&mra);
+
+    PoissonOperator P(*mra, build_prec);
+    FunctionTree<3> fTree(*mra);
+    project(proj_prec, fTree, *fFunc);
+
+    FunctionTree<3> gRef(*mra);
+    apply(apply_prec, gRef, P, fTree);
+    double E_ana = fFunc->calcCoulombEnergy(*fFunc);
+
+    SECTION("Grid from another function") {
+        FunctionTree<3> gTree(*mra);
+        apply_on_grid(apply_prec, gTree, P, fTree, gRef);
+        REQUIRE(gTree.getNNodes() == gRef.getNNodes());
+        REQUIRE(gTree.getSquareNorm() == Catch::Approx(gRef.getSquareNorm()).epsilon(apply_prec));
+        REQUIRE(dot(gTree, fTree) == Catch::Approx(E_ana).epsilon(apply_prec));
+    }
+    SECTION("Reuse own grid with refinement") {
+        apply_on_grid(apply_prec, gRef, P, fTree, gRef, true);
+        REQUIRE(gRef.getSquareNorm() > 0.0);
+        REQUIRE(dot(gRef, fTree) == Catch::Approx(E_ana).epsilon(apply_prec));
+    }
+    SECTION("Coarse grid is refined once") {
+        FunctionTree<3> gCoarse(*mra);
+        build_grid(gCoarse, 1);
+        FunctionTree<3> gTree(*mra);
+        apply_on_grid(apply_prec, gTree, P, fTree, gCoarse, true);
+        REQUIRE(gTree.getNNodes() > gCoarse.getNNodes());
+    }
+
+    finalize(&fFunc);
+    finalize(&mra);
+}
+
 TEST_CASE("Apply Periodic Poisson' operator", "[apply_periodic_Poisson], [poisson_operator], [mw_operator]") {
     double proj_prec = 3.0e-3;
     double apply_prec = 3.0e-2;
@@ -0,0 +1,68 @@
+/*
+ * MRCPP, a numerical library based on multiresolution analysis and
+ * the multiwavelet basis which provide low-scaling algorithms as well as
+ * rigorous error control in numerical computations.
+ * Copyright (C) 2021 Stig Rune Jensen, Jonas Juselius, Luca Frediani and contributors.
+ *
+ * This file is part of MRCPP.
+ *
+ * MRCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MRCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with MRCPP.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * For information on the complete list of contributors to MRCPP, see:
+ * <https://mrcpp.readthedocs.io/>
+ */
+
+#include "catch2/catch_all.hpp"
+
+#include <vector>
+
+#include "treebuilders/NodeScheduler.h"
+
+using namespace mrcpp;
+
+namespace node_scheduler {
+
+SCENARIO("Scheduling node vectors by cost", "[node_scheduler], [tree_builder]") {
+    GIVEN("A node vector with very uneven costs") {
+        int nNodes = 1000;
+        std::vector<double> costs(nNodes);
+        for (int n = 0; n < nNodes; n++) costs[n] = (n % 100 == 0) ? 100.0 : 1.0;
+
+        NodeScheduler sched;
+        WHEN("All nodes are computed") {
+            std::vector<int> visits(nNodes, 0);
+            sched.run(costs, [&visits](int n) {
+#pragma omp atomic
+                visits[n]++;
+            });
+            THEN("Every node is computed exactly once") {
+                for (int n = 0; n < nNodes; n++) REQUIRE(visits[n] == 1);
+            }
+            THEN("The load balance is recorded") {
+                REQUIRE(sched.getImbalance() >= 1.0);
+                sched.clearStatistics();
+                REQUIRE(sched.getImbalance() == 1.0);
+                REQUIRE(sched.getNStolen() == 0);
+            }
+        }
+        WHEN("An empty vector is computed") {
+            std::vector<double> empty;
+            int nCalls = 0;
+            sched.run(empty, [&nCalls](int n) { nCalls++; });
+            THEN("Nothing is computed") { REQUIRE(nCalls == 0); }
+        }
+    }
+}
+
+} // namespace node_scheduler
@@ -0,0 +1,130 @@
+/*
+ * MRCPP, a numerical library based on multiresolution analysis and
+ * the multiwavelet basis which provide low-scaling algorithms as well as
+ * rigorous error control in numerical computations.
+ * Copyright (C) 2021 Stig Rune Jensen, Jonas Juselius, Luca Frediani and contributors.
+ *
+ * This file is part of MRCPP.
+ *
+ * MRCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MRCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with MRCPP.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * For information on the complete list of contributors to MRCPP, see:
+ * <https://mrcpp.readthedocs.io/>
+ */
+
+#include "catch2/catch_all.hpp"
+
+#include "factory_functions.h"
+
+#include "utils/CompFunction.h"
+
+using namespace mrcpp;
+
+namespace comp_function {
+
+template <typename T> void testOverlapMatrix();
+
+SCENARIO("CompFunctionVector times a function", "[comp_function], [trees]") {
+    const double prec = 1.0e-5;
+    const int N = 3;
+
+    MultiResolutionAnalysis<3> *mra = nullptr;
+    initialize(&mra);
+    {
+        std::vector<CompFunction<3>> funcs;
+        for (int j = 0; j < N; j++) {
+            CompFunction<3> func(*mra);
+            GaussFunc<3> gauss(10.0 + 5.0 * j, 1.0, {0.1 * j, -0.1, 0.2 * j});
+            project(func, gauss, prec);
+            func.func_ptr->data.n1[0] = j;
+            funcs.push_back(func);
+        }
+        CompFunctionVector Phi(N);
+        for (int j = 0; j < N; j++) Phi[j] = funcs[j];
+
+        GaussFunc<3> f(1.0, 2.0, {0.0, 0.0, 0.0});
+        CompFunctionVector out = multiply(Phi, f, prec, nullptr, 0);
+        THEN("each output is the product with its own input") {
+            for (int j = 0; j < N; j++) {
+                CompFunction<3> ref(*mra);
+                multiply(ref, Phi[j], f, prec);
+                REQUIRE(out[j].func_ptr->data.n1[0] == j);
+                REQUIRE(out[j].getSquareNorm() == Catch::Approx(ref.getSquareNorm()).epsilon(1.0e-6));
+                REQUIRE(std::abs(dot(out[j], ref) - ref.getSquareNorm()) < 1.0e-6 * ref.getSquareNorm());
+            }
+        }
+    }
+    finalize(&mra);
+}
+
+SCENARIO("CompFunctionVector overlap matrix", "[comp_function], [trees]") {
+    GIVEN("real functions") { testOverlapMatrix<double>(); }
+    GIVEN("complex functions") { testOverlapMatrix<ComplexDouble>(); }
+}
+
+template <typename T> void testOverlapMatrix() {
+    const double prec = 1.0e-5;
+    const int N = 6;
+
+    MultiResolutionAnalysis<3> *mra = nullptr;
+    initialize(&mra);
+    {
+        // spins 0, 2, 1, 0, 1, 2: 0 (paired) overlaps with both 1 (alpha) and 2 (beta)
+        std::vector<CompFunction<3>> funcs;
+        for (int j = 0; j < N; j++) {
+            CompFunction<3> func(*mra);
+            Coord<3> pos = {0.1 * j, 0.2 - 0.05 * j, -0.1 * j};
+            double beta = 20.0 + 5.0 * j;
+            if constexpr (std::is_same<T, double>::value) {
+                GaussFunc<3> gauss(beta, 1.0, pos);
+                project(func, gauss, prec);
+            } else {
+                std::function<ComplexDouble(const Coord<3> &r)> f = [pos, beta, j](const Coord<3> &r) {
+                    double r2 = 0.0;
+                    for (int d = 0; d < 3; d++) r2 += (r[d] - pos[d]) * (r[d] - pos[d]);
+                    return std::exp(-beta * r2) * ComplexDouble(std::cos(j * r[0]), std::sin(j * r[1]));
+                };
+                project(func, f, prec);
+            }
+            func.func_ptr->data.n1[0] = (j % 3 == 0) ? 0 : 1 + j % 2;
+            funcs.push_back(func);
+        }
+        CompFunctionVector Phi(N);
+        for (int j = 0; j < N; j++) {
+            Phi[j] = funcs[j];
+            Phi[j].func_ptr->rank = j;
+        }
+
+        WHEN("the overlap matrix is computed") {
+            ComplexMatrix S = calc_overlap_matrix(Phi);
+            THEN("it equals the pairwise dot products") {
+                for (int i = 0; i < N; i++) {
+                    for (int j = 0; j < N; j++) {
+                        ComplexDouble ref = dot(Phi[i], Phi[j]);
+                        REQUIRE(std::abs(S(i, j) - ref) < 1.0e-12);
+                    }
+                }
+            }
+            THEN("functions of opposite spins do not overlap") {
+                REQUIRE(std::abs(S(1, 2)) == 0.0);
+                REQUIRE(std::abs(S(4, 5)) == 0.0);
+                REQUIRE(std::abs(S(2, 4)) > 0.0);
+                REQUIRE(std::abs(S(0, 1)) > 0.0);
+            }
+        }
+    }
+    finalize(&mra);
+}
+
+} // namespace comp_function
@@ -25,9 +25,14 @@
 
 #include "catch2/catch_all.hpp"
 
+#include <cstring>
+
 #include "factory_functions.h"
 
+#include "treebuilders/grid.h"
 #include "treebuilders/multiply.h"
+#include "treebuilders/project.h"
+#include "trees/MWNode.h"
 
 using namespace mrcpp;
 
@@ -35,6 +40,8 @@ namespace function_tree {
 
 template <int D> void testZeroFunction();
 template <int D> void testGeneratedNodes();
+template <int D> void testNodeOrdering(bool hilbert);
+template <int D> void testPackedCoefs();
 
 SCENARIO("Zero FunctionTree", "[function_tree_zero], [function_tree], [trees]") {
     GIVEN("a default function in 1D") { testZeroFunction<1>(); }
@@ -99,4 +106,184 @@ template <int D> void testGeneratedNodes() {
     finalize(&mra);
 }
 
+SCENARIO("Reordering FunctionTree nodes", "[function_tree_ordering], [function_tree], [trees]") {
+    GIVEN("a projected function in 1D") { testNodeOrdering<1>(true); }
+    GIVEN("a projected function in 2D") { testNodeOrdering<2>(true); }
+    GIVEN("a projected function in 3D") { testNodeOrdering<3>(true); }
+    GIVEN("a projected function in 3D, Morton order") { testNodeOrdering<3>(false); }
+}
+
+template <int D> void testNodeOrdering(bool hilbert) {
+    const double prec = 1.0e-3;
+
+    GaussFunc<D> *func = nullptr;
+    initialize(&func);
+    MultiResolutionAnalysis<D> *mra = nullptr;
+    initialize(&mra);
+
+    FunctionTree<D> tree(*mra);
+    project(prec, tree, *func);
+    tree.setNodeIndexing(true);
+
+    const Coord<D> r = func->getPos();
+    const double ref_val = tree.evalf(r);
+    const double ref_norm = tree.getSquareNorm();
+    const int ref_nodes = tree.getNNodes();
+    const int ref_ends = tree.getNEndNodes();
+
+    WHEN("the nodes are reordered") {
+        tree.reorderNodes(hilbert);
+        THEN("the function is unchanged") {
+            REQUIRE(tree.getNNodes() == ref_nodes);
+            REQUIRE(tree.getNEndNodes() == ref_ends);
+            REQUIRE(tree.evalf(r) == Catch::Approx(ref_val).epsilon(1.0e-12));
+            tree.calcSquareNorm();
+            REQUIRE(tree.getSquareNorm() == Catch::Approx(ref_norm).epsilon(1.0e-12));
+        }
+        THEN("the nodes are stored scale by scale with aligned siblings") {
+            auto &allocator = tree.getNodeAllocator();
+            const int nSlots = allocator.getNChunksUsed() * allocator.getMaxNodesPerChunk();
+            int lastScale = tree.getRootScale();
+            int lastIdx = -1;
+            for (int sIdx = 0; sIdx < nSlots; sIdx++) {
+                MWNode<D> *node = allocator.getNode_p(sIdx);
+                if (node == nullptr or node->getSerialIx() != sIdx) continue;
+                REQUIRE(node->getScale() >= lastScale);
+                if (node->getScale() > tree.getRootScale()) REQUIRE(&node->getMWParent().getMWChild(sIdx % (1 << D)) == node);
+                lastScale = node->getScale();
+                lastIdx = sIdx;
+            }
+            REQUIRE(lastIdx >= 0);
+        }
+        THEN("the node index is updated") {
+            for (int i = 0; i < tree.getNEndNodes(); i++) {
+                MWNode<D> &node = tree.getEndMWNode(i);
+                REQUIRE(tree.findNode(node.getNodeIndex()) == &node);
+            }
+        }
+        AND_WHEN("the tree is refined further") {
+            refine_grid(tree, 1);
+            FunctionTree<D> ref_tree(*mra);
+            project(prec, ref_tree, *func);
+            refine_grid(ref_tree, 1);
+            THEN("it is the same as refining the original tree") {
+                REQUIRE(tree.getNNodes() == ref_tree.getNNodes());
+                REQUIRE(tree.evalf(r) == Catch::Approx(ref_tree.evalf(r)).epsilon(1.0e-12));
+            }
+        }
+    }
+    finalize(&mra);
+    finalize(&func);
+}
+
+SCENARIO("Packing FunctionTree coefficients", "[function_tree_packing], [function_tree], [trees]") {
+    GIVEN("a projected function in 1D") { testPackedCoefs<1>(); }
+    GIVEN("a projected function in 2D") { testPackedCoefs<2>(); }
+    GIVEN("a projected function in 3D") { testPackedCoefs<3>(); }
+}
+
+template <int D> void testPackedCoefs() {
+    const double prec = 1.0e-3;
+
+    GaussFunc<D> *func = nullptr;
+    initialize(&func);
+    MultiResolutionAnalysis<D> *mra = nullptr;
+    initialize(&mra);
+
+    FunctionTree<D> tree(*mra);
+    project(prec, tree, *func);
+
+    const Coord<D> r = func->getPos();
+    const double ref_val = tree.evalf(r);
+    const double ref_norm = tree.getSquareNorm();
+    const int ref_nodes = tree.getNNodes();
+    const int ref_size = tree.getSizeNodes();
+
+    WHEN("the coefficients are packed") {
+        tree.packCoefs();
+        THEN("the memory footprint is halved") {
+            REQUIRE(tree.isPacked());
+            REQUIRE(tree.getNNodes() == ref_nodes);
+            REQUIRE(tree.getSizeNodes() == ref_size / 2);
+        }
+        THEN("the grid and norms are unchanged") {
+            REQUIRE(tree.getSquareNorm() == Catch::Approx(ref_norm).epsilon(1.0e-12));
+            REQUIRE(tree.getRootMWNode(0).getSquareNorm() >= 0.0);
+        }
+        AND_WHEN("the coefficients are unpacked") {
+            tree.unpackCoefs();
+            THEN("the function is the same to single precision") {
+                REQUIRE_FALSE(tree.isPacked());
+                REQUIRE(tree.evalf(r) == Catch::Approx(ref_val).epsilon(1.0e-6));
+                tree.calcSquareNorm();
+                REQUIRE(tree.getSquareNorm() == Catch::Approx(ref_norm).epsilon(1.0e-6));
+            }
+        }
+        AND_WHEN("the coefficients are set to zero") {
+            tree.setZero();
+            THEN("the grid is kept with double precision zeros") {
+                REQUIRE_FALSE(tree.isPacked());
+                REQUIRE(tree.getNNodes() == ref_nodes);
+                REQUIRE(tree.evalf(r) == 0.0);
+            }
+        }
+        AND_WHEN("the tree is cleared") {
+            tree.clear();
+            THEN("it can be used for a new function") {
+                REQUIRE_FALSE(tree.isPacked());
+                project(prec, tree, *func);
+                REQUIRE(tree.evalf(r) == Catch::Approx(ref_val).epsilon(1.0e-12));
+            }
+        }
+    }
+    finalize(&mra);
+    finalize(&func);
+}
+
+SCENARIO("Receiving FunctionTree chunks", "[function_tree_chunks], [function_tree], [trees]") {
+    const double prec = 1.0e-3;
+
+    GaussFunc<3> *func = nullptr;
+    initialize(&func);
+    MultiResolutionAnalysis<3> *mra = nullptr;
+    initialize(&mra);
+
+    FunctionTree<3> tree(*mra);
+    project(prec, tree, *func);
+    refine_grid(tree, 2);
+    tree.calcSquareNorm();
+    auto &src = tree.getNodeAllocator();
+    const int nChunks = src.getNChunksUsed();
+    const Coord<3> r = func->getPos();
+
+    GIVEN("a tree of several chunks") {
+        REQUIRE(nChunks > 1);
+        WHEN("the chunks are copied and relinked one by one, in any order") {
+            FunctionTree<3> copy(*mra);
+            copy.deleteRootNodes();
+            auto &dst = copy.getNodeAllocator();
+            dst.init(nChunks);
+            for (int i = nChunks - 1; i >= 0; i--) {
+                std::memcpy(dst.getNodeChunk(i), src.getNodeChunk(i), src.getNodeChunkSize());
+                std::memcpy(dst.getCoefChunk(i), src.getCoefChunk(i), src.getCoefChunkSize());
+                dst.relinkChunk(i);
+            }
+            dst.reassemble(false);
+            THEN("the copy is the same function") {
+                REQUIRE(copy.getNNodes() == tree.getNNodes());
+                REQUIRE(copy.getNEndNodes() == tree.getNEndNodes());
+                REQUIRE(copy.getSquareNorm() == Catch::Approx(tree.getSquareNorm()).epsilon(1.0e-12));
+                REQUIRE(copy.evalf(r) == Catch::Approx(tree.evalf(r)).epsilon(1.0e-12));
+                for (int i = 0; i < copy.getNEndNodes(); i++) {
+                    MWNode<3> &node = copy.getEndMWNode(i);
+                    REQUIRE(&node.getMWTree() == &copy);
+                    REQUIRE(copy.findNode(node.getNodeIndex()) == &node);
+                }
+            }
+        }
+    }
+    finalize(&mra);
+    finalize(&func);
+}
+
 } // namespace function_tree
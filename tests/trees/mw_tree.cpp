@@ -33,6 +33,7 @@ using namespace mrcpp;
 namespace mw_tree {
 
 template <int D> void testNodeFetchers();
+template <int D> void testNodeIndexing();
 
 TEST_CASE("MWTree: Fetching nodes", "[mw_tree_fetch], [mw_tree], [trees]") {
     SECTION("1D") { testNodeFetchers<1>(); }
@@ -40,6 +41,12 @@ TEST_CASE("MWTree: Fetching nodes", "[mw_tree_fetch], [mw_tree], [trees]") {
     SECTION("3D") { testNodeFetchers<3>(); }
 }
 
+TEST_CASE("MWTree: Hash indexed node lookup", "[mw_tree_indexing], [mw_tree], [trees]") {
+    SECTION("1D") { testNodeIndexing<1>(); }
+    SECTION("2D") { testNodeIndexing<2>(); }
+    SECTION("3D") { testNodeIndexing<3>(); }
+}
+
 template <int D> void testNodeFetchers() {
     Coord<D> r;
     if (D >= 1) r[0] = -0.3;
@@ -186,4 +193,56 @@ template <int D> void testNodeFetchers() {
     finalize(&mra);
 }
 
+template <int D> void testNodeIndexing() {
+    const int cIdx = 1 << (D - 1);
+    NodeIndex<D> *root = nullptr;
+    initialize(&root);
+    const NodeIndex<D> idx_0(*root);
+    const NodeIndex<D> idx_1 = idx_0.child(cIdx);
+    const NodeIndex<D> idx_2 = idx_1.child(cIdx);
+    const NodeIndex<D> idx_3 = idx_2.child(0);
+    finalize(&root);
+
+    MultiResolutionAnalysis<D> *mra = nullptr;
+    initialize(&mra);
+
+    FunctionTree<D> tree(*mra);
+    tree.setZero();
+    tree.getNode(idx_2, true);
+    tree.setNodeIndexing(true);
+    REQUIRE(tree.hasNodeIndexing());
+
+    // All allocated nodes are found, same as by tree descent
+    for (auto idx : {idx_0, idx_1, idx_2}) {
+        MWNode<D> *node = tree.findNode(idx);
+        REQUIRE(node != nullptr);
+        REQUIRE(node->getNodeIndex() == idx);
+        REQUIRE(&tree.getNode(idx) == node);
+    }
+    REQUIRE(tree.findNode(idx_3) == nullptr);
+
+    // Generated nodes are not indexed
+    MWNode<D> &gen = tree.getNode(idx_3);
+    REQUIRE(gen.isGenNode());
+    REQUIRE(tree.findNode(idx_3) == nullptr);
+    tree.deleteGenerated();
+
+    // Created nodes are added to the index
+    MWNode<D> &created = tree.getNode(idx_3, true);
+    REQUIRE_FALSE(created.isGenNode());
+    REQUIRE(tree.findNode(idx_3) == &created);
+
+    // Deleted nodes are removed from the index
+    tree.findNode(idx_1)->deleteChildren();
+    REQUIRE(tree.findNode(idx_1) != nullptr);
+    REQUIRE(tree.findNode(idx_2) == nullptr);
+    REQUIRE(tree.findNode(idx_3) == nullptr);
+
+    tree.setNodeIndexing(false);
+    REQUIRE_FALSE(tree.hasNodeIndexing());
+    REQUIRE(tree.findNode(idx_1) != nullptr);
+    REQUIRE(tree.findNode(idx_2) == nullptr);
+    finalize(&mra);
+}
+
 } // namespace mw_tree
@@ -23,6 +23,8 @@
  * <https://mrcpp.readthedocs.io/>
  */
 
+#include <unordered_map>
+
 #include "catch2/catch_all.hpp"
 
 #include "factory_functions.h"
@@ -150,6 +152,7 @@ template <int D> void testCompare() {
     THEN("aIdx == bIdx") {
         REQUIRE(*aIdx == *bIdx);
         REQUIRE_FALSE(*aIdx != *bIdx);
+        REQUIRE(std::hash<NodeIndex<D>>{}(*aIdx) == std::hash<NodeIndex<D>>{}(*bIdx));
     }
     WHEN("aIdx is given a deeper scale") {
         aIdx->setScale(2);
@@ -172,6 +175,20 @@ template <int D> void testCompare() {
             REQUIRE_FALSE(*aIdx == *bIdx);
         }
     }
+    WHEN("Indices are stored in a hash map") {
+        std::unordered_map<NodeIndex<D>, int> idxMap;
+        for (int n = -1; n < 3; n++) {
+            for (int l = -4; l < 4; l++) {
+                std::array<int, D> trans;
+                trans.fill(l);
+                idxMap[NodeIndex<D>(n, trans)] = 4 * n + l;
+            }
+        }
+        THEN("all distinct indices are found") {
+            REQUIRE(idxMap.size() == 32);
+            REQUIRE(idxMap[NodeIndex<D>(2, {})] == 8);
+        }
+    }
     finalize(&aIdx);
     finalize(&bIdx);
 }
@@ -0,0 +1,126 @@
+/*
+ * MRCPP, a numerical library based on multiresolution analysis and
+ * the multiwavelet basis which provide low-scaling algorithms as well as
+ * rigorous error control in numerical computations.
+ * Copyright (C) 2021 Stig Rune Jensen, Jonas Juselius, Luca Frediani and contributors.
+ *
+ * This file is part of MRCPP.
+ *
+ * MRCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MRCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with MRCPP.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * For information on the complete list of contributors to MRCPP, see:
+ * <https://mrcpp.readthedocs.io/>
+ */
+
+#include "catch2/catch_all.hpp"
+
+#include <memory>
+#include <vector>
+
+#include "utils/mpi_utils.h"
+
+using namespace mrcpp;
+
+namespace shared_memory {
+
+SCENARIO("SharedMemory segments", "[shared_memory], [trees]") {
+    // small pool: windows of 4 slabs of 1 MB
+    const int memory_size = mpi::shared_memory_size;
+    const int slab_size = mpi::shared_slab_size;
+    mpi::shared_memory_size = 4;
+    mpi::shared_slab_size = 1;
+    SharedMemoryPool::free_all();
+    SharedMemoryPool &pool = SharedMemoryPool::get(mpi::comm_share);
+
+    const int64_t slab = 1024 * 1024 / sizeof(double);
+    const int64_t n = 3 * slab / 4;
+    {
+        SharedMemory<double> mem(mpi::comm_share);
+        REQUIRE(mem.getNSegments() == 0);
+        REQUIRE(mem.sh_start_ptr() == nullptr);
+
+        double *a = mem.allocate(n);
+        double *b = mem.allocate(n);
+        for (int64_t i = 0; i < n; i++) a[i] = 1.0;
+        for (int64_t i = 0; i < n; i++) b[i] = 2.0;
+        REQUIRE(mem.getNSegments() == 2);
+        REQUIRE(mem.getSize() == 2 * n);
+        REQUIRE(a[n - 1] == 1.0);
+        REQUIRE(mem.sh_start_ptr() == a);
+        REQUIRE(mem.sh_end_ptr() == a + n);
+        REQUIRE(mem.sh_max_ptr() == a + slab);
+
+        WHEN("memory is deallocated across segments") {
+            mem.deallocate(b);
+            REQUIRE(mem.getSize() == n);
+            mem.deallocate(a);
+            REQUIRE(mem.getSize() == 0);
+            THEN("the segments are reused in the same order") {
+                REQUIRE(mem.allocate(n) == a);
+                REQUIRE(mem.allocate(n) == b);
+                REQUIRE(mem.getNSegments() == 2);
+            }
+        }
+        WHEN("memory is cleared") {
+            mem.clear();
+            REQUIRE(mem.getSize() == 0);
+            THEN("a block larger than the segments gets a new one") {
+                double *c = mem.allocate(2 * slab);
+                REQUIRE(mem.getNSegments() == 3);
+                REQUIRE(mem.getSize() == 2 * slab);
+                REQUIRE((c + 2 * slab <= a or c >= a + slab));
+                REQUIRE((c + 2 * slab <= b or c >= b + slab));
+                AND_THEN("the block grows beyond its own window") {
+                    REQUIRE(mem.allocate(slab) != nullptr);
+                    REQUIRE(mem.getNSegments() == 4);
+                }
+            }
+        }
+        WHEN("another block is created") {
+            int nWindows = pool.getNWindows();
+            SharedMemory<double> other(mpi::comm_share);
+            THEN("it gets a window of its own") {
+                REQUIRE(pool.getNWindows() > nWindows);
+                for (int i = 0; i < 4; i++) other.allocate(slab);
+                REQUIRE(other.getNSegments() == 4);
+                REQUIRE(mem.allocate(2 * slab) != nullptr);
+                REQUIRE(mem.getNSegments() == 3);
+            }
+        }
+    }
+    WHEN("several blocks fill their windows") {
+        std::vector<std::unique_ptr<SharedMemory<double>>> mems;
+        for (int i = 0; i < 4; i++) mems.push_back(std::make_unique<SharedMemory<double>>(mpi::comm_share));
+        for (auto &mem : mems) REQUIRE(mem->allocate(4 * slab) != nullptr);
+        THEN("each block keeps its whole window") {
+            for (auto &mem : mems) mem->clear();
+            for (auto &mem : mems) REQUIRE(mem->allocate(4 * slab) != nullptr);
+            REQUIRE(mems[0]->getNSegments() == 1);
+        }
+    }
+    WHEN("a block is destroyed") {
+        int nWindows = pool.getNWindows();
+        SharedMemory<double> mem(mpi::comm_share);
+        THEN("its window is reused") {
+            REQUIRE(pool.getNWindows() == nWindows);
+            REQUIRE(pool.getNFreeSlabs() == 4 * nWindows);
+        }
+    }
+
+    SharedMemoryPool::free_all();
+    mpi::shared_memory_size = memory_size;
+    mpi::shared_slab_size = slab_size;
+}
+
+} // namespace shared_memory
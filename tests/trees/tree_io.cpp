@@ -25,10 +25,17 @@
 
 #include "catch2/catch_all.hpp"
 
+#include <fstream>
+#include <sstream>
+
 #include "factory_functions.h"
 
+#include "treebuilders/add.h"
 #include "treebuilders/grid.h"
 #include "treebuilders/project.h"
+#include "trees/MWNode.h"
+#include "trees/TreeFile.h"
+#include "utils/CompFunction.h"
 
 using namespace mrcpp;
 
@@ -68,6 +75,100 @@ SCENARIO("FunctionTree IO", "[tree_io], [trees]") {
             }
         }
     }
+    WHEN("the header of a saved function is read") {
+        f_tree.saveTree("f");
+        tree_file::Header header;
+        std::ifstream in("f.tree", std::ios::binary);
+        in.read((char *)&header, sizeof(header));
+        THEN("it describes the tree") {
+            REQUIRE(tree_file::is_tree_file(header));
+            REQUIRE_FALSE(tree_file::swap_header(header));
+            REQUIRE(tree_file::check_header(header, *mra));
+            REQUIRE(header.nNodes == ref_nodes);
+            REQUIRE(header.coefType == tree_file::Real64);
+            REQUIRE(header.coefOffset % tree_file::Alignment == 0);
+        }
+        AND_WHEN("the header is written with the opposite byte order") {
+            tree_file::swap_bytes((char *)&header.version, 2, sizeof(uint32_t));
+            tree_file::swap_bytes((char *)&header.dim, 14, sizeof(int32_t));
+            tree_file::swap_bytes((char *)header.scaling, 3, sizeof(double));
+            tree_file::swap_bytes((char *)&header.nNodes, 1, sizeof(int64_t));
+            tree_file::swap_bytes((char *)&header.nCoefs, 2, sizeof(int32_t));
+            tree_file::swap_bytes((char *)&header.nodeOffset, 4, sizeof(int64_t));
+            THEN("it is swapped back by the reader") {
+                REQUIRE(tree_file::is_tree_file(header));
+                REQUIRE(tree_file::swap_header(header));
+                REQUIRE(tree_file::check_header(header, *mra));
+                REQUIRE(header.nNodes == ref_nodes);
+            }
+        }
+    }
+    WHEN("two functions are saved to the same stream") {
+        FunctionTree<3> h_tree(*mra);
+        project(100 * prec, h_tree, *func);
+        std::stringstream buffer;
+        f_tree.saveTree(buffer);
+        h_tree.saveTree(buffer);
+        AND_WHEN("they are read back one after another") {
+            FunctionTree<3> g_tree(*mra);
+            FunctionTree<3> k_tree(*mra);
+            g_tree.loadTree(buffer);
+            THEN("the first tree is identical to the old") {
+                REQUIRE(g_tree.getSquareNorm() == Catch::Approx(ref_norm).epsilon(1.0e-12));
+                REQUIRE(g_tree.getNNodes() == ref_nodes);
+            }
+            k_tree.loadTree(buffer);
+            THEN("the second tree is found after the first") {
+                REQUIRE(k_tree.getSquareNorm() == Catch::Approx(h_tree.getSquareNorm()).epsilon(1.0e-12));
+                REQUIRE(k_tree.getNNodes() == h_tree.getNNodes());
+            }
+        }
+    }
+    WHEN("a subregion of a saved function is loaded") {
+        f_tree.saveTree("f");
+        const Coord<3> r = {-0.2, 0.51, 1.01};
+        const BoundingBox<3> near(NodeIndex<3>(5, {-7, 16, 32}), {1, 1, 1});
+        const BoundingBox<3> far(NodeIndex<3>(5, {-16, 0, 16}), {1, 1, 1});
+        FunctionTree<3> g_tree(*mra);
+        THEN("the function is unchanged inside the region") {
+            g_tree.loadTree("f", near, mra->getMaxScale());
+            REQUIRE(g_tree.getNNodes() < ref_nodes);
+            REQUIRE(g_tree.evalf(r) == Catch::Approx(f_tree.evalf(r)).epsilon(1.0e-12));
+        }
+        THEN("only a few nodes are read away from the function") {
+            g_tree.loadTree("f", far, mra->getMaxScale());
+            REQUIRE(g_tree.getNNodes() < ref_nodes / 4);
+        }
+        THEN("no nodes are read below the given scale") {
+            g_tree.loadTree("f", near, mra->getRootScale() + 2);
+            REQUIRE(g_tree.getDepth() == 3);
+        }
+    }
+    WHEN("a saved function is mapped into a new tree") {
+        f_tree.saveTree("f");
+        FunctionTree<3> g_tree(*mra);
+        g_tree.mapTree("f");
+        THEN("the new tree is identical to the old") {
+            REQUIRE(g_tree.isMapped());
+            REQUIRE(g_tree.integrate() == Catch::Approx(ref_charge).epsilon(1.0e-12));
+            REQUIRE(g_tree.getSquareNorm() == Catch::Approx(ref_norm).epsilon(1.0e-12));
+            REQUIRE(g_tree.getNNodes() == ref_nodes);
+        }
+        AND_WHEN("the mapped tree is modified") {
+            g_tree.rescale(2.0);
+            refine_grid(g_tree, 1);
+            THEN("the file remains unchanged") {
+                REQUIRE(g_tree.getSquareNorm() == Catch::Approx(4.0 * ref_norm).epsilon(1.0e-12));
+                FunctionTree<3> h_tree(*mra);
+                h_tree.loadTree("f");
+                REQUIRE(h_tree.getSquareNorm() == Catch::Approx(ref_norm).epsilon(1.0e-12));
+            }
+        }
+        AND_WHEN("the mapped tree is cleared") {
+            g_tree.clear();
+            THEN("the mapping is released") { REQUIRE_FALSE(g_tree.isMapped()); }
+        }
+    }
     WHEN("a function with unused memory chunks is saved") {
         f_tree.clear();                     // leaves memory chunks
         project(100 * prec, f_tree, *func); // should use less chunks
@@ -94,6 +195,70 @@ SCENARIO("FunctionTree IO", "[tree_io], [trees]") {
             }
         }
     }
+    WHEN("a function is exported in the interop format") {
+        // the interop format requires a cubic world from -L to L
+        MultiResolutionAnalysis<3> cube_mra({-2, 2}, mra->getOrder());
+        FunctionTree<3> c_tree(cube_mra);
+        project(prec, c_tree, *func);
+        const double c_charge = c_tree.integrate();
+        const double c_norm = c_tree.getSquareNorm();
+
+        c_tree.saveTreeBIN("f.bin");
+        THEN("the old tree remains unchanged") {
+            REQUIRE(c_tree.integrate() == Catch::Approx(c_charge).epsilon(1.0e-12));
+            REQUIRE(c_tree.getSquareNorm() == Catch::Approx(c_norm).epsilon(1.0e-12));
+        }
+        THEN("the header describes the end nodes") {
+            tree_file::InteropHeader header;
+            std::ifstream in("f.bin", std::ios::binary);
+            in.read((char *)&header, sizeof(header));
+            REQUIRE(tree_file::is_interop_file(header));
+            REQUIRE_FALSE(tree_file::swap_interop_header(header));
+            REQUIRE(header.nNodes == 8 * c_tree.getNEndNodes());
+            REQUIRE(header.valueOffset % tree_file::Alignment == 0);
+        }
+        AND_WHEN("the exported function is imported into a new tree") {
+            FunctionTree<3> g_tree(cube_mra);
+            g_tree.loadTreeBIN("f.bin");
+            THEN("the new tree is identical to the old") {
+                REQUIRE(g_tree.integrate() == Catch::Approx(c_charge).epsilon(1.0e-10));
+                REQUIRE(g_tree.getSquareNorm() == Catch::Approx(c_norm).epsilon(1.0e-10));
+                REQUIRE(g_tree.getNEndNodes() == c_tree.getNEndNodes());
+            }
+        }
+        AND_WHEN("the function is also exported as text") {
+            c_tree.saveTreeTXT("f.txt");
+            FunctionTree<3> g_tree(cube_mra);
+            FunctionTree<3> h_tree(cube_mra);
+            g_tree.loadTreeBIN("f.bin");
+            h_tree.loadTreeTXT("f.txt");
+            THEN("both files give the same tree") {
+                REQUIRE(h_tree.getSquareNorm() == Catch::Approx(g_tree.getSquareNorm()).epsilon(1.0e-10));
+                REQUIRE(h_tree.getNNodes() == g_tree.getNNodes());
+            }
+            remove("f.txt");
+        }
+        remove("f.bin");
+    }
+    WHEN("a function with packed coefficients is saved") {
+        f_tree.packCoefs();
+        f_tree.saveTree("f");
+        AND_WHEN("the saved function is load into a new tree") {
+            FunctionTree<3> g_tree(*mra);
+            g_tree.loadTree("f");
+            THEN("the new tree is packed") {
+                REQUIRE(g_tree.isPacked());
+                REQUIRE(g_tree.getNNodes() == ref_nodes);
+            }
+            AND_WHEN("the new tree is unpacked") {
+                g_tree.unpackCoefs();
+                THEN("it is identical to the old to single precision") {
+                    REQUIRE(g_tree.integrate() == Catch::Approx(ref_charge).epsilon(1.0e-6));
+                    REQUIRE(g_tree.getSquareNorm() == Catch::Approx(ref_norm).epsilon(1.0e-6));
+                }
+            }
+        }
+    }
     // Delete saved file
     remove("f.tree");
 
@@ -101,4 +266,73 @@ SCENARIO("FunctionTree IO", "[tree_io], [trees]") {
     finalize(&func);
 }
 
+SCENARIO("CompFunctionVector checkpoint", "[tree_io], [trees]") {
+    const double prec = 1.0e-6;
+
+    MultiResolutionAnalysis<3> *mra = nullptr;
+    initialize(&mra);
+
+    // a real, a real two-component and a complex function
+    const int N = 3;
+    CompFunctionVector Phi(N);
+    for (int j = 0; j < N; j++) {
+        CompFunction<3> func(*mra);
+        Coord<3> pos = {0.1 * j, -0.1 * j, 0.2};
+        if (j < 2) {
+            GaussFunc<3> gauss(10.0 + j, 1.0, pos);
+            project(func, gauss, prec);
+        } else {
+            std::function<ComplexDouble(const Coord<3> &r)> f = [pos](const Coord<3> &r) {
+                double r2 = 0.0;
+                for (int d = 0; d < 3; d++) r2 += (r[d] - pos[d]) * (r[d] - pos[d]);
+                return std::exp(-10.0 * r2) * ComplexDouble(1.0, r[0]);
+            };
+            project(func, f, prec);
+        }
+        Phi[j] = func;
+        Phi[j].func_ptr->rank = j;
+    }
+    Phi[1].alloc_comp(1);
+    add(prec, *Phi[1].CompD[1], 2.0, *Phi[0].CompD[0], -1.0, *Phi[1].CompD[0]);
+
+    WHEN("a checkpoint is written and read back") {
+        save_checkpoint(Phi, "phi").get();
+        CompFunctionVector Psi(N);
+        load_checkpoint(Psi, "phi");
+        THEN("the functions are identical to the old") {
+            for (int j = 0; j < N; j++) {
+                REQUIRE(Psi[j].rank() == j);
+                REQUIRE(Psi[j].Ncomp() == Phi[j].Ncomp());
+                REQUIRE(Psi[j].isreal() == Phi[j].isreal());
+                REQUIRE(Psi[j].getSquareNorm() == Catch::Approx(Phi[j].getSquareNorm()).epsilon(1.0e-12));
+                REQUIRE(std::abs(Psi[j].integrate() - Phi[j].integrate()) < 1.0e-12);
+            }
+            REQUIRE(Psi[1].CompD[1]->getSquareNorm() == Catch::Approx(Phi[1].CompD[1]->getSquareNorm()).epsilon(1.0e-12));
+        }
+        remove("phi.0.chk");
+    }
+    WHEN("a checkpoint is written of trees with generated nodes") {
+        FunctionTree<3> &tree = *Phi[0].CompD[0];
+        tree.getNode(tree.getEndMWNode(0).getNodeIndex().child(0));
+        const int nGenNodes = tree.getNGenNodes();
+        const int nNodes = tree.getNNodes();
+        save_checkpoint(Phi, "phi").get();
+        THEN("the trees are not changed") {
+            REQUIRE(nGenNodes > 0);
+            REQUIRE(tree.getNGenNodes() == nGenNodes);
+            CompFunctionVector Psi(N);
+            load_checkpoint(Psi, "phi");
+            REQUIRE(Psi[0].CompD[0]->getNNodes() == nNodes);
+            REQUIRE(Psi[0].CompD[0]->getNGenNodes() == 0);
+        }
+        remove("phi.0.chk");
+    }
+    WHEN("a checkpoint cannot be written") {
+        auto saved = save_checkpoint(Phi, "no_such_dir/phi");
+        THEN("the error is raised by the future") { REQUIRE_THROWS_AS(saved.get(), std::runtime_error); }
+    }
+
+    finalize(&mra);
+}
+
 } // namespace tree_io
@@ -25,3 +25,38 @@
 
 #define CATCH_CONFIG_MAIN
 #include "catch2/catch_all.hpp"
+
+#ifdef MRCPP_HAS_MPI
+#include <cstdlib>
+
+#include "factory_functions.h"
+
+#include "utils/CompFunction.h"
+#include "utils/parallel.h"
+
+// MPI is initialized for the whole test run, as in a program using MRCPP
+class MPIListener : public Catch::EventListenerBase {
+public:
+    using Catch::EventListenerBase::EventListenerBase;
+    void testRunStarting(Catch::TestRunInfo const &info) override {
+        // the bank ranks are set up in initialize, the tests with several ranks pass their settings here
+        if (std::getenv("MRCPP_BANK_SIZE") != nullptr) {
+            mrcpp::mpi::bank_size = std::atoi(std::getenv("MRCPP_BANK_SIZE"));
+            // the bank ranks receive functions on the MRA of the tests
+            initialize(&this->mra);
+            mrcpp::SetdefaultMRA(this->mra);
+        }
+        if (std::getenv("MRCPP_BANK_MEM_LIMIT") != nullptr) mrcpp::mpi::bank_mem_limit = std::atoi(std::getenv("MRCPP_BANK_MEM_LIMIT"));
+        mrcpp::mpi::initialize();
+    }
+    void testRunEnded(Catch::TestRunStats const &stats) override {
+        mrcpp::mpi::finalize();
+        if (this->mra != nullptr) finalize(&this->mra);
+    }
+
+private:
+    mrcpp::MultiResolutionAnalysis<3> *mra = nullptr;
+};
+
+CATCH_REGISTER_LISTENER(MPIListener)
+#endif
@@ -0,0 +1,298 @@
+/*
+ * MRCPP, a numerical library based on multiresolution analysis and
+ * the multiwavelet basis which provide low-scaling algorithms as well as
+ * rigorous error control in numerical computations.
+ * Copyright (C) 2021 Stig Rune Jensen, Jonas Juselius, Luca Frediani and contributors.
+ *
+ * This file is part of MRCPP.
+ *
+ * MRCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MRCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with MRCPP.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * For information on the complete list of contributors to MRCPP, see:
+ * <https://mrcpp.readthedocs.io/>
+ */
+
+#include "catch2/catch_all.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "factory_functions.h"
+
+#include "utils/Bank.h"
+#include "utils/CompFunction.h"
+
+using namespace mrcpp;
+
+namespace bank {
+
+// with a single rank the bank is kept in one-sided windows (MPI only)
+class LocalBank {
+public:
+    LocalBank()
+            : rma(mpi::bank_rma)
+            , rma_size(mpi::bank_rma_size) {
+        mpi::bank_rma = true;
+        mpi::bank_rma_size = 16;
+    }
+    ~LocalBank() {
+        mpi::bank_rma = this->rma;
+        mpi::bank_rma_size = this->rma_size;
+    }
+
+private:
+    bool rma;
+    int rma_size;
+};
+
+SCENARIO("Bank statistics", "[bank]") {
+    GIVEN("Requests of different durations") {
+        BankStatistics stats;
+        stats.add(1, GET_DATA, 0.5e-6, 0, 80);
+        stats.add(1, GET_DATA, 3.0e-6, 0, 80);
+        stats.add(1, GET_DATA, 1.0e3, 0, 80);
+        stats.add(2, SAVE_DATA, 1.5e-6, 160, 0);
+        stats.add_queue_depth(2);
+        stats.add_queue_depth(4);
+        std::string json = stats.json("bank");
+        THEN("Each request is counted in the bin of its duration") {
+            std::string histogram = "\"histogram\": [1, 0, 1";
+            for (int i = 3; i < BankStatistics::nBins - 1; i++) histogram += ", 0";
+            histogram += ", 1]";
+            REQUIRE(json.find("{\"account\": 1, \"message\": \"GET_DATA\", \"count\": 3, \"bytes_in\": 0, \"bytes_out\": 240") != std::string::npos);
+            REQUIRE(json.find(histogram) != std::string::npos);
+            REQUIRE(json.find("{\"account\": 2, \"message\": \"SAVE_DATA\", \"count\": 1, \"bytes_in\": 160") != std::string::npos);
+            REQUIRE(json.find("\"max_queue_depth\": 4, \"mean_queue_depth\": 3,") != std::string::npos);
+        }
+        WHEN("The statistics are cleared") {
+            stats.clear();
+            THEN("No request is left") {
+                json = stats.json("bank");
+                REQUIRE(json.find("\"account\"") == std::string::npos);
+                REQUIRE(json.find("\"max_queue_depth\": 0") != std::string::npos);
+            }
+        }
+    }
+    GIVEN("A batched request of a client") {
+        LocalBank local;
+        const bool bank_stats = mpi::bank_stats;
+        mpi::bank_stats = true;
+        clientStatistics.clear();
+        {
+            BankAccount account;
+            std::vector<double> data(6, 1.0);
+            account.put_data({1, 2, 3}, 2, data.data());
+        }
+        mpi::bank_stats = bank_stats;
+        THEN("It is recorded once") {
+            std::string json = clientStatistics.json("client");
+            REQUIRE(json.find("\"message\": \"SAVE_DATA_MANY\", \"count\": 1, \"bytes_in\": 0, \"bytes_out\": 48") != std::string::npos);
+            REQUIRE(json.find("\"message\": \"SAVE_DATA\"") == std::string::npos);
+        }
+        clientStatistics.clear();
+    }
+}
+
+SCENARIO("Batched bank requests", "[bank]") {
+    GIVEN("Items for three bank ranks") {
+        std::vector<int> banks = {2, 0, 2, 1, 2, 0};
+        std::vector<long long> sizes = {4, 3, 4, 5, 4, 20};
+        WHEN("They are grouped in batches of at most 10 doubles") {
+            auto batches = make_batches(banks, sizes, 3, 10);
+            THEN("Each bank rank gets its items in order, split by size") {
+                REQUIRE(batches.size() == 5);
+                REQUIRE(batches[0].first == 0);
+                REQUIRE(batches[0].second == std::vector<int>{1});
+                REQUIRE(batches[1].first == 0);
+                REQUIRE(batches[1].second == std::vector<int>{5});
+                REQUIRE(batches[2].first == 1);
+                REQUIRE(batches[2].second == std::vector<int>{3});
+                REQUIRE(batches[3].first == 2);
+                REQUIRE(batches[3].second == std::vector<int>{0, 2});
+                REQUIRE(batches[4].first == 2);
+                REQUIRE(batches[4].second == std::vector<int>{4});
+            }
+        }
+        WHEN("The batches are large enough") {
+            auto batches = make_batches(banks, sizes, 3, 1000);
+            THEN("There is one batch per bank rank") {
+                REQUIRE(batches.size() == 3);
+                REQUIRE(batches[2].second == std::vector<int>{0, 2, 4});
+            }
+        }
+    }
+}
+
+SCENARIO("Tasks with affinity", "[bank]") {
+    GIVEN("Tasks with and without a preferred rank") {
+        std::vector<int> affinity = {0, -1, 0, -1, 0, -1};
+        TaskManager tasks(affinity);
+        WHEN("All tasks are taken") {
+            std::vector<int> taken;
+            for (int task = tasks.next_task(); task >= 0; task = tasks.next_task()) taken.push_back(task);
+            THEN("Each task is handed out once") {
+                std::sort(taken.begin(), taken.end());
+                REQUIRE(taken == std::vector<int>{0, 1, 2, 3, 4, 5});
+                REQUIRE(tasks.next_task() == -1);
+            }
+        }
+    }
+}
+
+#ifdef MRCPP_HAS_MPI
+SCENARIO("One-sided bank", "[bank]") {
+    LocalBank local;
+    GIVEN("Data in a bank account") {
+        BankAccount account;
+        std::vector<double> a = {1.0, 2.0, 3.0};
+        std::vector<double> b = {4.0, 5.0, 6.0, 7.0, 8.0, 9.0};
+        NodeIndex<3> idx(2, {1, 0, 3});
+        account.put_data(1, 3, a.data());
+        account.put_data({2, 3}, 3, b.data());
+        account.put_data(idx, 3, a.data());
+        THEN("The same data are read back") {
+            std::vector<double> data(6);
+            account.get_data(1, 3, data.data());
+            REQUIRE(std::equal(a.begin(), a.end(), data.begin()));
+            account.get_data({2, 3}, 3, data.data());
+            REQUIRE(data == b);
+            account.get_data(3, 3, data.data());
+            REQUIRE(std::equal(b.begin() + 3, b.end(), data.begin()));
+            account.get_data(idx, 3, data.data());
+            REQUIRE(std::equal(a.begin(), a.end(), data.begin()));
+        }
+    }
+    GIVEN("A function in a bank account") {
+        MultiResolutionAnalysis<3> *mra = nullptr;
+        initialize(&mra);
+        {
+            BankAccount account;
+            CompFunction<3> func(*mra);
+            GaussFunc<3> gauss(10.0, 1.0, {0.1, -0.1, 0.2});
+            project(func, gauss, 1.0e-4);
+            account.put_func(4, func);
+            THEN("The same function is read back") {
+                CompFunction<3> out(*mra);
+                REQUIRE(account.get_func(4, out) == 1);
+                REQUIRE(out.getSquareNorm() == func.getSquareNorm());
+                REQUIRE(out.CompD[0]->evalf({0.1, -0.1, 0.2}) == func.CompD[0]->evalf({0.1, -0.1, 0.2}));
+            }
+        }
+        finalize(&mra);
+    }
+    GIVEN("A task manager") {
+        TaskManager tasks(4);
+        THEN("The tasks are handed out in order") {
+            for (int i = 0; i < 4; i++) REQUIRE(tasks.next_task() == i);
+            REQUIRE(tasks.next_task() == -1);
+        }
+        THEN("Ready tasks are kept until they are deleted") {
+            tasks.put_readytask(2, 7);
+            REQUIRE(tasks.get_readytask(2, 0) == std::vector<int>{7});
+            REQUIRE(tasks.get_readytask(2, 1) == std::vector<int>{7});
+            REQUIRE(tasks.get_readytask(2, 0).empty());
+        }
+    }
+}
+
+// run with a bank rank and a memory limit, see tests/utils/CMakeLists.txt
+SCENARIO("Bank data spilled to disk", "[bank_spill]") {
+    REQUIRE(mpi::bank_size > 0);
+    REQUIRE(mpi::bank_mem_limit > 0);
+    std::string dir = (std::getenv("TMPDIR") != nullptr) ? std::getenv("TMPDIR") : "/tmp";
+    auto spill_files = [dir]() {
+        int n = 0;
+        for (auto &entry : std::filesystem::directory_iterator(dir)) {
+            std::string name = entry.path().filename().string();
+            if (name.find("mrcpp_bank_") == 0 and name.find("_func_") != std::string::npos) n++;
+        }
+        return n;
+    };
+
+    MultiResolutionAnalysis<3> *mra = nullptr;
+    initialize(&mra);
+    GIVEN("More functions and data than the memory limit of the bank") {
+        const int N = 4;
+        std::vector<CompFunction<3>> funcs;
+        std::vector<std::vector<double>> data;
+        {
+            BankAccount account;
+            for (int i = 0; i < N; i++) {
+                CompFunction<3> func(*mra);
+                GaussFunc<3> gauss(100.0, 1.0, {-0.2 + 0.1 * i, 0.5, 1.0});
+                project(func, gauss, 1.0e-5);
+                account.put_func(i, func);
+                funcs.push_back(func);
+                data.push_back(std::vector<double>(1 << 17, 1.0 * i));
+                account.put_data(N + i, data[i].size(), data[i].data());
+            }
+            THEN("Some functions are written to disk, and all are read back") {
+                REQUIRE(funcs[0].CompD[0]->getSizeNodes() > 1024 * mpi::bank_mem_limit / N);
+                for (int i = 0; i < N; i++) {
+                    CompFunction<3> out(*mra);
+                    REQUIRE(account.get_func(i, out) == 1);
+                    if (i == 0) REQUIRE(spill_files() > 0);
+                    REQUIRE(out.getSquareNorm() == Catch::Approx(funcs[i].getSquareNorm()).epsilon(1.0e-12));
+                    REQUIRE(out.CompD[0]->evalf({-0.2 + 0.1 * i, 0.5, 1.0}) == funcs[i].CompD[0]->evalf({-0.2 + 0.1 * i, 0.5, 1.0}));
+                }
+                std::vector<double> out(1 << 17);
+                for (int i = 0; i < N; i++) {
+                    account.get_data(N + i, out.size(), out.data());
+                    REQUIRE(out == data[i]);
+                }
+            }
+        }
+        THEN("The files are removed with the account") {
+            BankAccount next; // waits for the bank rank
+            REQUIRE(spill_files() == 0);
+        }
+    }
+    finalize(&mra);
+}
+
+SCENARIO("Prefetching node blocks", "[bank]") {
+    GIVEN("Node blocks of three functions in a bank account") {
+        LocalBank local;
+        const int rows = 4;
+        const int cols = 3;
+        BankAccount account;
+        for (int nodeid = 1; nodeid <= 4; nodeid++) {
+            for (int id = 0; id < cols; id++) {
+                std::vector<double> data(rows, 10.0 * nodeid + id);
+                account.put_nodedata(id, nodeid, rows, data.data());
+            }
+        }
+        WHEN("Some blocks are pushed to a prefetch") {
+            NodeBlockPrefetch prefetch(account, rows, cols, 2);
+            for (int nodeid = 1; nodeid <= 3; nodeid++) prefetch.push(nodeid);
+            THEN("Each block is the one of the account, also if skipped to or not pushed") {
+                for (int nodeid : {2, 4, 3}) {
+                    std::vector<double> data(rows * cols), ref(rows * cols);
+                    std::vector<int> idVec, refVec;
+                    prefetch.get_nodeblock(nodeid, data.data(), idVec);
+                    account.get_nodeblock(nodeid, ref.data(), refVec);
+                    REQUIRE(refVec.size() == cols);
+                    REQUIRE(idVec == refVec);
+                    REQUIRE(data == ref);
+                }
+            }
+        }
+    }
+}
+#endif
+
+} // namespace bank
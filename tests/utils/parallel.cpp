@@ -0,0 +1,78 @@
+/*
+ * MRCPP, a numerical library based on multiresolution analysis and
+ * the multiwavelet basis which provide low-scaling algorithms as well as
+ * rigorous error control in numerical computations.
+ * Copyright (C) 2021 Stig Rune Jensen, Jonas Juselius, Luca Frediani and contributors.
+ *
+ * This file is part of MRCPP.
+ *
+ * MRCPP is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * MRCPP is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with MRCPP.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * For information on the complete list of contributors to MRCPP, see:
+ * <https://mrcpp.readthedocs.io/>
+ */
+
+#include "catch2/catch_all.hpp"
+
+#include "factory_functions.h"
+
+#include "treebuilders/grid.h"
+#include "treebuilders/project.h"
+#include "utils/CompFunction.h"
+#include "utils/parallel.h"
+
+using namespace mrcpp;
+
+namespace parallel {
+
+SCENARIO("Reducing a function over the ranks", "[parallel]") {
+    const double prec = 1.0e-4;
+
+    MultiResolutionAnalysis<3> *mra = nullptr;
+    initialize(&mra);
+
+    CompFunction<3> func(*mra);
+    GaussFunc<3> gauss(10.0, 1.0, {0.1, -0.1, 0.2});
+    project(func, gauss, prec);
+    const double ref_norm = func.getSquareNorm();
+    const double ref_val = func.CompD[0]->evalf({0.1, -0.1, 0.2});
+
+    GIVEN("A grid that contains the grid of the function") {
+        FunctionTree<3> grid(*mra);
+        GaussFunc<3> wide(1.0, 1.0, {0.0, 0.0, 0.0});
+        build_grid(grid, *func.CompD[0]);
+        build_grid(grid, wide);
+        WHEN("The function is reduced over a single rank") {
+            mpi::reduce_function(func, grid, mpi::comm_wrk);
+            THEN("It is the same function") {
+                REQUIRE(func.Ncomp() == 1);
+                REQUIRE(func.getSquareNorm() == Catch::Approx(ref_norm).epsilon(1.0e-12));
+                REQUIRE(func.CompD[0]->evalf({0.1, -0.1, 0.2}) == Catch::Approx(ref_val).epsilon(1.0e-12));
+            }
+#ifdef MRCPP_HAS_MPI
+            THEN("It is represented on the grid") { REQUIRE(func.CompD[0]->getNNodes() == grid.getNNodes()); }
+#endif
+        }
+    }
+    GIVEN("The adaptive reduction over a single rank") {
+        mpi::reduce_function(prec, func, mpi::comm_wrk);
+        THEN("It is the same function") {
+            REQUIRE(func.getSquareNorm() == Catch::Approx(ref_norm).epsilon(1.0e-12));
+            REQUIRE(func.CompD[0]->evalf({0.1, -0.1, 0.2}) == Catch::Approx(ref_val).epsilon(1.0e-12));
+        }
+    }
+    finalize(&mra);
+}
+
+} // namespace parallel